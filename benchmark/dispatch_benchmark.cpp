@@ -0,0 +1,278 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+// before asio: the awaitables of boost 1.74 use std::exchange without including it
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+
+#include "communicator.h"
+
+/**
+ * Compares the per-message cost of the two ways to dispatch the stream
+ * communicators with the same I/O pattern, a header read, a payload read and
+ * an ACK write per message. VirtualDispatchCommunicator is the design the
+ * specialized templates replaced: one communicator for every mechanism,
+ * reaching each step of a message through a virtual call and reading it into a
+ * DataMessage owning its payload, as the Tcp* classes did. The specialized one is
+ * SpecializedCommunicator with the message at a time I/O policy, as the Asio
+ * backend builds it. Both are fed by the same driver over a loopback
+ * connection, so the difference is what dispatch costs per message.
+ */
+struct BenchmarkResult
+{
+    std::chrono::nanoseconds wall_time;
+    std::chrono::nanoseconds cpu_time;
+    Stats stats;
+};
+
+std::chrono::nanoseconds ProcessCpuTime()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return std::chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+           + std::chrono::microseconds(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+// sends pre-encoded messages and consumes the ACKs, identically for every design
+template <typename StreamProtocol>
+void Drive(typename StreamProtocol::socket& socket, CommunicationMechanism communication_mechanism, uint32_t no_of_messages,
+           uint32_t message_size)
+{
+    std::vector<uint8_t> frame(DataMessage::kSize + message_size, 0);
+    frame[0] = static_cast<uint8_t>(MessageTag::kDataMessage);
+    AcknowledgeMessage::Buffer ack;
+
+    if (communication_mechanism == CommunicationMechanism::kStopAndGo)
+    {
+        for (uint32_t i = 0; i < no_of_messages; ++i)
+        {
+            ToBytes(i, &frame[1]);
+            boost::asio::write(socket, boost::asio::buffer(frame));
+            boost::asio::read(socket, boost::asio::buffer(ack));
+        }
+        return;
+    }
+
+    boost::thread ack_reader([&socket, &ack, no_of_messages]() {
+        std::vector<uint8_t> acks(std::size_t{no_of_messages} * AcknowledgeMessage::kSize);
+        boost::asio::read(socket, boost::asio::buffer(acks));
+    });
+
+    for (uint32_t i = 0; i < no_of_messages; ++i)
+    {
+        ToBytes(i, &frame[1]);
+        boost::asio::write(socket, boost::asio::buffer(frame));
+    }
+
+    ack_reader.join();
+}
+
+template <typename StreamProtocol>
+class VirtualDispatchCommunicator : public Communicator
+{
+    using Transport = StreamTransport<StreamProtocol>;
+    static constexpr bool kTcp = Transport::kProtocol == Protocol::kTcp;
+
+public:
+    VirtualDispatchCommunicator(CommunicationMechanism communication_mechanism, std::size_t message_size, uint16_t client_id)
+        : message_size_{message_size}
+        , client_id_{client_id}
+        , io_service_{}
+        , acceptor_{io_service_, Transport::Endpoint(client_id)}
+        , socket_{io_service_}
+        , stats_{Transport::kProtocol, communication_mechanism, 0, 0}
+    {}
+
+    ~VirtualDispatchCommunicator() override
+    {
+        Transport::Release(client_id_);
+    }
+
+    void Start() override
+    {
+        boost::system::error_code error;
+        acceptor_.accept(socket_, error);
+        if (!error)
+        {
+            socket_options_.Apply(socket_.native_handle(), kTcp);
+            Communicate();
+        }
+    }
+
+    void Stop() override
+    {
+        ::shutdown(acceptor_.native_handle(), SHUT_RDWR);
+    }
+
+    Stats GetStats() const override
+    {
+        return stats_;
+    }
+
+    SocketOptions Configure(const SocketOptions& socket_options) override
+    {
+        socket_options_ = socket_options;
+        socket_options_.Apply(acceptor_.native_handle(), kTcp);
+        return SocketOptions::Query(acceptor_.native_handle(), kTcp);
+    }
+
+protected:
+    virtual boost::system::error_code ReadDataMessage(DataMessage& data_message)
+    {
+        boost::system::error_code error;
+        DataMessage::Buffer data_message_buffer;
+        boost::asio::read(socket_, boost::asio::buffer(data_message_buffer), error);
+        stats_.no_of_syscalls++;
+        if (error)
+        {
+            return error;
+        }
+
+        data_message = DataMessage::Decode(data_message_buffer);
+        data_message.data.resize(message_size_);
+        boost::asio::read(socket_, boost::asio::buffer(data_message.data), error);
+        stats_.no_of_syscalls++;
+        return error;
+    }
+
+    virtual void ProcessDataMessage(const DataMessage& data_message)
+    {
+        OnDataMessage(data_message.message_no, data_message.data.data(), data_message.data.size());
+        stats_.no_of_read_messages++;
+        stats_.no_of_read_bytes += DataMessage::kSize + message_size_;
+    }
+
+    virtual boost::system::error_code SendAckMessage(AcknowledgeMessage ack_message)
+    {
+        boost::system::error_code error;
+        boost::asio::write(socket_, boost::asio::buffer(AcknowledgeMessage::Encode(ack_message)), error);
+        stats_.no_of_syscalls++;
+        return error;
+    }
+
+private:
+    void Communicate()
+    {
+        for (;;)
+        {
+            DataMessage data_message;
+            if (ReadDataMessage(data_message))
+            {
+                return;
+            }
+
+            ProcessDataMessage(data_message);
+            if (SendAckMessage({ data_message.message_no }))
+            {
+                return;
+            }
+        }
+    }
+
+private:
+    std::size_t message_size_;
+    uint16_t client_id_;
+    SocketOptions socket_options_{};
+
+    boost::asio::io_service io_service_;
+    typename StreamProtocol::acceptor acceptor_;
+    typename StreamProtocol::socket socket_;
+    Stats stats_;
+};
+
+void Connect(tcp::socket& socket, uint16_t client_id)
+{
+    socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), client_id));
+    socket.set_option(tcp::no_delay(true));
+}
+
+void Connect(stream_protocol::socket& socket, uint16_t client_id)
+{
+    socket.connect(stream_protocol::endpoint(UnixSocketPath(client_id)));
+}
+
+template <typename StreamProtocol>
+BenchmarkResult Run(CommunicationMechanism communication_mechanism, bool specialized, uint32_t no_of_messages, uint32_t message_size,
+                    uint16_t client_id)
+{
+    std::unique_ptr<Communicator> communicator;
+    if (specialized)
+    {
+        communicator = SpecializedCommunicatorFactory<StreamProtocol, MessageAtATimeIo>(communication_mechanism, message_size, client_id,
+                                                                                        std::chrono::milliseconds{0});
+    }
+    else
+    {
+        communicator = std::make_unique<VirtualDispatchCommunicator<StreamProtocol>>(communication_mechanism, message_size, client_id);
+    }
+
+    SocketOptions socket_options{};
+    socket_options.no_delay = 1;
+    communicator->Configure(socket_options);
+
+    // the start and stop lines of the communicators are not part of the measurement
+    std::cout.setstate(std::ios::badbit);
+    auto start_cpu = ProcessCpuTime();
+    auto start_time = std::chrono::steady_clock::now();
+
+    boost::thread server([&communicator]() { communicator->Start(); });
+
+    boost::asio::io_service io_service;
+    typename StreamProtocol::socket socket(io_service);
+    Connect(socket, client_id);
+    Drive<StreamProtocol>(socket, communication_mechanism, no_of_messages, message_size);
+    socket.close();
+
+    server.join();
+    communicator->Stop();
+
+    BenchmarkResult result = { std::chrono::steady_clock::now() - start_time, ProcessCpuTime() - start_cpu, communicator->GetStats() };
+    std::cout.clear();
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t no_of_messages = argc > 1 ? static_cast<uint32_t>(std::stoul(argv[1])) : 100000;
+    uint32_t message_size = argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 64;
+    uint16_t client_id = 6000;
+
+    std::cout << "Per-message cost of " << no_of_messages << " messages of " << message_size
+              << " bytes, a header read, a payload read and an ACK write each" << std::endl;
+    std::cout << std::left << std::setw(14) << "Protocol" << std::setw(12) << "Mechanism" << std::setw(14) << "Dispatch" << std::right
+              << std::setw(14) << "ns/message" << std::setw(18) << "CPU ns/message" << std::setw(20) << "syscalls/message" << std::endl;
+
+    for (auto protocol : { Protocol::kTcp, Protocol::kUnixStream })
+    {
+        for (auto communication_mechanism : { CommunicationMechanism::kStopAndGo, CommunicationMechanism::kStreaming })
+        {
+            for (auto specialized : { false, true })
+            {
+                auto result = protocol == Protocol::kTcp
+                                  ? Run<tcp>(communication_mechanism, specialized, no_of_messages, message_size, client_id++)
+                                  : Run<stream_protocol>(communication_mechanism, specialized, no_of_messages, message_size, client_id++);
+
+                auto messages = std::max<uint32_t>(result.stats.no_of_read_messages, 1);
+                std::cout << std::left << std::setw(14) << protocol << std::setw(12) << communication_mechanism << std::setw(14)
+                          << (specialized ? "specialized" : "virtual")
+                          << std::right << std::setw(14) << result.wall_time.count() / messages << std::setw(18)
+                          << result.cpu_time.count() / messages << std::setw(20) << std::fixed << std::setprecision(2)
+                          << static_cast<double>(result.stats.no_of_syscalls) / messages << std::endl;
+
+                if (result.stats.no_of_read_messages != no_of_messages)
+                {
+                    std::cout << "  only " << result.stats.no_of_read_messages << " messages arrived" << std::endl;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
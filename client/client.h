@@ -5,8 +5,26 @@
 #ifndef MEASURE_TRANSFER_CLIENT_H
 #define MEASURE_TRANSFER_CLIENT_H
 
+#include <array>
 #include <chrono>
 #include <cstdint>
+#include <deque>
+#include <memory>
+
+#include <fcntl.h>
+#include <poll.h>
+
+#include "affinity.h"
+#include "cpu_usage.h"
+#include "io_uring.h"
+#include "orchestration.h"
+#include "payload.h"
+#include "phase_profile.h"
+#include "policies.h"
+#include "shared_memory_ring.h"
+#include "tcp_info.h"
+#include "trace.h"
+#include "udp_batch.h"
 
 struct Stats
 {
@@ -14,6 +32,63 @@ struct Stats
     std::chrono::time_point<std::chrono::steady_clock> end_time;
     uint32_t no_of_sent_messages;
     uint32_t no_of_sent_bytes;
+    // I/O system calls issued by the data path (io_uring_enter for the io_uring backend)
+    uint64_t no_of_syscalls;
+    // datagram transports only
+    uint32_t no_of_lost_messages;
+    CpuUsage cpu_usage;
+    Placement placement;
+    // TCP data sockets only
+    std::vector<TcpInfoSample> tcp_info;
+    // traced sessions only, zero otherwise
+    std::chrono::nanoseconds ack_latency_p50;
+    std::chrono::nanoseconds ack_latency_p99;
+    // request/response only: completed transactions, the response bytes they brought back and their round trips
+    uint32_t no_of_transactions;
+    uint64_t no_of_received_bytes;
+    LatencyPercentiles transaction_latency;
+    // UDP streaming with FEC only: the ParityMessages sent besides the DataMessages, and the encoder's throughput
+    uint32_t no_of_parity_messages;
+    uint64_t no_of_parity_bytes;
+    double fec_encode_gbps;
+    // reliable UDP streaming only: the user-space congestion controller's series and what it took to deliver every message
+    std::vector<CongestionSample> congestion;
+    uint32_t no_of_retransmissions;
+    uint32_t no_of_timeouts;
+};
+
+struct ClientOptions
+{
+    IoBackend io_backend = IoBackend::kAsio;
+    uint8_t io_uring_flags = 0;
+    // messages coalesced into one submission by the batching backends
+    uint32_t batch_size = 32;
+    uint8_t udp_flags = 0;
+    SocketOptions socket_options{};
+    // -1 leaves the placement to the kernel
+    int cpu = -1;
+    int memory_node = -1;
+    // TCP_INFO sampling period on the data socket, 0 disables it
+    uint16_t tcp_info_interval_ms = 100;
+    // generated before the transfer, shared by the sessions of a run
+    PayloadOptions payload{};
+    std::shared_ptr<const PayloadPool> payload_pool;
+    // the server checks every payload against the ones it regenerates
+    bool verify_payload = false;
+    // every DataMessage carries its send time, the server measures one-way delay and jitter
+    bool send_timestamps = false;
+    // consecutive TCP tests of a session on the asio backend keep their warmed-up data connection
+    bool reuse_data_connection = false;
+    // request/response only: data size of every response, and requests kept in flight on the connection
+    uint32_t response_size = 0;
+    uint32_t no_of_outstanding = 1;
+    // UDP streaming only: parity sent after every group of DataMessages, so the server can rebuild lost ones
+    FecOptions fec{};
+    // UDP streaming only: the stream becomes reliable, acknowledged and sent under this user-space congestion controller
+    UdpCongestionControl udp_congestion_control = UdpCongestionControl::kNone;
+    TraceOptions trace{};
+    // counts the messages handed to the transport for a ProgressReporter, shared by the tests of a run; null disables it
+    std::shared_ptr<TransferProgress> progress;
 };
 
 class Client
@@ -22,87 +97,410 @@ public:
     virtual ~Client() = default;
     virtual void TransferData(uint32_t no_of_messages, uint32_t message_size) = 0;
     virtual Stats GetStats() const = 0;
+
+    // the I/O backend the transfer runs on, Asio when the requested one fell back or does not apply
+    virtual IoBackend Backend() const
+    {
+        return IoBackend::kAsio;
+    }
+
+    // set before TransferData() when the client records a per-message trace
+    void EnableTracing(std::unique_ptr<TraceWriter> trace)
+    {
+        trace_ = std::move(trace);
+    }
+
+    const TraceWriter* Trace() const
+    {
+        return trace_.get();
+    }
+
+    // set before TransferData() when another thread reports the progress of the transfer
+    void EnableProgress(std::shared_ptr<TransferProgress> progress)
+    {
+        progress_ = std::move(progress);
+    }
+
+    // empty unless built with PHASE_PROFILE
+    const PhaseProfile& Phases() const
+    {
+        return phases_;
+    }
+
+    // set before TransferData() when the HelloMessage negotiated send timestamps
+    void EnableSendTimestamps()
+    {
+        send_timestamps_ = true;
+    }
+
+    // set before TransferData() when the test keeps its TCP data connection for the next test, see ReusesDataConnection()
+    void ReuseDataConnection(std::shared_ptr<boost::asio::ip::tcp::socket> data_connection)
+    {
+        data_connection_ = std::move(data_connection);
+    }
+
+protected:
+    // the data connection kept from the previous test if it is open, a new socket to connect otherwise
+    std::shared_ptr<boost::asio::ip::tcp::socket> DataConnection(boost::asio::io_service& io_service)
+    {
+        return data_connection_ ? data_connection_ : std::make_shared<boost::asio::ip::tcp::socket>(io_service);
+    }
+
+    // a kept data connection tells the server the test is over in band and stays open, any other one is closed
+    void EndDataConnection(boost::asio::ip::tcp::socket& socket, uint32_t no_of_messages)
+    {
+        if (!data_connection_)
+        {
+            socket.close();
+            return;
+        }
+
+        boost::system::error_code error;
+        boost::asio::write(socket, boost::asio::buffer(EndOfTestMessage::Encode({ no_of_messages })), error);
+        if (error)
+        {
+            std::cout << "Failed to end the test on the data connection: " << error << std::endl;
+            socket.close();
+        }
+    }
+
+    std::size_t HeaderSize() const
+    {
+        return send_timestamps_ ? TimestampedDataMessage::kSize : DataMessage::kSize;
+    }
+
+    // header of the next DataMessage, stamped right before it is handed to the transport; valid until the next call
+    boost::asio::const_buffer EncodeHeader(uint32_t message_no)
+    {
+        TimestampedDataMessage::Encode(message_no, send_timestamps_ ? RealtimeNow() : 0, header_);
+        return boost::asio::buffer(header_.data(), HeaderSize());
+    }
+
+    // called right before the message is handed to the transport
+    void TraceSend(uint32_t message_no, std::size_t size)
+    {
+        if (progress_)
+        {
+            progress_->no_of_messages.fetch_add(1, std::memory_order_relaxed);
+            progress_->no_of_bytes.fetch_add(size, std::memory_order_relaxed);
+        }
+
+        if (trace_)
+        {
+            trace_->Send(message_no, static_cast<uint32_t>(size), TraceNow());
+        }
+    }
+
+    void TraceAck(uint32_t message_no)
+    {
+        if (trace_)
+        {
+            trace_->Ack(message_no, TraceNow());
+        }
+    }
+
+    // the ACKs of an ordered stream acknowledge count messages starting at first_message_no
+    void TraceAcks(uint32_t first_message_no, uint32_t count)
+    {
+        if (trace_)
+        {
+            auto now = TraceNow();
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                trace_->Ack(first_message_no + i, now);
+            }
+        }
+    }
+
+    // the transferring thread enters each phase of its loop, see PhaseProbe
+    PhaseProfile phases_;
+
+private:
+    std::unique_ptr<TraceWriter> trace_;
+    std::shared_ptr<TransferProgress> progress_;
+    bool send_timestamps_ = false;
+    TimestampedDataMessage::Buffer header_{};
+    std::shared_ptr<boost::asio::ip::tcp::socket> data_connection_;
 };
 
 using boost::asio::ip::tcp;
 
-class TcpStopAndGoClient : public Client
+// applies the socket options before connecting so the buffer sizes already shape the TCP handshake
+void ConnectDataSocket(tcp::socket& socket, boost::asio::io_service& io_service, const std::string& host, uint16_t port,
+                       const SocketOptions& socket_options)
+{
+    tcp::resolver resolver(io_service);
+    tcp::resolver::query query(host, std::to_string(port));
+    tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
+
+    boost::system::error_code error = boost::asio::error::host_not_found;
+    for (; endpoint_iterator != tcp::resolver::iterator(); ++endpoint_iterator)
+    {
+        socket.close();
+        socket.open(endpoint_iterator->endpoint().protocol());
+        socket_options.Apply(socket.native_handle(), true);
+        socket.connect(endpoint_iterator->endpoint(), error);
+        if (!error)
+        {
+            break;
+        }
+    }
+
+    if (error)
+    {
+        throw boost::system::system_error(error);
+    }
+
+    std::cout << "Data socket options: " << SocketOptions::Query(socket.native_handle(), true) << std::endl;
+}
+
+/**
+ * Sends requests of message_size bytes and reads a response of response_size
+ * bytes for each, with up to no_of_outstanding requests in flight. Requests
+ * and responses flow on independent asynchronous chains, so neither side can
+ * block the other when both directions carry large messages. The server
+ * answers in order, so the response to the oldest outstanding request is
+ * always the next one to arrive.
+ */
+class TcpRequestResponseClient : public Client
 {
 public:
-    TcpStopAndGoClient(boost::asio::io_service& io_service, std::string host, uint16_t port)
+    TcpRequestResponseClient(boost::asio::io_service& io_service, std::string host, uint16_t port, const ClientOptions& options)
         : io_service_{io_service}
         , host_{std::move(host)}
         , port_{port}
+        , socket_options_{options.socket_options}
+        , tcp_info_interval_{options.tcp_info_interval_ms}
+        , payload_pool_{options.payload_pool}
+        , no_of_outstanding_{std::max<uint32_t>(options.no_of_outstanding, 1)}
+        , send_times_(no_of_outstanding_)
+        , response_(options.response_size)
         , stats_{}
     {}
 
-    void TransferData(uint32_t no_of_messages, uint32_t message_size) override
+    void TransferData(uint32_t no_of_messages, uint32_t) override
     {
-        boost::system::error_code error;
-        tcp::resolver resolver(io_service_);
-        tcp::resolver::query query(host_, std::to_string(port_));
-        tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
+        auto data_connection = DataConnection(io_service_);
+        socket_ = data_connection.get();
+        if (socket_->is_open())
+        {
+            socket_options_.Apply(socket_->native_handle(), true);
+        }
+        else
+        {
+            ConnectDataSocket(*socket_, io_service_, host_, port_, socket_options_);
+        }
+        TcpInfoSampler tcp_info_sampler(tcp_info_interval_);
+        tcp_info_sampler.Start(socket_->native_handle());
 
-        tcp::socket socket(io_service_);
-        boost::asio::connect(socket, endpoint_iterator);
+        no_of_messages_ = no_of_messages;
+        next_request_ = 0;
+        next_response_ = 0;
+        writing_ = false;
+
+        // stats
+        stats_.start_time = std::chrono::steady_clock::now();
+
+        SendRequest();
+        ReadResponse();
+        {
+            // outside the handlers the thread waits for the socket
+            PhaseProbe probe(phases_, Phase::kWait);
+            io_service_.restart();
+            io_service_.run();
+        }
+
+        // stats
+        stats_.end_time = std::chrono::steady_clock::now();
+        stats_.transaction_latency = Percentiles(latencies_);
+
+        tcp_info_sampler.Stop();
+        stats_.tcp_info = tcp_info_sampler.Samples();
+
+        EndDataConnection(*socket_, no_of_messages);
+    }
+
+    Stats GetStats() const override
+    {
+        return stats_;
+    }
+
+private:
+    void SendRequest()
+    {
+        if (writing_ || next_request_ == no_of_messages_ || next_request_ - next_response_ >= no_of_outstanding_)
+        {
+            return;
+        }
+
+        phases_.Enter(Phase::kEncode);
+        auto message_no = next_request_++;
+        const auto& payload = payload_pool_->Payload(message_no);
+        send_times_[message_no % no_of_outstanding_] = std::chrono::steady_clock::now();
+        TraceSend(message_no, payload.size());
+
+        // the header stays valid until the next EncodeHeader(), which waits for this write
+        writing_ = true;
+        std::array<boost::asio::const_buffer, 2> request = { EncodeHeader(message_no), boost::asio::buffer(payload) };
+        phases_.Enter(Phase::kSend);
+        boost::asio::async_write(*socket_, request, [this](const boost::system::error_code& error, std::size_t sent_bytes) {
+            writing_ = false;
+            stats_.no_of_syscalls++;
+            if (error)
+            {
+                std::cout << "Send request error: " << error << std::endl;
+                return;
+            }
+
+            phases_.Enter(Phase::kUpdateStats);
+            stats_.no_of_sent_messages++;
+            stats_.no_of_sent_bytes += sent_bytes;
+            SendRequest();
+            phases_.Enter(Phase::kWait);
+        });
+    }
+
+    void ReadResponse()
+    {
+        if (next_response_ == no_of_messages_)
+        {
+            return;
+        }
+
+        phases_.Enter(Phase::kReceiveAck);
+        std::array<boost::asio::mutable_buffer, 2> response = { boost::asio::buffer(response_header_), boost::asio::buffer(response_) };
+        boost::asio::async_read(*socket_, response, [this](const boost::system::error_code& error, std::size_t read_bytes) {
+            stats_.no_of_syscalls++;
+            if (error)
+            {
+                std::cout << "Receive ResponseMessage error: " << error << std::endl;
+                return;
+            }
+
+            phases_.Enter(Phase::kDecode);
+            auto response_message = ResponseMessage::Decode(response_header_);
+            if (response_message.message_no != next_response_)
+            {
+                std::cout << "ResponseMessage " << response_message.message_no << " out of order, expected " << next_response_ << std::endl;
+                return;
+            }
+
+            phases_.Enter(Phase::kUpdateStats);
+            latencies_.Add(std::chrono::steady_clock::now() - send_times_[next_response_ % no_of_outstanding_]);
+            TraceAck(next_response_);
+            stats_.no_of_transactions++;
+            stats_.no_of_received_bytes += read_bytes;
+            next_response_++;
+
+            // the freed slot lets the next request go
+            SendRequest();
+            ReadResponse();
+            phases_.Enter(Phase::kWait);
+        });
+    }
+
+private:
+    boost::asio::io_service& io_service_;
+    std::string host_;
+    uint16_t port_;
+    SocketOptions socket_options_;
+    std::chrono::milliseconds tcp_info_interval_;
+    std::shared_ptr<const PayloadPool> payload_pool_;
+    uint32_t no_of_outstanding_;
+
+    tcp::socket* socket_ = nullptr;
+    uint32_t no_of_messages_ = 0;
+    uint32_t next_request_ = 0;
+    uint32_t next_response_ = 0;
+    bool writing_ = false;
+    // send times of the outstanding requests, by message_no modulo no_of_outstanding
+    std::vector<std::chrono::steady_clock::time_point> send_times_;
+    ResponseMessage::Buffer response_header_;
+    std::vector<uint8_t> response_;
+
+    LatencyRecorder latencies_;
+    Stats stats_;
+};
 
-        // send data
-        std::vector<uint8_t> data(message_size, 0);
+using boost::asio::local::stream_protocol;
+
+class SharedMemoryClient : public Client
+{
+public:
+    SharedMemoryClient(CommunicationMechanism communication_mechanism, uint16_t port, const ClientOptions& options)
+        : communication_mechanism_{communication_mechanism}
+        , segment_{SharedMemorySegment::Open(SharedMemoryName(port))}
+        , data_ring_{segment_.DataRing()}
+        , ack_ring_{segment_.AckRing()}
+        , payload_pool_{options.payload_pool}
+        , stats_{}
+    {}
 
+    void TransferData(uint32_t no_of_messages, uint32_t) override
+    {
         // stats
         stats_.start_time = std::chrono::steady_clock::now();
+        uint32_t no_of_read_acks = 0;
 
         for (uint32_t i = 0; i < no_of_messages; ++i)
         {
+            // the server blocks once the ack ring is full, so streaming takes the ACKs already there before every write;
+            // what is left in the ring then only covers the messages still in the data ring, which the ack ring can hold
+            if (communication_mechanism_ == CommunicationMechanism::kStreaming)
+            {
+                PhaseProbe probe(phases_, Phase::kReceiveAck);
+                while (ack_ring_.ReadableSize() >= AcknowledgeMessage::kSize)
+                {
+                    ReadAckMessage();
+                    ++no_of_read_acks;
+                }
+            }
+
             // send data message
-            DataMessage data_message = { i, data };
+            PhaseProbe probe(phases_, Phase::kEncode);
+            const auto& payload = payload_pool_->Payload(i);
 
-            auto sent_bytes = socket.send(boost::asio::buffer(DataMessage::Encode(data_message)));
-            stats_.no_of_sent_bytes += sent_bytes;
-            if (sent_bytes < DataMessage::kSize)
+            TraceSend(i, payload.size());
+            auto header = EncodeHeader(i);
+            phases_.Enter(Phase::kSend);
+            auto error = data_ring_.Write(header.data(), header.size());
+            if (!error)
             {
-                std::cout << "Failed to send DataMessage message header" << std::endl;
-                continue;
+                error = data_ring_.Write(payload.data(), payload.size());
             }
 
-            std::cout << "DataMessage " << data_message.message_no << " header sent" << std::endl;
-
-            sent_bytes = socket.send(boost::asio::buffer(boost::asio::buffer(data_message.data)));
-            stats_.no_of_sent_bytes += sent_bytes;
-            if (sent_bytes < data_message.data.size())
+            if (error)
             {
-                std::cout << "Failed to send DataMessage message payload" << std::endl;
-                continue;
+                std::cout << "Failed to send DataMessage: " << error << std::endl;
+                break;
             }
 
             // stats
+            phases_.Enter(Phase::kUpdateStats);
+            stats_.no_of_sent_bytes += HeaderSize() + payload.size();
             stats_.no_of_sent_messages++;
-            std::cout << "DataMessage " << data_message.message_no << " payload sent" << std::endl;
 
-            // wait ack
-            AcknowledgeMessage::Buffer ack_buffer;
-            auto read_bytes = socket.read_some(boost::asio::buffer(ack_buffer), error);
-            if (error)
+            if (communication_mechanism_ == CommunicationMechanism::kStopAndGo)
             {
-                std::cout << "Receive AcknowledgeMessage error: " << error << std::endl;
-                continue;
+                phases_.Enter(Phase::kReceiveAck);
+                ReadAckMessage();
             }
+        }
 
-            if (read_bytes < AcknowledgeMessage::kSize)
+        if (communication_mechanism_ == CommunicationMechanism::kStreaming)
+        {
+            for (uint32_t i = no_of_read_acks; i < stats_.no_of_sent_messages; ++i)
             {
-                std::cout << "Read AcknowledgeMessage of wrong size" << std::endl;
-                continue;
+                PhaseProbe probe(phases_, Phase::kReceiveAck);
+                ReadAckMessage();
             }
-
-            auto ack_message = AcknowledgeMessage::Decode(ack_buffer);
-            std::cout << "ACK message received for " << ack_message.message_no << std::endl;
         }
 
         // stats
         stats_.end_time = std::chrono::steady_clock::now();
 
         // disconnect
-        socket.close();
+        data_ring_.Close();
     }
 
     Stats GetStats() const override
@@ -111,89 +509,123 @@ public:
     }
 
 private:
-    boost::asio::io_service& io_service_;
-    std::string host_;
-    uint16_t port_;
+    void ReadAckMessage()
+    {
+        // wait ack
+        AcknowledgeMessage::Buffer ack_buffer;
+        auto error = ack_ring_.Read(ack_buffer.data(), ack_buffer.size());
+        if (error)
+        {
+            std::cout << "Receive AcknowledgeMessage error: " << error << std::endl;
+            return;
+        }
+
+        phases_.Enter(Phase::kDecode);
+        auto ack_message = AcknowledgeMessage::Decode(ack_buffer);
+        TraceAck(ack_message.message_no);
+        phases_.Enter(Phase::kReceiveAck);
+    }
+
+private:
+    CommunicationMechanism communication_mechanism_;
+    SharedMemorySegment segment_;
+    SharedMemoryRing data_ring_;
+    SharedMemoryRing ack_ring_;
+    std::shared_ptr<const PayloadPool> payload_pool_;
     Stats stats_;
 };
 
-class TcpStreamingClient : public Client
+/**
+ * TCP client driven by io_uring. Each message is laid out as header + payload
+ * in a registered buffer and sent with one fixed write; stop-and-go submits
+ * that write together with the ACK read (one io_uring_enter per message),
+ * streaming coalesces batch_size messages into every write while an ACK read
+ * is always armed.
+ */
+class IoUringClient : public Client
 {
 public:
-    TcpStreamingClient(boost::asio::io_service& io_service, std::string host, uint16_t port)
-        : io_service_{io_service}
+    // registers its buffers here, so a kernel refusing them is caught where the factory falls back to Asio
+    IoUringClient(CommunicationMechanism communication_mechanism, boost::asio::io_service& io_service, std::string host, uint16_t port,
+                  uint32_t message_size, const ClientOptions& options)
+        : communication_mechanism_{communication_mechanism}
+        , io_service_{io_service}
         , host_{std::move(host)}
         , port_{port}
+        , batch_size_{communication_mechanism == CommunicationMechanism::kStopAndGo ? 1 : std::max<uint32_t>(options.batch_size, 1)}
+        , socket_options_{options.socket_options}
+        , tcp_info_interval_{options.tcp_info_interval_ms}
+        , ring_{kIoUringEntries, (options.io_uring_flags & kIoUringSqPoll) != 0}
+        // header and payload of batch_size messages back to back, with room for send timestamps if they are enabled later
+        , send_buffer_(batch_size_ * (TimestampedDataMessage::kSize + message_size), 0)
+        , ack_buffer_(kAckBufferSize)
+        , payload_pool_{options.payload_pool}
         , stats_{}
-    {}
+    {
+        ring_.RegisterBuffers({ { send_buffer_.data(), send_buffer_.size() },
+                                { ack_buffer_.data(), ack_buffer_.size() } });
+    }
 
     void TransferData(uint32_t no_of_messages, uint32_t message_size) override
     {
-        boost::system::error_code error;
-        tcp::resolver resolver(io_service_);
-        tcp::resolver::query query(host_, std::to_string(port_));
-        tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
-
         tcp::socket socket(io_service_);
-        boost::asio::connect(socket, endpoint_iterator);
-
-        // send data
-        std::vector<uint8_t> data(message_size, 0);
+        ConnectDataSocket(socket, io_service_, host_, port_, socket_options_);
+        TcpInfoSampler tcp_info_sampler(tcp_info_interval_);
+        tcp_info_sampler.Start(socket.native_handle());
+        int fd = socket.native_handle();
+        message_length_ = HeaderSize() + message_size;
 
         // stats
         stats_.start_time = std::chrono::steady_clock::now();
 
-        for (uint32_t i = 0; i < no_of_messages; ++i)
+        uint32_t next_message = 0;
+        while (no_of_acks_ < no_of_messages)
         {
-            // send data message
-            DataMessage data_message = { i, data };
-
-            auto sent_bytes = socket.send(boost::asio::buffer(DataMessage::Encode(data_message)));
-            stats_.no_of_sent_bytes += sent_bytes;
-            if (sent_bytes < DataMessage::kSize)
+            PhaseProbe probe(phases_, Phase::kEncode);
+            if (!write_in_flight_ && next_message < no_of_messages && CanSend(next_message))
             {
-                std::cout << "Failed to send DataMessage message header" << std::endl;
-                continue;
+                next_message += SubmitBatch(fd, next_message, no_of_messages);
             }
 
-            std::cout << "DataMessage " << data_message.message_no << " header sent" << std::endl;
-
-            sent_bytes = socket.send(boost::asio::buffer(boost::asio::buffer(data_message.data)));
-            stats_.no_of_sent_bytes += sent_bytes;
-            if (sent_bytes < data_message.data.size())
+            if (!read_in_flight_)
             {
-                std::cout << "Failed to send DataMessage message payload" << std::endl;
-                continue;
+                phases_.Enter(Phase::kReceiveAck);
+                IoUring::PrepReadFixed(ring_.GetSqe(), fd, ack_buffer_.data() + ack_end_, static_cast<uint32_t>(ack_buffer_.size() - ack_end_),
+                                       kAckBufferIndex, kRead);
+                read_in_flight_ = true;
             }
 
-            // stats
-            stats_.no_of_sent_messages++;
-            std::cout << "DataMessage " << data_message.message_no << " payload sent" << std::endl;
-        }
-
-        for (uint32_t i = 0; i < no_of_messages; ++i)
-        {
-            // wait ack
-            AcknowledgeMessage::Buffer ack_buffer;
-            auto read_bytes = socket.read_some(boost::asio::buffer(ack_buffer), error);
-            if (error)
+            // a stop-and-go round trip is the write plus its ACK: wait for both in one call
+            phases_.Enter(Phase::kWait);
+            bool stop_and_go = communication_mechanism_ == CommunicationMechanism::kStopAndGo;
+            int result = ring_.Submit(stop_and_go && write_in_flight_ ? 2 : 1);
+            if (result < 0)
             {
-                std::cout << "Receive AcknowledgeMessage error: " << error << std::endl;
-                continue;
+                std::cout << "io_uring_enter error: " << -result << std::endl;
+                break;
             }
 
-            if (read_bytes < AcknowledgeMessage::kSize)
+            io_uring_cqe cqe{};
+            bool failed = false;
+            while (ring_.PeekCompletion(cqe))
             {
-                std::cout << "Read AcknowledgeMessage of wrong size" << std::endl;
-                continue;
+                // a write completion only updates the stats
+                phases_.Enter(cqe.user_data == kWrite ? Phase::kUpdateStats : Phase::kReceiveAck);
+                failed |= !HandleCompletion(fd, cqe);
             }
 
-            auto ack_message = AcknowledgeMessage::Decode(ack_buffer);
-            std::cout << "ACK message received for " << ack_message.message_no << std::endl;
+            if (failed)
+            {
+                break;
+            }
         }
 
         // stats
         stats_.end_time = std::chrono::steady_clock::now();
+        stats_.no_of_syscalls = ring_.NoOfEnterCalls();
+
+        tcp_info_sampler.Stop();
+        stats_.tcp_info = tcp_info_sampler.Samples();
 
         // disconnect
         socket.close();
@@ -204,39 +636,1159 @@ public:
         return stats_;
     }
 
+    IoBackend Backend() const override
+    {
+        return IoBackend::kIoUring;
+    }
+
+private:
+    enum Operation : uint64_t
+    {
+        kRead = 1,
+        kWrite = 2
+    };
+
+    static const std::size_t kAckBufferSize = 64 * 1024;
+    static const uint16_t kSendBufferIndex = 0;
+    static const uint16_t kAckBufferIndex = 1;
+
+    bool CanSend(uint32_t next_message) const
+    {
+        // stop-and-go only sends the next message once the previous one is acknowledged
+        return communication_mechanism_ != CommunicationMechanism::kStopAndGo || next_message == no_of_acks_;
+    }
+
+    uint32_t SubmitBatch(int fd, uint32_t first_message, uint32_t no_of_messages)
+    {
+        uint32_t count = std::min(batch_size_, no_of_messages - first_message);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            DataMessage data_message = { first_message + i, {} };
+            auto header = EncodeHeader(data_message.message_no);
+            const auto& payload = payload_pool_->Payload(data_message.message_no);
+            std::memcpy(send_buffer_.data() + i * message_length_, header.data(), header.size());
+            std::copy(payload.begin(), payload.end(), send_buffer_.begin() + i * message_length_ + header.size());
+            TraceSend(data_message.message_no, payload.size());
+        }
+
+        write_length_ = count * message_length_;
+        write_offset_ = 0;
+        write_messages_ = count;
+        IoUring::PrepWriteFixed(ring_.GetSqe(), fd, send_buffer_.data(), static_cast<uint32_t>(write_length_), kSendBufferIndex, kWrite);
+        write_in_flight_ = true;
+
+        return count;
+    }
+
+    bool HandleCompletion(int fd, const io_uring_cqe& cqe)
+    {
+        if (cqe.res < 0)
+        {
+            std::cout << "io_uring operation " << cqe.user_data << " error: " << -cqe.res << std::endl;
+            return false;
+        }
+
+        if (cqe.user_data == kWrite)
+        {
+            write_offset_ += cqe.res;
+            stats_.no_of_sent_bytes += cqe.res;
+            if (write_offset_ < write_length_)
+            {
+                // short write, send the rest of the batch
+                IoUring::PrepWriteFixed(ring_.GetSqe(), fd, send_buffer_.data() + write_offset_,
+                                        static_cast<uint32_t>(write_length_ - write_offset_), kSendBufferIndex, kWrite);
+                return true;
+            }
+
+            stats_.no_of_sent_messages += write_messages_;
+            write_in_flight_ = false;
+            return true;
+        }
+
+        read_in_flight_ = false;
+        if (cqe.res == 0)
+        {
+            std::cout << "Connection closed while waiting for AcknowledgeMessages" << std::endl;
+            return false;
+        }
+
+        // count the complete ACKs and keep a partial one for the next read
+        ack_end_ += cqe.res;
+        std::size_t complete = ack_end_ - ack_end_ % AcknowledgeMessage::kSize;
+        TraceAcks(no_of_acks_, static_cast<uint32_t>(complete / AcknowledgeMessage::kSize));
+        no_of_acks_ += static_cast<uint32_t>(complete / AcknowledgeMessage::kSize);
+        std::memmove(ack_buffer_.data(), ack_buffer_.data() + complete, ack_end_ - complete);
+        ack_end_ -= complete;
+
+        return true;
+    }
+
 private:
+    CommunicationMechanism communication_mechanism_;
     boost::asio::io_service& io_service_;
     std::string host_;
     uint16_t port_;
+    uint32_t batch_size_;
+    SocketOptions socket_options_;
+    std::chrono::milliseconds tcp_info_interval_;
+
+    IoUring ring_;
+
+    std::vector<uint8_t> send_buffer_;
+    std::size_t message_length_ = 0;
+    std::size_t write_offset_ = 0;
+    std::size_t write_length_ = 0;
+    uint32_t write_messages_ = 0;
+    bool write_in_flight_ = false;
+
+    std::vector<uint8_t> ack_buffer_;
+    std::size_t ack_end_ = 0;
+    uint32_t no_of_acks_ = 0;
+    bool read_in_flight_ = false;
+
+    std::shared_ptr<const PayloadPool> payload_pool_;
     Stats stats_;
 };
 
-std::unique_ptr<Client> ClientFactory(Protocol protocol, CommunicationMechanism communication_mechanism, boost::asio::io_service& io_service, std::string host, uint16_t port)
+using boost::asio::ip::udp;
+
+/**
+ * UDP client built around sendmmsg: streaming sends batch_size datagrams per
+ * call (or per GSO super-datagram with kUdpGso) without waiting for ACKs,
+ * stop-and-go sends one datagram and waits for its ACK, counting it as lost
+ * when none arrives within kAckTimeoutUs.
+ */
+class UdpClient : public Client
 {
-    std::unique_ptr<Client> client = nullptr;
+public:
+    UdpClient(CommunicationMechanism communication_mechanism, boost::asio::io_service& io_service, std::string host, uint16_t port,
+              const ClientOptions& options)
+        : communication_mechanism_{communication_mechanism}
+        , io_service_{io_service}
+        , host_{std::move(host)}
+        , port_{port}
+        , batch_size_{communication_mechanism == CommunicationMechanism::kStopAndGo ? 1 : std::max<uint32_t>(options.batch_size, 1)}
+        , gso_{(options.udp_flags & kUdpGso) != 0}
+        , socket_options_{options.socket_options}
+        , payload_pool_{options.payload_pool}
+        , fec_{communication_mechanism == CommunicationMechanism::kStreaming ? options.fec : FecOptions{}}
+        , stats_{}
+    {}
 
-    switch (protocol)
+    void TransferData(uint32_t no_of_messages, uint32_t message_size) override
     {
-        case Protocol::kTcp:
+        udp::resolver resolver(io_service_);
+        udp::resolver::query query(udp::v4(), host_, std::to_string(port_));
+        udp::socket socket(io_service_);
+        socket.connect(*resolver.resolve(query));
+        int fd = socket.native_handle();
+        socket_options_.Apply(fd, false);
+        std::cout << "Data socket options: " << SocketOptions::Query(fd, false) << std::endl;
+
+        timeval timeout = { 0, kAckTimeoutUs };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        // header and payload of batch_size datagrams back to back, payloads copied from the pool
+        std::size_t datagram_size = HeaderSize() + message_size;
+        std::vector<uint8_t> batch(batch_size_ * datagram_size, 0);
+        UdpBatchSender sender(fd, batch_size_, gso_);
+
+        // the shards are the DataMessages after their MessageNo, send time included; the parity of the groups a batch completes follows it
+        std::unique_ptr<FecEncoder> encoder;
+        std::size_t parity_size = ParityMessage::kSize + datagram_size - DataMessage::kSize;
+        std::vector<uint8_t> parity_batch;
+        if (fec_.Enabled())
         {
-            switch (communication_mechanism)
+            encoder = std::make_unique<FecEncoder>(fec_, datagram_size - DataMessage::kSize);
+            parity_batch.resize(MaxFecGroupsPerBatch(batch_size_, fec_.data_shards) * fec_.NoOfParityShards() * parity_size);
+            std::cout << "FEC: " << fec_ << ", " << fec_.Overhead() * 100 << "% parity overhead" << std::endl;
+        }
+
+        // stats
+        stats_.start_time = std::chrono::steady_clock::now();
+
+        for (uint32_t i = 0; i < no_of_messages; i += batch_size_)
+        {
+            // the parity of the batch is encoded with it
+            PhaseProbe probe(phases_, Phase::kEncode);
+            uint32_t count = std::min(batch_size_, no_of_messages - i);
+            std::size_t no_of_parity_messages = 0;
+            for (uint32_t j = 0; j < count; ++j)
             {
-                case CommunicationMechanism::kStopAndGo:
+                auto header = EncodeHeader(i + j);
+                const auto& payload = payload_pool_->Payload(i + j);
+                std::memcpy(batch.data() + j * datagram_size, header.data(), header.size());
+                std::copy(payload.begin(), payload.end(), batch.begin() + j * datagram_size + header.size());
+                TraceSend(i + j, payload.size());
+
+                if (encoder && encoder->Add(batch.data() + j * datagram_size + DataMessage::kSize))
+                {
+                    no_of_parity_messages += WriteParity(*encoder, parity_batch.data() + no_of_parity_messages * parity_size, parity_size);
+                }
+            }
+
+            // the last group is cut short rather than left without parity
+            if (encoder && i + count == no_of_messages && encoder->NoOfShards() > 0)
+            {
+                no_of_parity_messages += WriteParity(*encoder, parity_batch.data() + no_of_parity_messages * parity_size, parity_size);
+            }
+
+            phases_.Enter(Phase::kSend);
+            auto error = sender.Send(batch.data(), datagram_size, count);
+            if (!error && no_of_parity_messages > 0)
+            {
+                error = sender.Send(parity_batch.data(), parity_size, no_of_parity_messages);
+                stats_.no_of_parity_messages += static_cast<uint32_t>(no_of_parity_messages);
+                stats_.no_of_parity_bytes += no_of_parity_messages * parity_size;
+            }
+
+            if (error)
+            {
+                std::cout << "Failed to send DataMessages " << i << ".." << i + count - 1 << ": " << error << std::endl;
+                break;
+            }
+
+            phases_.Enter(Phase::kUpdateStats);
+            stats_.no_of_sent_messages += count;
+            stats_.no_of_sent_bytes += count * datagram_size;
+
+            phases_.Enter(Phase::kReceiveAck);
+            if (communication_mechanism_ == CommunicationMechanism::kStopAndGo && !WaitAckMessage(fd, i))
+            {
+                stats_.no_of_lost_messages++;
+            }
+        }
+
+        // stats
+        stats_.end_time = std::chrono::steady_clock::now();
+        stats_.no_of_syscalls += sender.NoOfSyscalls();
+        if (encoder)
+        {
+            stats_.fec_encode_gbps = encoder->EncodeGbps();
+        }
+
+        // disconnect
+        socket.close();
+    }
+
+    Stats GetStats() const override
+    {
+        return stats_;
+    }
+
+private:
+    static const long kAckTimeoutUs = 200 * 1000;
+
+    // the ParityMessages of the encoder's open group, which is closed; returns their number
+    static std::size_t WriteParity(FecEncoder& encoder, uint8_t* buffer, std::size_t parity_size)
+    {
+        ParityMessage message = { encoder.GroupNo(), 0, static_cast<uint8_t>(encoder.NoOfShards()) };
+        for (std::size_t j = 0; j < encoder.NoOfParityShards(); ++j)
+        {
+            message.parity_index = static_cast<uint8_t>(j);
+            auto header = ParityMessage::Encode(message);
+            std::memcpy(buffer + j * parity_size, header.data(), header.size());
+            std::memcpy(buffer + j * parity_size + header.size(), encoder.Parity(j), parity_size - header.size());
+        }
+
+        encoder.CloseGroup();
+        return encoder.NoOfParityShards();
+    }
+
+    bool WaitAckMessage(int fd, uint32_t message_no)
+    {
+        while (true)
+        {
+            // wait ack, skipping late ACKs of messages already counted as lost
+            AcknowledgeMessage::Buffer ack_buffer;
+            stats_.no_of_syscalls++;
+            auto read_bytes = ::recv(fd, ack_buffer.data(), ack_buffer.size(), 0);
+            if (read_bytes < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+
+                std::cout << "Receive AcknowledgeMessage " << message_no << " error: " << errno << std::endl;
+                return false;
+            }
+
+            if (static_cast<std::size_t>(read_bytes) < AcknowledgeMessage::kSize)
+            {
+                continue;
+            }
+
+            if (AcknowledgeMessage::Decode(ack_buffer).message_no == message_no)
+            {
+                TraceAck(message_no);
+                return true;
+            }
+        }
+    }
+
+private:
+    CommunicationMechanism communication_mechanism_;
+    boost::asio::io_service& io_service_;
+    std::string host_;
+    uint16_t port_;
+    uint32_t batch_size_;
+    bool gso_;
+    SocketOptions socket_options_;
+    std::shared_ptr<const PayloadPool> payload_pool_;
+    FecOptions fec_;
+    Stats stats_;
+};
+
+/**
+ * Reliable UDP streaming under a user-space congestion controller: the server
+ * acknowledges every DataMessage, the client keeps at most the controller's
+ * window in flight, paces the datagrams at its rate and retransmits the lost
+ * ones. A datagram is lost once kReorderingThreshold datagrams sent after it
+ * are acknowledged, or when nothing is acknowledged for an RTO (RFC 6298,
+ * at least kMinRto like Linux TCP). Every ACK batch yields a sample of the
+ * controller's state for the congestion control series.
+ */
+class UdpReliableClient : public Client
+{
+public:
+    UdpReliableClient(boost::asio::io_service& io_service, std::string host, uint16_t port, const ClientOptions& options)
+        : io_service_{io_service}
+        , host_{std::move(host)}
+        , port_{port}
+        , batch_size_{std::max<uint32_t>(options.batch_size, 1)}
+        , gso_{(options.udp_flags & kUdpGso) != 0}
+        , socket_options_{options.socket_options}
+        , congestion_control_{options.udp_congestion_control}
+        , payload_pool_{options.payload_pool}
+        , stats_{}
+    {}
+
+    void TransferData(uint32_t no_of_messages, uint32_t message_size) override
+    {
+        udp::resolver resolver(io_service_);
+        udp::resolver::query query(udp::v4(), host_, std::to_string(port_));
+        udp::socket socket(io_service_);
+        socket.connect(*resolver.resolve(query));
+        int fd = socket.native_handle();
+        socket_options_.Apply(fd, false);
+        std::cout << "Data socket options: " << SocketOptions::Query(fd, false) << std::endl;
+
+        // ACKs are drained between sends, the waits are ppoll's
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        UdpBatchReceiver ack_receiver(fd, batch_size_, AcknowledgeMessage::kSize, false);
+
+        datagram_size_ = HeaderSize() + message_size;
+        std::vector<uint8_t> batch(batch_size_ * datagram_size_, 0);
+        UdpBatchSender sender(fd, batch_size_, gso_);
+
+        controller_ = MakeCongestionController(congestion_control_, datagram_size_);
+        packets_.assign(no_of_messages, {});
+        std::cout << "Congestion control: " << congestion_control_ << std::endl;
+
+        // stats
+        stats_.start_time = std::chrono::steady_clock::now();
+        last_progress_time_ = stats_.start_time;
+        next_send_time_ = stats_.start_time;
+
+        uint32_t next_message_no = 0;
+        while (no_of_acked_messages_ < no_of_messages)
+        {
+            PhaseProbe probe(phases_, Phase::kReceiveAck);
+            auto result = ack_receiver.Receive([&](const uint8_t* data, std::size_t size, const sockaddr_storage&, socklen_t) {
+                if (size >= AcknowledgeMessage::kSize && data[0] == static_cast<uint8_t>(MessageTag::kAcknowledgeMessage))
+                {
+                    OnAck(FromBytes(data + 1));
+                }
+            });
+            if (result < 0 && -result != EAGAIN && -result != EINTR)
+            {
+                std::cout << "Receive AcknowledgeMessages error: " << -result << std::endl;
+                break;
+            }
+
+            // the congestion controller's bookkeeping is the process phase of a sender
+            phases_.Enter(Phase::kProcess);
+            auto now = std::chrono::steady_clock::now();
+            if (result > 0)
+            {
+                DetectLosses(now);
+                Sample(now);
+            }
+
+            if (inflight_ > 0 && now >= last_progress_time_ + rto_)
+            {
+                if (now >= last_progress_time_ + kGiveUpTime)
                 {
-                    client = std::make_unique<TcpStopAndGoClient>(io_service, host, port);
+                    std::cout << "No AcknowledgeMessage for " << kGiveUpTime.count() << " s, giving up" << std::endl;
                     break;
                 }
-                case CommunicationMechanism::kStreaming:
+                OnTimeout(now);
+            }
+
+            // retransmissions first, then new messages, as far as the window and the pacing rate allow
+            phases_.Enter(Phase::kEncode);
+            uint32_t count = 0;
+            while (count < batch_size_ && inflight_ + datagram_size_ <= controller_->CongestionWindow() && now >= next_send_time_)
+            {
+                uint32_t message_no;
+                if (!retransmissions_.empty())
+                {
+                    message_no = retransmissions_.front();
+                    retransmissions_.pop_front();
+                    if (packets_[message_no].acked)
+                    {
+                        continue;
+                    }
+                    stats_.no_of_retransmissions++;
+                }
+                else if (next_message_no < no_of_messages)
+                {
+                    message_no = next_message_no++;
+                    TraceSend(message_no, message_size);
+                    stats_.no_of_sent_messages++;
+                    stats_.no_of_sent_bytes += datagram_size_;
+                }
+                else
                 {
-                    client = std::make_unique<TcpStreamingClient>(io_service, host, port);
                     break;
                 }
-                default:
+
+                auto header = EncodeHeader(message_no);
+                const auto& payload = payload_pool_->Payload(message_no);
+                std::memcpy(batch.data() + count * datagram_size_, header.data(), header.size());
+                std::copy(payload.begin(), payload.end(), batch.begin() + count * datagram_size_ + header.size());
+                OnSend(message_no, now);
+                count++;
+            }
+
+            if (count > 0)
+            {
+                phases_.Enter(Phase::kSend);
+                auto error = sender.Send(batch.data(), datagram_size_, count);
+                if (error)
                 {
-                    std::cerr << communication_mechanism << std::endl;
+                    std::cout << "Failed to send DataMessages: " << error << std::endl;
                     break;
                 }
+                continue;
             }
+
+            phases_.Enter(Phase::kWait);
+            Wait(fd, now, next_message_no < no_of_messages || !retransmissions_.empty());
+        }
+
+        // stats
+        stats_.end_time = std::chrono::steady_clock::now();
+        stats_.no_of_syscalls += sender.NoOfSyscalls() + ack_receiver.NoOfSyscalls();
+        stats_.no_of_lost_messages = no_of_messages - no_of_acked_messages_;
+        if (ack_receiver.NoOfTruncated() > 0)
+        {
+            std::cout << "Dropped " << ack_receiver.NoOfTruncated() << " truncated AcknowledgeMessage datagrams" << std::endl;
+        }
+        Sample(stats_.end_time);
+
+        // disconnect
+        socket.close();
+    }
+
+    Stats GetStats() const override
+    {
+        return stats_;
+    }
+
+private:
+    struct Packet
+    {
+        std::chrono::steady_clock::time_point send_time;
+        // of the latest transmission
+        uint64_t sequence = 0;
+        // the delivery rate estimation's snapshot at the send, see DeliveryRate()
+        uint64_t delivered = 0;
+        std::chrono::steady_clock::time_point delivered_time;
+        std::chrono::steady_clock::time_point first_send_time;
+        bool in_flight = false;
+        bool retransmitted = false;
+        bool acked = false;
+    };
+
+    static constexpr uint64_t kReorderingThreshold = 3;
+    static constexpr std::chrono::milliseconds kMinRto{200};
+    static constexpr std::chrono::seconds kGiveUpTime{10};
+    static constexpr std::chrono::milliseconds kSampleInterval{1};
+
+    void OnSend(uint32_t message_no, std::chrono::steady_clock::time_point now)
+    {
+        auto& packet = packets_[message_no];
+        packet.retransmitted = packet.sequence > 0;
+        packet.sequence = ++sequence_;
+        packet.send_time = now;
+
+        // an idle sender restarts the delivery rate intervals, draft-cheng-iccrg-delivery-rate-estimation
+        if (inflight_ == 0)
+        {
+            first_send_time_ = now;
+            delivered_time_ = now;
+        }
+        packet.delivered = delivered_;
+        packet.delivered_time = delivered_time_;
+        packet.first_send_time = first_send_time_;
+
+        if (!packet.in_flight)
+        {
+            packet.in_flight = true;
+            inflight_ += datagram_size_;
+        }
+        in_flight_.push_back({ packet.sequence, message_no });
+
+        if (controller_->PacingRate() > 0)
+        {
+            // no credit for time spent idle beyond one datagram
+            next_send_time_ = std::max(next_send_time_, now - std::chrono::nanoseconds(datagram_size_ * 1000000000 / controller_->PacingRate()))
+                              + std::chrono::nanoseconds(datagram_size_ * 1000000000 / controller_->PacingRate());
+        }
+    }
+
+    void OnAck(uint32_t message_no)
+    {
+        if (message_no >= packets_.size() || packets_[message_no].acked)
+        {
+            return;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        auto& packet = packets_[message_no];
+        packet.acked = true;
+        no_of_acked_messages_++;
+        if (packet.in_flight)
+        {
+            packet.in_flight = false;
+            inflight_ -= datagram_size_;
+        }
+        largest_acked_sequence_ = std::max(largest_acked_sequence_, packet.sequence);
+        last_progress_time_ = now;
+        TraceAck(message_no);
+
+        // Karn: a retransmitted datagram's ACK does not tell which transmission it acknowledges
+        std::chrono::nanoseconds rtt{0};
+        if (!packet.retransmitted)
+        {
+            rtt = now - packet.send_time;
+            UpdateRto(rtt);
+        }
+
+        delivered_ += datagram_size_;
+        delivered_time_ = now;
+        uint64_t delivery_rate = 0;
+        auto interval = std::max(now - packet.delivered_time, packet.send_time - packet.first_send_time);
+        if (interval.count() > 0 && !packet.retransmitted)
+        {
+            delivery_rate = (delivered_ - packet.delivered) * 1000000000 / static_cast<uint64_t>(std::chrono::nanoseconds(interval).count());
+            first_send_time_ = packet.send_time;
+            delivery_rate_ = delivery_rate;
+        }
+
+        controller_->OnAck({ now, datagram_size_, inflight_, rtt, smoothed_rtt_, delivery_rate, delivered_, packet.delivered, packet.send_time });
+    }
+
+    void DetectLosses(std::chrono::steady_clock::time_point now)
+    {
+        while (!in_flight_.empty())
+        {
+            auto [sequence, message_no] = in_flight_.front();
+            auto& packet = packets_[message_no];
+            // acknowledged, or superseded by a retransmission
+            if (packet.acked || packet.sequence != sequence)
+            {
+                in_flight_.pop_front();
+                continue;
+            }
+
+            if (sequence + kReorderingThreshold > largest_acked_sequence_)
+            {
+                break;
+            }
+
+            in_flight_.pop_front();
+            OnLoss(message_no, now);
+        }
+    }
+
+    void OnLoss(uint32_t message_no, std::chrono::steady_clock::time_point now)
+    {
+        auto& packet = packets_[message_no];
+        packet.in_flight = false;
+        inflight_ -= datagram_size_;
+        retransmissions_.push_back(message_no);
+        controller_->OnLoss(now, packet.send_time, datagram_size_);
+    }
+
+    // everything in flight is lost; the RTO backs off until the next ACK
+    void OnTimeout(std::chrono::steady_clock::time_point now)
+    {
+        for (const auto& [sequence, message_no] : in_flight_)
+        {
+            auto& packet = packets_[message_no];
+            if (!packet.acked && packet.sequence == sequence)
+            {
+                packet.in_flight = false;
+                inflight_ -= datagram_size_;
+                retransmissions_.push_back(message_no);
+            }
+        }
+        in_flight_.clear();
+
+        controller_->OnTimeout(now);
+        rto_ = std::min<std::chrono::nanoseconds>(rto_ * 2, kGiveUpTime);
+        last_progress_time_ = now;
+        stats_.no_of_timeouts++;
+    }
+
+    void UpdateRto(std::chrono::nanoseconds rtt)
+    {
+        if (smoothed_rtt_.count() == 0)
+        {
+            smoothed_rtt_ = rtt;
+            rtt_variance_ = rtt / 2;
+        }
+        else
+        {
+            auto deviation = smoothed_rtt_ > rtt ? smoothed_rtt_ - rtt : rtt - smoothed_rtt_;
+            rtt_variance_ = (3 * rtt_variance_ + deviation) / 4;
+            smoothed_rtt_ = (7 * smoothed_rtt_ + rtt) / 8;
+        }
+        rto_ = std::max<std::chrono::nanoseconds>(smoothed_rtt_ + 4 * rtt_variance_, kMinRto);
+    }
+
+    // until an ACK arrives, the next datagram is due or, with nothing sendable, the RTO expires
+    void Wait(int fd, std::chrono::steady_clock::time_point now, bool sendable)
+    {
+        auto deadline = last_progress_time_ + rto_;
+        if (sendable && inflight_ + datagram_size_ <= controller_->CongestionWindow())
+        {
+            deadline = std::min(deadline, next_send_time_);
+        }
+
+        auto timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(std::max(deadline - now, std::chrono::steady_clock::duration::zero()));
+        timespec time = { static_cast<time_t>(timeout.count() / 1000000000), static_cast<long>(timeout.count() % 1000000000) };
+        pollfd descriptor = { fd, POLLIN, 0 };
+        ppoll(&descriptor, 1, &time, nullptr);
+    }
+
+    void Sample(std::chrono::steady_clock::time_point now)
+    {
+        if (!stats_.congestion.empty() && now < last_sample_time_ + kSampleInterval)
+        {
+            return;
+        }
+
+        last_sample_time_ = now;
+        stats_.congestion.push_back({ std::chrono::duration_cast<std::chrono::microseconds>(now - stats_.start_time),
+                                      static_cast<uint32_t>(smoothed_rtt_.count() / 1000), controller_->CongestionWindow(), inflight_,
+                                      controller_->PacingRate(), delivery_rate_, stats_.no_of_retransmissions });
+    }
+
+private:
+    boost::asio::io_service& io_service_;
+    std::string host_;
+    uint16_t port_;
+    uint32_t batch_size_;
+    bool gso_;
+    SocketOptions socket_options_;
+    UdpCongestionControl congestion_control_;
+    std::shared_ptr<const PayloadPool> payload_pool_;
+    Stats stats_;
+
+    std::unique_ptr<CongestionController> controller_;
+    std::size_t datagram_size_ = 0;
+    std::vector<Packet> packets_;
+    // transmissions in send order, (sequence, message_no)
+    std::deque<std::pair<uint64_t, uint32_t>> in_flight_;
+    std::deque<uint32_t> retransmissions_;
+    uint64_t inflight_ = 0;
+    uint64_t sequence_ = 0;
+    uint64_t largest_acked_sequence_ = 0;
+    uint32_t no_of_acked_messages_ = 0;
+    uint64_t delivered_ = 0;
+    uint64_t delivery_rate_ = 0;
+    std::chrono::steady_clock::time_point delivered_time_;
+    std::chrono::steady_clock::time_point first_send_time_;
+    std::chrono::steady_clock::time_point next_send_time_;
+    std::chrono::steady_clock::time_point last_progress_time_;
+    std::chrono::steady_clock::time_point last_sample_time_;
+    std::chrono::nanoseconds smoothed_rtt_{0};
+    std::chrono::nanoseconds rtt_variance_{0};
+    std::chrono::nanoseconds rto_{std::chrono::seconds(1)};
+};
+
+// what differs between the stream transports of the coroutine and specialized clients
+template <typename StreamProtocol>
+struct StreamClientTransport;
+
+template <>
+struct StreamClientTransport<tcp>
+{
+    static constexpr bool kTcp = true;
+
+    static void Connect(tcp::socket& socket, boost::asio::io_context& io_context, const std::string& host, uint16_t port,
+                        const SocketOptions& socket_options)
+    {
+        ConnectDataSocket(socket, io_context, host, port, socket_options);
+    }
+};
+
+template <>
+struct StreamClientTransport<stream_protocol>
+{
+    static constexpr bool kTcp = false;
+
+    static void Connect(stream_protocol::socket& socket, boost::asio::io_context&, const std::string&, uint16_t port,
+                        const SocketOptions& socket_options)
+    {
+        socket.open();
+        socket_options.Apply(socket.native_handle(), false);
+        socket.connect(stream_protocol::endpoint(UnixSocketPath(port)));
+        std::cout << "Data socket options: " << SocketOptions::Query(socket.native_handle(), false) << std::endl;
+    }
+};
+
+/**
+ * Sends over TCP or a Unix stream socket with C++20 coroutines on a private
+ * io_context run by the calling thread. Stop-and-go is one coroutine waiting
+ * for every ACK inline; streaming adds a second coroutine that reads the ACKs
+ * while the first keeps sending, so neither side ever blocks the other.
+ */
+template <typename StreamProtocol>
+class CoroutineClient : public Client
+{
+    using Transport = StreamClientTransport<StreamProtocol>;
+
+public:
+    CoroutineClient(CommunicationMechanism communication_mechanism, std::string host, uint16_t port, const ClientOptions& options)
+        : communication_mechanism_{communication_mechanism}
+        , host_{std::move(host)}
+        , port_{port}
+        , socket_options_{options.socket_options}
+        , tcp_info_sampler_{std::chrono::milliseconds(options.tcp_info_interval_ms)}
+        , payload_pool_{options.payload_pool}
+        , stats_{}
+    {}
+
+    void TransferData(uint32_t no_of_messages, uint32_t) override
+    {
+        boost::asio::io_context io_context;
+        typename StreamProtocol::socket socket(io_context);
+        Transport::Connect(socket, io_context, host_, port_, socket_options_);
+
+        stats_.start_time = std::chrono::steady_clock::now();
+
+        auto on_error = [](std::exception_ptr exception) {
+            if (exception)
+            {
+                try
+                {
+                    std::rethrow_exception(exception);
+                }
+                catch (std::exception& ex)
+                {
+                    std::cout << "CoroutineClient error: " << ex.what() << std::endl;
+                }
+            }
+        };
+
+        boost::asio::co_spawn(io_context, Send(socket, no_of_messages), on_error);
+        if (communication_mechanism_ == CommunicationMechanism::kStreaming)
+        {
+            boost::asio::co_spawn(io_context, ReadAcks(socket, no_of_messages), on_error);
+        }
+        {
+            // the coroutines share the profile: a phase lasts until either of them enters the next one
+            PhaseProbe probe(phases_, Phase::kWait);
+            io_context.run();
+        }
+
+        stats_.end_time = std::chrono::steady_clock::now();
+        stats_.tcp_info = tcp_info_sampler_.Samples();
+
+        // disconnect
+        socket.close();
+    }
+
+    Stats GetStats() const override
+    {
+        return stats_;
+    }
+
+    IoBackend Backend() const override
+    {
+        return IoBackend::kCoroutine;
+    }
+
+private:
+    boost::asio::awaitable<void> Send(typename StreamProtocol::socket& socket, uint32_t no_of_messages)
+    {
+        for (uint32_t i = 0; i < no_of_messages; ++i)
+        {
+            // header and pooled payload gathered into one write
+            phases_.Enter(Phase::kEncode);
+            std::array<boost::asio::const_buffer, 2> message = { EncodeHeader(i), boost::asio::buffer(payload_pool_->Payload(i)) };
+
+            TraceSend(i, message[1].size());
+            phases_.Enter(Phase::kSend);
+            auto sent_bytes = co_await boost::asio::async_write(socket, message, boost::asio::use_awaitable);
+            phases_.Enter(Phase::kUpdateStats);
+            stats_.no_of_sent_bytes += sent_bytes;
+            stats_.no_of_syscalls++;
+            stats_.no_of_sent_messages++;
+
+            if (communication_mechanism_ == CommunicationMechanism::kStopAndGo)
+            {
+                co_await ReadAck(socket);
+            }
+
+            if (Transport::kTcp)
+            {
+                phases_.Enter(Phase::kUpdateStats);
+                tcp_info_sampler_.Poll(socket.native_handle());
+            }
+        }
+    }
+
+    boost::asio::awaitable<void> ReadAcks(typename StreamProtocol::socket& socket, uint32_t no_of_messages)
+    {
+        for (uint32_t i = 0; i < no_of_messages; ++i)
+        {
+            co_await ReadAck(socket);
+        }
+    }
+
+    boost::asio::awaitable<void> ReadAck(typename StreamProtocol::socket& socket)
+    {
+        phases_.Enter(Phase::kReceiveAck);
+        AcknowledgeMessage::Buffer ack_buffer;
+        co_await boost::asio::async_read(socket, boost::asio::buffer(ack_buffer), boost::asio::use_awaitable);
+        stats_.no_of_syscalls++;
+        phases_.Enter(Phase::kDecode);
+        TraceAck(AcknowledgeMessage::Decode(ack_buffer).message_no);
+    }
+
+private:
+    CommunicationMechanism communication_mechanism_;
+    std::string host_;
+    uint16_t port_;
+    SocketOptions socket_options_;
+    // polled from the sending coroutine, there is no thread to spare for it
+    TcpInfoSampler tcp_info_sampler_;
+    std::shared_ptr<const PayloadPool> payload_pool_;
+    Stats stats_;
+};
+
+/**
+ * One TCP or Unix stream client compiled per transport, mechanism and I/O
+ * policy, serving both the Asio and the specialized backend. Batched, every
+ * message is one gathered write of its header and pooled payload and the
+ * streaming variant reads the queued ACKs without blocking every few
+ * messages. A message at a time writes the header and the payload apart and
+ * reads the ACKs one by one. Stop-and-go waits for each ACK either way,
+ * decided at compile time.
+ */
+template <typename StreamProtocol, typename MechanismPolicy, typename IoPolicy>
+class SpecializedClient : public Client
+{
+    using Transport = StreamClientTransport<StreamProtocol>;
+    using Socket = typename StreamProtocol::socket;
+    static constexpr std::size_t kAckBufferSize = 1024 * AcknowledgeMessage::kSize;
+
+public:
+    SpecializedClient(boost::asio::io_service& io_service, std::string host, uint16_t port, const ClientOptions& options)
+        : io_service_{io_service}
+        , host_{std::move(host)}
+        , port_{port}
+        , socket_options_{options.socket_options}
+        , tcp_info_interval_{options.tcp_info_interval_ms}
+        , ack_buffer_(kAckBufferSize)
+        , payload_pool_{options.payload_pool}
+        , stats_{}
+    {}
+
+    void TransferData(uint32_t no_of_messages, uint32_t) override
+    {
+        auto data_connection = Connect();
+        Socket& socket = *data_connection;
+        TcpInfoSampler tcp_info_sampler(tcp_info_interval_);
+        if (Transport::kTcp)
+        {
+            tcp_info_sampler.Start(socket.native_handle());
+        }
+
+        stats_.start_time = std::chrono::steady_clock::now();
+
+        if (IoPolicy::kBatched)
+        {
+            TransferBatched(socket, no_of_messages);
+        }
+        else
+        {
+            TransferMessageAtATime(socket, no_of_messages);
+        }
+
+        stats_.end_time = std::chrono::steady_clock::now();
+
+        tcp_info_sampler.Stop();
+        stats_.tcp_info = tcp_info_sampler.Samples();
+
+        // disconnect, unless the TCP connection is kept for the next test
+        if constexpr (Transport::kTcp)
+        {
+            EndDataConnection(socket, no_of_messages);
+        }
+        else
+        {
+            socket.close();
+        }
+    }
+
+    Stats GetStats() const override
+    {
+        return stats_;
+    }
+
+    IoBackend Backend() const override
+    {
+        return IoPolicy::kBatched ? IoBackend::kSpecialized : IoBackend::kAsio;
+    }
+
+private:
+    // a TCP data connection kept from the previous test, which belongs to the caller's io_service, or a new one
+    std::shared_ptr<Socket> Connect()
+    {
+        std::shared_ptr<Socket> socket;
+        if constexpr (Transport::kTcp)
+        {
+            socket = DataConnection(io_service_);
+            if (socket->is_open())
+            {
+                socket_options_.Apply(socket->native_handle(), true);
+                return socket;
+            }
+        }
+        else
+        {
+            socket = std::make_shared<Socket>(io_service_);
+        }
+
+        Transport::Connect(*socket, io_service_, host_, port_, socket_options_);
+        return socket;
+    }
+
+    void TransferBatched(Socket& socket, uint32_t no_of_messages)
+    {
+        std::size_t no_of_ack_bytes = 0;
+        for (uint32_t i = 0; i < no_of_messages; ++i)
+        {
+            // header and pooled payload gathered into one write
+            PhaseProbe probe(phases_, Phase::kEncode);
+            std::array<boost::asio::const_buffer, 2> frame = { EncodeHeader(i), boost::asio::buffer(payload_pool_->Payload(i)) };
+            TraceSend(i, frame[1].size());
+            phases_.Enter(Phase::kSend);
+            auto sent_bytes = boost::asio::write(socket, frame);
+            phases_.Enter(Phase::kUpdateStats);
+            stats_.no_of_sent_bytes += sent_bytes;
+            stats_.no_of_syscalls++;
+            stats_.no_of_sent_messages++;
+
+            phases_.Enter(Phase::kReceiveAck);
+            if (MechanismPolicy::kWaitForAck)
+            {
+                no_of_ack_bytes += boost::asio::read(socket, boost::asio::buffer(ack_buffer_.data(), AcknowledgeMessage::kSize));
+                stats_.no_of_syscalls++;
+                TraceAck(i);
+            }
+            else if ((i + 1) % MechanismPolicy::kAckDrainInterval == 0)
+            {
+                // the server must never block writing ACKs while this blocks writing data
+                auto read_bytes = ::recv(socket.native_handle(), ack_buffer_.data(), ack_buffer_.size(), MSG_DONTWAIT);
+                stats_.no_of_syscalls++;
+                TraceAckBytes(no_of_ack_bytes, read_bytes > 0 ? read_bytes : 0);
+                no_of_ack_bytes += read_bytes > 0 ? read_bytes : 0;
+            }
+        }
+
+        for (std::size_t expected = std::size_t{no_of_messages} * AcknowledgeMessage::kSize; no_of_ack_bytes < expected;)
+        {
+            PhaseProbe probe(phases_, Phase::kReceiveAck);
+            auto read_bytes = socket.read_some(boost::asio::buffer(ack_buffer_.data(), std::min(ack_buffer_.size(), expected - no_of_ack_bytes)));
+            stats_.no_of_syscalls++;
+            TraceAckBytes(no_of_ack_bytes, read_bytes);
+            no_of_ack_bytes += read_bytes;
+        }
+    }
+
+    void TransferMessageAtATime(Socket& socket, uint32_t no_of_messages)
+    {
+        uint32_t no_of_read_acks = 0;
+        for (uint32_t i = 0; i < no_of_messages; ++i)
+        {
+            // send data message
+            PhaseProbe probe(phases_, Phase::kEncode);
+            const auto& payload = payload_pool_->Payload(i);
+            TraceSend(i, payload.size());
+            auto header = EncodeHeader(i);
+            phases_.Enter(Phase::kSend);
+            stats_.no_of_sent_bytes += boost::asio::write(socket, header);
+            stats_.no_of_sent_bytes += boost::asio::write(socket, boost::asio::buffer(payload));
+            stats_.no_of_syscalls += 2;
+
+            // stats
+            phases_.Enter(Phase::kUpdateStats);
+            stats_.no_of_sent_messages++;
+
+            phases_.Enter(Phase::kReceiveAck);
+            if (MechanismPolicy::kWaitForAck)
+            {
+                ReadAckMessage(socket);
+                no_of_read_acks++;
+                continue;
+            }
+
+            // read the ACKs already queued so the server never blocks writing them while we block writing data;
+            // unix sockets charge every small ACK with its full skb size to the server's send buffer
+            stats_.no_of_syscalls++;
+            while (socket.available() >= AcknowledgeMessage::kSize)
+            {
+                ReadAckMessage(socket);
+                no_of_read_acks++;
+            }
+        }
+
+        for (; no_of_read_acks < no_of_messages; ++no_of_read_acks)
+        {
+            PhaseProbe probe(phases_, Phase::kReceiveAck);
+            ReadAckMessage(socket);
+        }
+    }
+
+    void ReadAckMessage(Socket& socket)
+    {
+        boost::system::error_code error;
+
+        // wait ack
+        AcknowledgeMessage::Buffer ack_buffer;
+        boost::asio::read(socket, boost::asio::buffer(ack_buffer), error);
+        stats_.no_of_syscalls++;
+        if (error)
+        {
+            std::cout << "Receive AcknowledgeMessage error: " << error << std::endl;
+            return;
+        }
+
+        phases_.Enter(Phase::kDecode);
+        auto ack_message = AcknowledgeMessage::Decode(ack_buffer);
+        TraceAck(ack_message.message_no);
+        phases_.Enter(Phase::kReceiveAck);
+    }
+
+    // ACKs are counted, not parsed: the ones completed by these bytes acknowledge the next messages in order
+    void TraceAckBytes(std::size_t no_of_ack_bytes, std::size_t read_bytes)
+    {
+        auto first = static_cast<uint32_t>(no_of_ack_bytes / AcknowledgeMessage::kSize);
+        TraceAcks(first, static_cast<uint32_t>((no_of_ack_bytes + read_bytes) / AcknowledgeMessage::kSize) - first);
+    }
+
+private:
+    boost::asio::io_service& io_service_;
+    std::string host_;
+    uint16_t port_;
+    SocketOptions socket_options_;
+    std::chrono::milliseconds tcp_info_interval_;
+    std::vector<uint8_t> ack_buffer_;
+    std::shared_ptr<const PayloadPool> payload_pool_;
+    Stats stats_;
+};
+
+// the only runtime dispatch of the stream clients, once per session
+template <typename StreamProtocol, typename IoPolicy>
+std::unique_ptr<Client> SpecializedClientFactory(CommunicationMechanism communication_mechanism, boost::asio::io_service& io_service, std::string host,
+                                                 uint16_t port, const ClientOptions& options)
+{
+    switch (communication_mechanism)
+    {
+        case CommunicationMechanism::kStopAndGo:
+        {
+            return std::make_unique<SpecializedClient<StreamProtocol, StopAndGoPolicy, IoPolicy>>(io_service, host, port, options);
+        }
+        case CommunicationMechanism::kStreaming:
+        {
+            return std::make_unique<SpecializedClient<StreamProtocol, StreamingPolicy, IoPolicy>>(io_service, host, port, options);
+        }
+        default:
+        {
+            std::cerr << communication_mechanism << std::endl;
+            return nullptr;
+        }
+    }
+}
+
+std::unique_ptr<Client> ClientFactory(Protocol protocol, CommunicationMechanism communication_mechanism, boost::asio::io_service& io_service, std::string host, uint16_t port,
+                                      uint32_t message_size, const ClientOptions& options)
+{
+    std::unique_ptr<Client> client = nullptr;
+
+    // request/response is only implemented on Asio over TCP, whatever backend was asked for; the server falls back alike
+    if (communication_mechanism == CommunicationMechanism::kRequestResponse)
+    {
+        if (protocol != Protocol::kTcp)
+        {
+            std::cerr << protocol << " " << communication_mechanism << std::endl;
+            return nullptr;
+        }
+
+        return std::make_unique<TcpRequestResponseClient>(io_service, host, port, options);
+    }
+
+    if (options.io_backend == IoBackend::kSpecialized)
+    {
+        if (protocol == Protocol::kTcp)
+        {
+            return SpecializedClientFactory<tcp, BatchedIo>(communication_mechanism, io_service, host, port, options);
+        }
+
+        if (protocol == Protocol::kUnixStream)
+        {
+            return SpecializedClientFactory<stream_protocol, BatchedIo>(communication_mechanism, io_service, host, port, options);
+        }
+    }
+
+    if (options.io_backend == IoBackend::kCoroutine)
+    {
+        if (protocol == Protocol::kTcp)
+        {
+            return std::make_unique<CoroutineClient<tcp>>(communication_mechanism, host, port, options);
+        }
+
+        if (protocol == Protocol::kUnixStream)
+        {
+            return std::make_unique<CoroutineClient<stream_protocol>>(communication_mechanism, host, port, options);
+        }
+    }
+
+    if (protocol == Protocol::kTcp && options.io_backend == IoBackend::kIoUring)
+    {
+        try
+        {
+            return std::make_unique<IoUringClient>(communication_mechanism, io_service, host, port, message_size, options);
+        }
+        catch (std::exception& ex)
+        {
+            std::cout << "io_uring unavailable, falling back to Asio: " << ex.what() << std::endl;
+        }
+    }
+
+    switch (protocol)
+    {
+        case Protocol::kTcp:
+        {
+            client = SpecializedClientFactory<tcp, MessageAtATimeIo>(communication_mechanism, io_service, host, port, options);
             break;
         }
         case Protocol::kUdp:
@@ -245,12 +1797,19 @@ std::unique_ptr<Client> ClientFactory(Protocol protocol, CommunicationMechanism
             {
                 case CommunicationMechanism::kStopAndGo:
                 {
-//                    client = std::make_unique<UdpStopAndGoClient>(io_service, host, port);
+                    client = std::make_unique<UdpClient>(communication_mechanism, io_service, host, port, options);
                     break;
                 }
                 case CommunicationMechanism::kStreaming:
                 {
-//                    client = std::make_unique<UdpStreamingClient>(io_service, host, port);
+                    if (options.udp_congestion_control != UdpCongestionControl::kNone)
+                    {
+                        client = std::make_unique<UdpReliableClient>(io_service, host, port, options);
+                    }
+                    else
+                    {
+                        client = std::make_unique<UdpClient>(communication_mechanism, io_service, host, port, options);
+                    }
                     break;
                 }
                 default:
@@ -259,6 +1818,17 @@ std::unique_ptr<Client> ClientFactory(Protocol protocol, CommunicationMechanism
                     break;
                 }
             }
+            break;
+        }
+        case Protocol::kUnixStream:
+        {
+            client = SpecializedClientFactory<stream_protocol, MessageAtATimeIo>(communication_mechanism, io_service, host, port, options);
+            break;
+        }
+        case Protocol::kSharedMemory:
+        {
+            client = std::make_unique<SharedMemoryClient>(communication_mechanism, port, options);
+            break;
         }
         default:
         {
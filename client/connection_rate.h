@@ -0,0 +1,367 @@
+#ifndef MEASURE_TRANSFER_CONNECTION_RATE_H
+#define MEASURE_TRANSFER_CONNECTION_RATE_H
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "latency.h"
+#include "messages.h"
+
+using boost::asio::ip::tcp;
+
+struct ConnectionRateOptions
+{
+    // 0 disables the connection rate mode
+    uint32_t no_of_workers = 0;
+    std::chrono::seconds duration{10};
+};
+
+// one line of the connection rate report, covering one second
+struct ConnectionRateReport
+{
+    uint64_t no_of_connections;
+    uint64_t no_of_failures;
+    std::chrono::nanoseconds handshake_p50;
+    std::chrono::nanoseconds handshake_p99;
+};
+
+class ConnectionRateGenerator;
+
+/**
+ * One worker of the connection rate mode, cycling as fast as it can through
+ * short-lived sessions against the server's C10K port: connect, HelloMessage
+ * and its AcknowledgeMessage, no_of_messages stop-and-go DataMessages, close.
+ */
+class ConnectionWorker : public std::enable_shared_from_this<ConnectionWorker>
+{
+public:
+    ConnectionWorker(ConnectionRateGenerator& generator, boost::asio::io_service& io_service, uint32_t no_of_messages, uint32_t message_size)
+        : generator_(generator)
+        , socket_(io_service)
+        , no_of_messages_{no_of_messages}
+        , next_message_{0}
+        , message_(DataMessage::kSize + message_size, 0)
+    {}
+
+    void Connect();
+
+private:
+    void OnConnect(const boost::system::error_code& error);
+    void OnHelloAck(const boost::system::error_code& error);
+    void Send();
+    void OnAck(const boost::system::error_code& error);
+    void Close(const boost::system::error_code& error);
+
+private:
+    ConnectionRateGenerator& generator_;
+    tcp::socket socket_;
+    uint32_t no_of_messages_;
+    uint32_t next_message_;
+    std::chrono::steady_clock::time_point start_time_;
+    std::chrono::steady_clock::time_point connect_time_;
+    std::chrono::steady_clock::time_point handshake_time_;
+    std::vector<uint8_t> message_;
+    AcknowledgeMessage::Buffer ack_buffer_;
+};
+
+/**
+ * Measures connection setup rather than transfer: no_of_workers concurrent
+ * workers open, use and close sessions back to back for the duration, all on
+ * the calling thread's io_service. Reports connects per second, the latency
+ * of the TCP handshake, of the whole Hello/Ack handshake and of the whole
+ * session, and the accept queue overflows the kernel counted meanwhile.
+ */
+class ConnectionRateGenerator
+{
+public:
+    ConnectionRateGenerator(boost::asio::io_service& io_service, const std::string& host, uint16_t port, uint32_t no_of_messages,
+                            uint32_t message_size, const ConnectionRateOptions& options)
+        : io_service_(io_service)
+        , options_(options)
+        , no_of_messages_{no_of_messages}
+        , message_size_{message_size}
+        , stop_timer_(io_service)
+        , report_timer_(io_service)
+        , stopping_{false}
+    {
+        tcp::resolver resolver(io_service_);
+        endpoint_ = *resolver.resolve(tcp::resolver::query(host, std::to_string(port)));
+
+        // the C10K server only reads the message size, the rest asks for nothing beyond plain Asio over TCP
+        HelloMessage hello_message = { Protocol::kTcp, CommunicationMechanism::kStopAndGo, message_size_, IoBackend::kAsio, 0, 0, 0, SocketOptions{}, 0,
+                                       false, false, false, 0, FecOptions{}, UdpCongestionControl::kNone };
+        auto hello = HelloMessage::Encode(hello_message);
+        hello_.assign(hello.begin(), hello.end());
+
+        std::cout << "Connection rate: " << options_.no_of_workers << " workers for " << options_.duration.count() << " s, "
+                  << no_of_messages_ << " messages of " << message_size_ << " bytes per session, descriptor limit "
+                  << RaiseFileDescriptorLimit() << std::endl;
+    }
+
+    void Run()
+    {
+        auto listen_queue = ReadListenQueueCounters();
+        start_time_ = std::chrono::steady_clock::now();
+
+        for (uint32_t i = 0; i < options_.no_of_workers; ++i)
+        {
+            auto worker = std::make_shared<ConnectionWorker>(*this, io_service_, no_of_messages_, message_size_);
+            worker->Connect();
+        }
+
+        // the workers finish the session they are in, then stop
+        stop_timer_.expires_from_now(options_.duration);
+        stop_timer_.async_wait([this](const boost::system::error_code& error) {
+            if (!error)
+            {
+                stopping_ = true;
+            }
+        });
+        ScheduleReport();
+        io_service_.run();
+
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time_).count();
+        auto listen_queue_after = ReadListenQueueCounters();
+
+        std::cout << std::endl;
+        std::cout << std::setw(12) << "Connects/s" << std::setw(12) << "Failed" << std::setw(14) << "p50 (us)" << std::setw(14) << "p99 (us)"
+                  << std::endl;
+        for (const auto& report : reports_)
+        {
+            std::cout << std::setw(12) << report.no_of_connections << std::setw(12) << report.no_of_failures << std::setw(14)
+                      << report.handshake_p50.count() / 1000 << std::setw(14) << report.handshake_p99.count() / 1000 << std::endl;
+        }
+
+        std::cout << "Sessions: " << no_of_connections_ << " in " << seconds << " s, " << no_of_connections_ / seconds << " connects/s, "
+                  << no_of_failures_ << " failed" << std::endl;
+        PrintLatency("TCP handshake", connect_latencies_);
+        PrintLatency("Hello/Ack handshake", handshake_latencies_);
+        PrintLatency("Session", session_latencies_);
+        std::cout << "Accept queue overflows: " << listen_queue_after.overflows - listen_queue.overflows << ", listen drops: "
+                  << listen_queue_after.drops - listen_queue.drops << " (host-wide, only the server's when it runs on this host)" << std::endl;
+    }
+
+    // called by the workers
+    bool Stopping() const
+    {
+        return stopping_;
+    }
+
+    const tcp::endpoint& Endpoint() const
+    {
+        return endpoint_;
+    }
+
+    const std::vector<uint8_t>& Hello() const
+    {
+        return hello_;
+    }
+
+    void OnSession(std::chrono::nanoseconds connect, std::chrono::nanoseconds handshake, std::chrono::nanoseconds session)
+    {
+        no_of_connections_++;
+        connect_latencies_.Add(connect);
+        handshake_latencies_.Add(handshake);
+        session_latencies_.Add(session);
+        interval_handshake_latencies_.Add(handshake);
+    }
+
+    void OnFailure(const boost::system::error_code& error)
+    {
+        no_of_failures_++;
+        if (last_error_ != error)
+        {
+            // e.g. EADDRNOTAVAIL once TIME_WAIT has used up the ephemeral ports
+            std::cout << "Session failed: " << error.message() << std::endl;
+            last_error_ = error;
+        }
+    }
+
+    void OnWorkerStopped()
+    {
+        if (++no_of_stopped_workers_ == options_.no_of_workers)
+        {
+            boost::system::error_code cancel_error;
+            report_timer_.cancel(cancel_error);
+            Report();
+        }
+    }
+
+private:
+    void PrintLatency(const std::string& name, LatencyRecorder& recorder)
+    {
+        std::cout << name << " (us): p50 " << recorder.Percentile(50).count() / 1e3 << ", p90 " << recorder.Percentile(90).count() / 1e3
+                  << ", p99 " << recorder.Percentile(99).count() / 1e3 << ", p99.9 " << recorder.Percentile(99.9).count() / 1e3 << ", max "
+                  << recorder.Max().count() / 1e3 << std::endl;
+    }
+
+    void ScheduleReport()
+    {
+        report_timer_.expires_from_now(std::chrono::seconds(1));
+        report_timer_.async_wait([this](const boost::system::error_code& error) {
+            if (!error)
+            {
+                Report();
+                ScheduleReport();
+            }
+        });
+    }
+
+    void Report()
+    {
+        ConnectionRateReport report = { interval_handshake_latencies_.Count(), no_of_failures_ - last_no_of_failures_,
+                                        interval_handshake_latencies_.Percentile(50), interval_handshake_latencies_.Percentile(99) };
+        reports_.push_back(report);
+
+        std::cout << "Connection rate: " << report.no_of_connections << " connects/s, " << report.no_of_failures << " failed, handshake p50 "
+                  << report.handshake_p50.count() / 1000 << " us, p99 " << report.handshake_p99.count() / 1000 << " us" << std::endl;
+
+        last_no_of_failures_ = no_of_failures_;
+        interval_handshake_latencies_.Clear();
+    }
+
+private:
+    boost::asio::io_service& io_service_;
+    ConnectionRateOptions options_;
+    uint32_t no_of_messages_;
+    uint32_t message_size_;
+    tcp::endpoint endpoint_;
+    std::vector<uint8_t> hello_;
+    boost::asio::steady_timer stop_timer_;
+    boost::asio::steady_timer report_timer_;
+    bool stopping_;
+    std::chrono::steady_clock::time_point start_time_;
+
+    uint64_t no_of_connections_ = 0;
+    uint64_t no_of_failures_ = 0;
+    uint64_t last_no_of_failures_ = 0;
+    uint32_t no_of_stopped_workers_ = 0;
+    boost::system::error_code last_error_;
+    LatencyRecorder connect_latencies_;
+    LatencyRecorder handshake_latencies_;
+    LatencyRecorder session_latencies_;
+    LatencyRecorder interval_handshake_latencies_;
+    std::vector<ConnectionRateReport> reports_;
+};
+
+void ConnectionWorker::Connect()
+{
+    if (generator_.Stopping())
+    {
+        generator_.OnWorkerStopped();
+        return;
+    }
+
+    next_message_ = 0;
+    start_time_ = std::chrono::steady_clock::now();
+
+    // e.g. EMFILE
+    boost::system::error_code error;
+    socket_.open(tcp::v4(), error);
+    if (error)
+    {
+        Close(error);
+        return;
+    }
+
+    socket_.set_option(tcp::no_delay(true), error);
+    socket_.async_connect(generator_.Endpoint(),
+                          [this, self = shared_from_this()](const boost::system::error_code& error) { OnConnect(error); });
+}
+
+void ConnectionWorker::OnConnect(const boost::system::error_code& error)
+{
+    if (error)
+    {
+        Close(error);
+        return;
+    }
+
+    connect_time_ = std::chrono::steady_clock::now();
+    auto self = shared_from_this();
+    boost::asio::async_write(socket_, boost::asio::buffer(generator_.Hello()), [this, self](const boost::system::error_code& error, std::size_t) {
+        if (error)
+        {
+            Close(error);
+            return;
+        }
+
+        boost::asio::async_read(socket_, boost::asio::buffer(ack_buffer_),
+                                [this, self](const boost::system::error_code& error, std::size_t) { OnHelloAck(error); });
+    });
+}
+
+void ConnectionWorker::OnHelloAck(const boost::system::error_code& error)
+{
+    if (error)
+    {
+        Close(error);
+        return;
+    }
+
+    handshake_time_ = std::chrono::steady_clock::now();
+    Send();
+}
+
+void ConnectionWorker::Send()
+{
+    if (next_message_ == no_of_messages_)
+    {
+        Close(make_error_code(boost::system::errc::success));
+        return;
+    }
+
+    auto header = DataMessage::Encode({ next_message_++, {} });
+    std::copy(header.begin(), header.end(), message_.begin());
+
+    auto self = shared_from_this();
+    boost::asio::async_write(socket_, boost::asio::buffer(message_), [this, self](const boost::system::error_code& error, std::size_t) {
+        if (error)
+        {
+            Close(error);
+            return;
+        }
+
+        boost::asio::async_read(socket_, boost::asio::buffer(ack_buffer_),
+                                [this, self](const boost::system::error_code& error, std::size_t) { OnAck(error); });
+    });
+}
+
+void ConnectionWorker::OnAck(const boost::system::error_code& error)
+{
+    if (error)
+    {
+        Close(error);
+        return;
+    }
+
+    Send();
+}
+
+void ConnectionWorker::Close(const boost::system::error_code& error)
+{
+    boost::system::error_code close_error;
+    socket_.close(close_error);
+
+    if (error)
+    {
+        generator_.OnFailure(error);
+    }
+    else
+    {
+        auto now = std::chrono::steady_clock::now();
+        generator_.OnSession(connect_time_ - start_time_, handshake_time_ - start_time_, now - start_time_);
+    }
+
+    // the next session right away, or stop; posted, so a worker that keeps failing does not recurse
+    boost::asio::post(socket_.get_executor(), [self = shared_from_this()]() { self->Connect(); });
+}
+
+#endif //MEASURE_TRANSFER_CONNECTION_RATE_H
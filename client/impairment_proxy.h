@@ -0,0 +1,485 @@
+#ifndef MEASURE_TRANSFER_IMPAIRMENT_PROXY_H
+#define MEASURE_TRANSFER_IMPAIRMENT_PROXY_H
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+
+#include <boost/asio.hpp>
+
+#include "latency.h"
+#include "timer_wheel.h"
+#include "trace.h"
+
+using boost::asio::ip::tcp;
+
+/**
+ * Link conditions applied by the ImpairmentProxy to each direction, data and
+ * ACKs alike, so a delay of D gives a round trip of 2D. Loss, reordering and
+ * duplication are per packet for datagrams. A byte stream cannot lose or
+ * reorder anything, so for TCP a lost segment is instead held back for one
+ * retransmission timeout, and everything behind it waits too, the head-of-line
+ * blocking a real TCP loss causes.
+ */
+struct ImpairmentOptions
+{
+    std::chrono::microseconds delay{0};
+    // uniform in [-jitter, +jitter], never reordering a stream
+    std::chrono::microseconds jitter{0};
+    // probabilities in [0, 1]
+    double loss = 0;
+    double reorder = 0;
+    double duplicate = 0;
+    // bits per second per direction, 0 is unlimited
+    uint64_t bandwidth = 0;
+    // bytes queued per direction before datagrams are tail dropped and streams stop being read
+    std::size_t queue_limit = 4 * 1024 * 1024;
+    std::chrono::milliseconds retransmission_timeout{200};
+    uint64_t seed = 1;
+
+    bool Enabled() const
+    {
+        return delay.count() > 0 || jitter.count() > 0 || loss > 0 || reorder > 0 || duplicate > 0 || bandwidth > 0;
+    }
+};
+
+std::ostream& operator<<(std::ostream& os, const ImpairmentOptions& options)
+{
+    os << "delay " << options.delay.count() << " us, jitter " << options.jitter.count() << " us, loss " << options.loss * 100
+       << " %, reorder " << options.reorder * 100 << " %, duplicate " << options.duplicate * 100 << " %, bandwidth ";
+    if (options.bandwidth > 0)
+    {
+        os << options.bandwidth / 1e6 << " Mbit/s";
+    }
+    else
+    {
+        os << "unlimited";
+    }
+    return os;
+}
+
+/**
+ * Relays one session's data connection (TCP) or datagrams (UDP) between the
+ * client and the server's data port on its own thread, injecting the
+ * configured impairments. Every segment or datagram gets a departure time and
+ * waits in a timer wheel, so scheduling stays O(1) at high packet rates, and
+ * the thread sleeps in ppoll with nanosecond timeouts and a minimal timer slack
+ * until the next tick. The lateness of every departure is recorded to show how
+ * closely the schedule was met.
+ */
+class ImpairmentProxy
+{
+public:
+    ImpairmentProxy(Protocol protocol, const std::string& host, uint16_t port, const ImpairmentOptions& options)
+        : protocol_{protocol}
+        , options_(options)
+        , random_{options.seed}
+        , wheel_{kTick, kNoOfSlots, TraceNow()}
+        , acceptor_{io_service_}
+        , downstream_{io_service_}
+        , upstream_{io_service_}
+        , udp_downstream_{io_service_}
+        , udp_upstream_{io_service_}
+        , stopping_{false}
+    {
+        if (protocol_ == Protocol::kTcp)
+        {
+            tcp::resolver resolver(io_service_);
+            boost::asio::connect(upstream_, resolver.resolve(tcp::resolver::query(host, std::to_string(port))));
+            upstream_.set_option(tcp::no_delay(true));
+
+            tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), 0);
+            acceptor_.open(endpoint.protocol());
+            acceptor_.bind(endpoint);
+            acceptor_.listen();
+            port_ = acceptor_.local_endpoint().port();
+        }
+        else if (protocol_ == Protocol::kUdp)
+        {
+            udp::resolver resolver(io_service_);
+            udp_upstream_.connect(*resolver.resolve(udp::resolver::query(udp::v4(), host, std::to_string(port))));
+            // the client sends its bursts without flow control, the proxy must absorb them
+            udp_upstream_.set_option(boost::asio::socket_base::receive_buffer_size(kDatagramBufferSize));
+            udp_downstream_.open(udp::v4());
+            udp_downstream_.set_option(boost::asio::socket_base::receive_buffer_size(kDatagramBufferSize));
+            udp_downstream_.bind(udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+            port_ = udp_downstream_.local_endpoint().port();
+        }
+        else
+        {
+            throw std::invalid_argument("The impairment proxy only relays TCP and UDP");
+        }
+
+        std::cout << "Impairment proxy on port " << port_ << " to " << host << ":" << port << ": " << options_ << std::endl;
+    }
+
+    ~ImpairmentProxy()
+    {
+        Stop();
+    }
+
+    // the port the client connects to instead of the session's data port
+    uint16_t Port() const
+    {
+        return port_;
+    }
+
+    void Start()
+    {
+        thread_ = std::thread([this]() { Run(); });
+    }
+
+    // lets the packets still on the emulated link arrive, for at most kDrainTimeout
+    void Stop()
+    {
+        stopping_ = true;
+        if (thread_.joinable())
+        {
+            // an accept still waiting for the client is woken up by shutting the listening socket down
+            ::shutdown(acceptor_.native_handle(), SHUT_RDWR);
+            thread_.join();
+        }
+    }
+
+    void Print()
+    {
+        const char* names[] = { "client -> server", "server -> client" };
+        for (int i = 0; i < 2; ++i)
+        {
+            const auto& stats = flows_[i].stats;
+            std::cout << "Impaired " << names[i] << ": " << stats.no_of_packets << " packets, " << stats.no_of_bytes << " bytes, "
+                      << stats.no_of_lost << (protocol_ == Protocol::kTcp ? " retransmission delays, " : " lost, ")
+                      << stats.no_of_queue_drops << " queue drops, " << stats.no_of_reordered << " reordered, "
+                      << stats.no_of_duplicated << " duplicated" << std::endl;
+        }
+
+        std::cout << "Impairment schedule lateness (us): p50 " << lateness_.Percentile(50).count() / 1e3 << ", p99 "
+                  << lateness_.Percentile(99).count() / 1e3 << ", max " << lateness_.Max().count() / 1e3 << std::endl;
+    }
+
+private:
+    using udp = boost::asio::ip::udp;
+
+    // 50 us ticks and 8192 slots: one revolution covers 410 ms, longer delays just take more turns
+    static constexpr std::chrono::nanoseconds kTick{50000};
+    static constexpr std::size_t kNoOfSlots = 8192;
+    // TCP-like segmentation of the relayed stream
+    static constexpr std::size_t kSegmentSize = 1448;
+    static constexpr std::size_t kReadSize = 64 * 1024;
+    static constexpr std::chrono::seconds kDrainTimeout{5};
+    static constexpr int kDatagramBufferSize = 8 * 1024 * 1024;
+
+    struct FlowStats
+    {
+        uint64_t no_of_packets;
+        uint64_t no_of_bytes;
+        uint64_t no_of_lost;
+        uint64_t no_of_queue_drops;
+        uint64_t no_of_reordered;
+        uint64_t no_of_duplicated;
+    };
+
+    // one direction of the relay
+    struct Flow
+    {
+        int source = -1;
+        int destination = -1;
+        // departure of the last packet and when the emulated link is free again
+        int64_t last_departure = 0;
+        int64_t link_free_time = 0;
+        std::size_t queued_bytes = 0;
+        // stream bytes the destination socket did not take yet
+        std::vector<uint8_t> pending;
+        bool source_closed = false;
+        bool destination_shut = false;
+        FlowStats stats{};
+    };
+
+    struct Packet
+    {
+        int flow;
+        int64_t due;
+        std::vector<uint8_t> data;
+    };
+
+    void Run()
+    {
+        // the default 50 us timer slack would be as large as a tick
+        prctl(PR_SET_TIMERSLACK, 1, 0, 0, 0);
+
+        if (protocol_ == Protocol::kTcp)
+        {
+            boost::system::error_code error;
+            acceptor_.accept(downstream_, error);
+            if (error)
+            {
+                if (!stopping_)
+                {
+                    std::cout << "Impairment proxy accept error: " << error << std::endl;
+                }
+                return;
+            }
+
+            downstream_.set_option(tcp::no_delay(true));
+            downstream_.non_blocking(true);
+            upstream_.non_blocking(true);
+            flows_[0].source = flows_[1].destination = downstream_.native_handle();
+            flows_[0].destination = flows_[1].source = upstream_.native_handle();
+        }
+        else
+        {
+            udp_downstream_.non_blocking(true);
+            udp_upstream_.non_blocking(true);
+            flows_[0].source = flows_[1].destination = udp_downstream_.native_handle();
+            flows_[0].destination = flows_[1].source = udp_upstream_.native_handle();
+        }
+
+        std::vector<uint8_t> buffer(kReadSize);
+        int64_t drain_deadline = 0;
+        while (!stopping_ || !Drained())
+        {
+            if (stopping_ && drain_deadline == 0)
+            {
+                drain_deadline = TraceNow() + std::chrono::duration_cast<std::chrono::nanoseconds>(kDrainTimeout).count();
+            }
+            else if (stopping_ && TraceNow() > drain_deadline)
+            {
+                std::cout << "Impairment proxy stopped with " << wheel_.Size() << " packets still scheduled" << std::endl;
+                break;
+            }
+
+            wheel_.Advance(TraceNow(), [this](Packet& packet) { Deliver(packet); });
+            for (auto& flow : flows_)
+            {
+                Flush(flow);
+            }
+
+            pollfd fds[2];
+            for (int i = 0; i < 2; ++i)
+            {
+                auto& flow = flows_[i];
+                // a closed stream would report POLLHUP forever
+                fds[i] = { flow.source_closed ? -1 : flow.source, 0, 0 };
+                if (!flow.source_closed && flow.queued_bytes < options_.queue_limit)
+                {
+                    fds[i].events |= POLLIN;
+                }
+            }
+
+            // a stream the destination cannot take right now is flushed once it becomes writable
+            pollfd write_fds[2];
+            int no_of_write_fds = 0;
+            for (auto& flow : flows_)
+            {
+                if (!flow.pending.empty())
+                {
+                    write_fds[no_of_write_fds++] = { flow.destination, POLLOUT, 0 };
+                }
+            }
+
+            pollfd all[4];
+            std::copy(fds, fds + 2, all);
+            std::copy(write_fds, write_fds + no_of_write_fds, all + 2);
+
+            int64_t timeout = wheel_.Empty() ? 10000000 : std::max<int64_t>(0, wheel_.NextTick() - TraceNow());
+            timespec wait = { static_cast<time_t>(timeout / 1000000000), static_cast<long>(timeout % 1000000000) };
+            if (ppoll(all, 2 + no_of_write_fds, &wait, nullptr) < 0 && errno != EINTR)
+            {
+                std::cout << "Impairment proxy poll error: " << errno << std::endl;
+                break;
+            }
+
+            for (int i = 0; i < 2; ++i)
+            {
+                if (all[i].revents & (POLLIN | POLLHUP | POLLERR))
+                {
+                    Read(i, buffer);
+                }
+            }
+
+            for (auto& flow : flows_)
+            {
+                Flush(flow);
+            }
+        }
+    }
+
+    bool Drained() const
+    {
+        return wheel_.Empty() && flows_[0].pending.empty() && flows_[1].pending.empty();
+    }
+
+    void Read(int index, std::vector<uint8_t>& buffer)
+    {
+        auto& flow = flows_[index];
+        if (protocol_ == Protocol::kUdp)
+        {
+            // replies go back to wherever the client sends from
+            sockaddr_storage address{};
+            socklen_t address_size = sizeof(address);
+            ssize_t size;
+            while ((size = ::recvfrom(flow.source, buffer.data(), buffer.size(), 0, reinterpret_cast<sockaddr*>(&address), &address_size)) >= 0)
+            {
+                if (index == 0)
+                {
+                    client_address_ = address;
+                    client_address_size_ = address_size;
+                }
+                Admit(index, buffer.data(), static_cast<std::size_t>(size));
+                address_size = sizeof(address);
+            }
+            return;
+        }
+
+        ssize_t size = ::recv(flow.source, buffer.data(), buffer.size(), 0);
+        if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            flow.source_closed = true;
+            return;
+        }
+
+        for (ssize_t offset = 0; offset < size; offset += kSegmentSize)
+        {
+            Admit(index, buffer.data() + offset, std::min<std::size_t>(kSegmentSize, size - offset));
+        }
+    }
+
+    // decides the fate and the departure time of one segment or datagram
+    void Admit(int index, const uint8_t* data, std::size_t size)
+    {
+        auto& flow = flows_[index];
+        bool stream = protocol_ == Protocol::kTcp;
+        int64_t now = TraceNow();
+
+        if (!stream && flow.queued_bytes + size > options_.queue_limit)
+        {
+            flow.stats.no_of_queue_drops++;
+            return;
+        }
+
+        bool lost = Chance(options_.loss);
+        if (lost && !stream)
+        {
+            flow.stats.no_of_lost++;
+            return;
+        }
+
+        // serialization on the emulated link, then propagation
+        int64_t transmission = options_.bandwidth > 0 ? static_cast<int64_t>(size * 8 * 1e9 / options_.bandwidth) : 0;
+        flow.link_free_time = std::max(now, flow.link_free_time) + transmission;
+        int64_t due = flow.link_free_time + std::chrono::duration_cast<std::chrono::nanoseconds>(options_.delay).count() + Jitter();
+
+        if (stream)
+        {
+            if (lost)
+            {
+                flow.stats.no_of_lost++;
+                due += std::chrono::duration_cast<std::chrono::nanoseconds>(options_.retransmission_timeout).count();
+            }
+            due = std::max(due, flow.last_departure);
+        }
+        else if (Chance(options_.reorder))
+        {
+            // skips the propagation delay and overtakes the datagrams queued before it
+            flow.stats.no_of_reordered++;
+            due = flow.link_free_time;
+        }
+        flow.last_departure = std::max(flow.last_departure, due);
+
+        int copies = !stream && Chance(options_.duplicate) ? 2 : 1;
+        flow.stats.no_of_duplicated += copies - 1;
+        for (int i = 0; i < copies; ++i)
+        {
+            flow.queued_bytes += size;
+            wheel_.Schedule(due, Packet{ index, due, std::vector<uint8_t>(data, data + size) });
+        }
+    }
+
+    void Deliver(Packet& packet)
+    {
+        auto& flow = flows_[packet.flow];
+        flow.queued_bytes -= packet.data.size();
+        flow.stats.no_of_packets++;
+        flow.stats.no_of_bytes += packet.data.size();
+        lateness_.Add(std::chrono::nanoseconds(std::max<int64_t>(0, TraceNow() - packet.due)));
+
+        if (protocol_ == Protocol::kUdp)
+        {
+            if (packet.flow == 0)
+            {
+                ::send(flow.destination, packet.data.data(), packet.data.size(), 0);
+            }
+            else if (client_address_size_ > 0)
+            {
+                ::sendto(flow.destination, packet.data.data(), packet.data.size(), 0, reinterpret_cast<sockaddr*>(&client_address_),
+                         client_address_size_);
+            }
+            return;
+        }
+
+        // written out by the Flush after the tick, one send for everything that became due together
+        flow.pending.insert(flow.pending.end(), packet.data.begin(), packet.data.end());
+    }
+
+    void Flush(Flow& flow)
+    {
+        if (!flow.pending.empty())
+        {
+            ssize_t written = ::send(flow.destination, flow.pending.data(), flow.pending.size(), MSG_NOSIGNAL);
+            if (written > 0)
+            {
+                flow.pending.erase(flow.pending.begin(), flow.pending.begin() + written);
+            }
+        }
+
+        // the end of the stream is passed on once everything before it has left
+        if (protocol_ == Protocol::kTcp && flow.source_closed && !flow.destination_shut && flow.queued_bytes == 0 && flow.pending.empty())
+        {
+            ::shutdown(flow.destination, SHUT_WR);
+            flow.destination_shut = true;
+        }
+    }
+
+    bool Chance(double probability)
+    {
+        return probability > 0 && std::uniform_real_distribution<double>(0, 1)(random_) < probability;
+    }
+
+    int64_t Jitter()
+    {
+        auto jitter = std::chrono::duration_cast<std::chrono::nanoseconds>(options_.jitter).count();
+        auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(options_.delay).count();
+        return jitter > 0 ? std::max(-delay, std::uniform_int_distribution<int64_t>(-jitter, jitter)(random_)) : 0;
+    }
+
+private:
+    Protocol protocol_;
+    ImpairmentOptions options_;
+    std::mt19937_64 random_;
+    TimerWheel<Packet> wheel_;
+    Flow flows_[2];
+    LatencyRecorder lateness_;
+
+    boost::asio::io_service io_service_;
+    tcp::acceptor acceptor_;
+    tcp::socket downstream_;
+    tcp::socket upstream_;
+    udp::socket udp_downstream_;
+    udp::socket udp_upstream_;
+    sockaddr_storage client_address_{};
+    socklen_t client_address_size_ = 0;
+    uint16_t port_ = 0;
+
+    std::atomic<bool> stopping_;
+    std::thread thread_;
+};
+
+#endif //MEASURE_TRANSFER_IMPAIRMENT_PROXY_H
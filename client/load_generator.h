@@ -0,0 +1,362 @@
+#ifndef MEASURE_TRANSFER_LOAD_GENERATOR_H
+#define MEASURE_TRANSFER_LOAD_GENERATOR_H
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "latency.h"
+#include "messages.h"
+
+using boost::asio::ip::tcp;
+
+struct LoadOptions
+{
+    // 0 disables the load generator
+    uint32_t no_of_sessions = 0;
+    // messages per second sent by every session
+    double message_rate = 1;
+    // new sessions opened per second while ramping up
+    uint32_t ramp_rate = 1000;
+    uint16_t port = 4992;
+};
+
+// one line of the load report, covering one second
+struct LoadReport
+{
+    uint32_t no_of_sessions;
+    uint64_t no_of_connects;
+    uint64_t no_of_acks;
+    std::chrono::nanoseconds p50;
+    std::chrono::nanoseconds p99;
+    std::chrono::nanoseconds max;
+    std::size_t memory_per_session;
+};
+
+class LoadGenerator;
+
+/**
+ * One low-rate session: connect, send a HelloMessage on the data connection
+ * and wait for its AcknowledgeMessage, then one DataMessage per tick and record its ACK latency. At most one
+ * message is outstanding; a tick that finds the previous ACK still missing is
+ * counted as late and skipped.
+ */
+class LoadSession : public std::enable_shared_from_this<LoadSession>
+{
+public:
+    LoadSession(LoadGenerator& generator, boost::asio::io_service& io_service, uint32_t no_of_messages, uint32_t message_size)
+        : generator_(generator)
+        , socket_(io_service)
+        , timer_(io_service)
+        , no_of_messages_{no_of_messages}
+        , next_message_{0}
+        , ack_pending_{false}
+        , message_(DataMessage::kSize + message_size, 0)
+    {}
+
+    void Start(const tcp::endpoint& endpoint, const std::vector<uint8_t>& hello, std::chrono::nanoseconds first_tick);
+
+private:
+    void ScheduleSend(std::chrono::nanoseconds delay);
+    void Send();
+    void OnAck(const boost::system::error_code& error);
+    void Finish(const boost::system::error_code& error);
+
+private:
+    LoadGenerator& generator_;
+    tcp::socket socket_;
+    boost::asio::steady_timer timer_;
+    uint32_t no_of_messages_;
+    uint32_t next_message_;
+    bool ack_pending_;
+    std::chrono::steady_clock::time_point send_time_;
+    std::vector<uint8_t> message_;
+    AcknowledgeMessage::Buffer ack_buffer_;
+};
+
+/**
+ * Opens no_of_sessions sessions against the server's C10K port at ramp_rate
+ * sessions per second, all driven by one io_service on the calling thread,
+ * and reports once a second how ACK latency and memory evolve as the session
+ * count grows.
+ */
+class LoadGenerator
+{
+public:
+    LoadGenerator(boost::asio::io_service& io_service, const std::string& host, uint32_t no_of_messages, uint32_t message_size,
+                  const LoadOptions& options)
+        : io_service_(io_service)
+        , options_(options)
+        , no_of_messages_{no_of_messages}
+        , message_size_{message_size}
+        , ramp_timer_(io_service)
+        , report_timer_(io_service)
+        , interval_{static_cast<int64_t>(1e9 / std::max(options.message_rate, 1e-3))}
+        , random_(std::random_device{}())
+        , baseline_memory_{ResidentMemory()}
+    {
+        tcp::resolver resolver(io_service_);
+        endpoint_ = *resolver.resolve(tcp::resolver::query(host, std::to_string(options_.port)));
+
+        // the C10K server only reads the message size, the rest asks for nothing beyond plain Asio over TCP
+        HelloMessage hello_message = { Protocol::kTcp, CommunicationMechanism::kStopAndGo, message_size_, IoBackend::kAsio, 0, 0, 0, SocketOptions{}, 0,
+                                       false, false, false, 0, FecOptions{}, UdpCongestionControl::kNone };
+        auto hello = HelloMessage::Encode(hello_message);
+        hello_.assign(hello.begin(), hello.end());
+
+        std::cout << "Load generator: " << options_.no_of_sessions << " sessions, " << options_.message_rate
+                  << " messages/s each, descriptor limit " << RaiseFileDescriptorLimit() << std::endl;
+    }
+
+    void Run()
+    {
+        Ramp();
+        ScheduleReport();
+        io_service_.run();
+
+        std::cout << std::endl;
+        std::cout << std::setw(10) << "Sessions" << std::setw(12) << "Connects/s" << std::setw(10) << "ACKs/s" << std::setw(14) << "p50 (us)"
+                  << std::setw(14) << "p99 (us)" << std::setw(14) << "max (us)" << std::setw(16) << "RSS/session" << std::endl;
+        for (const auto& report : reports_)
+        {
+            std::cout << std::setw(10) << report.no_of_sessions << std::setw(12) << report.no_of_connects << std::setw(10) << report.no_of_acks
+                      << std::setw(14) << report.p50.count() / 1000 << std::setw(14) << report.p99.count() / 1000
+                      << std::setw(14) << report.max.count() / 1000 << std::setw(16) << report.memory_per_session << std::endl;
+        }
+        std::cout << "Failed sessions: " << no_of_failures_ << ", late ticks: " << no_of_late_ticks_ << std::endl;
+    }
+
+    // called by the sessions
+    void OnConnected()
+    {
+        no_of_connected_++;
+        no_of_connects_++;
+    }
+
+    void OnAck(std::chrono::nanoseconds latency)
+    {
+        latencies_.Add(latency);
+    }
+
+    void OnLateTick()
+    {
+        no_of_late_ticks_++;
+    }
+
+    void OnFinished(bool connected, const boost::system::error_code& error)
+    {
+        if (connected)
+        {
+            no_of_connected_--;
+        }
+
+        if (error && no_of_failures_++ == 0)
+        {
+            std::cout << "Session failed: " << error.message() << std::endl;
+        }
+
+        if (++no_of_finished_ == options_.no_of_sessions)
+        {
+            boost::system::error_code cancel_error;
+            report_timer_.cancel(cancel_error);
+            Report();
+        }
+    }
+
+    std::chrono::nanoseconds Interval() const
+    {
+        return interval_;
+    }
+
+private:
+    static const uint32_t kRampStepsPerSecond = 10;
+
+    void Ramp()
+    {
+        // a random first tick spreads the sessions evenly over the send interval
+        std::uniform_int_distribution<int64_t> phase(0, interval_.count());
+
+        uint32_t step = std::max<uint32_t>(1, options_.ramp_rate / kRampStepsPerSecond);
+        for (uint32_t i = 0; i < step && sessions_.size() < options_.no_of_sessions; ++i)
+        {
+            auto session = std::make_shared<LoadSession>(*this, io_service_, no_of_messages_, message_size_);
+            sessions_.push_back(session);
+            session->Start(endpoint_, hello_, std::chrono::nanoseconds(phase(random_)));
+        }
+
+        if (sessions_.size() < options_.no_of_sessions)
+        {
+            ramp_timer_.expires_from_now(std::chrono::milliseconds(1000 / kRampStepsPerSecond));
+            ramp_timer_.async_wait([this](const boost::system::error_code& error) {
+                if (!error)
+                {
+                    Ramp();
+                }
+            });
+        }
+    }
+
+    void ScheduleReport()
+    {
+        report_timer_.expires_from_now(std::chrono::seconds(1));
+        report_timer_.async_wait([this](const boost::system::error_code& error) {
+            if (!error)
+            {
+                Report();
+                ScheduleReport();
+            }
+        });
+    }
+
+    void Report()
+    {
+        std::size_t memory = ResidentMemory();
+        LoadReport report = { no_of_connected_,
+                              no_of_connects_,
+                              latencies_.Count(),
+                              latencies_.Percentile(50),
+                              latencies_.Percentile(99),
+                              latencies_.Max(),
+                              no_of_connected_ > 0 && memory > baseline_memory_ ? (memory - baseline_memory_) / no_of_connected_ : 0 };
+        reports_.push_back(report);
+
+        std::cout << "Load: " << report.no_of_sessions << " sessions, " << report.no_of_connects << " connects/s, " << report.no_of_acks
+                  << " ACKs/s, p50 " << report.p50.count() / 1000 << " us, p99 " << report.p99.count() / 1000 << " us, "
+                  << report.memory_per_session << " bytes RSS per session" << std::endl;
+
+        no_of_connects_ = 0;
+        latencies_.Clear();
+    }
+
+private:
+    boost::asio::io_service& io_service_;
+    LoadOptions options_;
+    uint32_t no_of_messages_;
+    uint32_t message_size_;
+    tcp::endpoint endpoint_;
+    boost::asio::steady_timer ramp_timer_;
+    boost::asio::steady_timer report_timer_;
+    std::chrono::nanoseconds interval_;
+    std::mt19937_64 random_;
+    std::size_t baseline_memory_;
+    std::vector<uint8_t> hello_;
+    std::vector<std::shared_ptr<LoadSession>> sessions_;
+
+    uint32_t no_of_connected_ = 0;
+    uint32_t no_of_finished_ = 0;
+    uint64_t no_of_connects_ = 0;
+    uint64_t no_of_failures_ = 0;
+    uint64_t no_of_late_ticks_ = 0;
+    LatencyRecorder latencies_;
+    std::vector<LoadReport> reports_;
+};
+
+void LoadSession::Start(const tcp::endpoint& endpoint, const std::vector<uint8_t>& hello, std::chrono::nanoseconds first_tick)
+{
+    auto self = shared_from_this();
+    socket_.async_connect(endpoint, [this, self, &hello, first_tick](const boost::system::error_code& error) {
+        if (error)
+        {
+            generator_.OnFinished(false, error);
+            return;
+        }
+
+        generator_.OnConnected();
+        socket_.set_option(tcp::no_delay(true));
+        boost::asio::async_write(socket_, boost::asio::buffer(hello), [this, self, first_tick](const boost::system::error_code& error, std::size_t) {
+            if (error)
+            {
+                Finish(error);
+                return;
+            }
+
+            boost::asio::async_read(socket_, boost::asio::buffer(ack_buffer_), [this, self, first_tick](const boost::system::error_code& error, std::size_t) {
+                if (error)
+                {
+                    Finish(error);
+                    return;
+                }
+
+                ScheduleSend(first_tick);
+            });
+        });
+    });
+}
+
+void LoadSession::ScheduleSend(std::chrono::nanoseconds delay)
+{
+    auto self = shared_from_this();
+    timer_.expires_from_now(delay);
+    timer_.async_wait([this, self](const boost::system::error_code& error) {
+        if (!error)
+        {
+            Send();
+        }
+    });
+}
+
+void LoadSession::Send()
+{
+    if (ack_pending_)
+    {
+        generator_.OnLateTick();
+        ScheduleSend(generator_.Interval());
+        return;
+    }
+
+    auto header = DataMessage::Encode({ next_message_++, {} });
+    std::copy(header.begin(), header.end(), message_.begin());
+
+    auto self = shared_from_this();
+    ack_pending_ = true;
+    send_time_ = std::chrono::steady_clock::now();
+    boost::asio::async_write(socket_, boost::asio::buffer(message_), [this, self](const boost::system::error_code& error, std::size_t) {
+        if (error)
+        {
+            Finish(error);
+            return;
+        }
+
+        boost::asio::async_read(socket_, boost::asio::buffer(ack_buffer_),
+                                [this, self](const boost::system::error_code& error, std::size_t) { OnAck(error); });
+    });
+
+    if (next_message_ < no_of_messages_)
+    {
+        ScheduleSend(generator_.Interval());
+    }
+}
+
+void LoadSession::OnAck(const boost::system::error_code& error)
+{
+    if (error)
+    {
+        Finish(error);
+        return;
+    }
+
+    generator_.OnAck(std::chrono::steady_clock::now() - send_time_);
+    ack_pending_ = false;
+
+    if (FromBytes(&ack_buffer_[1]) + 1 == no_of_messages_)
+    {
+        Finish(make_error_code(boost::system::errc::success));
+    }
+}
+
+void LoadSession::Finish(const boost::system::error_code& error)
+{
+    boost::system::error_code close_error;
+    timer_.cancel(close_error);
+    socket_.close(close_error);
+    generator_.OnFinished(true, error);
+}
+
+#endif //MEASURE_TRANSFER_LOAD_GENERATOR_H
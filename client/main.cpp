@@ -5,112 +5,959 @@
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
 #include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
 #include <iostream>
 #include <messages.h>
+#include <sstream>
 #include <thread>
 #include <utility>
 
 #include "client.h"
+#include "connection_rate.h"
+#include "impairment_proxy.h"
+#include "load_generator.h"
+#include "results.h"
+
+struct ScenarioTest
+{
+    Protocol protocol;
+    CommunicationMechanism communication_mechanism;
+    uint32_t no_of_messages;
+    uint32_t message_size;
+};
+
+struct RunResult
+{
+    Protocol protocol;
+    CommunicationMechanism communication_mechanism;
+    uint32_t no_of_messages;
+    uint32_t message_size;
+    bool reused_data_connection;
+    // the one the client ran on, which is not the requested one after a fallback
+    IoBackend io_backend;
+    Stats stats;
+    // as seen by the server
+    TestStatsMessage server_stats;
+};
+
+struct HistoryOptions
+{
+    // empty keeps the results in memory only
+    std::string path;
+    std::string label = "default";
+    uint32_t no_of_repetitions = 1;
+    RegressionOptions regression{};
+};
+
+// one test per line: <protocol> <communication mechanism> <no of messages> <message size>, numbered as on the command line; # starts a comment
+std::vector<ScenarioTest> LoadScenario(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("Cannot open scenario " + path);
+    }
+
+    std::vector<ScenarioTest> scenario;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line.substr(0, line.find('#')));
+        uint32_t protocol, communication_mechanism, no_of_messages, message_size;
+        if (fields >> protocol >> communication_mechanism >> no_of_messages >> message_size)
+        {
+            scenario.push_back({ static_cast<Protocol>(protocol), static_cast<CommunicationMechanism>(communication_mechanism), no_of_messages,
+                                 message_size });
+        }
+    }
+
+    if (scenario.empty())
+    {
+        throw std::runtime_error("No tests in scenario " + path);
+    }
+    return scenario;
+}
+
+// runs one test of the session on its control connection; the data connection is kept in data_connection while consecutive tests reuse it
+int RunTest(tcp::socket& socket, boost::asio::io_service& io_service, const std::string& host, const ScenarioTest& test, uint32_t test_no,
+            const ClientOptions& options, const ImpairmentOptions& impairment, std::shared_ptr<tcp::socket>& data_connection, RunResult& result)
+{
+    auto protocol = test.protocol;
+    auto communication_mechanism = test.communication_mechanism;
+    auto no_of_messages = test.no_of_messages;
+    auto message_size = test.message_size;
+    auto& stats = result.stats;
+
+    // send Hello message; the impairment proxy relays a new connection per test, so it never reuses one
+    HelloMessage hello_message = { protocol, communication_mechanism, message_size, options.io_backend, options.io_uring_flags,
+                                   static_cast<uint16_t>(std::min<uint32_t>(options.batch_size, UINT16_MAX)), options.udp_flags,
+                                   options.socket_options, options.tcp_info_interval_ms, options.verify_payload,
+                                   options.send_timestamps, options.reuse_data_connection && !impairment.Enabled(), options.response_size, options.fec,
+                                   options.udp_congestion_control };
+    HelloMessage::Buffer buf = HelloMessage::Encode(hello_message);
+    boost::system::error_code error;
+
+    auto sent_bytes = socket.send(boost::asio::buffer(buf));
+    if (sent_bytes != HelloMessage::kSize)
+    {
+        std::cout << "Failed to send Hello message" << std::endl;
+        return -1;
+    }
+
+    std::cout << "Hello Message sent for test " << test_no << std::endl;
+
+    // tell the server how to regenerate the payloads it should receive
+    if (options.verify_payload)
+    {
+        boost::asio::write(socket, boost::asio::buffer(PayloadMessage::Encode({ options.payload })));
+        std::cout << "Payload Message sent" << std::endl;
+    }
+
+    // wait Response message
+    AcknowledgeMessage::Buffer response_message_buffer;
+    auto read_bytes = socket.read_some(boost::asio::buffer(response_message_buffer), error);
+    if (error)
+    {
+        std::cout << "Receive ResponseMessage error: " << error << std::endl;
+        return -2;
+    }
+
+    if (read_bytes < AcknowledgeMessage::kSize)
+    {
+        std::cout << "Read ResponseMessage of wrong size" << std::endl;
+        return -3;
+    }
+
+    auto response_message = AcknowledgeMessage::Decode(response_message_buffer);
+    std::cout << "Response message received, new port = " << response_message.message_no << std::endl;
+
+    // wait the socket options granted on the server side
+    SocketOptionsMessage::Buffer options_message_buffer;
+    boost::asio::read(socket, boost::asio::buffer(options_message_buffer), error);
+    if (error)
+    {
+        std::cout << "Receive SocketOptionsMessage error: " << error << std::endl;
+        return -2;
+    }
+
+    auto options_message = SocketOptionsMessage::Decode(options_message_buffer);
+    std::cout << "Requested socket options: " << options.socket_options << std::endl;
+    std::cout << "Server granted socket options: " << options_message.socket_options << std::endl;
+
+    // the data connection goes through the impairment proxy instead, when there is anything to impair
+    auto data_host = host;
+    auto data_port = static_cast<uint16_t>(response_message.message_no);
+    std::unique_ptr<ImpairmentProxy> proxy;
+    if (impairment.Enabled())
+    {
+        if (protocol == Protocol::kTcp || protocol == Protocol::kUdp)
+        {
+            proxy = std::make_unique<ImpairmentProxy>(protocol, host, data_port, impairment);
+            proxy->Start();
+            data_host = "127.0.0.1";
+            data_port = proxy->Port();
+        }
+        else
+        {
+            std::cout << "No impairment for " << protocol << ", it does not go through a socket pair the proxy can relay" << std::endl;
+        }
+    }
+
+    // open new connection
+    auto client = ClientFactory(protocol, communication_mechanism, io_service, data_host, data_port, message_size, options);
+    if (!client)
+    {
+        std::cout << "Unsupported protocol/communication mechanism combination" << std::endl;
+        return -4;
+    }
+
+    // the server keeps its end under the same rule
+    result.reused_data_connection = ReusesDataConnection(hello_message) && data_connection && data_connection->is_open();
+    if (ReusesDataConnection(hello_message))
+    {
+        if (!data_connection)
+        {
+            data_connection = std::make_shared<tcp::socket>(io_service);
+        }
+        client->ReuseDataConnection(data_connection);
+    }
+    else if (data_connection)
+    {
+        data_connection->close();
+        data_connection.reset();
+    }
+
+    // pre-sized for every message of the session; the file is named after the session port, like the server's
+    if (!options.trace.prefix.empty())
+    {
+        client->EnableTracing(std::make_unique<TraceWriter>(TracePath(options.trace, TraceRole::kClient, static_cast<uint16_t>(response_message.message_no), test_no),
+                                                            TraceRole::kClient, no_of_messages, protocol, communication_mechanism, message_size));
+    }
+
+    if (options.send_timestamps)
+    {
+        client->EnableSendTimestamps();
+    }
+
+    if (options.progress)
+    {
+        client->EnableProgress(options.progress);
+    }
+
+    CpuUsageSampler sampler;
+    sampler.Start();
+
+    client->TransferData(no_of_messages, message_size);
+    stats = client->GetStats();
+    result.io_backend = client->Backend();
+    stats.cpu_usage = sampler.Stop();
+
+    if (proxy)
+    {
+        proxy->Stop();
+        proxy->Print();
+    }
+
+    client->Phases().Print();
+
+    if (client->Trace())
+    {
+        client->Trace()->Print();
+
+        LatencyRecorder ack_latencies;
+        client->Trace()->AckLatencies(ack_latencies);
+        stats.ack_latency_p50 = ack_latencies.Percentile(50);
+        stats.ack_latency_p99 = ack_latencies.Percentile(99);
+    }
+
+    // end the test and collect what the server saw of it
+    sent_bytes = socket.send(boost::asio::buffer(EndOfTestMessage::Encode({ stats.no_of_sent_messages })));
+    if (sent_bytes != EndOfTestMessage::kSize)
+    {
+        std::cout << "Failed to send EndOfTest message" << std::endl;
+        return -1;
+    }
+
+    TestStatsMessage::Buffer test_stats_buffer;
+    boost::asio::read(socket, boost::asio::buffer(test_stats_buffer), error);
+    if (error)
+    {
+        std::cout << "Receive TestStatsMessage error: " << error << std::endl;
+        return -2;
+    }
+
+    result.server_stats = TestStatsMessage::Decode(test_stats_buffer);
+    return 0;
+}
+
+// one control connection carries every test of a run, so the sweep pays the session setup once
+void ConnectControlSocket(tcp::socket& socket, boost::asio::io_service& io_service, const std::string& host, uint16_t port)
+{
+    tcp::resolver resolver(io_service);
+    tcp::resolver::query query(host, std::to_string(port));
+    tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
+    boost::asio::connect(socket, endpoint_iterator);
+}
+
+int EndSession(tcp::socket& socket)
+{
+    // send Goodbye message
+    GoodbyeMessage goodbye_message = {};
+    GoodbyeMessage::Buffer buffer = GoodbyeMessage::Encode(goodbye_message);
+
+    auto sent_bytes = socket.send(boost::asio::buffer(buffer));
+    if (sent_bytes != GoodbyeMessage::kSize)
+    {
+        std::cout << "Failed to send Goodbye message" << std::endl;
+        return -1;
+    }
+
+    std::cout << "Goodbye Message sent" << std::endl;
+
+    // disconnect
+    socket.close();
+
+    return 0;
+}
+
+void PrintStats(Protocol protocol, const Stats& stats)
+{
+    auto transmission_time = std::chrono::duration_cast<std::chrono::microseconds>(stats.end_time - stats.start_time);
+    double seconds = transmission_time.count() / 1e6;
+
+    std::cout << "Transmission time: " << transmission_time.count() / 1000 << " ms" << std::endl;
+    std::cout << "# sent messages: " << stats.no_of_sent_messages << std::endl;
+    std::cout << "# sent bytes: " << stats.no_of_sent_bytes << std::endl;
+    std::cout << "# I/O syscalls: " << stats.no_of_syscalls << std::endl;
+
+    if (seconds > 0 && stats.no_of_sent_messages > 0)
+    {
+        std::cout << "Throughput: " << stats.no_of_sent_bytes / seconds / (1024 * 1024) << " MiB/s" << std::endl;
+        std::cout << "Average time per message: " << transmission_time.count() / static_cast<double>(stats.no_of_sent_messages) << " us" << std::endl;
+        std::cout << "I/O syscalls per message: " << stats.no_of_syscalls / static_cast<double>(stats.no_of_sent_messages) << std::endl;
+        std::cout << "Messages per second: " << stats.no_of_sent_messages / seconds << std::endl;
+    }
+
+    if (protocol == Protocol::kUdp && stats.congestion.empty())
+    {
+        std::cout << "# unacknowledged messages: " << stats.no_of_lost_messages << std::endl;
+    }
+
+    if (stats.no_of_transactions > 0)
+    {
+        auto us = [](std::chrono::nanoseconds latency) { return latency.count() / 1e3; };
+        const auto& latency = stats.transaction_latency;
+        std::cout << "# transactions: " << stats.no_of_transactions << ", # received bytes: " << stats.no_of_received_bytes << std::endl;
+        std::cout << "Transactions per second: " << (seconds > 0 ? stats.no_of_transactions / seconds : 0) << std::endl;
+        std::cout << "Transaction latency (us): p50 " << us(latency.p50) << ", p90 " << us(latency.p90) << ", p99 " << us(latency.p99)
+                  << ", p99.9 " << us(latency.p999) << ", max " << us(latency.max) << std::endl;
+    }
+
+    if (!stats.congestion.empty())
+    {
+        std::cout << "# retransmissions: " << stats.no_of_retransmissions << ", # retransmission timeouts: " << stats.no_of_timeouts
+                  << ", # undelivered messages: " << stats.no_of_lost_messages << std::endl;
+        PrintCongestionSummary(stats.congestion);
+    }
+
+    if (stats.no_of_parity_messages > 0)
+    {
+        std::cout << "FEC: # parity messages: " << stats.no_of_parity_messages << ", # parity bytes: " << stats.no_of_parity_bytes
+                  << " (" << 100.0 * stats.no_of_parity_bytes / std::max<uint32_t>(stats.no_of_sent_bytes, 1) << "% overhead), encoded at "
+                  << stats.fec_encode_gbps << " GB/s" << std::endl;
+    }
+
+    PrintTcpInfoSummary(stats.tcp_info);
+    std::cout << "Placement: " << stats.placement << std::endl;
+    PrintCpuCost(stats.cpu_usage, stats.no_of_sent_bytes, stats.no_of_sent_messages, stats.end_time - stats.start_time);
+}
+
+void PrintServerStats(Protocol protocol, const TestStatsMessage& stats)
+{
+    std::cout << "Server: # read messages: " << stats.no_of_read_messages << ", # read bytes: " << stats.no_of_read_bytes
+              << ", # I/O syscalls: " << stats.no_of_syscalls << ", CPU time: " << stats.cpu_time_ns / 1e6 << " ms" << std::endl;
+    if (protocol == Protocol::kUdp)
+    {
+        std::cout << "Server: # lost messages: " << stats.no_of_lost_messages << ", # reordered messages: " << stats.no_of_reordered_messages
+                  << std::endl;
+    }
+    // the lost messages above are the ones FEC could not rebuild
+    if (stats.no_of_recovered_messages > 0)
+    {
+        std::cout << "Server: # recovered messages: " << stats.no_of_recovered_messages << ", # unrecoverable messages: "
+                  << stats.no_of_lost_messages << ", decoded at "
+                  << static_cast<double>(stats.no_of_fec_decoded_bytes) / std::max<uint64_t>(stats.fec_decode_time_ns, 1) << " GB/s" << std::endl;
+    }
+}
+
+// everything that shapes the transfer goes into the configuration, so only like runs are ever compared
+ResultRecord MakeResultRecord(const RunResult& result, const ClientOptions& options, const ImpairmentOptions& impairment, const std::string& label)
+{
+    std::ostringstream configuration;
+    configuration << "protocol=" << result.protocol << " mechanism=" << result.communication_mechanism << " backend=" << result.io_backend
+                  << " size=" << result.message_size << " messages=" << result.no_of_messages << " batch=" << options.batch_size
+                  << " io_uring_flags=" << static_cast<int>(options.io_uring_flags) << " udp_flags=" << static_cast<int>(options.udp_flags)
+                  << " payload=" << options.payload.mode << " cpu=" << options.cpu << " " << options.socket_options;
+    if (options.send_timestamps)
+    {
+        configuration << " timestamps=1";
+    }
+    if (result.communication_mechanism == CommunicationMechanism::kRequestResponse)
+    {
+        configuration << " response_size=" << (options.response_size > 0 ? options.response_size : result.message_size)
+                      << " outstanding=" << options.no_of_outstanding;
+    }
+    if (options.fec.Enabled() && result.protocol == Protocol::kUdp && result.communication_mechanism == CommunicationMechanism::kStreaming)
+    {
+        configuration << " fec=" << options.fec.scheme << " fec_k=" << static_cast<int>(options.fec.data_shards)
+                      << " fec_m=" << options.fec.NoOfParityShards();
+    }
+    if (options.udp_congestion_control != UdpCongestionControl::kNone && result.protocol == Protocol::kUdp
+        && result.communication_mechanism == CommunicationMechanism::kStreaming)
+    {
+        configuration << " udp_cc=" << options.udp_congestion_control;
+    }
+    // a warm connection skips the handshake and slow start
+    if (result.reused_data_connection)
+    {
+        configuration << " reused=1";
+    }
+    if (impairment.Enabled())
+    {
+        configuration << " delay_us=" << impairment.delay.count() << " jitter_us=" << impairment.jitter.count() << " loss=" << impairment.loss
+                      << " reorder=" << impairment.reorder << " duplicate=" << impairment.duplicate << " bandwidth=" << impairment.bandwidth;
+    }
+
+    const auto& stats = result.stats;
+    ResultRecord record = { CurrentTime(), label, KernelRelease(), configuration.str(), {} };
+
+    double seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(stats.end_time - stats.start_time).count() / 1e9;
+    if (seconds > 0 && stats.no_of_sent_messages > 0)
+    {
+        record.metrics["mib_per_s"] = stats.no_of_sent_bytes / seconds / (1024 * 1024);
+        record.metrics["messages_per_s"] = stats.no_of_sent_messages / seconds;
+        record.metrics["us_per_message"] = seconds * 1e6 / stats.no_of_sent_messages;
+        record.metrics["syscalls_per_message"] = stats.no_of_syscalls / static_cast<double>(stats.no_of_sent_messages);
+        record.metrics["cpu_ns_per_message"] = stats.cpu_usage.Total().count() / static_cast<double>(stats.no_of_sent_messages);
+    }
+
+    if (stats.no_of_sent_bytes > 0)
+    {
+        record.metrics["cpu_s_per_gb"] = stats.cpu_usage.Total().count() / static_cast<double>(stats.no_of_sent_bytes);
+        record.metrics["cycles_per_byte"] = static_cast<double>(stats.cpu_usage.cycles) / stats.no_of_sent_bytes;
+    }
+
+    if (stats.ack_latency_p50.count() > 0)
+    {
+        record.metrics["ack_p50_us"] = stats.ack_latency_p50.count() / 1e3;
+        record.metrics["ack_p99_us"] = stats.ack_latency_p99.count() / 1e3;
+    }
+
+    if (!stats.congestion.empty() && stats.no_of_sent_messages > 0)
+    {
+        record.metrics["retransmissions_per_message"] = stats.no_of_retransmissions / static_cast<double>(stats.no_of_sent_messages);
+    }
+
+    if (stats.no_of_parity_messages > 0)
+    {
+        const auto& server_stats = result.server_stats;
+        record.metrics["fec_overhead"] = static_cast<double>(stats.no_of_parity_bytes) / std::max<uint32_t>(stats.no_of_sent_bytes, 1);
+        record.metrics["fec_encode_gb_per_s"] = stats.fec_encode_gbps;
+        record.metrics["recovered_messages"] = server_stats.no_of_recovered_messages;
+        record.metrics["unrecoverable_messages"] = server_stats.no_of_lost_messages;
+        if (server_stats.fec_decode_time_ns > 0)
+        {
+            record.metrics["fec_decode_gb_per_s"] = static_cast<double>(server_stats.no_of_fec_decoded_bytes) / server_stats.fec_decode_time_ns;
+        }
+    }
+
+    if (seconds > 0 && stats.no_of_transactions > 0)
+    {
+        record.metrics["transactions_per_s"] = stats.no_of_transactions / seconds;
+        record.metrics["transaction_p50_us"] = stats.transaction_latency.p50.count() / 1e3;
+        record.metrics["transaction_p99_us"] = stats.transaction_latency.p99.count() / 1e3;
+    }
+
+    return record;
+}
+
+void PrintComparison(const std::vector<RunResult>& results)
+{
+    std::cout << std::endl;
+    std::cout << std::left << std::setw(14) << "Protocol" << std::setw(12) << "Mechanism" << std::right
+              << std::setw(10) << "Size" << std::setw(12) << "Messages" << std::setw(14) << "Time (ms)"
+              << std::setw(14) << "MiB/s" << std::setw(18) << "us/message" << std::setw(14) << "CPU s/GB" << std::setw(12) << "Received" << std::endl;
+
+    for (const auto& result : results)
+    {
+        auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(result.stats.end_time - result.stats.start_time).count();
+        double seconds = microseconds / 1e6;
+        double throughput = seconds > 0 ? result.stats.no_of_sent_bytes / seconds / (1024 * 1024) : 0;
+        double per_message = result.stats.no_of_sent_messages > 0 ? microseconds / static_cast<double>(result.stats.no_of_sent_messages) : 0;
+        double cpu_per_gb = result.stats.no_of_sent_bytes > 0 ? result.stats.cpu_usage.Total().count() / static_cast<double>(result.stats.no_of_sent_bytes) : 0;
+
+        std::ostringstream protocol;
+        protocol << result.protocol;
+        std::ostringstream communication_mechanism;
+        communication_mechanism << result.communication_mechanism;
+
+        std::cout << std::left << std::setw(14) << protocol.str() << std::setw(12) << communication_mechanism.str() << std::right
+                  << std::setw(10) << result.message_size << std::setw(12) << result.stats.no_of_sent_messages
+                  << std::setw(14) << microseconds / 1000 << std::setw(14) << std::fixed << std::setprecision(2) << throughput
+                  << std::setw(18) << per_message << std::setw(14) << cpu_per_gb << std::defaultfloat << std::setw(12)
+                  << result.server_stats.no_of_read_messages << std::endl;
+    }
+}
 
 int main(int argc, char* argv[])
 {
-    std::unique_ptr<Client> client = nullptr;
+    std::vector<RunResult> results;
+    int exit_code = 0;
 
     try
     {
         std::string host = "localhost";
-        Protocol protocol = Protocol::kTcp;
+        std::vector<Protocol> protocols = { Protocol::kTcp };
         CommunicationMechanism communication_mechanism = CommunicationMechanism::kStreaming;
         uint32_t no_of_messages = 10;
         uint32_t message_size = 1024;
+        ClientOptions options;
+        LoadOptions load_options;
+        ConnectionRateOptions connection_rate_options;
+        HistoryOptions history_options;
+        ImpairmentOptions impairment;
+        std::string scenario_path;
+        uint16_t control_port = 4991;
+        // 0 disables the machine-readable Interval: and Result: lines read by an agent
+        std::chrono::milliseconds report_interval{0};
+        // <prefix>.<test no>.csv per test: the congestion control series of the UDP controller or of TCP_INFO, empty disables it
+        std::string congestion_series_prefix;
 
-        if (argc == 6)
+        // a scenario replaces the test given by the positional arguments
+        bool scenario_only = argc >= 3 && std::string(argv[2]).rfind("--", 0) == 0;
+        if (argc >= 6 || scenario_only)
         {
             host = argv[1];
-            protocol = static_cast<Protocol>(std::stoul(argv[2]));
-            communication_mechanism = static_cast<CommunicationMechanism>(std::stoul(argv[3]));
-            no_of_messages = static_cast<uint32_t>(std::stoul(argv[4]));
-            message_size = static_cast<uint32_t>(std::stoul(argv[5]));
+
+            int first_option = 2;
+            if (!scenario_only)
+            {
+                // a comma separated list runs the same transfer over each protocol in turn
+                protocols.clear();
+                std::istringstream protocol_list(argv[2]);
+                std::string protocol;
+                while (std::getline(protocol_list, protocol, ','))
+                {
+                    protocols.push_back(static_cast<Protocol>(std::stoul(protocol)));
+                }
+
+                communication_mechanism = static_cast<CommunicationMechanism>(std::stoul(argv[3]));
+                no_of_messages = static_cast<uint32_t>(std::stoul(argv[4]));
+                message_size = static_cast<uint32_t>(std::stoul(argv[5]));
+                first_option = 6;
+            }
+
+            for (int i = first_option; i < argc; ++i)
+            {
+                std::string option = argv[i];
+                if (option == "--io-backend=io_uring")
+                {
+                    options.io_backend = IoBackend::kIoUring;
+                }
+                else if (option == "--io-backend=asio")
+                {
+                    options.io_backend = IoBackend::kAsio;
+                }
+                else if (option == "--io-backend=coroutine")
+                {
+                    options.io_backend = IoBackend::kCoroutine;
+                }
+                else if (option == "--io-backend=specialized")
+                {
+                    options.io_backend = IoBackend::kSpecialized;
+                }
+                else if (option == "--sqpoll")
+                {
+                    options.io_uring_flags |= kIoUringSqPoll;
+                }
+                else if (option == "--multishot")
+                {
+                    options.io_uring_flags |= kIoUringMultishot;
+                }
+                else if (option.rfind("--batch-size=", 0) == 0)
+                {
+                    options.batch_size = static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1)));
+                }
+                else if (option.rfind("--sndbuf=", 0) == 0)
+                {
+                    options.socket_options.send_buffer_size = static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1)));
+                }
+                else if (option.rfind("--rcvbuf=", 0) == 0)
+                {
+                    options.socket_options.receive_buffer_size = static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1)));
+                }
+                else if (option == "--nodelay")
+                {
+                    options.socket_options.no_delay = true;
+                }
+                else if (option == "--cork")
+                {
+                    options.socket_options.cork = true;
+                }
+                else if (option.rfind("--notsent-lowat=", 0) == 0)
+                {
+                    options.socket_options.not_sent_lowat = static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1)));
+                }
+                else if (option.rfind("--tcp-cc=", 0) == 0)
+                {
+                    options.socket_options.congestion_control = CongestionControlFromName(option.substr(option.find('=') + 1));
+                }
+                else if (option.rfind("--cpu=", 0) == 0)
+                {
+                    options.cpu = std::stoi(option.substr(option.find('=') + 1));
+                }
+                else if (option.rfind("--memory-node=", 0) == 0)
+                {
+                    options.memory_node = std::stoi(option.substr(option.find('=') + 1));
+                }
+                else if (option.rfind("--tcp-info-interval=", 0) == 0)
+                {
+                    options.tcp_info_interval_ms = static_cast<uint16_t>(std::stoul(option.substr(option.find('=') + 1)));
+                }
+                else if (option.rfind("--c10k-sessions=", 0) == 0)
+                {
+                    load_options.no_of_sessions = static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1)));
+                }
+                else if (option.rfind("--c10k-rate=", 0) == 0)
+                {
+                    load_options.message_rate = std::stod(option.substr(option.find('=') + 1));
+                }
+                else if (option.rfind("--c10k-ramp=", 0) == 0)
+                {
+                    load_options.ramp_rate = static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1)));
+                }
+                else if (option.rfind("--c10k-port=", 0) == 0)
+                {
+                    load_options.port = static_cast<uint16_t>(std::stoul(option.substr(option.find('=') + 1)));
+                }
+                else if (option.rfind("--connection-rate=", 0) == 0)
+                {
+                    connection_rate_options.no_of_workers = static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1)));
+                }
+                else if (option.rfind("--connection-rate-duration=", 0) == 0)
+                {
+                    connection_rate_options.duration = std::chrono::seconds(std::stoul(option.substr(option.find('=') + 1)));
+                }
+                else if (option.rfind("--payload=", 0) == 0)
+                {
+                    options.payload.mode = PayloadModeFromName(option.substr(option.find('=') + 1));
+                }
+                else if (option.rfind("--payload-pattern=", 0) == 0)
+                {
+                    options.payload.pattern = option.substr(option.find('=') + 1);
+                }
+                else if (option.rfind("--payload-corpus=", 0) == 0)
+                {
+                    options.payload.corpus_path = option.substr(option.find('=') + 1);
+                }
+                else if (option.rfind("--payload-seed=", 0) == 0)
+                {
+                    options.payload.seed = std::stoull(option.substr(option.find('=') + 1));
+                }
+                else if (option == "--verify")
+                {
+                    options.verify_payload = true;
+                }
+                else if (option == "--timestamps")
+                {
+                    options.send_timestamps = true;
+                }
+                else if (option.rfind("--payload-pool=", 0) == 0)
+                {
+                    options.payload.pool_size = static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1)));
+                }
+                else if (option.rfind("--scenario=", 0) == 0)
+                {
+                    scenario_path = option.substr(option.find('=') + 1);
+                }
+                else if (option.rfind("--response-size=", 0) == 0)
+                {
+                    options.response_size = static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1)));
+                }
+                else if (option.rfind("--outstanding=", 0) == 0)
+                {
+                    options.no_of_outstanding = std::max<uint32_t>(1, static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1))));
+                }
+                else if (option.rfind("--control-port=", 0) == 0)
+                {
+                    control_port = static_cast<uint16_t>(std::stoul(option.substr(option.find('=') + 1)));
+                }
+                else if (option.rfind("--report-interval=", 0) == 0)
+                {
+                    report_interval = std::chrono::milliseconds(std::stoul(option.substr(option.find('=') + 1)));
+                }
+                else if (option == "--reuse-connection")
+                {
+                    options.reuse_data_connection = true;
+                }
+                else if (option.rfind("--trace=", 0) == 0)
+                {
+                    options.trace.prefix = option.substr(option.find('=') + 1);
+                }
+                else if (option.rfind("--delay=", 0) == 0)
+                {
+                    impairment.delay = std::chrono::microseconds(std::stoll(option.substr(option.find('=') + 1)));
+                }
+                else if (option.rfind("--jitter=", 0) == 0)
+                {
+                    impairment.jitter = std::chrono::microseconds(std::stoll(option.substr(option.find('=') + 1)));
+                }
+                else if (option.rfind("--loss=", 0) == 0)
+                {
+                    impairment.loss = std::stod(option.substr(option.find('=') + 1)) / 100;
+                }
+                else if (option.rfind("--reorder=", 0) == 0)
+                {
+                    impairment.reorder = std::stod(option.substr(option.find('=') + 1)) / 100;
+                }
+                else if (option.rfind("--duplicate=", 0) == 0)
+                {
+                    impairment.duplicate = std::stod(option.substr(option.find('=') + 1)) / 100;
+                }
+                else if (option.rfind("--bandwidth=", 0) == 0)
+                {
+                    // Mbit/s
+                    impairment.bandwidth = static_cast<uint64_t>(std::stod(option.substr(option.find('=') + 1)) * 1e6);
+                }
+                else if (option.rfind("--queue-limit=", 0) == 0)
+                {
+                    impairment.queue_limit = std::stoul(option.substr(option.find('=') + 1));
+                }
+                else if (option.rfind("--rto=", 0) == 0)
+                {
+                    impairment.retransmission_timeout = std::chrono::milliseconds(std::stoll(option.substr(option.find('=') + 1)));
+                }
+                else if (option.rfind("--results=", 0) == 0)
+                {
+                    history_options.path = option.substr(option.find('=') + 1);
+                }
+                else if (option.rfind("--label=", 0) == 0)
+                {
+                    history_options.label = option.substr(option.find('=') + 1);
+                }
+                else if (option.rfind("--repeat=", 0) == 0)
+                {
+                    history_options.no_of_repetitions = std::max<uint32_t>(1, static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1))));
+                }
+                else if (option.rfind("--baseline=", 0) == 0)
+                {
+                    history_options.regression.baseline = option.substr(option.find('=') + 1);
+                }
+                else if (option.rfind("--alpha=", 0) == 0)
+                {
+                    history_options.regression.alpha = std::stod(option.substr(option.find('=') + 1));
+                }
+                else if (option.rfind("--tolerance=", 0) == 0)
+                {
+                    // percent
+                    history_options.regression.tolerance = std::stod(option.substr(option.find('=') + 1)) / 100;
+                }
+                else if (option.rfind("--udp-cc=", 0) == 0)
+                {
+                    options.udp_congestion_control = UdpCongestionControlFromName(option.substr(option.find('=') + 1));
+                }
+                else if (option.rfind("--cc-series=", 0) == 0)
+                {
+                    congestion_series_prefix = option.substr(option.find('=') + 1);
+                }
+                else if (option.rfind("--fec=", 0) == 0)
+                {
+                    options.fec.scheme = FecSchemeFromName(option.substr(option.find('=') + 1));
+                }
+                else if (option.rfind("--fec-data=", 0) == 0)
+                {
+                    options.fec.data_shards = static_cast<uint8_t>(std::clamp<unsigned long>(std::stoul(option.substr(option.find('=') + 1)), 1, 255));
+                }
+                else if (option.rfind("--fec-parity=", 0) == 0)
+                {
+                    options.fec.parity_shards = static_cast<uint8_t>(std::clamp<unsigned long>(std::stoul(option.substr(option.find('=') + 1)), 1, 255));
+                }
+                else if (option == "--gso")
+                {
+                    options.udp_flags |= kUdpGso;
+                }
+                else if (option == "--gro")
+                {
+                    options.udp_flags |= kUdpGro;
+                }
+                else
+                {
+                    std::cerr << "Unknown option " << option << std::endl;
+                    return -5;
+                }
+            }
+
+            if (options.fec.data_shards + options.fec.NoOfParityShards() > FecOptions::kMaxShards)
+            {
+                std::cerr << "FEC needs --fec-data + --fec-parity <= " << FecOptions::kMaxShards << std::endl;
+                return -5;
+            }
+
+            if (scenario_only && scenario_path.empty())
+            {
+                std::cerr << "Either the test or --scenario=PATH must be given" << std::endl;
+                return -5;
+            }
         }
         else
         {
-            std::cerr << "Usage: client <host> <protocol: 0 - TCP; 1 - UDP> <communication mechanism: 0 - StopAndGo; 1 - Streaming> <no of messages> <message size>" << std::endl;
+            std::cerr << "Usage: client <host> (<protocol: 0 - TCP; 1 - UDP; 2 - UnixStream; 3 - SharedMemory, or a comma separated list> "
+                         "<communication mechanism: 0 - Streaming; 1 - StopAndGo; 2 - RequestResponse> <no of messages> <message size> | --scenario=PATH) "
+                         "[--control-port=N] [--report-interval=MS] [--response-size=N] [--outstanding=N] [--reuse-connection] "
+                         "[--io-backend=asio|io_uring|coroutine|specialized] [--sqpoll] [--multishot] [--batch-size=N] [--gso] [--gro] [--fec=xor|rs [--fec-data=K] [--fec-parity=M]] [--udp-cc=newreno|bbr] [--cc-series=PREFIX] "
+                         "[--sndbuf=N] [--rcvbuf=N] [--nodelay] [--cork] [--notsent-lowat=N] [--tcp-cc=cubic|bbr|reno] "
+                         "[--cpu=N] [--memory-node=N] [--tcp-info-interval=MS] "
+                         "[--payload=zeros|pattern|random|corpus] [--payload-pattern=TEXT] [--payload-corpus=PATH] [--payload-seed=N] [--payload-pool=N] [--verify] [--timestamps] [--trace=PREFIX] "
+                         "[--delay=US] [--jitter=US] [--loss=PERCENT] [--reorder=PERCENT] [--duplicate=PERCENT] [--bandwidth=MBIT_PER_S] [--queue-limit=BYTES] [--rto=MS] "
+                         "[--results=PATH [--label=NAME] [--repeat=N] [--baseline=LABEL [--alpha=P] [--tolerance=PERCENT]]] "
+                         "[--c10k-sessions=N [--c10k-rate=MSG_PER_S] [--c10k-ramp=SESSIONS_PER_S] [--c10k-port=N]] "
+                         "[--connection-rate=WORKERS [--connection-rate-duration=S] [--c10k-port=N]]" << std::endl;
         }
 
-        boost::asio::io_service io_service;
+        // the transfer runs on this thread, so pinning it here also places every payload buffer allocated afterwards
+        auto placement = ApplyPlacement(options.cpu, options.memory_node);
 
-        tcp::resolver resolver(io_service);
-        tcp::resolver::query query(host, "4991");
-        tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
+        std::vector<ScenarioTest> scenario;
+        if (!scenario_path.empty())
+        {
+            scenario = LoadScenario(scenario_path);
+        }
+        else
+        {
+            for (auto protocol : protocols)
+            {
+                scenario.push_back({ protocol, communication_mechanism, no_of_messages, message_size });
+            }
+        }
+
+        // generated once per message size before any transfer, on the placed thread and outside the measured send loops
+        std::map<uint32_t, std::shared_ptr<const PayloadPool>> payload_pools;
+        for (const auto& test : scenario)
+        {
+            if (payload_pools.count(test.message_size) == 0)
+            {
+                auto payload_pool = std::make_shared<PayloadPool>(options.payload, test.message_size);
+                payload_pool->Print();
+                payload_pools[test.message_size] = payload_pool;
+            }
+        }
 
-        tcp::socket socket(io_service);
-        boost::asio::connect(socket, endpoint_iterator);
+        boost::asio::io_service io_service;
 
-        // send Hello message
-        HelloMessage hello_message = { protocol, communication_mechanism, message_size };
-        HelloMessage::Buffer buf = HelloMessage::Encode(hello_message);
-        boost::system::error_code error;
+        // the C10K load generator sends <no of messages> messages of <message size> bytes on every session
+        if (load_options.no_of_sessions > 0)
+        {
+            LoadGenerator generator(io_service, host, std::max<uint32_t>(no_of_messages, 1), message_size, load_options);
+            generator.Run();
+            return 0;
+        }
 
-        auto sent_bytes = socket.send(boost::asio::buffer(buf));
-        if (sent_bytes != HelloMessage::kSize)
+        // short sessions of <no of messages> messages of <message size> bytes against the C10K port, back to back
+        if (connection_rate_options.no_of_workers > 0)
         {
-            std::cout << "Failed to send Hello message" << std::endl;
-            return -1;
+            ConnectionRateGenerator generator(io_service, host, load_options.port, no_of_messages, message_size, connection_rate_options);
+            generator.Run();
+            return 0;
         }
 
-        std::cout << "Hello Message sent" << std::endl;
+        tcp::socket control_socket(io_service);
+        ConnectControlSocket(control_socket, io_service, host, control_port);
 
-        // wait Response message
-        AcknowledgeMessage::Buffer response_message_buffer;
-        auto read_bytes = socket.read_some(boost::asio::buffer(response_message_buffer), error);
-        if (error)
+        std::unique_ptr<ProgressReporter> reporter;
+        if (report_interval.count() > 0)
         {
-            std::cout << "Receive ResponseMessage error: " << error << std::endl;
-            return -2;
+            options.progress = std::make_shared<TransferProgress>();
+            reporter = std::make_unique<ProgressReporter>(options.progress, report_interval);
+            reporter->Start();
         }
 
-        if (read_bytes < AcknowledgeMessage::kSize)
+        uint32_t test_no = 0;
+        std::shared_ptr<tcp::socket> data_connection;
+        for (const auto& test : scenario)
         {
-            std::cout << "Read ResponseMessage of wrong size" << std::endl;
-            return -3;
-        }
+            auto test_options = options;
+            test_options.payload_pool = payload_pools[test.message_size];
+            // responses as large as the requests unless sized explicitly
+            if (test_options.response_size == 0)
+            {
+                test_options.response_size = test.message_size;
+            }
 
-        auto response_message = AcknowledgeMessage::Decode(response_message_buffer);
-        std::cout << "Response message received, new port = " << response_message.message_no << std::endl;
+            for (uint32_t repetition = 0; repetition < history_options.no_of_repetitions; ++repetition)
+            {
+                RunResult result = { test.protocol, test.communication_mechanism, test.no_of_messages, test.message_size, false, options.io_backend, {}, {} };
+                auto error = RunTest(control_socket, io_service, host, test, ++test_no, test_options, impairment, data_connection, result);
+                if (error)
+                {
+                    return error;
+                }
 
+                result.stats.placement = placement;
+                result.stats.placement.observed_cpu = CurrentCpu();
 
-        // open new connection
-        client = ClientFactory(protocol, communication_mechanism, io_service, host, static_cast<uint16_t>(response_message.message_no));
-        client->TransferData(no_of_messages, message_size);
+                // print stats
+                std::cout << "Protocol: " << test.protocol << std::endl;
+                std::cout << "I/O backend: " << result.io_backend << std::endl;
+                if (result.reused_data_connection)
+                {
+                    std::cout << "Reused the data connection of the previous test" << std::endl;
+                }
+                PrintStats(test.protocol, result.stats);
+                PrintServerStats(test.protocol, result.server_stats);
+                // the user-space controller's series, or the kernel's from TCP_INFO, in the same format
+                if (!congestion_series_prefix.empty())
+                {
+                    auto series = result.stats.congestion.empty() ? CongestionSeries(result.stats.tcp_info) : result.stats.congestion;
+                    if (!series.empty())
+                    {
+                        WriteCongestionSeries(congestion_series_prefix + "." + std::to_string(test_no) + ".csv", series);
+                    }
+                }
+                if (reporter)
+                {
+                    std::cout << kResultMarker + FormatResultRecord(MakeResultRecord(result, test_options, impairment, history_options.label)) + "\n"
+                              << std::flush;
+                }
+                results.push_back(result);
+            }
+        }
 
-        // send Goodbye message
-        GoodbyeMessage goodbye_message = {};
-        GoodbyeMessage::Buffer buffer = GoodbyeMessage::Encode(goodbye_message);
+        if (reporter)
+        {
+            reporter->Stop();
+        }
 
-        sent_bytes = socket.send(boost::asio::buffer(buffer));
-        if (sent_bytes != GoodbyeMessage::kSize)
+        if (auto error = EndSession(control_socket))
         {
-            std::cout << "Failed to send Goodbye message" << std::endl;
-            return -1;
+            return error;
         }
 
-        std::cout << "Goodbye Message sent" << std::endl;
+        if (!history_options.path.empty())
+        {
+            ResultsStore store(history_options.path);
+            auto history = store.Load();
+
+            std::vector<ResultRecord> records;
+            for (const auto& result : results)
+            {
+                records.push_back(MakeResultRecord(result, options, impairment, history_options.label));
+                store.Append(records.back());
+            }
+            std::cout << records.size() << " runs appended to " << history_options.path << " as " << history_options.label << std::endl;
 
-        // disconnect
-        socket.close();
+            // a gate that compared nothing, or left a configuration unchecked, did not pass
+            if (!history_options.regression.baseline.empty() && records.empty())
+            {
+                std::cout << "No runs recorded to compare against " << history_options.regression.baseline << std::endl;
+                exit_code = -7;
+            }
+            else if (!history_options.regression.baseline.empty())
+            {
+                switch (CompareWithBaseline(history, records, history_options.regression))
+                {
+                    case BaselineComparison::kRegressed:
+                    {
+                        std::cout << "Significant regression against " << history_options.regression.baseline << std::endl;
+                        exit_code = -6;
+                        break;
+                    }
+                    case BaselineComparison::kMissingBaseline:
+                    {
+                        std::cout << "Configurations without " << history_options.regression.baseline << " runs to compare against" << std::endl;
+                        exit_code = -7;
+                        break;
+                    }
+                    case BaselineComparison::kPassed:
+                    {
+                        break;
+                    }
+                }
+            }
+        }
     }
     catch (std::exception& e)
     {
+        // a crashed run must not pass for a clean one
         std::cerr << e.what() << std::endl;
+        exit_code = -8;
     }
 
-    auto stats = client->GetStats();
-
-    // print stats
-    auto transmission_time = std::chrono::duration_cast<std::chrono::milliseconds>(stats.end_time - stats.start_time);
-    std::cout << "Transmission time: " << transmission_time.count() << " ms" << std::endl;
-    std::cout << "# sent messages: " << stats.no_of_sent_messages << std::endl;
-    std::cout << "# sent bytes: " << stats.no_of_sent_bytes << std::endl;
+    if (results.size() > 1)
+    {
+        PrintComparison(results);
+    }
 
-    return 0;
-}
\ No newline at end of file
+    return exit_code;
+}
@@ -0,0 +1,130 @@
+#ifndef MEASURE_TRANSFER_AFFINITY_H
+#define MEASURE_TRANSFER_AFFINITY_H
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * Where a thread ran and where its memory came from; -1 means the kernel was
+ * left free to choose. observed_cpu is the core the thread was on when the
+ * placement was last sampled.
+ */
+struct Placement
+{
+    int cpu;
+    int cpu_node;
+    int memory_node;
+    int observed_cpu;
+};
+
+std::ostream& operator<<(std::ostream& os, const Placement& placement)
+{
+    auto print = [&os](int value) -> std::ostream& {
+        return value < 0 ? os << "any" : os << value;
+    };
+
+    os << "cpu ";
+    print(placement.cpu) << " (node ";
+    print(placement.cpu_node) << "), memory node ";
+    print(placement.memory_node) << ", last seen on cpu ";
+    print(placement.observed_cpu);
+    return os;
+}
+
+int NumaNodeOfCpu(int cpu)
+{
+    // the cpu directory holds a nodeN link to the node it belongs to
+    for (int node = 0; node < 1024; ++node)
+    {
+        struct stat info{};
+        auto path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/node" + std::to_string(node);
+        if (stat(path.c_str(), &info) == 0)
+        {
+            return node;
+        }
+    }
+
+    return -1;
+}
+
+// a node the kernel knows of has a directory of its own
+bool NumaNodeExists(int node)
+{
+    struct stat info{};
+    auto path = "/sys/devices/system/node/node" + std::to_string(node);
+    return node >= 0 && stat(path.c_str(), &info) == 0;
+}
+
+int CurrentCpu()
+{
+    return sched_getcpu();
+}
+
+/**
+ * Pins the calling thread to cpu and binds its future allocations to
+ * memory_node; the memory node defaults to the cpu's own node so payload
+ * buffers are local unless a cross-node run is requested on purpose.
+ * Threads created afterwards inherit both. Failures are logged and the thread
+ * keeps running wherever the kernel puts it.
+ */
+Placement ApplyPlacement(int cpu, int memory_node)
+{
+    Placement placement = { -1, -1, -1, -1 };
+
+    if (cpu >= 0)
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu, &cpu_set);
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+        if (error == 0)
+        {
+            placement.cpu = cpu;
+            placement.cpu_node = NumaNodeOfCpu(cpu);
+        }
+        else
+        {
+            std::cout << "Failed to pin thread to cpu " << cpu << ": " << std::strerror(error) << std::endl;
+        }
+    }
+
+    if (memory_node < 0)
+    {
+        memory_node = placement.cpu_node;
+    }
+
+    if (memory_node >= 0 && !NumaNodeExists(memory_node))
+    {
+        std::cout << "Failed to bind memory to node " << memory_node << ": no such NUMA node" << std::endl;
+    }
+    else if (memory_node >= 0)
+    {
+        // as many words as the node number needs, a single one only holds the first 64 nodes
+        const std::size_t bits_per_word = sizeof(unsigned long) * 8;
+        std::vector<unsigned long> node_mask(memory_node / bits_per_word + 1, 0);
+        node_mask[memory_node / bits_per_word] = 1UL << (memory_node % bits_per_word);
+        if (syscall(SYS_set_mempolicy, MPOL_BIND, node_mask.data(), node_mask.size() * bits_per_word + 1) == 0)
+        {
+            placement.memory_node = memory_node;
+        }
+        else
+        {
+            std::cout << "Failed to bind memory to node " << memory_node << ": " << std::strerror(errno) << std::endl;
+        }
+    }
+
+    placement.observed_cpu = CurrentCpu();
+    return placement;
+}
+
+#endif //MEASURE_TRANSFER_AFFINITY_H
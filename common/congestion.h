@@ -0,0 +1,515 @@
+#ifndef MEASURE_TRANSFER_CONGESTION_H
+#define MEASURE_TRANSFER_CONGESTION_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "tcp_info.h"
+
+const std::size_t kUdpCongestionControlSize = 1;
+
+// user-space congestion control of a reliable UDP stream, the kernel's TCP one is set with SocketOptions
+enum class UdpCongestionControl : uint8_t
+{
+    // streams at full rate without ACKs
+    kNone = 0,
+    // AIMD on loss: slow start, then one datagram per RTT, halved once per loss episode
+    kNewReno = 1,
+    // model based: paced at the bottleneck bandwidth estimated from the delivery rate, cwnd twice the BDP
+    kBbr = 2
+};
+
+std::ostream& operator<<(std::ostream& os, const UdpCongestionControl& congestion_control)
+{
+    switch (congestion_control)
+    {
+        case UdpCongestionControl::kNone:
+            os << "none";
+            break;
+        case UdpCongestionControl::kNewReno:
+            os << "newreno";
+            break;
+        case UdpCongestionControl::kBbr:
+            os << "bbr";
+            break;
+        default:
+            os << "Unknown UdpCongestionControl";
+            break;
+    }
+
+    return os;
+}
+
+UdpCongestionControl UdpCongestionControlFromName(const std::string& name)
+{
+    if (name == "none")
+    {
+        return UdpCongestionControl::kNone;
+    }
+
+    if (name == "newreno")
+    {
+        return UdpCongestionControl::kNewReno;
+    }
+
+    if (name == "bbr")
+    {
+        return UdpCongestionControl::kBbr;
+    }
+
+    throw std::invalid_argument("Unknown UDP congestion control " + name);
+}
+
+/**
+ * One point of a sender's congestion control time series. The user-space
+ * controllers and the kernel's TCP_INFO readings share the format, so the two
+ * can be plotted against each other; rates are in bytes per second.
+ */
+struct CongestionSample
+{
+    std::chrono::microseconds time;
+    uint32_t rtt_us;
+    uint64_t cwnd;
+    // unknown for TCP
+    uint64_t inflight;
+    uint64_t pacing_rate;
+    uint64_t delivery_rate;
+    uint32_t retransmits;
+};
+
+std::vector<CongestionSample> CongestionSeries(const std::vector<TcpInfoSample>& samples)
+{
+    std::vector<CongestionSample> series;
+    for (const auto& sample : samples)
+    {
+        series.push_back({ sample.time, sample.rtt_us, uint64_t{sample.cwnd} * sample.mss, 0, sample.pacing_rate, sample.delivery_rate,
+                           sample.total_retransmits });
+    }
+    return series;
+}
+
+void WriteCongestionSeries(const std::string& path, const std::vector<CongestionSample>& series)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cout << "Failed to write the congestion control series to " << path << std::endl;
+        return;
+    }
+
+    file << "time_us,rtt_us,cwnd_bytes,inflight_bytes,pacing_rate,delivery_rate,retransmits\n";
+    for (const auto& sample : series)
+    {
+        file << sample.time.count() << "," << sample.rtt_us << "," << sample.cwnd << "," << sample.inflight << "," << sample.pacing_rate << ","
+             << sample.delivery_rate << "," << sample.retransmits << "\n";
+    }
+    std::cout << "Congestion control series: " << path << ", " << series.size() << " samples" << std::endl;
+}
+
+void PrintCongestionSummary(const std::vector<CongestionSample>& series)
+{
+    if (series.empty())
+    {
+        return;
+    }
+
+    uint32_t min_rtt = UINT32_MAX;
+    uint64_t max_cwnd = 0;
+    uint64_t max_pacing_rate = 0;
+    uint64_t max_delivery_rate = 0;
+    for (const auto& sample : series)
+    {
+        if (sample.rtt_us > 0)
+        {
+            min_rtt = std::min(min_rtt, sample.rtt_us);
+        }
+        max_cwnd = std::max(max_cwnd, sample.cwnd);
+        max_pacing_rate = std::max(max_pacing_rate, sample.pacing_rate);
+        max_delivery_rate = std::max(max_delivery_rate, sample.delivery_rate);
+    }
+
+    const auto& last = series.back();
+    std::cout << "Congestion control samples: " << series.size() << ", min RTT " << (min_rtt == UINT32_MAX ? 0 : min_rtt) << " us, cwnd last/max "
+              << last.cwnd << "/" << max_cwnd << " bytes" << std::endl;
+    std::cout << "Pacing rate last/max: " << last.pacing_rate / (1024 * 1024) << "/" << max_pacing_rate / (1024 * 1024)
+              << " MiB/s, delivery rate max " << max_delivery_rate / (1024 * 1024) << " MiB/s, retransmits " << last.retransmits << std::endl;
+}
+
+// what the sender learnt from the ACK of one datagram
+struct AckEvent
+{
+    std::chrono::steady_clock::time_point time;
+    uint64_t acked_bytes;
+    uint64_t inflight;
+    // zero when the ACK is ambiguous, i.e. of a retransmitted datagram
+    std::chrono::nanoseconds rtt;
+    std::chrono::nanoseconds smoothed_rtt;
+    // delivered bytes per second over the flight of the datagram, zero when there is no sample
+    uint64_t delivery_rate;
+    // bytes delivered up to this ACK and up to the send of the datagram, which count round trips
+    uint64_t delivered;
+    uint64_t delivered_at_send;
+    std::chrono::steady_clock::time_point send_time;
+};
+
+/**
+ * Decides how much a sender may have in flight and how fast it sends it.
+ * Driven by the sender's ACK timing: every ACK, every datagram declared lost
+ * and every retransmission timeout.
+ */
+class CongestionController
+{
+public:
+    virtual ~CongestionController() = default;
+    virtual void OnAck(const AckEvent& ack) = 0;
+    // a datagram sent at send_time declared lost
+    virtual void OnLoss(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point send_time, uint64_t bytes) = 0;
+    virtual void OnTimeout(std::chrono::steady_clock::time_point now) = 0;
+    // bytes
+    virtual uint64_t CongestionWindow() const = 0;
+    // bytes per second
+    virtual uint64_t PacingRate() const = 0;
+};
+
+const std::size_t kInitialWindow = 10;
+
+/**
+ * NewReno (RFC 5681, 6582) with byte counting: slow start up to ssthresh,
+ * then one datagram per window of ACKs. The losses of one window are a
+ * single congestion event, halving the window once. Paced like Linux TCP,
+ * at twice cwnd / srtt in slow start and 1.2 times in congestion avoidance.
+ */
+class NewRenoController : public CongestionController
+{
+public:
+    explicit NewRenoController(uint64_t mss)
+        : mss_{mss}
+        , cwnd_{kInitialWindow * mss}
+        , ssthresh_{UINT64_MAX}
+        , smoothed_rtt_{std::chrono::milliseconds(1)}
+    {}
+
+    void OnAck(const AckEvent& ack) override
+    {
+        if (ack.smoothed_rtt.count() > 0)
+        {
+            smoothed_rtt_ = ack.smoothed_rtt;
+        }
+
+        // datagrams sent before the loss was noticed do not grow the halved window
+        if (ack.send_time <= recovery_start_)
+        {
+            return;
+        }
+
+        if (cwnd_ < ssthresh_)
+        {
+            cwnd_ += ack.acked_bytes;
+        }
+        else
+        {
+            cwnd_ += std::max<uint64_t>(1, mss_ * ack.acked_bytes / cwnd_);
+        }
+    }
+
+    void OnLoss(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point send_time, uint64_t) override
+    {
+        if (send_time <= recovery_start_)
+        {
+            return;
+        }
+
+        recovery_start_ = now;
+        ssthresh_ = std::max(cwnd_ / 2, 2 * mss_);
+        cwnd_ = ssthresh_;
+    }
+
+    void OnTimeout(std::chrono::steady_clock::time_point now) override
+    {
+        recovery_start_ = now;
+        ssthresh_ = std::max(cwnd_ / 2, 2 * mss_);
+        cwnd_ = mss_;
+    }
+
+    uint64_t CongestionWindow() const override
+    {
+        return cwnd_;
+    }
+
+    uint64_t PacingRate() const override
+    {
+        double gain = cwnd_ < ssthresh_ ? 2.0 : 1.2;
+        return static_cast<uint64_t>(gain * cwnd_ * 1e9 / smoothed_rtt_.count());
+    }
+
+private:
+    uint64_t mss_;
+    uint64_t cwnd_;
+    uint64_t ssthresh_;
+    std::chrono::nanoseconds smoothed_rtt_;
+    std::chrono::steady_clock::time_point recovery_start_;
+};
+
+/**
+ * BBR v1 (draft-cardwell-iccrg-bbr-congestion-control-00): a model of the path
+ * made of the bottleneck bandwidth, the windowed maximum of the delivery rate
+ * over 10 round trips, and the minimum RTT over 10 seconds. Startup doubles
+ * the rate per round trip until the bandwidth stops growing by 25% for 3
+ * rounds, Drain empties the queue Startup built, ProbeBW cycles the pacing
+ * gain through 1.25, 0.75 and six times 1, and ProbeRTT shrinks the window to
+ * 4 datagrams for 200 ms once the minimum RTT is 10 seconds old. Losses are
+ * not a signal, as in v1.
+ */
+class BbrController : public CongestionController
+{
+public:
+    explicit BbrController(uint64_t mss)
+        : mss_{mss}
+        , state_{State::kStartup}
+        , pacing_gain_{kHighGain}
+        , cwnd_gain_{kHighGain}
+        , cwnd_{kInitialWindow * mss}
+        , min_rtt_{0}
+        , round_count_{0}
+        , next_round_delivered_{0}
+        , full_bandwidth_{0}
+        , full_bandwidth_rounds_{0}
+        , cycle_index_{0}
+    {}
+
+    void OnAck(const AckEvent& ack) override
+    {
+        bool round_start = false;
+        if (ack.delivered_at_send >= next_round_delivered_)
+        {
+            next_round_delivered_ = ack.delivered;
+            round_count_++;
+            round_start = true;
+        }
+
+        // the maximum of every round, so the window maximum is over kBandwidthWindowRounds values
+        if (ack.delivery_rate > 0)
+        {
+            if (bandwidth_samples_.empty() || bandwidth_samples_.back().round != round_count_)
+            {
+                bandwidth_samples_.push_back({ round_count_, 0 });
+            }
+            bandwidth_samples_.back().rate = std::max(bandwidth_samples_.back().rate, ack.delivery_rate);
+        }
+        while (!bandwidth_samples_.empty() && bandwidth_samples_.front().round + kBandwidthWindowRounds <= round_count_)
+        {
+            bandwidth_samples_.pop_front();
+        }
+
+        bool min_rtt_expired = min_rtt_.count() > 0 && ack.time > min_rtt_time_ + kMinRttWindow;
+        if (ack.rtt.count() > 0 && (min_rtt_.count() == 0 || ack.rtt <= min_rtt_ || min_rtt_expired))
+        {
+            min_rtt_ = ack.rtt;
+            min_rtt_time_ = ack.time;
+        }
+
+        if (min_rtt_expired && state_ != State::kProbeRtt)
+        {
+            EnterProbeRtt(ack.time);
+        }
+
+        if (state_ == State::kStartup && round_start)
+        {
+            CheckFullBandwidth();
+        }
+
+        if (state_ == State::kDrain && ack.inflight <= Bdp())
+        {
+            EnterProbeBw(ack.time);
+        }
+
+        // each gain lasts a min RTT, except that 0.75 ends early once the queue 1.25 built is gone
+        bool drained = pacing_gain_ < 1 && ack.inflight <= Bdp();
+        if (state_ == State::kProbeBw && min_rtt_.count() > 0 && (ack.time > cycle_start_ + min_rtt_ || drained))
+        {
+            cycle_index_ = (cycle_index_ + 1) % kCycleLength;
+            cycle_start_ = ack.time;
+            pacing_gain_ = kPacingGainCycle[cycle_index_];
+        }
+
+        if (state_ == State::kProbeRtt && ack.time > probe_rtt_done_)
+        {
+            min_rtt_time_ = ack.time;
+            if (full_bandwidth_rounds_ >= kFullBandwidthRounds)
+            {
+                EnterProbeBw(ack.time);
+            }
+            else
+            {
+                state_ = State::kStartup;
+                pacing_gain_ = kHighGain;
+                cwnd_gain_ = kHighGain;
+            }
+        }
+
+        UpdateCongestionWindow(ack.acked_bytes);
+    }
+
+    void OnLoss(std::chrono::steady_clock::time_point, std::chrono::steady_clock::time_point, uint64_t) override
+    {
+    }
+
+    void OnTimeout(std::chrono::steady_clock::time_point) override
+    {
+        // the path model survives, only the window restarts from what is deliverable in one round trip
+        cwnd_ = std::max(std::min(cwnd_, Bdp()), kMinPipeWindow * mss_);
+    }
+
+    uint64_t CongestionWindow() const override
+    {
+        return state_ == State::kProbeRtt ? kMinPipeWindow * mss_ : cwnd_;
+    }
+
+    uint64_t PacingRate() const override
+    {
+        auto bandwidth = BottleneckBandwidth();
+        if (bandwidth == 0)
+        {
+            // no delivery rate yet: the initial window over the RTT, 1 ms while that is unknown too
+            auto rtt = min_rtt_.count() > 0 ? min_rtt_ : std::chrono::nanoseconds(std::chrono::milliseconds(1));
+            return static_cast<uint64_t>(pacing_gain_ * cwnd_ * 1e9 / rtt.count());
+        }
+        return static_cast<uint64_t>(pacing_gain_ * bandwidth);
+    }
+
+private:
+    enum class State
+    {
+        kStartup,
+        kDrain,
+        kProbeBw,
+        kProbeRtt
+    };
+
+    struct BandwidthSample
+    {
+        uint64_t round;
+        uint64_t rate;
+    };
+
+    // 2 / ln 2, the smallest gain that doubles the delivery rate every round trip
+    static constexpr double kHighGain = 2.885;
+    static constexpr uint64_t kBandwidthWindowRounds = 10;
+    static constexpr uint64_t kFullBandwidthRounds = 3;
+    static constexpr uint64_t kMinPipeWindow = 4;
+    static constexpr std::size_t kCycleLength = 8;
+    static constexpr double kPacingGainCycle[kCycleLength] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+    static constexpr std::chrono::seconds kMinRttWindow{10};
+    static constexpr std::chrono::milliseconds kProbeRttDuration{200};
+
+    uint64_t BottleneckBandwidth() const
+    {
+        uint64_t bandwidth = 0;
+        for (const auto& sample : bandwidth_samples_)
+        {
+            bandwidth = std::max(bandwidth, sample.rate);
+        }
+        return bandwidth;
+    }
+
+    uint64_t Bdp() const
+    {
+        if (min_rtt_.count() == 0 || BottleneckBandwidth() == 0)
+        {
+            return kInitialWindow * mss_;
+        }
+        return static_cast<uint64_t>(static_cast<double>(BottleneckBandwidth()) * min_rtt_.count() / 1e9);
+    }
+
+    void CheckFullBandwidth()
+    {
+        auto bandwidth = BottleneckBandwidth();
+        if (bandwidth >= full_bandwidth_ * 5 / 4)
+        {
+            full_bandwidth_ = bandwidth;
+            full_bandwidth_rounds_ = 0;
+            return;
+        }
+
+        if (++full_bandwidth_rounds_ >= kFullBandwidthRounds)
+        {
+            state_ = State::kDrain;
+            pacing_gain_ = 1 / kHighGain;
+            cwnd_gain_ = kHighGain;
+        }
+    }
+
+    void EnterProbeBw(std::chrono::steady_clock::time_point now)
+    {
+        state_ = State::kProbeBw;
+        cwnd_gain_ = 2;
+        // any phase but the draining one
+        cycle_index_ = (cycle_index_ + 2) % kCycleLength;
+        cycle_start_ = now;
+        pacing_gain_ = kPacingGainCycle[cycle_index_];
+    }
+
+    void EnterProbeRtt(std::chrono::steady_clock::time_point now)
+    {
+        state_ = State::kProbeRtt;
+        pacing_gain_ = 1;
+        probe_rtt_done_ = now + kProbeRttDuration;
+    }
+
+    void UpdateCongestionWindow(uint64_t acked_bytes)
+    {
+        auto target = std::max(static_cast<uint64_t>(cwnd_gain_ * Bdp()), kMinPipeWindow * mss_);
+        // grows by what was acked until the target is reached, and in Startup regardless of it
+        if (state_ == State::kStartup && full_bandwidth_rounds_ < kFullBandwidthRounds)
+        {
+            cwnd_ += acked_bytes;
+        }
+        else
+        {
+            cwnd_ = std::min(cwnd_ + acked_bytes, target);
+        }
+        cwnd_ = std::max(cwnd_, kMinPipeWindow * mss_);
+    }
+
+private:
+    uint64_t mss_;
+    State state_;
+    double pacing_gain_;
+    double cwnd_gain_;
+    uint64_t cwnd_;
+    std::deque<BandwidthSample> bandwidth_samples_;
+    std::chrono::nanoseconds min_rtt_;
+    std::chrono::steady_clock::time_point min_rtt_time_;
+    uint64_t round_count_;
+    uint64_t next_round_delivered_;
+    uint64_t full_bandwidth_;
+    uint64_t full_bandwidth_rounds_;
+    std::size_t cycle_index_;
+    std::chrono::steady_clock::time_point cycle_start_;
+    std::chrono::steady_clock::time_point probe_rtt_done_;
+};
+
+// null for kNone; mss is the datagram size
+std::unique_ptr<CongestionController> MakeCongestionController(UdpCongestionControl congestion_control, uint64_t mss)
+{
+    switch (congestion_control)
+    {
+        case UdpCongestionControl::kNewReno:
+            return std::make_unique<NewRenoController>(mss);
+        case UdpCongestionControl::kBbr:
+            return std::make_unique<BbrController>(mss);
+        default:
+            return nullptr;
+    }
+}
+
+#endif //MEASURE_TRANSFER_CONGESTION_H
@@ -0,0 +1,246 @@
+#ifndef MEASURE_TRANSFER_CPU_USAGE_H
+#define MEASURE_TRANSFER_CPU_USAGE_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * CPU consumed by one thread over one run.
+ * Cycles come from a per-thread hardware counter when perf events are
+ * available; otherwise they are estimated from the CPU time and the nominal
+ * clock in /proc/cpuinfo and estimated_cycles is set.
+ */
+struct CpuUsage
+{
+    std::chrono::nanoseconds Total() const
+    {
+        return user_time + system_time;
+    }
+
+    // data members
+    std::chrono::nanoseconds user_time;
+    std::chrono::nanoseconds system_time;
+    uint64_t cycles;
+    bool estimated_cycles;
+    uint64_t voluntary_context_switches;
+    uint64_t involuntary_context_switches;
+};
+
+/**
+ * Samples the CPU usage of the thread that constructed it; Start() and Stop()
+ * must be called from that same thread.
+ */
+class CpuUsageSampler
+{
+public:
+    CpuUsageSampler()
+        : cycles_fd_{OpenCyclesCounter()}
+        , start_{}
+    {}
+
+    CpuUsageSampler(const CpuUsageSampler&) = delete;
+    CpuUsageSampler& operator=(const CpuUsageSampler&) = delete;
+
+    ~CpuUsageSampler()
+    {
+        if (cycles_fd_ >= 0)
+        {
+            close(cycles_fd_);
+        }
+    }
+
+    void Start()
+    {
+        start_ = Sample();
+    }
+
+    CpuUsage Stop() const
+    {
+        CpuUsage end = Sample();
+        CpuUsage usage = { end.user_time - start_.user_time,
+                           end.system_time - start_.system_time,
+                           end.cycles - start_.cycles,
+                           false,
+                           end.voluntary_context_switches - start_.voluntary_context_switches,
+                           end.involuntary_context_switches - start_.involuntary_context_switches };
+
+        if (cycles_fd_ < 0)
+        {
+            usage.cycles = static_cast<uint64_t>(usage.Total().count() * NominalGhz());
+            usage.estimated_cycles = true;
+        }
+
+        return usage;
+    }
+
+    // nominal clock from /proc/cpuinfo, used to estimate cycles where no counter is available
+    static double NominalGhz()
+    {
+        static double ghz = []() {
+            std::ifstream cpuinfo("/proc/cpuinfo");
+            std::string line;
+            while (std::getline(cpuinfo, line))
+            {
+                if (line.rfind("cpu MHz", 0) == 0)
+                {
+                    return std::stod(line.substr(line.find(':') + 1)) / 1000;
+                }
+            }
+            return 0.0;
+        }();
+
+        return ghz;
+    }
+
+private:
+    CpuUsage Sample() const
+    {
+        rusage usage{};
+        getrusage(RUSAGE_THREAD, &usage);
+
+        uint64_t cycles = 0;
+        if (cycles_fd_ >= 0 && read(cycles_fd_, &cycles, sizeof(cycles)) != sizeof(cycles))
+        {
+            cycles = 0;
+        }
+
+        return { ToNanoseconds(usage.ru_utime),
+                 ToNanoseconds(usage.ru_stime),
+                 cycles,
+                 false,
+                 static_cast<uint64_t>(usage.ru_nvcsw),
+                 static_cast<uint64_t>(usage.ru_nivcsw) };
+    }
+
+    static std::chrono::nanoseconds ToNanoseconds(const timeval& time)
+    {
+        return std::chrono::seconds(time.tv_sec) + std::chrono::microseconds(time.tv_usec);
+    }
+
+    static int OpenCyclesCounter()
+    {
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        attr.exclude_hv = 1;
+
+        // pid 0 and cpu -1 count the calling thread on whatever core it runs, user and kernel mode
+        int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd < 0)
+        {
+            // unprivileged users may only count their own user mode
+            attr.exclude_kernel = 1;
+            fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+
+        return fd;
+    }
+
+private:
+    int cycles_fd_;
+    CpuUsage start_;
+};
+
+/**
+ * Prints what a run cost in CPU next to what it moved: user/sys seconds, the
+ * share of a core it kept busy, CPU per GB and per message and cycles per byte.
+ */
+void PrintCpuCost(const CpuUsage& usage, uint64_t no_of_bytes, uint64_t no_of_messages, std::chrono::nanoseconds wall_time)
+{
+    double cpu_seconds = usage.Total().count() / 1e9;
+
+    std::cout << "CPU user time: " << usage.user_time.count() / 1e9 << " s" << std::endl;
+    std::cout << "CPU system time: " << usage.system_time.count() / 1e9 << " s" << std::endl;
+
+    if (wall_time.count() > 0)
+    {
+        std::cout << "CPU utilisation: " << 100.0 * usage.Total().count() / wall_time.count() << " % of a core" << std::endl;
+    }
+
+    if (no_of_bytes > 0)
+    {
+        std::cout << "CPU per GB: " << cpu_seconds * 1e9 / no_of_bytes << " s" << std::endl;
+        std::cout << "Cycles per byte: " << static_cast<double>(usage.cycles) / no_of_bytes
+                  << (usage.estimated_cycles ? " (estimated from nominal clock)" : "") << std::endl;
+    }
+
+    if (no_of_messages > 0)
+    {
+        std::cout << "CPU per message: " << usage.Total().count() / no_of_messages << " ns" << std::endl;
+    }
+
+    std::cout << "Context switches (voluntary/involuntary): " << usage.voluntary_context_switches << "/"
+              << usage.involuntary_context_switches << std::endl;
+}
+
+/**
+ * CPU usage of any thread of this process so far, read from procfs; unlike the
+ * sampler this works from another thread, at clock tick resolution and with
+ * the cycles estimated from the nominal clock.
+ */
+CpuUsage ThreadCpuUsage(pid_t thread_id)
+{
+    CpuUsage usage{};
+    std::string task = "/proc/self/task/" + std::to_string(thread_id);
+
+    // utime and stime are fields 14 and 15, counted after the parenthesised command name
+    std::ifstream stat(task + "/stat");
+    std::string line;
+    if (std::getline(stat, line) && line.rfind(')') != std::string::npos)
+    {
+        std::istringstream fields(line.substr(line.rfind(')') + 2));
+        std::string field;
+        uint64_t user_ticks = 0;
+        uint64_t system_ticks = 0;
+        for (int i = 3; i < 14; ++i)
+        {
+            fields >> field;
+        }
+        fields >> user_ticks >> system_ticks;
+
+        auto tick = std::chrono::nanoseconds(1000000000 / sysconf(_SC_CLK_TCK));
+        usage.user_time = tick * user_ticks;
+        usage.system_time = tick * system_ticks;
+    }
+
+    std::ifstream status(task + "/status");
+    while (std::getline(status, line))
+    {
+        if (line.rfind("voluntary_ctxt_switches:", 0) == 0)
+        {
+            usage.voluntary_context_switches = std::stoull(line.substr(line.find(':') + 1));
+        }
+        else if (line.rfind("nonvoluntary_ctxt_switches:", 0) == 0)
+        {
+            usage.involuntary_context_switches = std::stoull(line.substr(line.find(':') + 1));
+        }
+    }
+
+    usage.cycles = static_cast<uint64_t>(usage.Total().count() * CpuUsageSampler::NominalGhz());
+    usage.estimated_cycles = true;
+    return usage;
+}
+
+CpuUsage operator-(const CpuUsage& end, const CpuUsage& start)
+{
+    return { end.user_time - start.user_time,
+             end.system_time - start.system_time,
+             end.cycles - start.cycles,
+             end.estimated_cycles || start.estimated_cycles,
+             end.voluntary_context_switches - start.voluntary_context_switches,
+             end.involuntary_context_switches - start.involuntary_context_switches };
+}
+
+#endif //MEASURE_TRANSFER_CPU_USAGE_H
@@ -0,0 +1,704 @@
+#ifndef MEASURE_TRANSFER_FEC_H
+#define MEASURE_TRANSFER_FEC_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <immintrin.h>
+
+enum class FecScheme : uint8_t
+{
+    kNone = 0,
+    // one parity shard, the XOR of the data shards of the group
+    kXor = 1,
+    // m parity shards of a systematic Cauchy Reed-Solomon code, any k of the k + m shards rebuild the group
+    kReedSolomon = 2
+};
+
+std::ostream& operator<<(std::ostream& os, const FecScheme& scheme)
+{
+    switch (scheme)
+    {
+        case FecScheme::kNone:
+            os << "none";
+            break;
+        case FecScheme::kXor:
+            os << "xor";
+            break;
+        case FecScheme::kReedSolomon:
+            os << "rs";
+            break;
+        default:
+            os << "Unknown FecScheme";
+            break;
+    }
+
+    return os;
+}
+
+FecScheme FecSchemeFromName(const std::string& name)
+{
+    if (name == "none")
+    {
+        return FecScheme::kNone;
+    }
+
+    if (name == "xor")
+    {
+        return FecScheme::kXor;
+    }
+
+    if (name == "rs")
+    {
+        return FecScheme::kReedSolomon;
+    }
+
+    throw std::invalid_argument("Unknown FEC scheme " + name);
+}
+
+/**
+ * Forward error correction of a UDP stream: every group of data_shards
+ * consecutive DataMessages is followed by parity_shards ParityMessages.
+ * Format: | FecScheme | DataShards | ParityShards |
+ * Index:  |     0     |     1      |      2       |
+ * Size:   |   1byte   |   1byte    |    1byte     |
+ */
+struct FecOptions
+{
+    static const std::size_t kSize = 3;
+    // the Cauchy matrix needs k + m distinct field elements
+    static const std::size_t kMaxShards = 256;
+
+    static FecOptions Decode(const uint8_t* bytes)
+    {
+        return { static_cast<FecScheme>(bytes[0]), bytes[1], bytes[2] };
+    }
+
+    static void Encode(const FecOptions& options, uint8_t* bytes)
+    {
+        bytes[0] = static_cast<uint8_t>(options.scheme);
+        bytes[1] = options.data_shards;
+        bytes[2] = options.parity_shards;
+    }
+
+    bool Enabled() const
+    {
+        return scheme != FecScheme::kNone && data_shards > 0 && NoOfParityShards() > 0;
+    }
+
+    // XOR parity is a single shard whatever was asked for
+    std::size_t NoOfParityShards() const
+    {
+        return scheme == FecScheme::kXor ? 1 : parity_shards;
+    }
+
+    // bytes on the wire per data byte
+    double Overhead() const
+    {
+        return Enabled() ? static_cast<double>(NoOfParityShards()) / data_shards : 0;
+    }
+
+    // data members
+    FecScheme scheme = FecScheme::kNone;
+    uint8_t data_shards = 8;
+    uint8_t parity_shards = 2;
+};
+
+std::ostream& operator<<(std::ostream& os, const FecOptions& options)
+{
+    os << options.scheme;
+    if (options.Enabled())
+    {
+        os << " k=" << static_cast<int>(options.data_shards) << " m=" << options.NoOfParityShards();
+    }
+    return os;
+}
+
+/**
+ * GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1, the field of most
+ * Reed-Solomon erasure codes; 2 generates its multiplicative group.
+ */
+class GaloisField
+{
+public:
+    static const GaloisField& Instance()
+    {
+        static const GaloisField field;
+        return field;
+    }
+
+    uint8_t Multiply(uint8_t a, uint8_t b) const
+    {
+        return a == 0 || b == 0 ? 0 : exp_[log_[a] + log_[b]];
+    }
+
+    uint8_t Inverse(uint8_t a) const
+    {
+        return exp_[255 - log_[a]];
+    }
+
+private:
+    GaloisField()
+    {
+        unsigned x = 1;
+        for (unsigned i = 0; i < 255; ++i)
+        {
+            exp_[i] = static_cast<uint8_t>(x);
+            log_[x] = static_cast<uint8_t>(i);
+            x <<= 1;
+            if (x & 0x100)
+            {
+                x ^= 0x11D;
+            }
+        }
+
+        // doubled, so a product needs no modulo of the summed logarithms
+        for (unsigned i = 255; i < 512; ++i)
+        {
+            exp_[i] = exp_[i - 255];
+        }
+        log_[0] = 0;
+    }
+
+private:
+    uint8_t exp_[512];
+    uint8_t log_[256];
+};
+
+/**
+ * dst ^= c * src over size bytes, the only operation encoding and decoding
+ * need. A product is split into the products of the low and the high nibble
+ * of every byte, each a lookup in a 16 entry table, which PSHUFB does for 16
+ * (SSSE3) or 32 (AVX2) bytes at once. c == 1 is a plain XOR.
+ */
+class GaloisRegion
+{
+public:
+    static void MultiplyAdd(uint8_t* dst, const uint8_t* src, uint8_t c, std::size_t size)
+    {
+        if (c == 0)
+        {
+            return;
+        }
+
+        if (c == 1)
+        {
+            Xor(dst, src, size);
+            return;
+        }
+
+        uint8_t low[16];
+        uint8_t high[16];
+        const auto& field = GaloisField::Instance();
+        for (uint8_t nibble = 0; nibble < 16; ++nibble)
+        {
+            low[nibble] = field.Multiply(c, nibble);
+            high[nibble] = field.Multiply(c, static_cast<uint8_t>(nibble << 4));
+        }
+
+        std::size_t done = 0;
+        if (__builtin_cpu_supports("avx2"))
+        {
+            done = MultiplyAddAvx2(dst, src, low, high, size);
+        }
+        else if (__builtin_cpu_supports("ssse3"))
+        {
+            done = MultiplyAddSsse3(dst, src, low, high, size);
+        }
+
+        for (std::size_t i = done; i < size; ++i)
+        {
+            dst[i] ^= static_cast<uint8_t>(low[src[i] & 0x0F] ^ high[src[i] >> 4]);
+        }
+    }
+
+    static void Xor(uint8_t* dst, const uint8_t* src, std::size_t size)
+    {
+        std::size_t done = __builtin_cpu_supports("avx2") ? XorAvx2(dst, src, size) : 0;
+        for (; done + sizeof(uint64_t) <= size; done += sizeof(uint64_t))
+        {
+            uint64_t a, b;
+            std::memcpy(&a, dst + done, sizeof(a));
+            std::memcpy(&b, src + done, sizeof(b));
+            a ^= b;
+            std::memcpy(dst + done, &a, sizeof(a));
+        }
+
+        for (; done < size; ++done)
+        {
+            dst[done] ^= src[done];
+        }
+    }
+
+private:
+    // the bytes processed, a multiple of 32
+    __attribute__((target("avx2"))) static std::size_t MultiplyAddAvx2(uint8_t* dst, const uint8_t* src, const uint8_t* low,
+                                                                       const uint8_t* high, std::size_t size)
+    {
+        const __m256i low_table = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(low)));
+        const __m256i high_table = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(high)));
+        const __m256i mask = _mm256_set1_epi8(0x0F);
+
+        std::size_t i = 0;
+        for (; i + 32 <= size; i += 32)
+        {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            __m256i product = _mm256_xor_si256(_mm256_shuffle_epi8(low_table, _mm256_and_si256(x, mask)),
+                                               _mm256_shuffle_epi8(high_table, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask)));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(y, product));
+        }
+        return i;
+    }
+
+    // the bytes processed, a multiple of 16
+    __attribute__((target("ssse3"))) static std::size_t MultiplyAddSsse3(uint8_t* dst, const uint8_t* src, const uint8_t* low,
+                                                                         const uint8_t* high, std::size_t size)
+    {
+        const __m128i low_table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(low));
+        const __m128i high_table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(high));
+        const __m128i mask = _mm_set1_epi8(0x0F);
+
+        std::size_t i = 0;
+        for (; i + 16 <= size; i += 16)
+        {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i product = _mm_xor_si128(_mm_shuffle_epi8(low_table, _mm_and_si128(x, mask)),
+                                            _mm_shuffle_epi8(high_table, _mm_and_si128(_mm_srli_epi64(x, 4), mask)));
+            __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(y, product));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2"))) static std::size_t XorAvx2(uint8_t* dst, const uint8_t* src, std::size_t size)
+    {
+        std::size_t i = 0;
+        for (; i + 32 <= size; i += 32)
+        {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(x, y));
+        }
+        return i;
+    }
+};
+
+// coefficient of data shard i in parity shard j: all ones for XOR, the Cauchy matrix 1 / (x_j + y_i) with x_j = k + j, y_i = i for Reed-Solomon
+std::vector<uint8_t> FecCoefficients(const FecOptions& options)
+{
+    std::size_t k = options.data_shards;
+    std::size_t m = options.NoOfParityShards();
+    std::vector<uint8_t> coefficients(m * k, 1);
+    if (options.scheme == FecScheme::kReedSolomon)
+    {
+        const auto& field = GaloisField::Instance();
+        for (std::size_t j = 0; j < m; ++j)
+        {
+            for (std::size_t i = 0; i < k; ++i)
+            {
+                coefficients[j * k + i] = field.Inverse(static_cast<uint8_t>((k + j) ^ i));
+            }
+        }
+    }
+    return coefficients;
+}
+
+/**
+ * Computes the parity of a group while its data shards go out: every shard
+ * is multiplied into the m parity shards as it is added, so nothing of the
+ * group has to be kept back. A group cut short by the end of the transfer
+ * is closed early; its missing shards count as zeros on both ends.
+ */
+class FecEncoder
+{
+public:
+    FecEncoder(const FecOptions& options, std::size_t shard_size)
+        : k_{options.data_shards}
+        , m_{options.NoOfParityShards()}
+        , shard_size_{shard_size}
+        , coefficients_{FecCoefficients(options)}
+        , parity_(m_ * shard_size_, 0)
+        , group_no_{0}
+        , no_of_shards_{0}
+        , encode_time_{0}
+        , no_of_encoded_bytes_{0}
+    {
+        if (!options.Enabled() || k_ + m_ > FecOptions::kMaxShards)
+        {
+            throw std::invalid_argument("FEC needs 1 <= k, 1 <= m and k + m <= 256");
+        }
+    }
+
+    // adds the next data shard of the group, true once the group is complete and its parity ready
+    bool Add(const uint8_t* shard)
+    {
+        auto start_time = std::chrono::steady_clock::now();
+        if (no_of_shards_ == 0)
+        {
+            std::fill(parity_.begin(), parity_.end(), 0);
+        }
+
+        for (std::size_t j = 0; j < m_; ++j)
+        {
+            GaloisRegion::MultiplyAdd(&parity_[j * shard_size_], shard, coefficients_[j * k_ + no_of_shards_], shard_size_);
+        }
+        no_of_shards_++;
+
+        encode_time_ += std::chrono::steady_clock::now() - start_time;
+        no_of_encoded_bytes_ += shard_size_;
+        return no_of_shards_ == k_;
+    }
+
+    // data shards added to the open group
+    std::size_t NoOfShards() const
+    {
+        return no_of_shards_;
+    }
+
+    uint32_t GroupNo() const
+    {
+        return group_no_;
+    }
+
+    std::size_t NoOfParityShards() const
+    {
+        return m_;
+    }
+
+    const uint8_t* Parity(std::size_t j) const
+    {
+        return &parity_[j * shard_size_];
+    }
+
+    // once its parity has been sent, complete or not
+    void CloseGroup()
+    {
+        group_no_++;
+        no_of_shards_ = 0;
+    }
+
+    std::chrono::nanoseconds EncodeTime() const
+    {
+        return encode_time_;
+    }
+
+    // data bytes per second of encoding time
+    double EncodeGbps() const
+    {
+        return encode_time_.count() > 0 ? static_cast<double>(no_of_encoded_bytes_) / encode_time_.count() : 0;
+    }
+
+private:
+    std::size_t k_;
+    std::size_t m_;
+    std::size_t shard_size_;
+    std::vector<uint8_t> coefficients_;
+    std::vector<uint8_t> parity_;
+    uint32_t group_no_;
+    std::size_t no_of_shards_;
+    std::chrono::nanoseconds encode_time_;
+    uint64_t no_of_encoded_bytes_;
+};
+
+// the most groups the data shards of one batch can close: every one they complete, the first having been opened by an earlier
+// batch, and the group the end of the transfer cuts short
+std::size_t MaxFecGroupsPerBatch(std::size_t batch_size, std::size_t data_shards)
+{
+    return (batch_size + data_shards - 1) / data_shards + 1;
+}
+
+/**
+ * Rebuilds lost data shards from the parity of their group. The last kWindow
+ * groups are kept, so parity and data may arrive out of order within that
+ * window; a group is rebuilt as soon as as many shards as it has data shards
+ * have arrived. Each of the e missing shards is then a linear combination of
+ * the e syndromes, the parity shards with the received data taken out, with
+ * the inverse of the e x e submatrix of the coefficients as weights; every
+ * square submatrix of a Cauchy matrix is invertible.
+ */
+class FecDecoder
+{
+public:
+    static const std::size_t kWindow = 16;
+
+    FecDecoder(const FecOptions& options, std::size_t shard_size)
+        : k_{options.data_shards}
+        , m_{options.NoOfParityShards()}
+        , shard_size_{shard_size}
+        , coefficients_{FecCoefficients(options)}
+        , groups_(kWindow)
+        , no_of_recovered_messages_{0}
+        , decode_time_{0}
+        , no_of_decoded_bytes_{0}
+    {
+        if (!options.Enabled() || k_ + m_ > FecOptions::kMaxShards)
+        {
+            throw std::invalid_argument("FEC needs 1 <= k, 1 <= m and k + m <= 256");
+        }
+
+        for (auto& group : groups_)
+        {
+            group.present.assign(k_ + m_, 0);
+            group.shards.assign((k_ + m_) * shard_size_, 0);
+        }
+    }
+
+    /**
+     * A received data shard, false if it is not new: a duplicate, or the late
+     * original of a message rebuilt already. on_recovered(message_no, shard)
+     * is called for every message this shard allows to rebuild.
+     */
+    template <typename Handler>
+    bool AddData(uint32_t message_no, const uint8_t* shard, Handler&& on_recovered)
+    {
+        auto* group = Find(static_cast<uint32_t>(message_no / k_));
+        if (group == nullptr)
+        {
+            // older than the window, nothing to rebuild with it any more
+            return true;
+        }
+
+        auto i = message_no % k_;
+        if (group->present[i] || group->recovered)
+        {
+            return false;
+        }
+
+        group->present[i] = 1;
+        group->no_of_data_shards++;
+        if (!group->complete)
+        {
+            std::memcpy(&group->shards[i * shard_size_], shard, shard_size_);
+            Rebuild(*group, on_recovered);
+        }
+        return true;
+    }
+
+    // a received parity shard of a group of no_of_data_shards data shards
+    template <typename Handler>
+    void AddParity(uint32_t group_no, std::size_t parity_index, std::size_t no_of_data_shards, const uint8_t* shard, Handler&& on_recovered)
+    {
+        if (parity_index >= m_ || no_of_data_shards == 0 || no_of_data_shards > k_)
+        {
+            return;
+        }
+
+        auto* group = Find(group_no);
+        if (group == nullptr || group->complete || group->present[k_ + parity_index])
+        {
+            return;
+        }
+
+        group->present[k_ + parity_index] = 1;
+        group->no_of_parity_shards++;
+        group->size = no_of_data_shards;
+        std::memcpy(&group->shards[(k_ + parity_index) * shard_size_], shard, shard_size_);
+        Rebuild(*group, on_recovered);
+    }
+
+    uint32_t NoOfRecoveredMessages() const
+    {
+        return no_of_recovered_messages_;
+    }
+
+    std::chrono::nanoseconds DecodeTime() const
+    {
+        return decode_time_;
+    }
+
+    // rebuilt bytes
+    uint64_t NoOfDecodedBytes() const
+    {
+        return no_of_decoded_bytes_;
+    }
+
+private:
+    struct Group
+    {
+        int64_t group_no = -1;
+        // data shards of the group, known from its parity; 0 until a parity shard arrived
+        std::size_t size = 0;
+        std::size_t no_of_data_shards = 0;
+        std::size_t no_of_parity_shards = 0;
+        // nothing left to rebuild
+        bool complete = false;
+        // some data shards were rebuilt rather than received
+        bool recovered = false;
+        // k data flags, then m parity flags
+        std::vector<uint8_t> present;
+        std::vector<uint8_t> shards;
+    };
+
+    // the window slot of the group, recycled from the group kWindow before it; null for a group that fell out of the window
+    Group* Find(uint32_t group_no)
+    {
+        auto& group = groups_[group_no % kWindow];
+        if (group.group_no > static_cast<int64_t>(group_no))
+        {
+            return nullptr;
+        }
+
+        if (group.group_no < static_cast<int64_t>(group_no))
+        {
+            group.group_no = group_no;
+            group.size = 0;
+            group.no_of_data_shards = 0;
+            group.no_of_parity_shards = 0;
+            group.complete = false;
+            group.recovered = false;
+            std::fill(group.present.begin(), group.present.end(), 0);
+        }
+        return &group;
+    }
+
+    template <typename Handler>
+    void Rebuild(Group& group, Handler&& on_recovered)
+    {
+        if (group.size == 0)
+        {
+            return;
+        }
+
+        if (group.no_of_data_shards >= group.size)
+        {
+            group.complete = true;
+            return;
+        }
+
+        if (group.no_of_data_shards + group.no_of_parity_shards < group.size)
+        {
+            return;
+        }
+
+        auto start_time = std::chrono::steady_clock::now();
+
+        std::vector<std::size_t> missing;
+        for (std::size_t i = 0; i < group.size; ++i)
+        {
+            if (!group.present[i])
+            {
+                missing.push_back(i);
+            }
+        }
+
+        std::vector<std::size_t> rows;
+        for (std::size_t j = 0; j < m_ && rows.size() < missing.size(); ++j)
+        {
+            if (group.present[k_ + j])
+            {
+                rows.push_back(j);
+            }
+        }
+
+        // syndromes in place of the parity shards used
+        for (auto j : rows)
+        {
+            auto* syndrome = &group.shards[(k_ + j) * shard_size_];
+            for (std::size_t i = 0; i < group.size; ++i)
+            {
+                if (group.present[i])
+                {
+                    GaloisRegion::MultiplyAdd(syndrome, &group.shards[i * shard_size_], coefficients_[j * k_ + i], shard_size_);
+                }
+            }
+        }
+
+        auto e = missing.size();
+        std::vector<uint8_t> matrix(e * e);
+        for (std::size_t r = 0; r < e; ++r)
+        {
+            for (std::size_t c = 0; c < e; ++c)
+            {
+                matrix[r * e + c] = coefficients_[rows[r] * k_ + missing[c]];
+            }
+        }
+        auto inverse = Invert(matrix, e);
+
+        for (std::size_t c = 0; c < e; ++c)
+        {
+            auto* shard = &group.shards[missing[c] * shard_size_];
+            std::fill(shard, shard + shard_size_, 0);
+            for (std::size_t r = 0; r < e; ++r)
+            {
+                GaloisRegion::MultiplyAdd(shard, &group.shards[(k_ + rows[r]) * shard_size_], inverse[c * e + r], shard_size_);
+            }
+        }
+
+        decode_time_ += std::chrono::steady_clock::now() - start_time;
+        no_of_decoded_bytes_ += e * shard_size_;
+        no_of_recovered_messages_ += static_cast<uint32_t>(e);
+        group.complete = true;
+        group.recovered = true;
+
+        for (auto i : missing)
+        {
+            on_recovered(static_cast<uint32_t>(group.group_no * k_ + i), &group.shards[i * shard_size_]);
+        }
+    }
+
+    // Gauss-Jordan elimination over the field; the matrix is a Cauchy submatrix, so it never is singular
+    static std::vector<uint8_t> Invert(std::vector<uint8_t> matrix, std::size_t n)
+    {
+        const auto& field = GaloisField::Instance();
+        std::vector<uint8_t> inverse(n * n, 0);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            inverse[i * n + i] = 1;
+        }
+
+        for (std::size_t column = 0; column < n; ++column)
+        {
+            auto pivot = column;
+            while (matrix[pivot * n + column] == 0)
+            {
+                pivot++;
+            }
+            for (std::size_t c = 0; c < n; ++c)
+            {
+                std::swap(matrix[pivot * n + c], matrix[column * n + c]);
+                std::swap(inverse[pivot * n + c], inverse[column * n + c]);
+            }
+
+            auto scale = field.Inverse(matrix[column * n + column]);
+            for (std::size_t c = 0; c < n; ++c)
+            {
+                matrix[column * n + c] = field.Multiply(matrix[column * n + c], scale);
+                inverse[column * n + c] = field.Multiply(inverse[column * n + c], scale);
+            }
+
+            for (std::size_t r = 0; r < n; ++r)
+            {
+                auto factor = matrix[r * n + column];
+                if (r == column || factor == 0)
+                {
+                    continue;
+                }
+                for (std::size_t c = 0; c < n; ++c)
+                {
+                    matrix[r * n + c] ^= field.Multiply(factor, matrix[column * n + c]);
+                    inverse[r * n + c] ^= field.Multiply(factor, inverse[column * n + c]);
+                }
+            }
+        }
+        return inverse;
+    }
+
+private:
+    std::size_t k_;
+    std::size_t m_;
+    std::size_t shard_size_;
+    std::vector<uint8_t> coefficients_;
+    std::vector<Group> groups_;
+    uint32_t no_of_recovered_messages_;
+    std::chrono::nanoseconds decode_time_;
+    uint64_t no_of_decoded_bytes_;
+};
+
+#endif //MEASURE_TRANSFER_FEC_H
@@ -0,0 +1,397 @@
+#ifndef MEASURE_TRANSFER_IO_URING_H
+#define MEASURE_TRANSFER_IO_URING_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <boost/system/system_error.hpp>
+
+const unsigned kIoUringEntries = 256;
+
+/**
+ * Thin wrapper over the raw io_uring system calls (no liburing dependency).
+ * Submissions are only queued by GetSqe(); nothing reaches the kernel until
+ * Submit(), so a caller can batch every operation of a loop iteration into a
+ * single io_uring_enter. With SQPOLL the kernel thread picks submissions up on
+ * its own and io_uring_enter is only needed to wake it or to block.
+ * Another thread interrupts a blocking Submit() with Wake(), which completes
+ * the poll ArmWakeup() queued on an eventfd.
+ */
+class IoUring
+{
+public:
+    IoUring(unsigned entries, bool sqpoll)
+        : fd_{-1}
+        , wake_fd_{-1}
+        , sqpoll_{sqpoll}
+        , sqe_tail_{0}
+        , no_of_enter_calls_{0}
+    {
+        io_uring_params params{};
+        if (sqpoll_)
+        {
+            params.flags |= IORING_SETUP_SQPOLL;
+            params.sq_thread_idle = 1000;
+        }
+
+        fd_ = static_cast<int>(syscall(SYS_io_uring_setup, entries, &params));
+        if (fd_ < 0)
+        {
+            throw boost::system::system_error(errno, boost::system::system_category(), "io_uring_setup");
+        }
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+        {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+
+        // the destructor does not run for a constructor that throws, so undo what was set up before the failure
+        try
+        {
+            sq_ring_ = Map(sq_ring_size_, IORING_OFF_SQ_RING);
+            cq_ring_ = single_mmap ? sq_ring_ : Map(cq_ring_size_, IORING_OFF_CQ_RING);
+            sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+            sqes_ = static_cast<io_uring_sqe*>(Map(sqes_size_, IORING_OFF_SQES));
+
+            wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (wake_fd_ < 0)
+            {
+                throw boost::system::system_error(errno, boost::system::system_category(), "eventfd");
+            }
+        }
+        catch (...)
+        {
+            Release();
+            throw;
+        }
+
+        auto sq = static_cast<uint8_t*>(sq_ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_flags_ = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+
+        // sqes are always used in ring order, so the indirection array is the identity
+        auto sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < sq_entries_; ++i)
+        {
+            sq_array[i] = i;
+        }
+
+        auto cq = static_cast<uint8_t*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    ~IoUring()
+    {
+        Release();
+    }
+
+    void RegisterBuffers(const std::vector<iovec>& buffers)
+    {
+        if (syscall(SYS_io_uring_register, fd_, IORING_REGISTER_BUFFERS, buffers.data(), buffers.size()) < 0)
+        {
+            throw boost::system::system_error(errno, boost::system::system_category(), "IORING_REGISTER_BUFFERS");
+        }
+    }
+
+    /**
+     * Registers a ring of provided buffers for multishot receives: the kernel
+     * picks a buffer per completion and reports its id in the cqe flags.
+     * count must be a power of two.
+     */
+    void RegisterBufferRing(uint16_t group, uint8_t* base, uint32_t buffer_size, uint16_t count)
+    {
+        buffer_ring_size_ = count * sizeof(io_uring_buf);
+        void* memory = mmap(nullptr, buffer_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            throw boost::system::system_error(errno, boost::system::system_category(), "mmap");
+        }
+
+        // the kernel reads the ring tail from this memory, so start from an empty ring
+        std::memset(memory, 0, buffer_ring_size_);
+        buffer_ring_ = static_cast<io_uring_buf_ring*>(memory);
+        buffer_ring_mask_ = count - 1;
+        buffer_base_ = base;
+        buffer_size_ = buffer_size;
+
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uint64_t>(buffer_ring_);
+        reg.ring_entries = count;
+        reg.bgid = group;
+        if (syscall(SYS_io_uring_register, fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        {
+            throw boost::system::system_error(errno, boost::system::system_category(), "IORING_REGISTER_PBUF_RING");
+        }
+
+        for (uint16_t id = 0; id < count; ++id)
+        {
+            AddBuffer(id, id);
+        }
+        __atomic_store_n(&buffer_ring_->tail, count, __ATOMIC_RELEASE);
+    }
+
+    const uint8_t* ProvidedBuffer(uint16_t id) const
+    {
+        return buffer_base_ + static_cast<std::size_t>(id) * buffer_size_;
+    }
+
+    void RecycleBuffer(uint16_t id)
+    {
+        uint16_t tail = buffer_ring_->tail;
+        AddBuffer(id, tail);
+        __atomic_store_n(&buffer_ring_->tail, static_cast<uint16_t>(tail + 1), __ATOMIC_RELEASE);
+    }
+
+    // never null: a full submission queue is handed to the kernel first, which frees its entries
+    io_uring_sqe* GetSqe()
+    {
+        for (int i = 0; sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_; ++i)
+        {
+            // with SQPOLL the poller thread takes them on its own, Submit() only wakes it up
+            int result = Submit(0);
+            if (result < 0 || i == kSqPollSpinCount)
+            {
+                throw boost::system::system_error(result < 0 ? -result : EBUSY, boost::system::system_category(), "io_uring submission queue full");
+            }
+        }
+
+        io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+        sqe_tail_++;
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    /**
+     * Hands every queued sqe to the kernel and optionally waits until at least
+     * wait_nr completions are available. Returns a negative errno on failure.
+     */
+    int Submit(unsigned wait_nr)
+    {
+        unsigned to_submit = sqe_tail_ - __atomic_load_n(sq_tail_, __ATOMIC_RELAXED);
+        __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+
+        unsigned flags = 0;
+        if (sqpoll_)
+        {
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(sq_flags_, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP)
+            {
+                flags |= IORING_ENTER_SQ_WAKEUP;
+            }
+
+            // the poller thread submits for us; spin briefly before sleeping in the kernel
+            for (int i = 0; wait_nr > 0 && i < kSqPollSpinCount && Ready() < wait_nr; ++i)
+            {
+            }
+
+            if (wait_nr > 0 && Ready() >= wait_nr)
+            {
+                wait_nr = 0;
+            }
+
+            to_submit = 0;
+        }
+
+        if (wait_nr > 0)
+        {
+            flags |= IORING_ENTER_GETEVENTS;
+        }
+
+        if (flags == 0 && to_submit == 0)
+        {
+            return 0;
+        }
+
+        while (true)
+        {
+            no_of_enter_calls_++;
+            auto ret = syscall(SYS_io_uring_enter, fd_, to_submit, wait_nr, flags, nullptr, 0);
+            if (ret >= 0)
+            {
+                return static_cast<int>(ret);
+            }
+
+            if (errno != EINTR)
+            {
+                return -errno;
+            }
+        }
+    }
+
+    // queues a poll that completes with user_data once Wake() is called
+    void ArmWakeup(uint64_t user_data)
+    {
+        io_uring_sqe* sqe = GetSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = wake_fd_;
+        sqe->poll32_events = POLLIN;
+        sqe->user_data = user_data;
+    }
+
+    // safe to call from any thread; a write that fails finds the counter saturated, so a wakeup is already pending
+    bool Wake()
+    {
+        uint64_t one = 1;
+        return write(wake_fd_, &one, sizeof(one)) == sizeof(one);
+    }
+
+    bool PeekCompletion(io_uring_cqe& cqe)
+    {
+        unsigned head = *cq_head_;
+        if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+        {
+            return false;
+        }
+
+        cqe = cqes_[head & cq_mask_];
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    uint64_t NoOfEnterCalls() const
+    {
+        return no_of_enter_calls_;
+    }
+
+    static void PrepReadFixed(io_uring_sqe* sqe, int fd, void* buffer, uint32_t size, uint16_t buffer_index, uint64_t user_data)
+    {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        sqe->len = size;
+        sqe->buf_index = buffer_index;
+        sqe->user_data = user_data;
+    }
+
+    static void PrepWriteFixed(io_uring_sqe* sqe, int fd, const void* buffer, uint32_t size, uint16_t buffer_index, uint64_t user_data)
+    {
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        sqe->len = size;
+        sqe->buf_index = buffer_index;
+        sqe->user_data = user_data;
+    }
+
+    static void PrepRecvMultishot(io_uring_sqe* sqe, int fd, uint16_t group, uint64_t user_data)
+    {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = group;
+        sqe->user_data = user_data;
+    }
+
+private:
+    static const int kSqPollSpinCount = 100000;
+
+    void* Map(std::size_t size, uint64_t offset)
+    {
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, static_cast<off_t>(offset));
+        if (memory == MAP_FAILED)
+        {
+            throw boost::system::system_error(errno, boost::system::system_category(), "io_uring mmap");
+        }
+
+        return memory;
+    }
+
+    void Release()
+    {
+        if (buffer_ring_ != nullptr)
+        {
+            munmap(buffer_ring_, buffer_ring_size_);
+        }
+
+        if (sqes_ != nullptr)
+        {
+            munmap(sqes_, sqes_size_);
+        }
+        if (cq_ring_ != nullptr && cq_ring_ != sq_ring_)
+        {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        if (sq_ring_ != nullptr)
+        {
+            munmap(sq_ring_, sq_ring_size_);
+        }
+
+        if (wake_fd_ >= 0)
+        {
+            close(wake_fd_);
+        }
+        close(fd_);
+    }
+
+    unsigned Ready() const
+    {
+        return __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) - *cq_head_;
+    }
+
+    void AddBuffer(uint16_t id, uint16_t position)
+    {
+        // the bufs flexible array is misplaced when <linux/io_uring.h> is compiled as C++
+        // (its empty struct wrapper takes a byte), so index the entries directly
+        io_uring_buf& buffer = reinterpret_cast<io_uring_buf*>(buffer_ring_)[position & buffer_ring_mask_];
+        buffer.addr = reinterpret_cast<uint64_t>(ProvidedBuffer(id));
+        buffer.len = buffer_size_;
+        buffer.bid = id;
+    }
+
+private:
+    int fd_;
+    int wake_fd_;
+    bool sqpoll_;
+
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    std::size_t sq_ring_size_;
+    std::size_t cq_ring_size_;
+    io_uring_sqe* sqes_ = nullptr;
+    std::size_t sqes_size_ = 0;
+
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_flags_;
+    unsigned sq_mask_;
+    unsigned sq_entries_;
+    unsigned sqe_tail_;
+
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned cq_mask_;
+    io_uring_cqe* cqes_;
+
+    io_uring_buf_ring* buffer_ring_ = nullptr;
+    std::size_t buffer_ring_size_ = 0;
+    uint16_t buffer_ring_mask_ = 0;
+    uint8_t* buffer_base_ = nullptr;
+    uint32_t buffer_size_ = 0;
+
+    uint64_t no_of_enter_calls_;
+};
+
+#endif //MEASURE_TRANSFER_IO_URING_H
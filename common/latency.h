@@ -0,0 +1,134 @@
+#ifndef MEASURE_TRANSFER_LATENCY_H
+#define MEASURE_TRANSFER_LATENCY_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+/**
+ * Keeps every latency of an interval; percentiles are exact and computed by
+ * partially sorting the samples on demand, which is cheap next to the I/O
+ * that produced them.
+ */
+class LatencyRecorder
+{
+public:
+    void Add(std::chrono::nanoseconds latency)
+    {
+        samples_.push_back(latency.count());
+    }
+
+    std::size_t Count() const
+    {
+        return samples_.size();
+    }
+
+    void Clear()
+    {
+        samples_.clear();
+    }
+
+    // p in [0, 100]
+    std::chrono::nanoseconds Percentile(double p)
+    {
+        if (samples_.empty())
+        {
+            return std::chrono::nanoseconds(0);
+        }
+
+        auto rank = static_cast<std::size_t>(std::ceil(p / 100 * samples_.size()));
+        auto index = std::min(samples_.size() - 1, rank > 0 ? rank - 1 : 0);
+        std::nth_element(samples_.begin(), samples_.begin() + index, samples_.end());
+        return std::chrono::nanoseconds(samples_[index]);
+    }
+
+    std::chrono::nanoseconds Max() const
+    {
+        return samples_.empty() ? std::chrono::nanoseconds(0) : std::chrono::nanoseconds(*std::max_element(samples_.begin(), samples_.end()));
+    }
+
+private:
+    std::vector<int64_t> samples_;
+};
+
+// the percentiles a report prints, taken once the recorder is complete
+struct LatencyPercentiles
+{
+    std::chrono::nanoseconds p50;
+    std::chrono::nanoseconds p90;
+    std::chrono::nanoseconds p99;
+    std::chrono::nanoseconds p999;
+    std::chrono::nanoseconds max;
+};
+
+LatencyPercentiles Percentiles(LatencyRecorder& recorder)
+{
+    return { recorder.Percentile(50), recorder.Percentile(90), recorder.Percentile(99), recorder.Percentile(99.9), recorder.Max() };
+}
+
+/**
+ * One-way delay of timestamped messages, taken as the receive time minus the
+ * send time carried in the message. Absolute delays are only meaningful when
+ * both ends read the same clock (same host, or hosts synchronised by PTP);
+ * the interarrival jitter is the RFC 3550 estimate, which only depends on
+ * differences of delays and so is immune to a constant clock offset.
+ */
+class OneWayDelayMeter
+{
+public:
+    // times in nanoseconds on the realtime clock of the sender and of the receiver, in arrival order
+    void Add(int64_t send_time, int64_t receive_time)
+    {
+        int64_t delay = receive_time - send_time;
+        if (delays_.Count() > 0)
+        {
+            // J += (|D(i-1, i)| - J) / 16
+            double difference = std::abs(static_cast<double>(delay - last_delay_));
+            jitter_ += (difference - jitter_) / 16;
+        }
+
+        delays_.Add(std::chrono::nanoseconds(delay));
+        min_ = std::min(min_, delay);
+        last_delay_ = delay;
+    }
+
+    std::size_t Count() const
+    {
+        return delays_.Count();
+    }
+
+    std::chrono::nanoseconds Jitter() const
+    {
+        return std::chrono::nanoseconds(static_cast<int64_t>(jitter_));
+    }
+
+    void Print()
+    {
+        if (delays_.Count() == 0)
+        {
+            return;
+        }
+
+        auto us = [](std::chrono::nanoseconds value) { return value.count() / 1e3; };
+        std::cout << "One-way delay (us) of " << delays_.Count() << " messages: min " << us(std::chrono::nanoseconds(min_))
+                  << ", p50 " << us(delays_.Percentile(50)) << ", p90 " << us(delays_.Percentile(90)) << ", p99 "
+                  << us(delays_.Percentile(99)) << ", p99.9 " << us(delays_.Percentile(99.9)) << ", max " << us(delays_.Max())
+                  << ", jitter " << us(Jitter()) << std::endl;
+        if (min_ < 0)
+        {
+            std::cout << "Negative one-way delays, the clocks of client and server are not synchronised" << std::endl;
+        }
+    }
+
+private:
+    LatencyRecorder delays_;
+    int64_t min_ = std::numeric_limits<int64_t>::max();
+    int64_t last_delay_ = 0;
+    double jitter_ = 0;
+};
+
+#endif //MEASURE_TRANSFER_LATENCY_H
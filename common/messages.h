@@ -5,8 +5,14 @@
 #ifndef MEASURE_TRANSFER_MESSAGES_H
 #define MEASURE_TRANSFER_MESSAGES_H
 
+#include <chrono>
+
 #include <boost/array.hpp>
 
+#include "congestion.h"
+#include "fec.h"
+#include "payload.h"
+#include "socket_options.h"
 #include "types.h"
 #include "utils.h"
 
@@ -14,6 +20,7 @@ const std::size_t kMaxMessageSize = 65535;
 
 const std::size_t kMessageTagSize = 1;
 const std::size_t kMessageNoSize = 4;
+const std::size_t kMessageSizeSize = 4;
 
 /**
  * Messages have the following format:
@@ -27,18 +34,41 @@ enum class MessageTag : int8_t
     kHelloMessage = 0,
     kGoodbyeMessage = 1,
     kDataMessage = 2,
-    kAcknowledgeMessage = 3
+    kAcknowledgeMessage = 3,
+    kSocketOptionsMessage = 4,
+    kPayloadMessage = 5,
+    kEndOfTestMessage = 6,
+    kTestStatsMessage = 7,
+    kResponseMessage = 8,
+    kParityMessage = 9
 };
 
 /**
  * Hello Message format:
- * Format: | MessageTag | Protocol | CommunicationMechanism | MessageSize |
- * Index:  |     0      |    1     |           2            |     3       |
- * Size:   |   1byte    |  1byte   |         1byte          |   4byte     |
+ * Format: | MessageTag | Protocol | CommunicationMechanism | MessageSize | IoBackend | IoUringFlags | BatchSize | UdpFlags | SocketOptions | TcpInfoInterval | VerifyPayload | SendTimestamps | ReuseDataConnection | ResponseSize | FecOptions | UdpCongestionControl |
+ * Index:  |     0      |    1     |           2            |     3       |     7     |      8       |     9     |    11    |      12       |       27        |      29       |       30       |         31          |      32      |     36     |          39          |
+ * Size:   |   1byte    |  1byte   |         1byte          |   4bytes    |   1byte   |    1byte     |   2bytes  |  1byte   |    15bytes    |     2bytes      |    1byte      |     1byte      |        1byte        |    4bytes    |   3bytes   |        1byte         |
+ * TcpInfoInterval is the TCP_INFO sampling period in milliseconds, 0 disables sampling.
+ * VerifyPayload set means a PayloadMessage follows the HelloMessage.
+ * SendTimestamps set means every DataMessage of the session carries its send time.
+ * ReuseDataConnection set asks to run the test over the data connection kept
+ * from the previous test of the session and to keep it for the next one, see
+ * ReusesDataConnection().
+ * ResponseSize is the data size of every ResponseMessage of a request/response
+ * test, the requests being MessageSize; other mechanisms ignore it.
+ * FecOptions protect a UDP streaming test with ParityMessages, see FecEncoder;
+ * other tests ignore them.
+ * UdpCongestionControl other than none makes a UDP streaming test reliable:
+ * the server acknowledges every DataMessage and the client retransmits the
+ * lost ones, sending under the window and pacing rate of the controller.
  */
 struct HelloMessage
 {
-    static const std::size_t kSize = kMessageTagSize + kProtocolSize + kCommunicationMechanismSize + sizeof(std::size_t);
+    static const std::size_t kSize = kMessageTagSize + kProtocolSize + kCommunicationMechanismSize + kMessageSizeSize
+                                   + kIoBackendSize + kIoUringFlagsSize + kBatchSizeSize + kUdpFlagsSize + SocketOptions::kSize
+                                   + kTcpInfoIntervalSize + kVerifyPayloadSize + kSendTimestampsSize
+                                   + kReuseDataConnectionSize + kResponseSizeSize + FecOptions::kSize
+                                   + kUdpCongestionControlSize;
     using Buffer = boost::array<uint8_t, kSize>;
 
     static HelloMessage Decode(const Buffer& buffer)
@@ -50,7 +80,19 @@ struct HelloMessage
 
         return { static_cast<Protocol>(buffer[1]),
                  static_cast<CommunicationMechanism>(buffer[2]),
-                 FromBytes(&buffer[3]) };
+                 FromBytes(&buffer[3]),
+                 static_cast<IoBackend>(buffer[7]),
+                 buffer[8],
+                 static_cast<uint16_t>((buffer[9] << 8) | buffer[10]),
+                 buffer[11],
+                 SocketOptions::Decode(&buffer[12]),
+                 static_cast<uint16_t>((buffer[27] << 8) | buffer[28]),
+                 buffer[29] != 0,
+                 buffer[30] != 0,
+                 buffer[31] != 0,
+                 FromBytes(&buffer[32]),
+                 FecOptions::Decode(&buffer[36]),
+                 static_cast<UdpCongestionControl>(buffer[39]) };
     }
 
     static Buffer Encode(const HelloMessage& message)
@@ -64,6 +106,20 @@ struct HelloMessage
         buffer[4] = static_cast<uint8_t>((message.message_size >> 16) & 0xFF);
         buffer[5] = static_cast<uint8_t>((message.message_size >> 8) & 0xFF);
         buffer[6] = static_cast<uint8_t>(message.message_size & 0xFF);
+        buffer[7] = static_cast<uint8_t>(message.io_backend);
+        buffer[8] = message.io_uring_flags;
+        buffer[9] = static_cast<uint8_t>((message.batch_size >> 8) & 0xFF);
+        buffer[10] = static_cast<uint8_t>(message.batch_size & 0xFF);
+        buffer[11] = message.udp_flags;
+        SocketOptions::Encode(message.socket_options, &buffer[12]);
+        buffer[27] = static_cast<uint8_t>((message.tcp_info_interval_ms >> 8) & 0xFF);
+        buffer[28] = static_cast<uint8_t>(message.tcp_info_interval_ms & 0xFF);
+        buffer[29] = message.verify_payload ? 1 : 0;
+        buffer[30] = message.send_timestamps ? 1 : 0;
+        buffer[31] = message.reuse_data_connection ? 1 : 0;
+        ToBytes(message.response_size, &buffer[32]);
+        FecOptions::Encode(message.fec, &buffer[36]);
+        buffer[39] = static_cast<uint8_t>(message.udp_congestion_control);
 
         return buffer;
     }
@@ -72,6 +128,130 @@ struct HelloMessage
     Protocol protocol;
     CommunicationMechanism communication_mechanism;
     std::size_t message_size;
+    IoBackend io_backend;
+    uint8_t io_uring_flags;
+    uint16_t batch_size;
+    uint8_t udp_flags;
+    SocketOptions socket_options;
+    uint16_t tcp_info_interval_ms;
+    bool verify_payload;
+    bool send_timestamps;
+    bool reuse_data_connection;
+    uint32_t response_size;
+    FecOptions fec;
+    UdpCongestionControl udp_congestion_control;
+};
+
+// both ends decide alike whether a test runs over, and keeps, the data connection of the session
+bool ReusesDataConnection(const HelloMessage& message)
+{
+    return message.reuse_data_connection && message.protocol == Protocol::kTcp && message.io_backend == IoBackend::kAsio;
+}
+
+/**
+ * Payload Message format, sent by the client right after a HelloMessage that
+ * asks for payload verification, so the server can regenerate every payload:
+ * Format: | MessageTag | PayloadMode | Seed | PoolSize | TextSize |   Text   |
+ * Index:  |     0      |      1      |  2   |    10    |    14    |    16    |
+ * Size:   |   1byte    |    1byte    |8bytes|  4bytes  |  2bytes  | TextSize |
+ * Text is the pattern in pattern mode and the corpus path in corpus mode.
+ */
+struct PayloadMessage
+{
+    static const std::size_t kHeaderSize = 16;
+    using HeaderBuffer = boost::array<uint8_t, kHeaderSize>;
+
+    static std::size_t TextSize(const HeaderBuffer& header)
+    {
+        if (header[0] != static_cast<uint8_t>(MessageTag::kPayloadMessage))
+        {
+            throw std::invalid_argument("Buffer doesn't contain a PayloadMessage");
+        }
+
+        return static_cast<std::size_t>((header[14] << 8) | header[15]);
+    }
+
+    static PayloadMessage Decode(const HeaderBuffer& header, const std::string& text)
+    {
+        PayloadOptions options;
+        options.mode = static_cast<PayloadMode>(header[1]);
+        options.seed = 0;
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            options.seed = (options.seed << 8) | header[2 + i];
+        }
+        options.pool_size = FromBytes(&header[10]);
+
+        if (options.mode == PayloadMode::kPattern)
+        {
+            options.pattern = text;
+        }
+        else if (options.mode == PayloadMode::kCorpus)
+        {
+            options.corpus_path = text;
+        }
+
+        return { options };
+    }
+
+    static std::vector<uint8_t> Encode(const PayloadMessage& message)
+    {
+        const auto& options = message.payload_options;
+        const std::string& text = options.mode == PayloadMode::kCorpus ? options.corpus_path : options.pattern;
+        auto text_size = std::min<std::size_t>(text.size(), UINT16_MAX);
+
+        std::vector<uint8_t> buffer(kHeaderSize + text_size);
+        buffer[0] = static_cast<uint8_t>(MessageTag::kPayloadMessage);
+        buffer[1] = static_cast<uint8_t>(options.mode);
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            buffer[2 + i] = static_cast<uint8_t>((options.seed >> (56 - 8 * i)) & 0xFF);
+        }
+        ToBytes(options.pool_size, &buffer[10]);
+        buffer[14] = static_cast<uint8_t>((text_size >> 8) & 0xFF);
+        buffer[15] = static_cast<uint8_t>(text_size & 0xFF);
+        std::copy_n(text.begin(), text_size, buffer.begin() + kHeaderSize);
+
+        return buffer;
+    }
+
+    // data members
+    PayloadOptions payload_options;
+};
+
+/**
+ * Socket Options Message format, sent by the server right after the
+ * AcknowledgeMessage of a HelloMessage with the options granted by the kernel:
+ * Format: | MessageTag | SocketOptions |
+ * Index:  |     0      |       1       |
+ * Size:   |   1byte    |    15bytes    |
+ */
+struct SocketOptionsMessage
+{
+    static const std::size_t kSize = kMessageTagSize + SocketOptions::kSize;
+    using Buffer = boost::array<uint8_t, kSize>;
+
+    static SocketOptionsMessage Decode(const Buffer& buffer)
+    {
+        if (buffer[0] != static_cast<uint8_t>(MessageTag::kSocketOptionsMessage))
+        {
+            throw std::invalid_argument("Buffer doesn't contain a SocketOptionsMessage");
+        }
+
+        return { SocketOptions::Decode(&buffer[1]) };
+    }
+
+    static Buffer Encode(const SocketOptionsMessage& message)
+    {
+        Buffer buffer;
+        buffer[0] = static_cast<uint8_t>(MessageTag::kSocketOptionsMessage);
+        SocketOptions::Encode(message.socket_options, &buffer[1]);
+
+        return buffer;
+    }
+
+    // data members
+    SocketOptions socket_options;
 };
 
 /**
@@ -103,6 +283,107 @@ struct GoodbyeMessage
     }
 };
 
+/**
+ * End Of Test Message format, sent by the client after the transfer of every
+ * test of a session on the control connection, and in place of a DataMessage
+ * header on a data connection it keeps for the next test:
+ * Format: | MessageTag | NoOfMessages |
+ * Index:  |     0      |      1       |
+ * Size:   |   1byte    |    4bytes    |
+ * It is as long as a DataMessage header, so a receive loop reads it as one.
+ */
+struct EndOfTestMessage
+{
+    static const std::size_t kSize = kMessageTagSize + kMessageNoSize;
+    using Buffer = boost::array<uint8_t, kSize>;
+
+    static EndOfTestMessage Decode(const Buffer& buffer)
+    {
+        if (buffer[0] != static_cast<uint8_t>(MessageTag::kEndOfTestMessage))
+        {
+            throw std::invalid_argument("Buffer doesn't contain an EndOfTestMessage");
+        }
+
+        return { FromBytes(&buffer[1]) };
+    }
+
+    static Buffer Encode(const EndOfTestMessage& message)
+    {
+        Buffer buffer;
+        buffer[0] = static_cast<uint8_t>(MessageTag::kEndOfTestMessage);
+        ToBytes(message.no_of_messages, &buffer[1]);
+        return buffer;
+    }
+
+    // data members
+    uint32_t no_of_messages;
+};
+
+/**
+ * Test Stats Message format, the server's answer to an EndOfTestMessage on
+ * the control connection once the test's communicator has finished:
+ * Format: | MessageTag | NoOfReadMessages | NoOfReadBytes | NoOfSyscalls | NoOfLostMessages | NoOfReorderedMessages | CpuTime | NoOfRecoveredMessages | FecDecodeTime | FecDecodedBytes |
+ * Index:  |     0      |        1         |       5       |      9       |        17        |          21           |   25    |          33           |      37       |       45        |
+ * Size:   |   1byte    |      4bytes      |    4bytes     |    8bytes    |      4bytes      |        4bytes         | 8bytes  |        4bytes         |    8bytes     |     8bytes      |
+ * CpuTime is the user and system time of the communicator in nanoseconds.
+ * NoOfRecoveredMessages are the messages FEC rebuilt, NoOfLostMessages those
+ * still missing afterwards; FecDecodeTime in nanoseconds.
+ */
+struct TestStatsMessage
+{
+    static const std::size_t kSize = kMessageTagSize + 4 + 4 + 8 + 4 + 4 + 8 + 4 + 8 + 8;
+    using Buffer = boost::array<uint8_t, kSize>;
+
+    static TestStatsMessage Decode(const Buffer& buffer)
+    {
+        if (buffer[0] != static_cast<uint8_t>(MessageTag::kTestStatsMessage))
+        {
+            throw std::invalid_argument("Buffer doesn't contain a TestStatsMessage");
+        }
+
+        return { FromBytes(&buffer[1]),
+                 FromBytes(&buffer[5]),
+                 (static_cast<uint64_t>(FromBytes(&buffer[9])) << 32) | FromBytes(&buffer[13]),
+                 FromBytes(&buffer[17]),
+                 FromBytes(&buffer[21]),
+                 (static_cast<uint64_t>(FromBytes(&buffer[25])) << 32) | FromBytes(&buffer[29]),
+                 FromBytes(&buffer[33]),
+                 (static_cast<uint64_t>(FromBytes(&buffer[37])) << 32) | FromBytes(&buffer[41]),
+                 (static_cast<uint64_t>(FromBytes(&buffer[45])) << 32) | FromBytes(&buffer[49]) };
+    }
+
+    static Buffer Encode(const TestStatsMessage& message)
+    {
+        Buffer buffer;
+        buffer[0] = static_cast<uint8_t>(MessageTag::kTestStatsMessage);
+        ToBytes(message.no_of_read_messages, &buffer[1]);
+        ToBytes(message.no_of_read_bytes, &buffer[5]);
+        ToBytes(static_cast<uint32_t>(message.no_of_syscalls >> 32), &buffer[9]);
+        ToBytes(static_cast<uint32_t>(message.no_of_syscalls), &buffer[13]);
+        ToBytes(message.no_of_lost_messages, &buffer[17]);
+        ToBytes(message.no_of_reordered_messages, &buffer[21]);
+        ToBytes(static_cast<uint32_t>(message.cpu_time_ns >> 32), &buffer[25]);
+        ToBytes(static_cast<uint32_t>(message.cpu_time_ns), &buffer[29]);
+        ToBytes(message.no_of_recovered_messages, &buffer[33]);
+        ToBytes(static_cast<uint32_t>(message.fec_decode_time_ns >> 32), &buffer[37]);
+        ToBytes(static_cast<uint32_t>(message.fec_decode_time_ns), &buffer[41]);
+        ToBytes(static_cast<uint32_t>(message.no_of_fec_decoded_bytes >> 32), &buffer[45]);
+        ToBytes(static_cast<uint32_t>(message.no_of_fec_decoded_bytes), &buffer[49]);
+        return buffer;
+    }
+
+    // data members
+    uint32_t no_of_read_messages;
+    uint32_t no_of_read_bytes;
+    uint64_t no_of_syscalls;
+    uint32_t no_of_lost_messages;
+    uint32_t no_of_reordered_messages;
+    uint64_t cpu_time_ns;
+    uint32_t no_of_recovered_messages;
+    uint64_t fec_decode_time_ns;
+    uint64_t no_of_fec_decoded_bytes;
+};
+
 /**
  * Data Messages format:
  * Format: | MessageTag | MessageNo |  Data  |
@@ -147,6 +428,84 @@ struct DataMessage
     std::vector<uint8_t> data;
 };
 
+/**
+ * Data Messages of a session that negotiated send timestamps:
+ * Format: | MessageTag | MessageNo | SendTime |  Data  |
+ * Index:  |     0      |     1     |    5     |   13   |
+ * Size:   |   1byte    |   4bytes  |  8bytes  | Nbytes |
+ * SendTime is the client's realtime clock in nanoseconds since the epoch,
+ * comparable with the server's on the same host or under PTP. Receivers frame
+ * it as the first kSendTimeSize bytes of the data, so every receive loop reads
+ * these messages unchanged, only with a larger message size.
+ */
+struct TimestampedDataMessage
+{
+    static const std::size_t kSize = DataMessage::kSize + kSendTimeSize;
+    using Buffer = boost::array<uint8_t, kSize>;
+
+    static void Encode(uint32_t message_no, int64_t send_time, Buffer& buffer)
+    {
+        buffer[0] = static_cast<uint8_t>(MessageTag::kDataMessage);
+        ToBytes(message_no, &buffer[1]);
+        ToBytes(static_cast<uint32_t>(static_cast<uint64_t>(send_time) >> 32), &buffer[5]);
+        ToBytes(static_cast<uint32_t>(send_time), &buffer[9]);
+    }
+
+    // data points to the data as framed by a receive loop, i.e. at the send time
+    static int64_t SendTime(const uint8_t* data)
+    {
+        return static_cast<int64_t>((static_cast<uint64_t>(FromBytes(data)) << 32) | FromBytes(data + 4));
+    }
+};
+
+/**
+ * Parity Messages format, the datagrams a UDP streaming test with FEC sends
+ * after the DataMessages of every group:
+ * Format: | MessageTag | GroupNo | ParityIndex | NoOfDataShards |  Data  |
+ * Index:  |     0      |    1    |      5      |       6        |   7    |
+ * Size:   |   1byte    | 4bytes  |    1byte    |     1byte      | Nbytes |
+ * Group g is made of the DataMessages g * k to g * k + NoOfDataShards - 1,
+ * NoOfDataShards being k but for a last group cut short. Data is parity shard
+ * ParityIndex over the data of those DataMessages, i.e. everything after
+ * their MessageNo, so N is the data size of the DataMessages.
+ */
+struct ParityMessage
+{
+    static const std::size_t kSize = kMessageTagSize + 4 + 1 + 1;
+    using Buffer = boost::array<uint8_t, kSize>;
+
+    static ParityMessage Decode(const uint8_t* buffer)
+    {
+        if (buffer[0] != static_cast<uint8_t>(MessageTag::kParityMessage))
+        {
+            throw std::invalid_argument("Buffer doesn't contain a ParityMessage");
+        }
+
+        return { FromBytes(&buffer[1]), buffer[5], buffer[6] };
+    }
+
+    static Buffer Encode(const ParityMessage& message)
+    {
+        Buffer buffer;
+        buffer[0] = static_cast<uint8_t>(MessageTag::kParityMessage);
+        ToBytes(message.group_no, &buffer[1]);
+        buffer[5] = message.parity_index;
+        buffer[6] = message.no_of_data_shards;
+
+        return buffer;
+    }
+
+    // data members
+    uint32_t group_no;
+    uint8_t parity_index;
+    uint8_t no_of_data_shards;
+};
+
+int64_t RealtimeNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
 /**
  * Acknowledge Messages format:
  * Format: | MessageTag | MessageNo |
@@ -184,4 +543,39 @@ struct AcknowledgeMessage
     uint32_t message_no;
 };
 
+/**
+ * Response Messages format, the server's answer to the DataMessage of the
+ * same number in a request/response test:
+ * Format: | MessageTag | MessageNo |  Data  |
+ * Index:  |     0      |     1     |   5    |
+ * Size:   |   1byte    |   4bytes  | Rbytes |, R the ResponseSize of the HelloMessage
+ */
+struct ResponseMessage
+{
+    static const std::size_t kSize = kMessageTagSize + kMessageNoSize;
+    using Buffer = boost::array<uint8_t, kSize>;
+
+    static ResponseMessage Decode(const Buffer& buffer)
+    {
+        if (buffer[0] != static_cast<uint8_t>(MessageTag::kResponseMessage))
+        {
+            throw std::invalid_argument("Buffer doesn't contain a ResponseMessage");
+        }
+
+        return { FromBytes(&buffer[1]) };
+    }
+
+    static Buffer Encode(const ResponseMessage& message)
+    {
+        Buffer buffer;
+        buffer[0] = static_cast<uint8_t>(MessageTag::kResponseMessage);
+        ToBytes(message.message_no, &buffer[1]);
+
+        return buffer;
+    }
+
+    // data members
+    uint32_t message_no;
+};
+
 #endif //MEASURE_TRANSFER_MESSAGES_H
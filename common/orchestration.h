@@ -0,0 +1,258 @@
+#ifndef MEASURE_TRANSFER_ORCHESTRATION_H
+#define MEASURE_TRANSFER_ORCHESTRATION_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "messages.h"
+
+// next to the server's control port 4991 and the load generator's 4992
+const uint16_t kAgentPort = 4993;
+
+/**
+ * Agent control protocol: one text line per message on a TCP connection from
+ * the controller to an agent, one connection per process the agent runs.
+ * Controller -> agent:
+ *   RUN <Token> <client|server> <StartTime> <argument> ...   starts the Client or Server binary at StartTime
+ *   STOP                                                     sends SIGTERM to the process; a server drains its sessions
+ * Agent -> controller:
+ *   STARTED <pid>
+ *   LINE <output line>                                       the process' Interval:, Result: and Sessions: lines
+ *   EXIT <status>                                            the exit status, 128 + signal if killed; the agent closes the connection
+ *   ERROR <reason>
+ * Token is the secret the agent was started with, a RUN without it is refused.
+ * It reaches the agent and the controller through kTokenVariable or a token
+ * file, never their command line, which /proc shows to every user.
+ * StartTime is in realtime nanoseconds since the epoch, 0 starts at once.
+ * Arguments are separated by single spaces, so they cannot contain any. An
+ * agent only passes on the arguments on its allowlist: none naming a file,
+ * since whoever holds the token could otherwise write anywhere the agent can.
+ * A bad command is answered with ERROR and leaves the connection usable.
+ */
+const std::string kRunCommand = "RUN";
+const std::string kStopCommand = "STOP";
+const std::string kStartedReply = "STARTED";
+const std::string kLineReply = "LINE";
+const std::string kExitReply = "EXIT";
+const std::string kErrorReply = "ERROR";
+
+const char* const kTokenVariable = "MEASURE_TRANSFER_TOKEN";
+
+// the first line of a file only its owner can access, empty if the file is missing or open to others
+std::string ReadTokenFile(const std::string& path)
+{
+    struct stat status{};
+    if (stat(path.c_str(), &status) != 0)
+    {
+        std::cerr << "Cannot read the token file " << path << std::endl;
+        return {};
+    }
+
+    if (status.st_mode & (S_IRWXG | S_IRWXO))
+    {
+        std::cerr << "The token file " << path << " must only be accessible by its owner (chmod 600)" << std::endl;
+        return {};
+    }
+
+    std::ifstream file(path);
+    std::string token;
+    std::getline(file, token);
+    return token;
+}
+
+// takes the token out of the environment, so the processes started later do not inherit it
+std::string TakeTokenVariable()
+{
+    const char* value = getenv(kTokenVariable);
+    std::string token = value != nullptr ? value : "";
+    unsetenv(kTokenVariable);
+    return token;
+}
+
+// where the agent and the controller find the Client, Server and Agent binaries unless told otherwise
+std::string ExecutableDirectory()
+{
+    char path[PATH_MAX];
+    auto length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0)
+    {
+        return ".";
+    }
+
+    std::string executable(path, static_cast<std::size_t>(length));
+    return executable.substr(0, executable.rfind('/'));
+}
+
+// markers of the output lines an agent forwards, found anywhere in a line since the client's threads share stdout
+const std::string kIntervalMarker = "Interval: ";
+const std::string kResultMarker = "Result: ";
+const std::string kSessionsMarker = "Sessions: ";
+
+std::vector<std::string> SplitWords(const std::string& line)
+{
+    std::vector<std::string> words;
+    std::istringstream fields(line);
+    std::string word;
+    while (fields >> word)
+    {
+        words.push_back(word);
+    }
+    return words;
+}
+
+// counted on the sending thread, read by the reporting one
+struct TransferProgress
+{
+    std::atomic<uint64_t> no_of_messages{0};
+    std::atomic<uint64_t> no_of_bytes{0};
+};
+
+/**
+ * Interval report, one line per interval on the reporting process' stdout:
+ * Format: Interval: time=<Time> length=<Length> messages=<Messages> bytes=<Bytes>
+ * Time is the start of the interval in realtime nanoseconds since the epoch
+ * and a multiple of Length, so the intervals of every process whose clock is
+ * synchronised (same host, or PTP) line up and can be summed. Messages and
+ * bytes are those handed to the transport during the interval.
+ */
+struct IntervalReport
+{
+    int64_t time;
+    int64_t length;
+    uint64_t no_of_messages;
+    uint64_t no_of_bytes;
+};
+
+std::string FormatIntervalReport(const IntervalReport& report)
+{
+    std::ostringstream os;
+    os << kIntervalMarker << "time=" << report.time << " length=" << report.length << " messages=" << report.no_of_messages
+       << " bytes=" << report.no_of_bytes;
+    return os.str();
+}
+
+bool ParseIntervalReport(const std::string& line, IntervalReport& report)
+{
+    auto marker = line.find(kIntervalMarker);
+    if (marker == std::string::npos)
+    {
+        return false;
+    }
+
+    report = {};
+    int found = 0;
+    for (const auto& field : SplitWords(line.substr(marker + kIntervalMarker.size())))
+    {
+        auto value = field.substr(field.find('=') + 1);
+        if (field.rfind("time=", 0) == 0)
+        {
+            report.time = std::stoll(value);
+            found++;
+        }
+        else if (field.rfind("length=", 0) == 0)
+        {
+            report.length = std::stoll(value);
+            found++;
+        }
+        else if (field.rfind("messages=", 0) == 0)
+        {
+            report.no_of_messages = std::stoull(value);
+            found++;
+        }
+        else if (field.rfind("bytes=", 0) == 0)
+        {
+            report.no_of_bytes = std::stoull(value);
+            found++;
+        }
+    }
+    return found == 4 && report.length > 0;
+}
+
+/**
+ * Prints an interval report of the transfer progress at every multiple of the
+ * interval on the realtime clock, from a thread of its own, until stopped.
+ * The first and the last interval are partial.
+ */
+class ProgressReporter
+{
+public:
+    ProgressReporter(std::shared_ptr<TransferProgress> progress, std::chrono::milliseconds interval)
+        : progress_{std::move(progress)}
+        , length_{std::chrono::duration_cast<std::chrono::nanoseconds>(std::max(interval, std::chrono::milliseconds(1))).count()}
+        , stopped_{false}
+    {}
+
+    ~ProgressReporter()
+    {
+        Stop();
+    }
+
+    void Start()
+    {
+        thread_ = std::thread([this]() { Run(); });
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopped_ = true;
+        }
+        condition_.notify_all();
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+    }
+
+private:
+    void Run()
+    {
+        int64_t start = RealtimeNow() / length_ * length_;
+        uint64_t no_of_messages = 0;
+        uint64_t no_of_bytes = 0;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        bool last = false;
+        while (!last)
+        {
+            auto end = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                std::chrono::nanoseconds(start + length_)));
+            last = condition_.wait_until(lock, end, [this]() { return stopped_; });
+
+            auto messages = progress_->no_of_messages.load(std::memory_order_relaxed);
+            auto bytes = progress_->no_of_bytes.load(std::memory_order_relaxed);
+            // a single write, so the line is not torn by the transfer thread's output
+            std::cout << FormatIntervalReport({ start, length_, messages - no_of_messages, bytes - no_of_bytes }) + "\n" << std::flush;
+
+            no_of_messages = messages;
+            no_of_bytes = bytes;
+            start += length_;
+        }
+    }
+
+private:
+    std::shared_ptr<TransferProgress> progress_;
+    int64_t length_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stopped_;
+};
+
+#endif //MEASURE_TRANSFER_ORCHESTRATION_H
@@ -0,0 +1,485 @@
+#ifndef MEASURE_TRANSFER_PAYLOAD_H
+#define MEASURE_TRANSFER_PAYLOAD_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <immintrin.h>
+
+enum class PayloadMode : uint8_t
+{
+    kZeros = 0,
+    // a short text repeated over the whole payload
+    kPattern = 1,
+    // incompressible bytes from a xoshiro256** generator
+    kRandom = 2,
+    // bytes sampled from a file, to send data that looks like the real one
+    kCorpus = 3
+};
+
+std::ostream& operator<<(std::ostream& os, const PayloadMode& payload_mode)
+{
+    switch (payload_mode)
+    {
+        case PayloadMode::kZeros:
+            os << "zeros";
+            break;
+        case PayloadMode::kPattern:
+            os << "pattern";
+            break;
+        case PayloadMode::kRandom:
+            os << "random";
+            break;
+        case PayloadMode::kCorpus:
+            os << "corpus";
+            break;
+        default:
+            os << "Unknown PayloadMode";
+            break;
+    }
+
+    return os;
+}
+
+PayloadMode PayloadModeFromName(const std::string& name)
+{
+    if (name == "zeros")
+    {
+        return PayloadMode::kZeros;
+    }
+
+    if (name == "pattern")
+    {
+        return PayloadMode::kPattern;
+    }
+
+    if (name == "random")
+    {
+        return PayloadMode::kRandom;
+    }
+
+    if (name == "corpus")
+    {
+        return PayloadMode::kCorpus;
+    }
+
+    throw std::invalid_argument("Unknown payload mode " + name);
+}
+
+struct PayloadOptions
+{
+    PayloadMode mode = PayloadMode::kZeros;
+    std::string pattern = "MeasureTransfer";
+    std::string corpus_path;
+    uint64_t seed = 1;
+    // distinct payloads, message n carries payload n % pool_size
+    uint32_t pool_size = 64;
+};
+
+/**
+ * xoshiro256** run as four independent streams whose outputs are interleaved
+ * 8 bytes at a time, so that four 64 bit lanes of an AVX2 register advance in
+ * one step. The scalar fallback produces the same bytes, the output only
+ * depends on the seed and the stream number.
+ */
+class Xoshiro256x4
+{
+public:
+    static constexpr std::size_t kLanes = 4;
+    static constexpr std::size_t kBlockSize = kLanes * sizeof(uint64_t);
+
+    Xoshiro256x4(uint64_t seed, uint64_t stream)
+    {
+        // splitmix64 expands the seed into the 16 state words, as recommended by the xoshiro authors
+        uint64_t x = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+        for (std::size_t word = 0; word < 4; ++word)
+        {
+            for (std::size_t lane = 0; lane < kLanes; ++lane)
+            {
+                x += 0x9E3779B97F4A7C15ULL;
+                uint64_t z = x;
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                state_[word][lane] = z ^ (z >> 31);
+            }
+        }
+    }
+
+    void Fill(uint8_t* data, std::size_t size)
+    {
+        std::size_t blocks = size / kBlockSize;
+        if (__builtin_cpu_supports("avx2"))
+        {
+            FillAvx2(data, blocks);
+        }
+        else
+        {
+            FillScalar(data, blocks);
+        }
+
+        std::size_t tail = size - blocks * kBlockSize;
+        if (tail > 0)
+        {
+            uint8_t block[kBlockSize];
+            FillScalar(block, 1);
+            std::memcpy(data + blocks * kBlockSize, block, tail);
+        }
+    }
+
+private:
+    static uint64_t Rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    void FillScalar(uint8_t* data, std::size_t blocks)
+    {
+        auto& s = state_;
+        for (std::size_t block = 0; block < blocks; ++block)
+        {
+            for (std::size_t lane = 0; lane < kLanes; ++lane)
+            {
+                uint64_t result = Rotl(s[1][lane] * 5, 7) * 9;
+                uint64_t t = s[1][lane] << 17;
+                s[2][lane] ^= s[0][lane];
+                s[3][lane] ^= s[1][lane];
+                s[1][lane] ^= s[2][lane];
+                s[0][lane] ^= s[3][lane];
+                s[2][lane] ^= t;
+                s[3][lane] = Rotl(s[3][lane], 45);
+                std::memcpy(data + block * kBlockSize + lane * sizeof(uint64_t), &result, sizeof(result));
+            }
+        }
+    }
+
+    __attribute__((target("avx2"))) void FillAvx2(uint8_t* data, std::size_t blocks)
+    {
+        __m256i s0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state_[0]));
+        __m256i s1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state_[1]));
+        __m256i s2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state_[2]));
+        __m256i s3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state_[3]));
+
+        for (std::size_t block = 0; block < blocks; ++block)
+        {
+            // AVX2 has no 64 bit multiply, x * 5 and x * 9 are shifts and adds
+            __m256i times5 = _mm256_add_epi64(s1, _mm256_slli_epi64(s1, 2));
+            __m256i rotated = _mm256_or_si256(_mm256_slli_epi64(times5, 7), _mm256_srli_epi64(times5, 57));
+            __m256i result = _mm256_add_epi64(rotated, _mm256_slli_epi64(rotated, 3));
+
+            __m256i t = _mm256_slli_epi64(s1, 17);
+            s2 = _mm256_xor_si256(s2, s0);
+            s3 = _mm256_xor_si256(s3, s1);
+            s1 = _mm256_xor_si256(s1, s2);
+            s0 = _mm256_xor_si256(s0, s3);
+            s2 = _mm256_xor_si256(s2, t);
+            s3 = _mm256_or_si256(_mm256_slli_epi64(s3, 45), _mm256_srli_epi64(s3, 19));
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + block * kBlockSize), result);
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(state_[0]), s0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(state_[1]), s1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(state_[2]), s2);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(state_[3]), s3);
+    }
+
+private:
+    // state_[word][lane]
+    uint64_t state_[4][kLanes];
+};
+
+/**
+ * The payloads of a run, generated before the first message is sent so the
+ * send loops only ever reference them. Payload k is a pure function of the
+ * options and k, so a receiver can regenerate what it should have received.
+ */
+class PayloadPool
+{
+public:
+    static constexpr std::size_t kMaxPoolBytes = 256 * 1024 * 1024;
+
+    PayloadPool(const PayloadOptions& options, std::size_t message_size)
+        : options_(options)
+        , generation_time_{0}
+    {
+        // identical payloads need no more than one buffer
+        bool identical = options_.mode == PayloadMode::kZeros || options_.mode == PayloadMode::kPattern;
+        std::size_t pool_size = identical ? 1 : std::max<std::size_t>(options_.pool_size, 1);
+        pool_size = std::max<std::size_t>(1, std::min(pool_size, kMaxPoolBytes / std::max<std::size_t>(message_size, 1)));
+
+        std::vector<uint8_t> corpus;
+        if (options_.mode == PayloadMode::kCorpus)
+        {
+            corpus = ReadCorpus(options_.corpus_path, pool_size * std::max<std::size_t>(message_size, 1));
+        }
+
+        // allocated and faulted in first, so the reported rate is the generator's own
+        payloads_.assign(pool_size, std::vector<uint8_t>(message_size, 0));
+
+        auto start_time = std::chrono::steady_clock::now();
+        for (std::size_t k = 0; k < pool_size; ++k)
+        {
+            Generate(k, corpus, payloads_[k].data(), message_size);
+        }
+        generation_time_ = std::chrono::steady_clock::now() - start_time;
+    }
+
+    const std::vector<uint8_t>& Payload(uint32_t message_no) const
+    {
+        return payloads_[message_no % payloads_.size()];
+    }
+
+    std::size_t Size() const
+    {
+        return payloads_.size();
+    }
+
+    // generator throughput, 0 when the pool was too small to time
+    double GeneratorGbps() const
+    {
+        std::size_t bytes = payloads_.size() * payloads_.front().size();
+        return generation_time_.count() > 0 ? static_cast<double>(bytes) / generation_time_.count() : 0;
+    }
+
+    void Print() const
+    {
+        std::cout << "Payload: " << options_.mode << ", " << payloads_.size() << " distinct buffers of " << payloads_.front().size()
+                  << " bytes, generated at " << GeneratorGbps() << " GB/s" << std::endl;
+    }
+
+private:
+    void Generate(std::size_t k, const std::vector<uint8_t>& corpus, uint8_t* data, std::size_t size) const
+    {
+        switch (options_.mode)
+        {
+            case PayloadMode::kZeros:
+            {
+                std::fill(data, data + size, 0);
+                break;
+            }
+            case PayloadMode::kPattern:
+            {
+                // one copy of the pattern, then the filled prefix doubles until the payload is full
+                const std::string& pattern = options_.pattern.empty() ? std::string(1, '\0') : options_.pattern;
+                std::size_t filled = std::min(size, pattern.size());
+                std::memcpy(data, pattern.data(), filled);
+                while (filled < size)
+                {
+                    std::size_t run = std::min(filled, size - filled);
+                    std::memcpy(data + filled, data, run);
+                    filled += run;
+                }
+                break;
+            }
+            case PayloadMode::kRandom:
+            {
+                Xoshiro256x4 generator(options_.seed, k);
+                generator.Fill(data, size);
+                break;
+            }
+            case PayloadMode::kCorpus:
+            {
+                // consecutive payloads continue where the previous one stopped, wrapping around the corpus
+                std::size_t offset = (k * size) % corpus.size();
+                for (std::size_t i = 0; i < size;)
+                {
+                    std::size_t run = std::min(size - i, corpus.size() - offset);
+                    std::memcpy(data + i, corpus.data() + offset, run);
+                    i += run;
+                    offset = 0;
+                }
+                break;
+            }
+        }
+    }
+
+    static std::vector<uint8_t> ReadCorpus(const std::string& path, std::size_t max_size)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            throw std::runtime_error("Cannot open payload corpus " + path);
+        }
+
+        std::vector<uint8_t> corpus;
+        corpus.reserve(std::min<std::size_t>(max_size, kMaxPoolBytes));
+        std::istreambuf_iterator<char> it(file);
+        for (; it != std::istreambuf_iterator<char>() && corpus.size() < max_size; ++it)
+        {
+            corpus.push_back(static_cast<uint8_t>(*it));
+        }
+
+        if (corpus.empty())
+        {
+            throw std::runtime_error("Payload corpus " + path + " is empty");
+        }
+
+        return corpus;
+    }
+
+private:
+    PayloadOptions options_;
+    std::vector<std::vector<uint8_t>> payloads_;
+    std::chrono::nanoseconds generation_time_;
+};
+
+/**
+ * Checks received payloads against the pool the sender generated, rebuilt
+ * here from the same options. Comparison runs 128 bytes per step with AVX2,
+ * 16 with SSE2 otherwise, so checking keeps up with the transfer; the first
+ * mismatches are logged with their offset, the rest only counted.
+ */
+class PayloadVerifier
+{
+public:
+    static const uint32_t kMaxLoggedMismatches = 10;
+
+    PayloadVerifier(const PayloadOptions& options, std::size_t message_size)
+        : pool_(options, message_size)
+        , no_of_verified_messages_{0}
+        , no_of_corrupted_messages_{0}
+        , compare_gbps_{0}
+    {
+        // time a pass over the whole pool once, the hot path carries no clock reads
+        auto start_time = std::chrono::steady_clock::now();
+        std::size_t bytes = 0;
+        for (uint32_t k = 0; k < pool_.Size(); ++k)
+        {
+            const auto& payload = pool_.Payload(k);
+            bytes += FirstMismatch(payload.data(), payload.data(), payload.size());
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time);
+        compare_gbps_ = elapsed.count() > 0 ? static_cast<double>(bytes) / elapsed.count() : 0;
+    }
+
+    // returns false if the payload differs from the one generated for message_no
+    bool Check(uint32_t message_no, const uint8_t* data, std::size_t size)
+    {
+        no_of_verified_messages_++;
+
+        const auto& expected = pool_.Payload(message_no);
+        std::size_t length = std::min(size, expected.size());
+        std::size_t offset = FirstMismatch(expected.data(), data, length);
+        if (offset == length && size == expected.size())
+        {
+            return true;
+        }
+
+        if (++no_of_corrupted_messages_ <= kMaxLoggedMismatches)
+        {
+            std::cout << "Payload mismatch in message " << message_no << " at offset " << offset;
+            if (offset < length)
+            {
+                std::cout << ": expected 0x" << std::hex << static_cast<int>(expected[offset]) << ", received 0x"
+                          << static_cast<int>(data[offset]) << std::dec;
+            }
+            else
+            {
+                std::cout << ": received " << size << " of " << expected.size() << " bytes";
+            }
+            std::cout << std::endl;
+        }
+
+        return false;
+    }
+
+    void Print() const
+    {
+        std::cout << "# verified messages: " << no_of_verified_messages_ << std::endl;
+        std::cout << "# corrupted messages: " << no_of_corrupted_messages_ << std::endl;
+        std::cout << "Verifier compare rate: " << compare_gbps_ << " GB/s" << std::endl;
+    }
+
+    uint64_t NoOfCorruptedMessages() const
+    {
+        return no_of_corrupted_messages_;
+    }
+
+    // offset of the first differing byte, size if there is none
+    static std::size_t FirstMismatch(const uint8_t* expected, const uint8_t* received, std::size_t size)
+    {
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return FirstMismatchAvx2(expected, received, size);
+        }
+
+        return FirstMismatchSse2(expected, received, size);
+    }
+
+private:
+    static std::size_t FirstMismatchScalar(const uint8_t* expected, const uint8_t* received, std::size_t size)
+    {
+        std::size_t i = 0;
+        while (i < size && expected[i] == received[i])
+        {
+            ++i;
+        }
+        return i;
+    }
+
+    static std::size_t FirstMismatchSse2(const uint8_t* expected, const uint8_t* received, std::size_t size)
+    {
+        std::size_t i = 0;
+        for (; i + 16 <= size; i += 16)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(expected + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(received + i));
+            auto equal = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)));
+            if (equal != 0xFFFF)
+            {
+                return i + __builtin_ctz(~equal);
+            }
+        }
+
+        return i + FirstMismatchScalar(expected + i, received + i, size - i);
+    }
+
+    __attribute__((target("avx2"))) static __m256i Load(const uint8_t* p)
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    }
+
+    __attribute__((target("avx2"))) static std::size_t FirstMismatchAvx2(const uint8_t* expected, const uint8_t* received, std::size_t size)
+    {
+        std::size_t i = 0;
+        for (; i + 128 <= size; i += 128)
+        {
+            // one test for four vectors; only a block that differs is searched
+            __m256i diff = _mm256_or_si256(_mm256_or_si256(_mm256_xor_si256(Load(expected + i), Load(received + i)),
+                                                           _mm256_xor_si256(Load(expected + i + 32), Load(received + i + 32))),
+                                           _mm256_or_si256(_mm256_xor_si256(Load(expected + i + 64), Load(received + i + 64)),
+                                                           _mm256_xor_si256(Load(expected + i + 96), Load(received + i + 96))));
+            if (!_mm256_testz_si256(diff, diff))
+            {
+                break;
+            }
+        }
+
+        for (; i + 32 <= size; i += 32)
+        {
+            auto equal = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(Load(expected + i), Load(received + i))));
+            if (equal != 0xFFFFFFFF)
+            {
+                return i + __builtin_ctz(~equal);
+            }
+        }
+
+        return i + FirstMismatchScalar(expected + i, received + i, size - i);
+    }
+
+private:
+    PayloadPool pool_;
+    uint64_t no_of_verified_messages_;
+    uint64_t no_of_corrupted_messages_;
+    double compare_gbps_;
+};
+
+#endif //MEASURE_TRANSFER_PAYLOAD_H
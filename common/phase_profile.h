@@ -0,0 +1,200 @@
+#ifndef MEASURE_TRANSFER_PHASE_PROFILE_H
+#define MEASURE_TRANSFER_PHASE_PROFILE_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// set by configuring with -DPHASE_PROFILE=ON; otherwise every probe compiles to nothing
+#ifdef MEASURE_TRANSFER_PHASE_PROFILE
+constexpr bool kPhaseProfileEnabled = true;
+#else
+constexpr bool kPhaseProfileEnabled = false;
+#endif
+
+// the phases of a data path loop, shared by the communicators and the clients
+enum class Phase : uint8_t
+{
+    kReadHeader,
+    kDecode,
+    kReadPayload,
+    kReceive,
+    kProcess,
+    kUpdateStats,
+    kSendAck,
+    kEncode,
+    kSend,
+    kReceiveAck,
+    kWait,
+    kLog,
+    kCount
+};
+
+constexpr std::size_t kNoOfPhases = static_cast<std::size_t>(Phase::kCount);
+
+std::ostream& operator<<(std::ostream& os, Phase phase)
+{
+    switch (phase)
+    {
+        case Phase::kReadHeader:
+            return os << "read header";
+        case Phase::kDecode:
+            return os << "decode";
+        case Phase::kReadPayload:
+            return os << "read payload";
+        case Phase::kReceive:
+            return os << "receive";
+        case Phase::kProcess:
+            return os << "process";
+        case Phase::kUpdateStats:
+            return os << "update stats";
+        case Phase::kSendAck:
+            return os << "send ack";
+        case Phase::kEncode:
+            return os << "encode";
+        case Phase::kSend:
+            return os << "send";
+        case Phase::kReceiveAck:
+            return os << "receive ack";
+        case Phase::kWait:
+            return os << "wait";
+        case Phase::kLog:
+            return os << "log";
+        default:
+            return os << "Unknown phase";
+    }
+}
+
+// rdtsc where there is one: no system call, no vDSO, some 20 cycles; the steady clock in nanoseconds elsewhere
+uint64_t PhaseTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+/**
+ * Time spent in each phase of one data path loop. The loop's thread enters a
+ * phase at each boundary, which closes the previous one, so a boundary costs
+ * one tick read and two adds. A profile belongs to the communicator or client
+ * running the loop, i.e. to a single thread, and takes whole cache lines so
+ * that no other thread's data shares them. Ticks are converted to time when
+ * printed, against the steady clock over the profile's lifetime.
+ */
+class alignas(64) PhaseProfile
+{
+public:
+    PhaseProfile()
+        : start_ticks_{PhaseTicks()}
+        , start_time_{std::chrono::steady_clock::now()}
+    {}
+
+    // closes the current phase, if any, and opens the given one
+    void Enter(Phase phase)
+    {
+        if constexpr (kPhaseProfileEnabled)
+        {
+            auto now = PhaseTicks();
+            Close(now);
+            current_ = phase;
+            phase_start_ = now;
+        }
+    }
+
+    // closes the current phase; the time until the next Enter() is not accounted
+    void Leave()
+    {
+        if constexpr (kPhaseProfileEnabled)
+        {
+            Close(PhaseTicks());
+            current_ = Phase::kCount;
+        }
+    }
+
+    // one line per phase entered, nothing when profiling is compiled out
+    void Print() const
+    {
+        uint64_t total_ticks = 0;
+        for (auto ticks : ticks_)
+        {
+            total_ticks += ticks;
+        }
+        if (total_ticks == 0)
+        {
+            return;
+        }
+
+        // the tick rate, measured over the whole run
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start_time_).count();
+        auto ns_per_tick = elapsed / static_cast<double>(std::max<uint64_t>(PhaseTicks() - start_ticks_, 1));
+
+        std::cout << "Phase breakdown: " << total_ticks * ns_per_tick / 1e6 << " ms in probed phases" << std::endl;
+        for (std::size_t i = 0; i < kNoOfPhases; ++i)
+        {
+            if (counts_[i] == 0)
+            {
+                continue;
+            }
+            std::cout << "  " << std::left << std::setw(14) << static_cast<Phase>(i) << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(6) << 100.0 * static_cast<double>(ticks_[i]) / static_cast<double>(total_ticks) << " %, "
+                      << static_cast<double>(ticks_[i]) * ns_per_tick / static_cast<double>(counts_[i]) << " ns x " << counts_[i]
+                      << std::defaultfloat << std::setprecision(6) << std::endl;
+        }
+    }
+
+private:
+    void Close(uint64_t now)
+    {
+        if (current_ != Phase::kCount)
+        {
+            auto index = static_cast<std::size_t>(current_);
+            ticks_[index] += now - phase_start_;
+            counts_[index]++;
+        }
+    }
+
+private:
+    std::array<uint64_t, kNoOfPhases> ticks_{};
+    std::array<uint64_t, kNoOfPhases> counts_{};
+    uint64_t phase_start_ = 0;
+    Phase current_ = Phase::kCount;
+    uint64_t start_ticks_;
+    std::chrono::steady_clock::time_point start_time_;
+};
+
+/**
+ * Enters a phase for the rest of the scope. Further phases may be entered
+ * within the scope through the profile; whichever is current when the scope
+ * ends is closed, so an early return or an error still accounts its time.
+ */
+class PhaseProbe
+{
+public:
+    PhaseProbe(PhaseProfile& profile, Phase phase)
+        : profile_(profile)
+    {
+        profile_.Enter(phase);
+    }
+
+    ~PhaseProbe()
+    {
+        profile_.Leave();
+    }
+
+    PhaseProbe(const PhaseProbe&) = delete;
+    PhaseProbe& operator=(const PhaseProbe&) = delete;
+
+private:
+    PhaseProfile& profile_;
+};
+
+#endif //MEASURE_TRANSFER_PHASE_PROFILE_H
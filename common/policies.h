@@ -0,0 +1,45 @@
+#ifndef MEASURE_TRANSFER_POLICIES_H
+#define MEASURE_TRANSFER_POLICIES_H
+
+#include <cstdint>
+
+#include "types.h"
+
+/**
+ * Mechanism policies of the specialized communicators and clients. They are
+ * resolved at compile time, so a hot loop never branches on the mechanism.
+ */
+struct StopAndGoPolicy
+{
+    static constexpr CommunicationMechanism kMechanism = CommunicationMechanism::kStopAndGo;
+    // the client waits for the ACK of every message before sending the next
+    static constexpr bool kWaitForAck = true;
+    static constexpr uint32_t kAckDrainInterval = 1;
+};
+
+struct StreamingPolicy
+{
+    static constexpr CommunicationMechanism kMechanism = CommunicationMechanism::kStreaming;
+    static constexpr bool kWaitForAck = false;
+    // messages sent between two non-blocking reads of the queued ACKs
+    static constexpr uint32_t kAckDrainInterval = 16;
+};
+
+/**
+ * I/O policies of the stream communicators and clients. A message at a time
+ * is the loop of the Asio backend: a call for the header and one for the
+ * payload, one per ACK, and a log line per message. Batched is the loop of
+ * the specialized backend: one gathered write per message, every complete
+ * message of a read parsed in place and the ACKs of a read sent or read at once.
+ */
+struct MessageAtATimeIo
+{
+    static constexpr bool kBatched = false;
+};
+
+struct BatchedIo
+{
+    static constexpr bool kBatched = true;
+};
+
+#endif //MEASURE_TRANSFER_POLICIES_H
@@ -0,0 +1,369 @@
+#ifndef MEASURE_TRANSFER_RESULTS_H
+#define MEASURE_TRANSFER_RESULTS_H
+
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/utsname.h>
+
+/**
+ * One run as stored in the results history, one line per run:
+ * Format: time=T label=L kernel=K | <configuration> | <metric>=<value> ...
+ * The configuration is a canonical list of key=value pairs; runs are only
+ * ever compared with runs of the same configuration. The label names what is
+ * being gated (a kernel, a driver, a library version) and kernel is recorded
+ * on every run, so neither takes part in the match.
+ */
+struct ResultRecord
+{
+    std::string time;
+    std::string label;
+    std::string kernel;
+    std::string configuration;
+    std::map<std::string, double> metrics;
+};
+
+struct RegressionOptions
+{
+    // empty disables the comparison
+    std::string baseline;
+    // significance level of the two-sided Welch t-test
+    double alpha = 0.05;
+    // smaller relative changes are never reported, however significant
+    double tolerance = 0.05;
+};
+
+std::string KernelRelease()
+{
+    utsname name{};
+    return uname(&name) == 0 ? name.release : "unknown";
+}
+
+std::string CurrentTime()
+{
+    std::time_t now = std::time(nullptr);
+    std::tm utc{};
+    gmtime_r(&now, &utc);
+
+    std::ostringstream os;
+    os << std::put_time(&utc, "%Y-%m-%dT%H:%M:%SZ");
+    return os.str();
+}
+
+std::string FormatResultRecord(const ResultRecord& record)
+{
+    std::ostringstream os;
+    os << "time=" << record.time << " label=" << record.label << " kernel=" << record.kernel << " | " << record.configuration << " |";
+    for (const auto& metric : record.metrics)
+    {
+        os << " " << metric.first << "=" << std::setprecision(9) << metric.second;
+    }
+    return os.str();
+}
+
+bool ParseResultRecord(const std::string& line, ResultRecord& record)
+{
+    auto first = line.find(" | ");
+    auto second = first == std::string::npos ? std::string::npos : line.find(" |", first + 3);
+    if (second == std::string::npos)
+    {
+        return false;
+    }
+
+    record = {};
+    record.configuration = line.substr(first + 3, second - first - 3);
+
+    std::istringstream identity(line.substr(0, first));
+    std::istringstream metrics(line.substr(second + 2));
+    std::string field;
+    while (identity >> field)
+    {
+        auto value = field.substr(field.find('=') + 1);
+        if (field.rfind("time=", 0) == 0)
+        {
+            record.time = value;
+        }
+        else if (field.rfind("label=", 0) == 0)
+        {
+            record.label = value;
+        }
+        else if (field.rfind("kernel=", 0) == 0)
+        {
+            record.kernel = value;
+        }
+    }
+
+    while (metrics >> field)
+    {
+        auto equals = field.find('=');
+        if (equals != std::string::npos)
+        {
+            record.metrics[field.substr(0, equals)] = std::stod(field.substr(equals + 1));
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Append-only history of runs in a plain text file. Every run is a single
+ * write of a single line, so concurrent clients appending to the same file
+ * never interleave their records.
+ */
+class ResultsStore
+{
+public:
+    explicit ResultsStore(std::string path)
+        : path_{std::move(path)}
+    {}
+
+    void Append(const ResultRecord& record) const
+    {
+        std::ofstream file(path_, std::ios::app);
+        file << FormatResultRecord(record) + "\n" << std::flush;
+        if (!file)
+        {
+            throw std::runtime_error("Cannot append to results file " + path_);
+        }
+    }
+
+    std::vector<ResultRecord> Load() const
+    {
+        std::vector<ResultRecord> records;
+        std::ifstream file(path_);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            ResultRecord record;
+            if (ParseResultRecord(line, record))
+            {
+                records.push_back(record);
+            }
+        }
+        return records;
+    }
+
+private:
+    std::string path_;
+};
+
+// throughputs and rates are better higher, times and costs lower
+bool HigherIsBetter(const std::string& metric)
+{
+    return metric.size() >= 6 && metric.compare(metric.size() - 6, 6, "_per_s") == 0;
+}
+
+// continued fraction of the incomplete beta function, modified Lentz's method
+double BetaContinuedFraction(double a, double b, double x)
+{
+    const double kTiny = 1e-300;
+    double c = 1;
+    double d = 1 - (a + b) * x / (a + 1);
+    d = 1 / (std::fabs(d) < kTiny ? kTiny : d);
+    double result = d;
+
+    for (int m = 1; m <= 300; ++m)
+    {
+        for (int step = 0; step < 2; ++step)
+        {
+            double numerator = step == 0 ? m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m))
+                                         : -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+            d = 1 + numerator * d;
+            d = 1 / (std::fabs(d) < kTiny ? kTiny : d);
+            c = 1 + numerator / c;
+            c = std::fabs(c) < kTiny ? kTiny : c;
+            result *= d * c;
+        }
+
+        if (std::fabs(d * c - 1) < 1e-12)
+        {
+            break;
+        }
+    }
+
+    return result;
+}
+
+// regularized incomplete beta function I_x(a, b)
+double IncompleteBeta(double a, double b, double x)
+{
+    if (x <= 0 || x >= 1)
+    {
+        return x <= 0 ? 0 : 1;
+    }
+
+    double front = std::exp(std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b) + a * std::log(x) + b * std::log(1 - x));
+    if (x < (a + 1) / (a + b + 2))
+    {
+        return front * BetaContinuedFraction(a, b, x) / a;
+    }
+    return 1 - front * BetaContinuedFraction(b, a, 1 - x) / b;
+}
+
+struct SampleSummary
+{
+    std::size_t count;
+    double mean;
+    double variance;
+};
+
+SampleSummary Summarize(const std::vector<double>& samples)
+{
+    SampleSummary summary = { samples.size(), 0, 0 };
+    for (auto sample : samples)
+    {
+        summary.mean += sample / samples.size();
+    }
+
+    for (auto sample : samples)
+    {
+        summary.variance += samples.size() > 1 ? (sample - summary.mean) * (sample - summary.mean) / (samples.size() - 1) : 0;
+    }
+    return summary;
+}
+
+// two-sided p-value of Welch's t-test, which does not assume equal variances; both samples need two runs
+double WelchTest(const SampleSummary& a, const SampleSummary& b)
+{
+    double a_error = a.variance / a.count;
+    double b_error = b.variance / b.count;
+    double error = a_error + b_error;
+    if (error <= 0)
+    {
+        return a.mean == b.mean ? 1 : 0;
+    }
+
+    double t = (a.mean - b.mean) / std::sqrt(error);
+    double df = error * error / (a_error * a_error / (a.count - 1) + b_error * b_error / (b.count - 1));
+    return IncompleteBeta(df / 2, 0.5, df / (df + t * t));
+}
+
+/**
+ * Compares every configuration of the current runs with the runs of the
+ * same configuration labelled as the baseline. A metric regresses when it
+ * moved the wrong way by more than the tolerance and, given at least two runs
+ * on each side, the Welch t-test finds the move significant. With a single
+ * run on either side only the tolerance applies; --repeat gives the test
+ * something to work with. A configuration without baseline runs was not
+ * checked at all, so it fails the comparison unless something regressed.
+ */
+enum class BaselineComparison
+{
+    kPassed,
+    kRegressed,
+    kMissingBaseline
+};
+
+BaselineComparison CompareWithBaseline(const std::vector<ResultRecord>& history, const std::vector<ResultRecord>& current, const RegressionOptions& options)
+{
+    std::set<std::string> configurations;
+    for (const auto& record : current)
+    {
+        configurations.insert(record.configuration);
+    }
+
+    bool regressed = false;
+    bool missing_baseline = false;
+    for (const auto& configuration : configurations)
+    {
+        std::map<std::string, std::vector<double>> baseline_samples;
+        std::map<std::string, std::vector<double>> current_samples;
+        for (const auto& record : history)
+        {
+            if (record.label == options.baseline && record.configuration == configuration)
+            {
+                for (const auto& metric : record.metrics)
+                {
+                    baseline_samples[metric.first].push_back(metric.second);
+                }
+            }
+        }
+
+        for (const auto& record : current)
+        {
+            if (record.configuration == configuration)
+            {
+                for (const auto& metric : record.metrics)
+                {
+                    current_samples[metric.first].push_back(metric.second);
+                }
+            }
+        }
+
+        std::cout << std::endl << "Against baseline " << options.baseline << ": " << configuration << std::endl;
+        if (baseline_samples.empty())
+        {
+            std::cout << "No baseline runs of this configuration" << std::endl;
+            missing_baseline = true;
+            continue;
+        }
+
+        std::cout << std::left << std::setw(22) << "Metric" << std::right << std::setw(24) << "Baseline (n)" << std::setw(24) << "Current (n)"
+                  << std::setw(12) << "Change" << std::setw(10) << "p" << "  Verdict" << std::endl;
+        for (const auto& samples : current_samples)
+        {
+            auto found = baseline_samples.find(samples.first);
+            if (found == baseline_samples.end())
+            {
+                continue;
+            }
+
+            auto baseline = Summarize(found->second);
+            auto now = Summarize(samples.second);
+            double change = baseline.mean != 0 ? (now.mean - baseline.mean) / baseline.mean : 0;
+            bool worse = HigherIsBetter(samples.first) ? change < -options.tolerance : change > options.tolerance;
+            bool better = HigherIsBetter(samples.first) ? change > options.tolerance : change < -options.tolerance;
+
+            bool tested = baseline.count >= 2 && now.count >= 2;
+            double p = tested ? WelchTest(baseline, now) : 1;
+            bool significant = !tested || p < options.alpha;
+
+            const char* verdict = "ok";
+            if (worse && significant)
+            {
+                verdict = "REGRESSION";
+                regressed = true;
+            }
+            else if (better && significant)
+            {
+                verdict = "improved";
+            }
+
+            std::ostringstream baseline_column;
+            baseline_column << std::setprecision(6) << baseline.mean << " (" << baseline.count << ")";
+            std::ostringstream current_column;
+            current_column << std::setprecision(6) << now.mean << " (" << now.count << ")";
+            std::ostringstream p_column;
+            p_column << std::setprecision(3);
+            if (tested)
+            {
+                p_column << p;
+            }
+            else
+            {
+                p_column << "-";
+            }
+
+            std::cout << std::left << std::setw(22) << samples.first << std::right << std::setw(24) << baseline_column.str() << std::setw(24)
+                      << current_column.str() << std::setw(11) << std::fixed << std::setprecision(1) << change * 100 << "%"
+                      << std::defaultfloat << std::setw(10) << p_column.str() << "  " << verdict << std::endl;
+        }
+    }
+
+    if (regressed)
+    {
+        return BaselineComparison::kRegressed;
+    }
+
+    return missing_baseline ? BaselineComparison::kMissingBaseline : BaselineComparison::kPassed;
+}
+
+#endif //MEASURE_TRANSFER_RESULTS_H
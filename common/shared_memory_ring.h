@@ -0,0 +1,370 @@
+#ifndef MEASURE_TRANSFER_SHARED_MEMORY_RING_H
+#define MEASURE_TRANSFER_SHARED_MEMORY_RING_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <boost/system/error_code.hpp>
+#include <boost/system/system_error.hpp>
+
+// must be a power of two
+const std::size_t kSharedMemoryRingCapacity = 4 * 1024 * 1024;
+const uint64_t kSharedMemoryMagic = 0x4d54534852494e47; // "MTSHRING"
+
+/**
+ * Control block of a single-producer/single-consumer byte ring.
+ * The producer only writes head, the consumer only writes tail; each lives on
+ * its own cache line. The *_seq words are futex words bumped on every publish,
+ * so a blocked peer can sleep in the kernel instead of spinning.
+ */
+struct RingControl
+{
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) std::atomic<uint32_t> head_seq;
+    std::atomic<uint32_t> consumer_waiting;
+    alignas(64) std::atomic<uint32_t> tail_seq;
+    std::atomic<uint32_t> producer_waiting;
+    alignas(64) std::atomic<uint32_t> closed;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring indexes must be lock free to be shared between processes");
+
+/**
+ * Shared memory segment format:
+ * Format: | Magic | Capacity | DataRing control | DataRing bytes | AckRing control | AckRing bytes |
+ * The data ring carries DataMessages from the client to the server,
+ * the ack ring carries AcknowledgeMessages back.
+ */
+struct alignas(64) SegmentHeader
+{
+    uint64_t magic;
+    uint64_t capacity;
+};
+
+class SharedMemoryRing
+{
+public:
+    SharedMemoryRing(RingControl* control, uint8_t* data, std::size_t capacity)
+        : control_{control}
+        , data_{data}
+        , capacity_{capacity}
+    {}
+
+    boost::system::error_code Write(const void* buffer, std::size_t size)
+    {
+        auto in = static_cast<const uint8_t*>(buffer);
+
+        while (size > 0)
+        {
+            if (control_->closed.load(std::memory_order_acquire))
+            {
+                return make_error_code(boost::system::errc::broken_pipe);
+            }
+
+            uint64_t head = control_->head.load(std::memory_order_relaxed);
+            uint64_t free_space = capacity_ - (head - control_->tail.load(std::memory_order_acquire));
+            if (free_space == 0)
+            {
+                WaitForSpace(head);
+                continue;
+            }
+
+            std::size_t chunk = std::min<std::size_t>(size, free_space);
+            std::size_t offset = head & (capacity_ - 1);
+            std::size_t first = std::min(chunk, capacity_ - offset);
+            std::memcpy(data_ + offset, in, first);
+            std::memcpy(data_, in + first, chunk - first);
+
+            control_->head.store(head + chunk, std::memory_order_release);
+            control_->head_seq.fetch_add(1, std::memory_order_seq_cst);
+            if (control_->consumer_waiting.load(std::memory_order_seq_cst))
+            {
+                FutexWake(&control_->head_seq);
+            }
+
+            in += chunk;
+            size -= chunk;
+        }
+
+        return make_error_code(boost::system::errc::success);
+    }
+
+    boost::system::error_code Read(void* buffer, std::size_t size)
+    {
+        auto out = static_cast<uint8_t*>(buffer);
+
+        while (size > 0)
+        {
+            uint64_t tail = control_->tail.load(std::memory_order_relaxed);
+            uint64_t available = control_->head.load(std::memory_order_acquire) - tail;
+            if (available == 0)
+            {
+                if (control_->closed.load(std::memory_order_acquire))
+                {
+                    return make_error_code(boost::system::errc::no_message_available);
+                }
+
+                WaitForData(tail);
+                continue;
+            }
+
+            std::size_t chunk = std::min<std::size_t>(size, available);
+            std::size_t offset = tail & (capacity_ - 1);
+            std::size_t first = std::min(chunk, capacity_ - offset);
+            std::memcpy(out, data_ + offset, first);
+            std::memcpy(out + first, data_, chunk - first);
+
+            control_->tail.store(tail + chunk, std::memory_order_release);
+            control_->tail_seq.fetch_add(1, std::memory_order_seq_cst);
+            if (control_->producer_waiting.load(std::memory_order_seq_cst))
+            {
+                FutexWake(&control_->tail_seq);
+            }
+
+            out += chunk;
+            size -= chunk;
+        }
+
+        return make_error_code(boost::system::errc::success);
+    }
+
+    // bytes the consumer can read without blocking
+    std::size_t ReadableSize() const
+    {
+        return control_->head.load(std::memory_order_acquire) - control_->tail.load(std::memory_order_relaxed);
+    }
+
+    void Close()
+    {
+        control_->closed.store(1, std::memory_order_release);
+        control_->head_seq.fetch_add(1, std::memory_order_seq_cst);
+        control_->tail_seq.fetch_add(1, std::memory_order_seq_cst);
+        FutexWake(&control_->head_seq);
+        FutexWake(&control_->tail_seq);
+    }
+
+private:
+    static const int kSpinCount = 2000;
+
+    void WaitForData(uint64_t tail)
+    {
+        for (int i = 0; i < kSpinCount; ++i)
+        {
+            if (control_->head.load(std::memory_order_acquire) != tail || control_->closed.load(std::memory_order_acquire))
+            {
+                return;
+            }
+            CpuRelax();
+        }
+
+        uint32_t seq = control_->head_seq.load(std::memory_order_seq_cst);
+        control_->consumer_waiting.store(1, std::memory_order_seq_cst);
+        if (control_->head.load(std::memory_order_seq_cst) == tail && !control_->closed.load(std::memory_order_seq_cst))
+        {
+            FutexWait(&control_->head_seq, seq);
+        }
+        control_->consumer_waiting.store(0, std::memory_order_relaxed);
+    }
+
+    void WaitForSpace(uint64_t head)
+    {
+        for (int i = 0; i < kSpinCount; ++i)
+        {
+            if (head - control_->tail.load(std::memory_order_acquire) < capacity_ || control_->closed.load(std::memory_order_acquire))
+            {
+                return;
+            }
+            CpuRelax();
+        }
+
+        uint32_t seq = control_->tail_seq.load(std::memory_order_seq_cst);
+        control_->producer_waiting.store(1, std::memory_order_seq_cst);
+        if (head - control_->tail.load(std::memory_order_seq_cst) == capacity_ && !control_->closed.load(std::memory_order_seq_cst))
+        {
+            FutexWait(&control_->tail_seq, seq);
+        }
+        control_->producer_waiting.store(0, std::memory_order_relaxed);
+    }
+
+    static void CpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    static void FutexWait(std::atomic<uint32_t>* word, uint32_t expected)
+    {
+        // the timeout only matters if the peer process dies without closing the ring
+        timespec timeout = { 0, 100 * 1000 * 1000 };
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+    }
+
+    static void FutexWake(std::atomic<uint32_t>* word)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+    }
+
+private:
+    RingControl* control_;
+    uint8_t* data_;
+    std::size_t capacity_;
+};
+
+class SharedMemorySegment
+{
+public:
+    static SharedMemorySegment Create(const std::string& name, std::size_t capacity = kSharedMemoryRingCapacity)
+    {
+        // remove a segment left behind by a crashed run
+        shm_unlink(name.c_str());
+
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+        {
+            throw boost::system::system_error(errno, boost::system::system_category(), "shm_open");
+        }
+
+        std::size_t size = SegmentSize(capacity);
+        if (ftruncate(fd, static_cast<off_t>(size)) < 0)
+        {
+            int error = errno;
+            close(fd);
+            shm_unlink(name.c_str());
+            throw boost::system::system_error(error, boost::system::system_category(), "ftruncate");
+        }
+
+        SharedMemorySegment segment(name, fd, size, true);
+        auto header = reinterpret_cast<SegmentHeader*>(segment.memory_);
+        header->capacity = capacity;
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = kSharedMemoryMagic;
+
+        return segment;
+    }
+
+    static SharedMemorySegment Open(const std::string& name)
+    {
+        int fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0)
+        {
+            throw boost::system::system_error(errno, boost::system::system_category(), "shm_open");
+        }
+
+        struct stat info{};
+        if (fstat(fd, &info) < 0)
+        {
+            int error = errno;
+            close(fd);
+            throw boost::system::system_error(error, boost::system::system_category(), "fstat");
+        }
+
+        SharedMemorySegment segment(name, fd, static_cast<std::size_t>(info.st_size), false);
+        auto header = reinterpret_cast<SegmentHeader*>(segment.memory_);
+        if (header->magic != kSharedMemoryMagic || SegmentSize(header->capacity) != segment.size_)
+        {
+            throw std::invalid_argument("Shared memory segment " + name + " is not a MeasureTransfer segment");
+        }
+
+        return segment;
+    }
+
+    SharedMemorySegment(SharedMemorySegment&& other) noexcept
+        : name_{std::move(other.name_)}
+        , memory_{other.memory_}
+        , size_{other.size_}
+        , owner_{other.owner_}
+    {
+        other.memory_ = nullptr;
+        other.owner_ = false;
+    }
+
+    SharedMemorySegment(const SharedMemorySegment&) = delete;
+    SharedMemorySegment& operator=(const SharedMemorySegment&) = delete;
+
+    ~SharedMemorySegment()
+    {
+        if (memory_ != nullptr)
+        {
+            munmap(memory_, size_);
+        }
+
+        if (owner_)
+        {
+            shm_unlink(name_.c_str());
+        }
+    }
+
+    SharedMemoryRing DataRing()
+    {
+        return RingAt(sizeof(SegmentHeader));
+    }
+
+    SharedMemoryRing AckRing()
+    {
+        return RingAt(sizeof(SegmentHeader) + RingSize(Capacity()));
+    }
+
+private:
+    SharedMemorySegment(std::string name, int fd, std::size_t size, bool owner)
+        : name_{std::move(name)}
+        , memory_{nullptr}
+        , size_{size}
+        , owner_{owner}
+    {
+        void* memory = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int error = errno;
+        close(fd);
+
+        if (memory == MAP_FAILED)
+        {
+            if (owner_)
+            {
+                shm_unlink(name_.c_str());
+            }
+            throw boost::system::system_error(error, boost::system::system_category(), "mmap");
+        }
+
+        memory_ = static_cast<uint8_t*>(memory);
+    }
+
+    std::size_t Capacity() const
+    {
+        return reinterpret_cast<const SegmentHeader*>(memory_)->capacity;
+    }
+
+    SharedMemoryRing RingAt(std::size_t offset)
+    {
+        auto control = reinterpret_cast<RingControl*>(memory_ + offset);
+        return { control, memory_ + offset + sizeof(RingControl), Capacity() };
+    }
+
+    static std::size_t RingSize(std::size_t capacity)
+    {
+        return sizeof(RingControl) + capacity;
+    }
+
+    static std::size_t SegmentSize(std::size_t capacity)
+    {
+        return sizeof(SegmentHeader) + 2 * RingSize(capacity);
+    }
+
+private:
+    std::string name_;
+    uint8_t* memory_;
+    std::size_t size_;
+    bool owner_;
+};
+
+#endif //MEASURE_TRANSFER_SHARED_MEMORY_RING_H
@@ -0,0 +1,199 @@
+#ifndef MEASURE_TRANSFER_SOCKET_OPTIONS_H
+#define MEASURE_TRANSFER_SOCKET_OPTIONS_H
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "utils.h"
+
+enum class CongestionControl : int8_t
+{
+    kDefault = 0,
+    kCubic = 1,
+    kBbr = 2,
+    kReno = 3
+};
+
+std::string CongestionControlName(CongestionControl congestion_control)
+{
+    switch (congestion_control)
+    {
+        case CongestionControl::kCubic:
+            return "cubic";
+        case CongestionControl::kBbr:
+            return "bbr";
+        case CongestionControl::kReno:
+            return "reno";
+        default:
+            return "default";
+    }
+}
+
+CongestionControl CongestionControlFromName(const std::string& name)
+{
+    if (name == "cubic")
+    {
+        return CongestionControl::kCubic;
+    }
+
+    if (name == "bbr")
+    {
+        return CongestionControl::kBbr;
+    }
+
+    if (name == "reno")
+    {
+        return CongestionControl::kReno;
+    }
+
+    return CongestionControl::kDefault;
+}
+
+/**
+ * Socket options requested by the client in the HelloMessage and echoed back
+ * by the server with the values the kernel actually granted.
+ * Zero sizes and kDefault leave the kernel default untouched.
+ * Format: | SndBuf | RcvBuf | NoDelay | Cork | NotSentLowat | CongestionControl |
+ * Index:  |   0    |   4    |    8    |  9   |      10      |        14         |
+ * Size:   | 4bytes | 4bytes |  1byte  | 1byte|    4bytes    |       1byte       |
+ */
+struct SocketOptions
+{
+    static const std::size_t kSize = 15;
+
+    static SocketOptions Decode(const uint8_t* bytes)
+    {
+        return { FromBytes(&bytes[0]),
+                 FromBytes(&bytes[4]),
+                 bytes[8] != 0,
+                 bytes[9] != 0,
+                 FromBytes(&bytes[10]),
+                 static_cast<CongestionControl>(bytes[14]) };
+    }
+
+    static void Encode(const SocketOptions& options, uint8_t* bytes)
+    {
+        ToBytes(options.send_buffer_size, &bytes[0]);
+        ToBytes(options.receive_buffer_size, &bytes[4]);
+        bytes[8] = options.no_delay ? 1 : 0;
+        bytes[9] = options.cork ? 1 : 0;
+        ToBytes(options.not_sent_lowat, &bytes[10]);
+        bytes[14] = static_cast<uint8_t>(options.congestion_control);
+    }
+
+    /**
+     * Applies every requested option to fd; TCP-level options are skipped for
+     * other socket types. Failures are logged and the remaining options are
+     * still applied, Query() tells what the kernel ended up with.
+     */
+    void Apply(int fd, bool tcp) const
+    {
+        if (send_buffer_size > 0)
+        {
+            SetOption(fd, SOL_SOCKET, SO_SNDBUF, static_cast<int>(send_buffer_size), "SO_SNDBUF");
+        }
+
+        if (receive_buffer_size > 0)
+        {
+            SetOption(fd, SOL_SOCKET, SO_RCVBUF, static_cast<int>(receive_buffer_size), "SO_RCVBUF");
+        }
+
+        if (!tcp)
+        {
+            return;
+        }
+
+        if (no_delay)
+        {
+            SetOption(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+        }
+
+        if (cork)
+        {
+            SetOption(fd, IPPROTO_TCP, TCP_CORK, 1, "TCP_CORK");
+        }
+
+        if (not_sent_lowat > 0)
+        {
+            SetOption(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, static_cast<int>(not_sent_lowat), "TCP_NOTSENT_LOWAT");
+        }
+
+        if (congestion_control != CongestionControl::kDefault)
+        {
+            auto name = CongestionControlName(congestion_control);
+            if (setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, name.c_str(), static_cast<socklen_t>(name.size())) < 0)
+            {
+                std::cout << "Failed to set TCP_CONGESTION " << name << ": " << std::strerror(errno) << std::endl;
+            }
+        }
+    }
+
+    static SocketOptions Query(int fd, bool tcp)
+    {
+        SocketOptions options{};
+        options.send_buffer_size = static_cast<uint32_t>(GetOption(fd, SOL_SOCKET, SO_SNDBUF));
+        options.receive_buffer_size = static_cast<uint32_t>(GetOption(fd, SOL_SOCKET, SO_RCVBUF));
+
+        if (!tcp)
+        {
+            return options;
+        }
+
+        options.no_delay = GetOption(fd, IPPROTO_TCP, TCP_NODELAY) != 0;
+        options.cork = GetOption(fd, IPPROTO_TCP, TCP_CORK) != 0;
+        options.not_sent_lowat = static_cast<uint32_t>(GetOption(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT));
+
+        char name[16] = {};
+        socklen_t length = sizeof(name);
+        if (getsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, name, &length) == 0)
+        {
+            options.congestion_control = CongestionControlFromName(std::string(name, strnlen(name, length)));
+        }
+
+        return options;
+    }
+
+    // data members
+    uint32_t send_buffer_size;
+    uint32_t receive_buffer_size;
+    bool no_delay;
+    bool cork;
+    uint32_t not_sent_lowat;
+    CongestionControl congestion_control;
+
+private:
+    static void SetOption(int fd, int level, int name, int value, const char* option)
+    {
+        if (setsockopt(fd, level, name, &value, sizeof(value)) < 0)
+        {
+            std::cout << "Failed to set " << option << ": " << std::strerror(errno) << std::endl;
+        }
+    }
+
+    static int GetOption(int fd, int level, int name)
+    {
+        int value = 0;
+        socklen_t length = sizeof(value);
+        getsockopt(fd, level, name, &value, &length);
+        return value;
+    }
+};
+
+std::ostream& operator<<(std::ostream& os, const SocketOptions& options)
+{
+    os << "SO_SNDBUF=" << options.send_buffer_size
+       << " SO_RCVBUF=" << options.receive_buffer_size
+       << " TCP_NODELAY=" << options.no_delay
+       << " TCP_CORK=" << options.cork
+       << " TCP_NOTSENT_LOWAT=" << options.not_sent_lowat
+       << " TCP_CONGESTION=" << CongestionControlName(options.congestion_control);
+    return os;
+}
+
+#endif //MEASURE_TRANSFER_SOCKET_OPTIONS_H
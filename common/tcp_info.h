@@ -0,0 +1,238 @@
+#ifndef MEASURE_TRANSFER_TCP_INFO_H
+#define MEASURE_TRANSFER_TCP_INFO_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <boost/thread.hpp>
+
+/**
+ * glibc's tcp_info stops at tcpi_total_retrans; the kernel only ever appends
+ * to the structure, so the newer fields follow it here with the kernel layout.
+ */
+struct KernelTcpInfo
+{
+    tcp_info base;
+    uint64_t pacing_rate;
+    uint64_t max_pacing_rate;
+    uint64_t bytes_acked;
+    uint64_t bytes_received;
+    uint32_t segs_out;
+    uint32_t segs_in;
+    uint32_t notsent_bytes;
+    uint32_t min_rtt;
+    uint32_t data_segs_in;
+    uint32_t data_segs_out;
+    uint64_t delivery_rate;
+    uint64_t busy_time;
+    uint64_t rwnd_limited;
+    uint64_t sndbuf_limited;
+};
+
+static_assert(sizeof(tcp_info) == 104, "unexpected glibc tcp_info layout");
+
+/**
+ * One TCP_INFO reading of a data socket. Rates are in bytes per second, the
+ * *_time fields are cumulative microseconds since the connection started.
+ */
+struct TcpInfoSample
+{
+    std::chrono::microseconds time;
+    uint32_t rtt_us;
+    uint32_t rttvar_us;
+    uint32_t cwnd;
+    uint32_t total_retransmits;
+    uint64_t delivery_rate;
+    uint64_t pacing_rate;
+    uint64_t busy_time_us;
+    uint64_t rwnd_limited_us;
+    uint64_t sndbuf_limited_us;
+    uint32_t mss;
+};
+
+/**
+ * Reads TCP_INFO of one socket every interval from a helper thread, so the
+ * data path itself is not touched. A final sample is always taken on Stop(),
+ * which makes short runs yield at least one reading.
+ */
+class TcpInfoSampler
+{
+public:
+    explicit TcpInfoSampler(std::chrono::milliseconds interval)
+        : interval_{interval}
+        , fd_{-1}
+        , running_{false}
+    {}
+
+    TcpInfoSampler(const TcpInfoSampler&) = delete;
+    TcpInfoSampler& operator=(const TcpInfoSampler&) = delete;
+
+    ~TcpInfoSampler()
+    {
+        Stop();
+    }
+
+    void Start(int fd)
+    {
+        if (interval_.count() <= 0 || running_)
+        {
+            return;
+        }
+
+        fd_ = fd;
+        start_time_ = std::chrono::steady_clock::now();
+        samples_.clear();
+        running_ = true;
+        thread_ = boost::thread([this]() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (running_)
+            {
+                Sample();
+                stopped_.wait_for(lock, interval_, [this]() { return !running_; });
+            }
+        });
+    }
+
+    // must be called while the socket is still open
+    void Stop()
+    {
+        if (!running_)
+        {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        stopped_.notify_one();
+        thread_.join();
+        Sample();
+    }
+
+    // samples from the caller's own event loop instead of a sampler thread, at most once per interval
+    void Poll(int fd)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (interval_.count() <= 0 || running_ || (fd == fd_ && now < next_poll_time_))
+        {
+            return;
+        }
+
+        if (fd != fd_)
+        {
+            fd_ = fd;
+            start_time_ = now;
+            samples_.clear();
+        }
+
+        next_poll_time_ = now + interval_;
+        Sample();
+    }
+
+    const std::vector<TcpInfoSample>& Samples() const
+    {
+        return samples_;
+    }
+
+private:
+    void Sample()
+    {
+        KernelTcpInfo info{};
+        socklen_t length = sizeof(info);
+        if (getsockopt(fd_, IPPROTO_TCP, TCP_INFO, &info, &length) < 0)
+        {
+            return;
+        }
+
+        auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time_);
+        samples_.push_back({ time,
+                             info.base.tcpi_rtt,
+                             info.base.tcpi_rttvar,
+                             info.base.tcpi_snd_cwnd,
+                             info.base.tcpi_total_retrans,
+                             info.delivery_rate,
+                             info.pacing_rate,
+                             info.busy_time,
+                             info.rwnd_limited,
+                             info.sndbuf_limited,
+                             info.base.tcpi_snd_mss });
+    }
+
+private:
+    std::chrono::milliseconds interval_;
+    int fd_;
+    bool running_;
+    std::mutex mutex_;
+    std::condition_variable stopped_;
+    std::chrono::steady_clock::time_point start_time_;
+    std::chrono::steady_clock::time_point next_poll_time_;
+    std::vector<TcpInfoSample> samples_;
+    boost::thread thread_;
+};
+
+/**
+ * Summarizes a TCP_INFO time series and names what limited the sender most:
+ * the receive window, the send buffer or, for the rest of the busy time, the
+ * congestion window / the application itself.
+ */
+void PrintTcpInfoSummary(const std::vector<TcpInfoSample>& samples)
+{
+    if (samples.empty())
+    {
+        return;
+    }
+
+    uint64_t rtt_sum = 0;
+    uint32_t min_rtt = UINT32_MAX;
+    uint32_t max_rtt = 0;
+    uint32_t max_cwnd = 0;
+    uint64_t max_delivery_rate = 0;
+    for (const auto& sample : samples)
+    {
+        rtt_sum += sample.rtt_us;
+        min_rtt = std::min(min_rtt, sample.rtt_us);
+        max_rtt = std::max(max_rtt, sample.rtt_us);
+        max_cwnd = std::max(max_cwnd, sample.cwnd);
+        max_delivery_rate = std::max(max_delivery_rate, sample.delivery_rate);
+    }
+
+    // the limited times are cumulative, the last sample holds the totals
+    const auto& last = samples.back();
+    uint64_t window_limited = last.rwnd_limited_us + last.sndbuf_limited_us;
+    uint64_t cwnd_limited = last.busy_time_us > window_limited ? last.busy_time_us - window_limited : 0;
+
+    const char* limit = "congestion window / application";
+    uint64_t limit_time = cwnd_limited;
+    if (last.rwnd_limited_us > limit_time)
+    {
+        limit = "receive window";
+        limit_time = last.rwnd_limited_us;
+    }
+    if (last.sndbuf_limited_us > limit_time)
+    {
+        limit = "send buffer";
+    }
+
+    std::cout << "TCP_INFO samples: " << samples.size() << std::endl;
+    std::cout << "RTT min/avg/max: " << min_rtt << "/" << rtt_sum / samples.size() << "/" << max_rtt
+              << " us, rttvar " << last.rttvar_us << " us" << std::endl;
+    std::cout << "cwnd last/max: " << last.cwnd << "/" << max_cwnd << " segments" << std::endl;
+    std::cout << "Retransmits: " << last.total_retransmits << std::endl;
+    std::cout << "Delivery rate last/max: " << last.delivery_rate / (1024 * 1024) << "/" << max_delivery_rate / (1024 * 1024)
+              << " MiB/s, pacing rate " << last.pacing_rate / (1024 * 1024) << " MiB/s" << std::endl;
+    std::cout << "Busy/rwnd-limited/sndbuf-limited: " << last.busy_time_us << "/" << last.rwnd_limited_us << "/"
+              << last.sndbuf_limited_us << " us" << std::endl;
+    std::cout << "Limiting factor: " << (last.busy_time_us > 0 ? limit : "none (sender idle)") << std::endl;
+}
+
+#endif //MEASURE_TRANSFER_TCP_INFO_H
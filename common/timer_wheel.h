@@ -0,0 +1,94 @@
+#ifndef MEASURE_TRANSFER_TIMER_WHEEL_H
+#define MEASURE_TRANSFER_TIMER_WHEEL_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Hashed timing wheel: a timer due at time t lands in slot (t / tick) % slots,
+ * so scheduling is O(1) whatever the number of pending timers, and advancing
+ * by one tick only looks at one slot. Timers further out than a revolution
+ * share slots with nearer ones and simply stay put until their tick comes.
+ * Timers due in the same tick fire in the order they were scheduled, which
+ * keeps a FIFO stream in order.
+ */
+template <typename Entry>
+class TimerWheel
+{
+public:
+    TimerWheel(std::chrono::nanoseconds tick, std::size_t no_of_slots, int64_t now)
+        : tick_{std::max<int64_t>(tick.count(), 1)}
+        , slots_(std::max<std::size_t>(no_of_slots, 1))
+        , current_tick_{now / tick_}
+        , size_{0}
+    {}
+
+    // times are nanoseconds on the caller's clock; a due time in the past fires on the next Advance
+    void Schedule(int64_t due, Entry entry)
+    {
+        int64_t due_tick = std::max(due / tick_, current_tick_);
+        slots_[due_tick % slots_.size()].push_back({ due_tick, std::move(entry) });
+        size_++;
+    }
+
+    // fires every timer due up to now, tick by tick
+    template <typename Handler>
+    void Advance(int64_t now, Handler&& handler)
+    {
+        int64_t now_tick = now / tick_;
+        for (; current_tick_ <= now_tick && size_ > 0; ++current_tick_)
+        {
+            auto& slot = slots_[current_tick_ % slots_.size()];
+            if (slot.empty())
+            {
+                continue;
+            }
+
+            // the handler may schedule into this very slot, so take the due timers out first
+            auto due = std::stable_partition(slot.begin(), slot.end(), [this](const Timer& timer) { return timer.tick > current_tick_; });
+            fired_.assign(std::make_move_iterator(due), std::make_move_iterator(slot.end()));
+            slot.erase(due, slot.end());
+            size_ -= fired_.size();
+
+            for (auto& timer : fired_)
+            {
+                handler(timer.entry);
+            }
+        }
+
+        current_tick_ = std::max(current_tick_, now_tick);
+    }
+
+    // start of the next tick, when the next timer could become due
+    int64_t NextTick() const
+    {
+        return (current_tick_ + 1) * tick_;
+    }
+
+    bool Empty() const
+    {
+        return size_ == 0;
+    }
+
+    std::size_t Size() const
+    {
+        return size_;
+    }
+
+private:
+    struct Timer
+    {
+        int64_t tick;
+        Entry entry;
+    };
+
+    int64_t tick_;
+    std::vector<std::vector<Timer>> slots_;
+    int64_t current_tick_;
+    std::size_t size_;
+    std::vector<Timer> fired_;
+};
+
+#endif //MEASURE_TRANSFER_TIMER_WHEEL_H
@@ -0,0 +1,301 @@
+#ifndef MEASURE_TRANSFER_TRACE_H
+#define MEASURE_TRANSFER_TRACE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/system/error_code.hpp>
+#include <boost/system/system_error.hpp>
+
+#include "latency.h"
+#include "types.h"
+
+const uint64_t kTraceMagic = 0x4d54545241434531; // "MTTRACE1"
+
+enum class TraceRole : uint8_t
+{
+    kClient = 0,
+    kServer = 1
+};
+
+std::ostream& operator<<(std::ostream& os, TraceRole role)
+{
+    switch (role)
+    {
+        case TraceRole::kClient:
+            return os << "Client";
+        case TraceRole::kServer:
+            return os << "Server";
+        default:
+            return os << "Unknown trace role";
+    }
+}
+
+struct TraceOptions
+{
+    // empty disables tracing; every session writes <prefix>.<client|server>.<session port>, later tests of it append .<test no>
+    std::string prefix;
+    // records pre-sized on the server, which does not know the number of messages in advance
+    uint32_t capacity = 1024 * 1024;
+};
+
+/**
+ * Trace file format, host byte order since traces are analysed where they are recorded:
+ * Format: | TraceHeader | TraceRecord of message 0 | TraceRecord of message 1 | ... |
+ * Size:   |   64bytes   |         32bytes          |         32bytes          | ... |
+ * Record n belongs to message n; timestamps are steady clock nanoseconds, so the
+ * client and server traces of one machine share a time base. A zero timestamp
+ * means the event was not seen, e.g. a lost datagram or a server-side send.
+ */
+struct alignas(64) TraceHeader
+{
+    uint64_t magic;
+    uint32_t record_size;
+    uint32_t capacity;
+    // one past the highest recorded message_no, the file is cut after it
+    uint32_t no_of_records;
+    // events of message numbers beyond the capacity
+    uint32_t no_of_dropped_events;
+    uint32_t message_size;
+    TraceRole role;
+    Protocol protocol;
+    CommunicationMechanism communication_mechanism;
+};
+
+struct TraceRecord
+{
+    uint32_t message_no;
+    uint32_t size;
+    int64_t send_time;
+    int64_t receive_time;
+    int64_t ack_time;
+};
+
+static_assert(sizeof(TraceHeader) == 64, "the trace header is one cache line");
+static_assert(sizeof(TraceRecord) == 32, "trace records are fixed size");
+
+int64_t TraceNow()
+{
+    // clock_gettime goes through the vDSO, no system call
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// test_no counts the tests of a session from 1
+std::string TracePath(const TraceOptions& options, TraceRole role, uint16_t port, uint32_t test_no)
+{
+    auto path = options.prefix + (role == TraceRole::kClient ? ".client." : ".server.") + std::to_string(port);
+    return test_no > 1 ? path + "." + std::to_string(test_no) : path;
+}
+
+/**
+ * Appends per-message records to a pre-sized, pre-faulted shared mapping of
+ * the trace file. Recording an event is a bounds check and a store into the
+ * mapping: no formatting, no allocation and no system call on the hot path.
+ * The file is cut to the recorded messages when the writer is destroyed.
+ */
+class TraceWriter
+{
+public:
+    TraceWriter(const std::string& path, TraceRole role, uint32_t capacity, Protocol protocol,
+                CommunicationMechanism communication_mechanism, uint32_t message_size)
+        : path_{path}
+        , capacity_{std::max<uint32_t>(capacity, 1)}
+        , size_{sizeof(TraceHeader) + std::size_t{capacity_} * sizeof(TraceRecord)}
+        , no_of_records_{0}
+        , no_of_dropped_events_{0}
+    {
+        fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0)
+        {
+            throw boost::system::system_error(errno, boost::system::system_category(), "open " + path_);
+        }
+
+        // the file stays sparse until written, MAP_POPULATE faults the pages in before the transfer
+        void* memory = MAP_FAILED;
+        if (ftruncate(fd_, static_cast<off_t>(size_)) == 0)
+        {
+            memory = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, 0);
+        }
+
+        if (memory == MAP_FAILED)
+        {
+            int error = errno;
+            close(fd_);
+            throw boost::system::system_error(error, boost::system::system_category(), "map trace " + path_);
+        }
+
+        header_ = static_cast<TraceHeader*>(memory);
+        records_ = reinterpret_cast<TraceRecord*>(static_cast<uint8_t*>(memory) + sizeof(TraceHeader));
+        *header_ = { kTraceMagic, sizeof(TraceRecord), capacity_, 0, 0, message_size, role, protocol, communication_mechanism };
+    }
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    ~TraceWriter()
+    {
+        header_->no_of_records = no_of_records_;
+        header_->no_of_dropped_events = no_of_dropped_events_;
+        munmap(header_, size_);
+
+        if (ftruncate(fd_, static_cast<off_t>(sizeof(TraceHeader) + std::size_t{no_of_records_} * sizeof(TraceRecord))) != 0)
+        {
+            std::cout << "Failed to cut trace " << path_ << ": " << errno << std::endl;
+        }
+        close(fd_);
+    }
+
+    void Send(uint32_t message_no, uint32_t size, int64_t time)
+    {
+        if (auto* record = Record(message_no))
+        {
+            record->size = size;
+            record->send_time = time;
+        }
+    }
+
+    void Receive(uint32_t message_no, uint32_t size, int64_t time)
+    {
+        if (auto* record = Record(message_no))
+        {
+            record->size = size;
+            record->receive_time = time;
+        }
+    }
+
+    void Ack(uint32_t message_no, int64_t time)
+    {
+        if (auto* record = Record(message_no))
+        {
+            record->ack_time = time;
+        }
+    }
+
+    // round trips of the acknowledged messages recorded so far
+    void AckLatencies(LatencyRecorder& recorder) const
+    {
+        for (uint32_t i = 0; i < no_of_records_; ++i)
+        {
+            if (records_[i].send_time != 0 && records_[i].ack_time != 0)
+            {
+                recorder.Add(std::chrono::nanoseconds(records_[i].ack_time - records_[i].send_time));
+            }
+        }
+    }
+
+    void Print() const
+    {
+        std::cout << "Trace: " << path_ << ", " << no_of_records_ << " records";
+        if (no_of_dropped_events_ > 0)
+        {
+            std::cout << ", " << no_of_dropped_events_ << " events beyond the capacity of " << capacity_ << " dropped";
+        }
+        std::cout << std::endl;
+    }
+
+private:
+    TraceRecord* Record(uint32_t message_no)
+    {
+        if (message_no >= capacity_)
+        {
+            no_of_dropped_events_++;
+            return nullptr;
+        }
+
+        no_of_records_ = std::max(no_of_records_, message_no + 1);
+        records_[message_no].message_no = message_no;
+        return &records_[message_no];
+    }
+
+private:
+    std::string path_;
+    uint32_t capacity_;
+    std::size_t size_;
+    int fd_;
+    TraceHeader* header_;
+    TraceRecord* records_;
+    uint32_t no_of_records_;
+    uint32_t no_of_dropped_events_;
+};
+
+/**
+ * Read-only mapping of a trace file written by a TraceWriter.
+ */
+class TraceReader
+{
+public:
+    explicit TraceReader(const std::string& path)
+        : path_{path}
+    {
+        int fd = open(path_.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw boost::system::system_error(errno, boost::system::system_category(), "open " + path_);
+        }
+
+        struct stat status{};
+        if (fstat(fd, &status) != 0 || static_cast<std::size_t>(status.st_size) < sizeof(TraceHeader))
+        {
+            close(fd);
+            throw std::invalid_argument(path_ + " is not a MeasureTransfer trace");
+        }
+
+        size_ = static_cast<std::size_t>(status.st_size);
+        void* memory = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        int error = errno;
+        close(fd);
+        if (memory == MAP_FAILED)
+        {
+            throw boost::system::system_error(error, boost::system::system_category(), "map trace " + path_);
+        }
+
+        header_ = static_cast<const TraceHeader*>(memory);
+        records_ = reinterpret_cast<const TraceRecord*>(static_cast<const uint8_t*>(memory) + sizeof(TraceHeader));
+        if (header_->magic != kTraceMagic || header_->record_size != sizeof(TraceRecord)
+            || size_ < sizeof(TraceHeader) + std::size_t{header_->no_of_records} * sizeof(TraceRecord))
+        {
+            munmap(memory, size_);
+            throw std::invalid_argument(path_ + " is not a MeasureTransfer trace");
+        }
+    }
+
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    ~TraceReader()
+    {
+        munmap(const_cast<TraceHeader*>(header_), size_);
+    }
+
+    const TraceHeader& Header() const
+    {
+        return *header_;
+    }
+
+    const TraceRecord* begin() const
+    {
+        return records_;
+    }
+
+    const TraceRecord* end() const
+    {
+        return records_ + header_->no_of_records;
+    }
+
+private:
+    std::string path_;
+    std::size_t size_;
+    const TraceHeader* header_;
+    const TraceRecord* records_;
+};
+
+#endif //MEASURE_TRANSFER_TRACE_H
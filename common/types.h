@@ -9,19 +9,51 @@
 
 const std::size_t kProtocolSize = 1;
 const std::size_t kCommunicationMechanismSize = 1;
+const std::size_t kIoBackendSize = 1;
+const std::size_t kIoUringFlagsSize = 1;
+const std::size_t kBatchSizeSize = 2;
+const std::size_t kUdpFlagsSize = 1;
+const std::size_t kTcpInfoIntervalSize = 2;
+const std::size_t kVerifyPayloadSize = 1;
+const std::size_t kSendTimestampsSize = 1;
+const std::size_t kSendTimeSize = 8;
+const std::size_t kReuseDataConnectionSize = 1;
+const std::size_t kResponseSizeSize = 4;
 
 enum class Protocol : int8_t
 {
     kTcp = 0,
-    kUdp = 1
+    kUdp = 1,
+    kUnixStream = 2,
+    kSharedMemory = 3
 };
 
 enum class CommunicationMechanism : int8_t
 {
     kStreaming = 0,
-    kStopAndGo = 1
+    kStopAndGo = 1,
+    // every request is answered by a response of its own, negotiated size
+    kRequestResponse = 2
 };
 
+enum class IoBackend : int8_t
+{
+    kAsio = 0,
+    kIoUring = 1,
+    // C++20 coroutines on a shared scheduler thread, stream transports only
+    kCoroutine = 2,
+    // compile-time specialized loops, stream transports only
+    kSpecialized = 3
+};
+
+// IoUringFlags bits
+const uint8_t kIoUringSqPoll = 0x01;
+const uint8_t kIoUringMultishot = 0x02;
+
+// UdpFlags bits
+const uint8_t kUdpGso = 0x01;
+const uint8_t kUdpGro = 0x02;
+
 std::ostream& operator<<(std::ostream& os, const Protocol& protocol)
 {
     if (protocol == Protocol::kTcp)
@@ -36,6 +68,18 @@ std::ostream& operator<<(std::ostream& os, const Protocol& protocol)
         return os;
     }
 
+    if (protocol == Protocol::kUnixStream)
+    {
+        os << "UnixStream";
+        return os;
+    }
+
+    if (protocol == Protocol::kSharedMemory)
+    {
+        os << "SharedMemory";
+        return os;
+    }
+
     os << "Unknown Protocol";
     return os;
 }
@@ -54,8 +98,44 @@ std::ostream& operator<<(std::ostream& os, const CommunicationMechanism& communi
         return os;
     }
 
+    if (communication_mechanism == CommunicationMechanism::kRequestResponse)
+    {
+        os << "RequestResponse";
+        return os;
+    }
+
     os << "Unknown CommunicationMechanism";
     return os;
 }
 
+std::ostream& operator<<(std::ostream& os, const IoBackend& io_backend)
+{
+    if (io_backend == IoBackend::kAsio)
+    {
+        os << "Asio";
+        return os;
+    }
+
+    if (io_backend == IoBackend::kIoUring)
+    {
+        os << "io_uring";
+        return os;
+    }
+
+    if (io_backend == IoBackend::kCoroutine)
+    {
+        os << "Coroutine";
+        return os;
+    }
+
+    if (io_backend == IoBackend::kSpecialized)
+    {
+        os << "Specialized";
+        return os;
+    }
+
+    os << "Unknown IoBackend";
+    return os;
+}
+
 #endif //MEASURE_TRANSFER_TYPES_H
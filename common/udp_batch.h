@@ -0,0 +1,240 @@
+#ifndef MEASURE_TRANSFER_UDP_BATCH_H
+#define MEASURE_TRANSFER_UDP_BATCH_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+
+#include <boost/system/error_code.hpp>
+
+const std::size_t kMaxUdpPayload = 65507;
+const std::size_t kMaxGsoSegments = 64;
+
+/**
+ * Sends runs of equally sized datagrams laid out back to back in one buffer.
+ * Without GSO every datagram is one mmsghdr of a single sendmmsg call; with
+ * GSO up to kMaxGsoSegments datagrams share one mmsghdr carrying a UDP_SEGMENT
+ * cmsg and the kernel (or the NIC) splits them.
+ */
+class UdpBatchSender
+{
+public:
+    UdpBatchSender(int fd, std::size_t batch_size, bool gso)
+        : fd_{fd}
+        , gso_{gso}
+        , messages_(std::max<std::size_t>(batch_size, 1))
+        , iovecs_(messages_.size())
+        , controls_(messages_.size() * CMSG_SPACE(sizeof(uint16_t)))
+        , no_of_syscalls_{0}
+    {}
+
+    boost::system::error_code Send(const uint8_t* buffer, std::size_t segment_size, std::size_t count,
+                                   const sockaddr_storage* to = nullptr, socklen_t to_length = 0)
+    {
+        std::size_t segments_per_message = gso_ ? std::max<std::size_t>(1, std::min(kMaxGsoSegments, kMaxUdpPayload / segment_size)) : 1;
+
+        while (count > 0)
+        {
+            std::size_t no_of_messages = 0;
+            std::size_t no_of_segments = 0;
+            while (no_of_messages < messages_.size() && no_of_segments < count)
+            {
+                std::size_t segments = std::min(segments_per_message, count - no_of_segments);
+                Prepare(no_of_messages, buffer + no_of_segments * segment_size, segment_size, segments, to, to_length);
+                no_of_segments += segments;
+                no_of_messages++;
+            }
+
+            std::size_t sent = 0;
+            while (sent < no_of_messages)
+            {
+                no_of_syscalls_++;
+                int result = sendmmsg(fd_, messages_.data() + sent, static_cast<unsigned>(no_of_messages - sent), 0);
+                if (result < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return boost::system::error_code(errno, boost::system::system_category());
+                }
+                sent += result;
+            }
+
+            buffer += no_of_segments * segment_size;
+            count -= no_of_segments;
+        }
+
+        return make_error_code(boost::system::errc::success);
+    }
+
+    uint64_t NoOfSyscalls() const
+    {
+        return no_of_syscalls_;
+    }
+
+private:
+    void Prepare(std::size_t index, const uint8_t* data, std::size_t segment_size, std::size_t segments,
+                 const sockaddr_storage* to, socklen_t to_length)
+    {
+        iovecs_[index] = { const_cast<uint8_t*>(data), segment_size * segments };
+
+        msghdr& header = messages_[index].msg_hdr;
+        header = {};
+        header.msg_name = const_cast<sockaddr_storage*>(to);
+        header.msg_namelen = to_length;
+        header.msg_iov = &iovecs_[index];
+        header.msg_iovlen = 1;
+
+        if (segments > 1)
+        {
+            header.msg_control = controls_.data() + index * CMSG_SPACE(sizeof(uint16_t));
+            header.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+
+            cmsghdr* control = CMSG_FIRSTHDR(&header);
+            control->cmsg_level = SOL_UDP;
+            control->cmsg_type = UDP_SEGMENT;
+            control->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            auto size = static_cast<uint16_t>(segment_size);
+            std::memcpy(CMSG_DATA(control), &size, sizeof(size));
+        }
+    }
+
+private:
+    int fd_;
+    bool gso_;
+    std::vector<mmsghdr> messages_;
+    std::vector<iovec> iovecs_;
+    std::vector<uint8_t> controls_;
+    uint64_t no_of_syscalls_;
+};
+
+/**
+ * Receives up to batch_size datagrams per recvmmsg call. With GRO enabled a
+ * single entry may hold several coalesced datagrams; the UDP_GRO cmsg gives
+ * their size and the handler is called once per original datagram.
+ */
+class UdpBatchReceiver
+{
+public:
+    UdpBatchReceiver(int fd, std::size_t batch_size, std::size_t datagram_size, bool gro)
+        : fd_{fd}
+        , buffer_size_{gro ? kMaxUdpPayload + 28 : datagram_size}
+        , messages_(std::max<std::size_t>(batch_size, 1))
+        , iovecs_(messages_.size())
+        , addresses_(messages_.size())
+        , controls_(messages_.size() * kControlSize)
+        , buffer_(messages_.size() * buffer_size_)
+        , no_of_syscalls_{0}
+    {
+        if (gro)
+        {
+            int enable = 1;
+            setsockopt(fd_, SOL_UDP, UDP_GRO, &enable, sizeof(enable));
+        }
+    }
+
+    /**
+     * Blocks until at least one datagram is available (or the socket receive
+     * timeout expires) and hands every datagram to handler(data, size, from).
+     * A datagram larger than the buffer is cut short by the kernel; it is
+     * dropped and counted instead, see NoOfTruncated().
+     * Returns the number of datagrams handed over or a negative errno.
+     */
+    template <typename Handler>
+    int Receive(Handler&& handler)
+    {
+        for (std::size_t i = 0; i < messages_.size(); ++i)
+        {
+            iovecs_[i] = { buffer_.data() + i * buffer_size_, buffer_size_ };
+
+            msghdr& header = messages_[i].msg_hdr;
+            header = {};
+            header.msg_name = &addresses_[i];
+            header.msg_namelen = sizeof(addresses_[i]);
+            header.msg_iov = &iovecs_[i];
+            header.msg_iovlen = 1;
+            header.msg_control = controls_.data() + i * kControlSize;
+            header.msg_controllen = kControlSize;
+        }
+
+        no_of_syscalls_++;
+        int result = recvmmsg(fd_, messages_.data(), static_cast<unsigned>(messages_.size()), MSG_WAITFORONE, nullptr);
+        if (result < 0)
+        {
+            return -errno;
+        }
+
+        int no_of_datagrams = 0;
+        for (int i = 0; i < result; ++i)
+        {
+            if (messages_[i].msg_hdr.msg_flags & MSG_TRUNC)
+            {
+                no_of_truncated_++;
+                continue;
+            }
+
+            const uint8_t* data = buffer_.data() + i * buffer_size_;
+            std::size_t size = messages_[i].msg_len;
+            std::size_t segment_size = SegmentSize(messages_[i].msg_hdr);
+            if (segment_size == 0)
+            {
+                segment_size = size;
+            }
+
+            for (std::size_t offset = 0; offset < size; offset += segment_size)
+            {
+                handler(data + offset, std::min(segment_size, size - offset), addresses_[i], messages_[i].msg_hdr.msg_namelen);
+                no_of_datagrams++;
+            }
+        }
+
+        return no_of_datagrams;
+    }
+
+    uint64_t NoOfSyscalls() const
+    {
+        return no_of_syscalls_;
+    }
+
+    uint64_t NoOfTruncated() const
+    {
+        return no_of_truncated_;
+    }
+
+private:
+    static const std::size_t kControlSize = 64;
+
+    static std::size_t SegmentSize(msghdr& header)
+    {
+        for (cmsghdr* control = CMSG_FIRSTHDR(&header); control != nullptr; control = CMSG_NXTHDR(&header, control))
+        {
+            if (control->cmsg_level == SOL_UDP && control->cmsg_type == UDP_GRO)
+            {
+                int size = 0;
+                std::memcpy(&size, CMSG_DATA(control), sizeof(size));
+                return static_cast<std::size_t>(size);
+            }
+        }
+
+        return 0;
+    }
+
+private:
+    int fd_;
+    std::size_t buffer_size_;
+    std::vector<mmsghdr> messages_;
+    std::vector<iovec> iovecs_;
+    std::vector<sockaddr_storage> addresses_;
+    std::vector<uint8_t> controls_;
+    std::vector<uint8_t> buffer_;
+    uint64_t no_of_syscalls_;
+    uint64_t no_of_truncated_ = 0;
+};
+
+#endif //MEASURE_TRANSFER_UDP_BATCH_H
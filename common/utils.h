@@ -5,7 +5,16 @@
 #ifndef MEASURE_TRANSFER_UTILS_H
 #define MEASURE_TRANSFER_UTILS_H
 
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <sys/resource.h>
+#include <unistd.h>
 
 uint32_t FromBytes(const uint8_t* bytes)
 {
@@ -17,4 +26,98 @@ uint32_t FromBytes(const uint8_t* bytes)
     return value;
 }
 
+void ToBytes(uint32_t value, uint8_t* bytes)
+{
+    bytes[0] = static_cast<uint8_t>((value >> 24) & 0xFF);
+    bytes[1] = static_cast<uint8_t>((value >> 16) & 0xFF);
+    bytes[2] = static_cast<uint8_t>((value >> 8) & 0xFF);
+    bytes[3] = static_cast<uint8_t>(value & 0xFF);
+}
+
+/**
+ * Same-host transports have no port, so the session id handed out in the
+ * Hello/Acknowledge handshake is mapped to a filesystem or shm name instead.
+ */
+std::string UnixSocketPath(uint16_t client_id)
+{
+    return "/tmp/measure_transfer_" + std::to_string(client_id) + ".sock";
+}
+
+std::string SharedMemoryName(uint16_t client_id)
+{
+    return "/measure_transfer_" + std::to_string(client_id);
+}
+
+// resident set size of the whole process
+std::size_t ResidentMemory()
+{
+    long size = 0;
+    long resident = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm == nullptr)
+    {
+        return 0;
+    }
+
+    if (fscanf(statm, "%ld %ld", &size, &resident) != 2)
+    {
+        resident = 0;
+    }
+    fclose(statm);
+
+    return static_cast<std::size_t>(resident) * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// thousands of concurrent sessions need as many descriptors; raise the soft limit up to the hard one
+rlim_t RaiseFileDescriptorLimit()
+{
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    return limit.rlim_cur;
+}
+
+struct ListenQueueCounters
+{
+    // handshakes that completed while the accept queue was full
+    uint64_t overflows;
+    // SYNs and handshakes dropped on a listening socket, overflows included
+    uint64_t drops;
+};
+
+// TcpExt counters of the network namespace, i.e. of every listener on this host; zero if unavailable
+ListenQueueCounters ReadListenQueueCounters()
+{
+    ListenQueueCounters counters = { 0, 0 };
+    std::ifstream netstat("/proc/net/netstat");
+    std::string names;
+    std::string values;
+    while (std::getline(netstat, names) && std::getline(netstat, values))
+    {
+        if (names.rfind("TcpExt:", 0) != 0)
+        {
+            continue;
+        }
+
+        std::istringstream name_fields(names);
+        std::istringstream value_fields(values);
+        std::string name;
+        std::string value;
+        while (name_fields >> name && value_fields >> value)
+        {
+            if (name == "ListenOverflows")
+            {
+                counters.overflows = std::stoull(value);
+            }
+            else if (name == "ListenDrops")
+            {
+                counters.drops = std::stoull(value);
+            }
+        }
+    }
+    return counters;
+}
+
 #endif //MEASURE_TRANSFER_UTILS_H
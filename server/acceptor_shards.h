@@ -0,0 +1,195 @@
+#ifndef MEASURE_TRANSFER_ACCEPTOR_SHARDS_H
+#define MEASURE_TRANSFER_ACCEPTOR_SHARDS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+
+using boost::asio::ip::tcp;
+
+using ReusePort = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+struct AcceptorStats
+{
+    std::vector<uint64_t> no_of_accepts;
+    // over the span from the first to the last accept of any shard
+    double accepts_per_second;
+};
+
+/**
+ * Listening sockets sharing one port, each accepting on an io_service and a
+ * thread of its own. With more than one shard every socket is opened with
+ * SO_REUSEPORT and the kernel hashes each incoming connection to one of them,
+ * so accepting is no longer serialized through a single accept queue and a
+ * single thread. Shard 0 runs on the io_service it is given, i.e. on the
+ * threads of its owner; the other shards own their io_service and thread.
+ */
+class AcceptorShards
+{
+public:
+    AcceptorShards(boost::asio::io_service& io_service, uint16_t port, uint32_t no_of_shards, int backlog)
+    {
+        tcp::endpoint endpoint(tcp::v4(), port);
+        for (uint32_t i = 0; i < std::max<uint32_t>(1, no_of_shards); ++i)
+        {
+            auto shard = std::make_unique<Shard>(i == 0 ? &io_service : nullptr);
+            shard->acceptor.open(endpoint.protocol());
+            shard->acceptor.set_option(tcp::acceptor::reuse_address(true));
+            if (no_of_shards > 1)
+            {
+                // must precede the bind, every socket of the group sets it
+                shard->acceptor.set_option(ReusePort(true));
+            }
+            shard->acceptor.bind(endpoint);
+            shard->acceptor.listen(backlog);
+            shards_.push_back(std::move(shard));
+        }
+    }
+
+    ~AcceptorShards()
+    {
+        Stop();
+    }
+
+    std::size_t Size() const
+    {
+        return shards_.size();
+    }
+
+    boost::asio::io_service& IoService(std::size_t shard)
+    {
+        return shards_[shard]->io_service;
+    }
+
+    tcp::acceptor& Acceptor(std::size_t shard)
+    {
+        return shards_[shard]->acceptor;
+    }
+
+    // on the shard's own thread
+    void CountAccept(std::size_t shard)
+    {
+        auto& counters = *shards_[shard];
+        auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        int64_t none = 0;
+        counters.first_accept_time.compare_exchange_strong(none, now, std::memory_order_relaxed);
+        counters.last_accept_time.store(now, std::memory_order_relaxed);
+        counters.no_of_accepts.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // runs the shards owning their io_service, on_start is called first on each of their threads with the shard number
+    void Start(const std::function<void(std::size_t)>& on_start = {})
+    {
+        for (std::size_t i = 1; i < shards_.size(); ++i)
+        {
+            threads_.create_thread([this, i, on_start]() {
+                if (on_start)
+                {
+                    on_start(i);
+                }
+                shards_[i]->io_service.run();
+            });
+        }
+    }
+
+    // stops the threads of the shards and closes every acceptor; shard 0 is closed on the calling thread
+    void Stop()
+    {
+        for (std::size_t i = 1; i < shards_.size(); ++i)
+        {
+            shards_[i]->io_service.stop();
+        }
+        threads_.join_all();
+
+        for (auto& shard : shards_)
+        {
+            boost::system::error_code error;
+            shard->acceptor.close(error);
+        }
+    }
+
+    AcceptorStats GetStats() const
+    {
+        AcceptorStats stats = { {}, 0.0 };
+        int64_t first = 0;
+        int64_t last = 0;
+        for (auto& shard : shards_)
+        {
+            stats.no_of_accepts.push_back(shard->no_of_accepts.load(std::memory_order_relaxed));
+            auto shard_first = shard->first_accept_time.load(std::memory_order_relaxed);
+            if (shard_first != 0)
+            {
+                first = first == 0 ? shard_first : std::min(first, shard_first);
+                last = std::max(last, shard->last_accept_time.load(std::memory_order_relaxed));
+            }
+        }
+
+        uint64_t total = 0;
+        for (auto no_of_accepts : stats.no_of_accepts)
+        {
+            total += no_of_accepts;
+        }
+        auto span = std::chrono::duration<double>(std::chrono::steady_clock::duration(last - first)).count();
+        stats.accepts_per_second = span > 0 ? static_cast<double>(total) / span : 0.0;
+        return stats;
+    }
+
+private:
+    // a cache line each, the counters are written by the shard's own threads only
+    struct alignas(64) Shard
+    {
+        explicit Shard(boost::asio::io_service* shared_io_service)
+            : own_io_service{shared_io_service == nullptr ? std::make_unique<boost::asio::io_service>() : nullptr}
+            , io_service{shared_io_service == nullptr ? *own_io_service : *shared_io_service}
+            , acceptor{io_service}
+        {}
+
+        std::unique_ptr<boost::asio::io_service> own_io_service;
+        boost::asio::io_service& io_service;
+        tcp::acceptor acceptor;
+        std::atomic<uint64_t> no_of_accepts{0};
+        std::atomic<int64_t> first_accept_time{0};
+        std::atomic<int64_t> last_accept_time{0};
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    boost::thread_group threads_;
+};
+
+// the spread of the accepts over the shards, max/mean is 1 for a perfectly even one
+void PrintShardDistribution(std::ostream& os, const std::vector<uint64_t>& no_of_accepts)
+{
+    uint64_t total = 0;
+    uint64_t max = 0;
+    for (std::size_t i = 0; i < no_of_accepts.size(); ++i)
+    {
+        os << (i == 0 ? "" : "/") << no_of_accepts[i];
+        total += no_of_accepts[i];
+        max = std::max(max, no_of_accepts[i]);
+    }
+    double mean = static_cast<double>(total) / static_cast<double>(std::max<std::size_t>(1, no_of_accepts.size()));
+    os << " (max/mean " << (mean > 0 ? static_cast<double>(max) / mean : 0.0) << ")";
+}
+
+std::ostream& operator<<(std::ostream& os, const AcceptorStats& stats)
+{
+    uint64_t total = 0;
+    for (auto no_of_accepts : stats.no_of_accepts)
+    {
+        total += no_of_accepts;
+    }
+    os << stats.no_of_accepts.size() << " acceptor shards, " << total << " accepts at " << stats.accepts_per_second << " accepts/s, per shard ";
+    PrintShardDistribution(os, stats.no_of_accepts);
+    return os;
+}
+
+#endif //MEASURE_TRANSFER_ACCEPTOR_SHARDS_H
@@ -0,0 +1,290 @@
+#ifndef MEASURE_TRANSFER_C10K_SERVER_H
+#define MEASURE_TRANSFER_C10K_SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "acceptor_shards.h"
+#include "messages.h"
+
+using boost::asio::ip::tcp;
+
+const std::size_t kC10kMaxMessageSize = 64 * 1024;
+const int kC10kListenBacklog = 4096;
+
+struct C10kStats
+{
+    std::atomic<uint64_t> no_of_accepted_sessions{0};
+    std::atomic<uint64_t> no_of_closed_sessions{0};
+    std::atomic<uint64_t> no_of_read_messages{0};
+    std::atomic<uint32_t> peak_active_sessions{0};
+};
+
+/**
+ * One low-rate data session of the C10K mode. The client opens it with a
+ * HelloMessage on the data connection itself, acknowledged with message
+ * number 0, then every DataMessage is answered with an AcknowledgeMessage.
+ * Everything is asynchronous, so an idle session costs a socket and a few
+ * small buffers, never a thread.
+ */
+class C10kConnection : public boost::enable_shared_from_this<C10kConnection>
+{
+public:
+    using Pointer = boost::shared_ptr<C10kConnection>;
+
+    // the stats are shared so that connections destroyed with the io_service outlive the server safely
+    static Pointer Create(boost::asio::io_service& io_service, const boost::shared_ptr<C10kStats>& stats)
+    {
+        return Pointer(new C10kConnection(io_service, stats));
+    }
+
+    ~C10kConnection()
+    {
+        if (started_)
+        {
+            stats_->no_of_closed_sessions++;
+        }
+    }
+
+    void Start()
+    {
+        started_ = true;
+        boost::asio::async_read(socket_, boost::asio::buffer(hello_buffer_),
+                                boost::bind(&C10kConnection::OnHello, shared_from_this(), boost::asio::placeholders::error));
+    }
+
+    tcp::socket& Socket()
+    {
+        return socket_;
+    }
+
+private:
+    C10kConnection(boost::asio::io_service& io_service, const boost::shared_ptr<C10kStats>& stats)
+        : socket_(io_service)
+        , stats_(stats)
+        , started_{false}
+    {}
+
+    void OnHello(const boost::system::error_code& error)
+    {
+        if (error)
+        {
+            return;
+        }
+
+        if (hello_buffer_[0] != static_cast<uint8_t>(MessageTag::kHelloMessage))
+        {
+            std::cout << "C10K session rejected, it did not start with a HelloMessage" << std::endl;
+            return;
+        }
+
+        HelloMessage hello_message = HelloMessage::Decode(hello_buffer_);
+        if (hello_message.message_size > kC10kMaxMessageSize)
+        {
+            std::cout << "C10K session rejected, message size " << hello_message.message_size << " too large" << std::endl;
+            return;
+        }
+
+        payload_.resize(hello_message.message_size);
+
+        // completes the handshake, whose latency the connection rate mode measures
+        ack_buffer_ = AcknowledgeMessage::Encode({ 0 });
+        boost::asio::async_write(socket_, boost::asio::buffer(ack_buffer_),
+                                 boost::bind(&C10kConnection::OnAckSent, shared_from_this(), boost::asio::placeholders::error));
+    }
+
+    void ReadHeader()
+    {
+        boost::asio::async_read(socket_, boost::asio::buffer(header_buffer_),
+                                boost::bind(&C10kConnection::OnHeader, shared_from_this(), boost::asio::placeholders::error));
+    }
+
+    void OnHeader(const boost::system::error_code& error)
+    {
+        // EOF is the normal end of a load generator session
+        if (error)
+        {
+            return;
+        }
+
+        boost::asio::async_read(socket_, boost::asio::buffer(payload_),
+                                boost::bind(&C10kConnection::OnPayload, shared_from_this(), boost::asio::placeholders::error));
+    }
+
+    void OnPayload(const boost::system::error_code& error)
+    {
+        if (error || header_buffer_[0] != static_cast<uint8_t>(MessageTag::kDataMessage))
+        {
+            return;
+        }
+
+        stats_->no_of_read_messages++;
+
+        ack_buffer_ = AcknowledgeMessage::Encode({ DataMessage::Decode(header_buffer_).message_no });
+        boost::asio::async_write(socket_, boost::asio::buffer(ack_buffer_),
+                                 boost::bind(&C10kConnection::OnAckSent, shared_from_this(), boost::asio::placeholders::error));
+    }
+
+    void OnAckSent(const boost::system::error_code& error)
+    {
+        if (!error)
+        {
+            ReadHeader();
+        }
+    }
+
+private:
+    tcp::socket socket_;
+    boost::shared_ptr<C10kStats> stats_;
+    bool started_;
+    HelloMessage::Buffer hello_buffer_;
+    DataMessage::Buffer header_buffer_;
+    AcknowledgeMessage::Buffer ack_buffer_;
+    std::vector<uint8_t> payload_;
+};
+
+/**
+ * Accepts C10K sessions on a single port and serves all of them from the
+ * threads running the shared io_service, or with acceptor shards each
+ * session from the io_service of the shard that accepted it. Once a second
+ * it reports the live session count, the accept rate, its spread over the
+ * shards and the resident memory per session.
+ */
+class C10kServer
+{
+public:
+    C10kServer(boost::asio::io_service& io_service, uint16_t port, uint32_t no_of_acceptor_shards = 1)
+        : acceptors_(io_service, port, no_of_acceptor_shards, kC10kListenBacklog)
+        , report_timer_(io_service)
+        , stats_(boost::make_shared<C10kStats>())
+        , baseline_memory_{ResidentMemory()}
+        , last_no_of_accepted_sessions_{0}
+        , last_no_of_read_messages_{0}
+        , last_listen_queue_{ReadListenQueueCounters()}
+        , last_shard_accepts_(acceptors_.Size(), 0)
+    {
+        std::cout << "C10K mode listening on port " << port << " with " << acceptors_.Size() << " acceptor shards, descriptor limit "
+                  << RaiseFileDescriptorLimit() << std::endl;
+    }
+
+    void Start()
+    {
+        for (std::size_t shard = 0; shard < acceptors_.Size(); ++shard)
+        {
+            Accept(shard);
+        }
+        acceptors_.Start();
+        ScheduleReport();
+    }
+
+    // the sessions of the other shards end with their threads, those of shard 0 with the caller's io_service
+    void Stop()
+    {
+        boost::system::error_code error;
+        acceptors_.Stop();
+        report_timer_.cancel(error);
+        Report();
+        std::cout << "C10K accepts: " << acceptors_.GetStats() << std::endl;
+    }
+
+private:
+    // a shard's sessions are served by the shard's io_service, i.e. by the thread that accepted them
+    void Accept(std::size_t shard)
+    {
+        auto connection = C10kConnection::Create(acceptors_.IoService(shard), stats_);
+        acceptors_.Acceptor(shard).async_accept(connection->Socket(),
+                                                boost::bind(&C10kServer::OnAccept, this, shard, connection, boost::asio::placeholders::error));
+    }
+
+    void OnAccept(std::size_t shard, C10kConnection::Pointer connection, const boost::system::error_code& error)
+    {
+        if (error == boost::asio::error::operation_aborted)
+        {
+            return;
+        }
+
+        if (!error)
+        {
+            stats_->no_of_accepted_sessions++;
+            acceptors_.CountAccept(shard);
+            connection->Start();
+        }
+        else
+        {
+            // typically EMFILE: keep accepting, the next closed session frees a descriptor
+            std::cout << "C10kServer::OnAccept error: " << error << std::endl;
+        }
+
+        Accept(shard);
+    }
+
+    void ScheduleReport()
+    {
+        report_timer_.expires_from_now(boost::posix_time::seconds(1));
+        report_timer_.async_wait([this](const boost::system::error_code& error) {
+            if (!error)
+            {
+                Report();
+                ScheduleReport();
+            }
+        });
+    }
+
+    void Report()
+    {
+        uint64_t accepted = stats_->no_of_accepted_sessions;
+        uint64_t read_messages = stats_->no_of_read_messages;
+        auto active = static_cast<uint32_t>(accepted - stats_->no_of_closed_sessions);
+        stats_->peak_active_sessions = std::max<uint32_t>(stats_->peak_active_sessions, active);
+
+        std::size_t memory = ResidentMemory();
+        std::size_t memory_per_session = active > 0 && memory > baseline_memory_ ? (memory - baseline_memory_) / active : 0;
+
+        // a full accept queue shows up as dropped handshakes long before accept() fails
+        auto listen_queue = ReadListenQueueCounters();
+
+        std::cout << "C10K: " << active << " active sessions (peak " << stats_->peak_active_sessions << "), "
+                  << accepted - last_no_of_accepted_sessions_ << " accepts/s, "
+                  << read_messages - last_no_of_read_messages_ << " messages/s, "
+                  << memory_per_session << " bytes RSS per session, "
+                  << listen_queue.overflows - last_listen_queue_.overflows << " accept queue overflows/s";
+        if (acceptors_.Size() > 1)
+        {
+            // how evenly the kernel spread this second's connections over the shards
+            auto shard_accepts = acceptors_.GetStats().no_of_accepts;
+            std::vector<uint64_t> interval_accepts;
+            for (std::size_t i = 0; i < shard_accepts.size(); ++i)
+            {
+                interval_accepts.push_back(shard_accepts[i] - last_shard_accepts_[i]);
+            }
+            std::cout << ", accepts/s per shard ";
+            PrintShardDistribution(std::cout, interval_accepts);
+            last_shard_accepts_ = shard_accepts;
+        }
+        std::cout << std::endl;
+
+        last_no_of_accepted_sessions_ = accepted;
+        last_no_of_read_messages_ = read_messages;
+        last_listen_queue_ = listen_queue;
+    }
+
+private:
+    AcceptorShards acceptors_;
+    boost::asio::deadline_timer report_timer_;
+    boost::shared_ptr<C10kStats> stats_;
+    std::size_t baseline_memory_;
+    uint64_t last_no_of_accepted_sessions_;
+    uint64_t last_no_of_read_messages_;
+    ListenQueueCounters last_listen_queue_;
+    std::vector<uint64_t> last_shard_accepts_;
+};
+
+#endif //MEASURE_TRANSFER_C10K_SERVER_H
@@ -5,39 +5,1065 @@
 #ifndef MEASURE_TRANSFER_COMMUNICATOR_H
 #define MEASURE_TRANSFER_COMMUNICATOR_H
 
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <type_traits>
+
+#include "io_uring.h"
 #include "messages.h"
+#include "phase_profile.h"
+#include "policies.h"
+#include "shared_memory_ring.h"
+#include "tcp_info.h"
+#include "trace.h"
+#include "udp_batch.h"
+
+struct Stats
+{
+    Protocol protocol;
+    CommunicationMechanism communication_mechanism;
+    uint32_t no_of_read_messages;
+    uint32_t no_of_read_bytes;
+    // I/O system calls issued by the data path (io_uring_enter for the io_uring backend)
+    uint64_t no_of_syscalls;
+    // datagram transports only
+    uint32_t no_of_lost_messages;
+    uint32_t no_of_reordered_messages;
+    // TCP data sockets only
+    std::vector<TcpInfoSample> tcp_info;
+    // UDP streaming with FEC only: the lost messages rebuilt from parity, and the time and bytes of rebuilding them
+    uint32_t no_of_recovered_messages;
+    std::chrono::nanoseconds fec_decode_time;
+    uint64_t no_of_fec_decoded_bytes;
+};
+
+class Communicator
+{
+public:
+    virtual ~Communicator() = default;
+    virtual void Start() = 0;
+    virtual void Stop() = 0;
+    virtual Stats GetStats() const = 0;
+
+    // applies the socket options requested in the HelloMessage and returns the values the kernel granted
+    virtual SocketOptions Configure(const SocketOptions& socket_options)
+    {
+        return {};
+    }
+
+    // true if Start() returns at once and the transfer runs elsewhere until Stop()
+    virtual bool Asynchronous() const
+    {
+        return false;
+    }
+
+    // runs the test over a data connection kept from the previous test instead of accepting one; false if unsupported
+    virtual bool AdoptDataConnection(int fd)
+    {
+        return false;
+    }
+
+    // hands over the data connection of a finished test that ended with an EndOfTestMessage, -1 if there is none
+    virtual int ReleaseDataConnection()
+    {
+        return -1;
+    }
+
+    // the number of DataMessages the client sent, from its EndOfTestMessage, given before Stop()
+    virtual void EndTest(uint32_t no_of_sent_messages)
+    {
+    }
+
+    // set before Start() when the client asked for payload verification
+    void EnableVerification(std::unique_ptr<PayloadVerifier> verifier)
+    {
+        verifier_ = std::move(verifier);
+    }
+
+    const PayloadVerifier* Verifier() const
+    {
+        return verifier_.get();
+    }
+
+    // set before Start() when the server records a per-message trace
+    void EnableTracing(std::unique_ptr<TraceWriter> trace)
+    {
+        trace_ = std::move(trace);
+    }
+
+    const TraceWriter* Trace() const
+    {
+        return trace_.get();
+    }
+
+    // set before Start() when the client stamps its DataMessages with their send time
+    void EnableOneWayDelay()
+    {
+        one_way_delay_ = std::make_unique<OneWayDelayMeter>();
+    }
+
+    OneWayDelayMeter* OneWayDelay() const
+    {
+        return one_way_delay_.get();
+    }
+
+    // empty unless built with PHASE_PROFILE
+    const PhaseProfile& Phases() const
+    {
+        return phases_;
+    }
+
+protected:
+    // called once per received DataMessage, with its payload still in the receive buffer
+    void OnDataMessage(uint32_t message_no, const uint8_t* data, std::size_t size)
+    {
+        if (one_way_delay_ && size >= kSendTimeSize)
+        {
+            one_way_delay_->Add(TimestampedDataMessage::SendTime(data), RealtimeNow());
+            data += kSendTimeSize;
+            size -= kSendTimeSize;
+        }
+
+        if (trace_)
+        {
+            trace_->Receive(message_no, static_cast<uint32_t>(size), TraceNow());
+        }
+
+        if (verifier_)
+        {
+            verifier_->Check(message_no, data, size);
+        }
+    }
+
+    // the communicating thread enters each phase of its loop, see PhaseProbe
+    PhaseProfile phases_;
+
+private:
+    std::unique_ptr<PayloadVerifier> verifier_;
+    std::unique_ptr<TraceWriter> trace_;
+    std::unique_ptr<OneWayDelayMeter> one_way_delay_;
+};
+
+using boost::asio::ip::tcp;
+
+/**
+ * Answers every request, a DataMessage of message_size bytes, with a
+ * ResponseMessage carrying response_size bytes, so small requests with large
+ * responses and the other way round can be measured. Requests are served in
+ * order; a client keeping several of them outstanding on the connection finds
+ * them already queued in the socket.
+ */
+class TcpRequestResponseCommunicator : public Communicator
+{
+public:
+    TcpRequestResponseCommunicator(std::size_t message_size, std::size_t response_size, uint16_t client_id,
+                                   std::chrono::milliseconds tcp_info_interval)
+        : protocol_{Protocol::kTcp}
+        , communication_mechanism_{CommunicationMechanism::kRequestResponse}
+        , message_size_{message_size}
+        , io_service_{}
+        , acceptor_{io_service_, tcp::endpoint(tcp::v4(), client_id)}
+        , socket_{io_service_}
+        , request_(message_size)
+        , response_(response_size)
+        , tcp_info_sampler_{tcp_info_interval}
+        , stats_{protocol_, communication_mechanism_, 0, 0}
+    {
+        // a real payload, generated once: the response is about its size, not its content
+        for (std::size_t i = 0; i < response_.size(); ++i)
+        {
+            response_[i] = static_cast<uint8_t>('a' + i % 26);
+        }
+    }
+
+    void Start() override
+    {
+        try
+        {
+            Run();
+            io_service_.run();
+        }
+        catch (std::exception& ex)
+        {
+            std::cout << ex.what() << std::endl;
+        }
+    }
+
+    void Stop() override
+    {
+        std::cout << "TcpRequestResponseCommunicator::Stop" << std::endl;
+        io_service_.stop();
+    }
+
+    Stats GetStats() const override
+    {
+        auto stats = stats_;
+        stats.tcp_info = tcp_info_sampler_.Samples();
+        return stats;
+    }
+
+    SocketOptions Configure(const SocketOptions& socket_options) override
+    {
+        socket_options_ = socket_options;
+        socket_options_.Apply(acceptor_.native_handle(), true);
+        return SocketOptions::Query(acceptor_.native_handle(), true);
+    }
+
+    bool AdoptDataConnection(int fd) override
+    {
+        socket_.assign(tcp::v4(), fd);
+        return true;
+    }
+
+    int ReleaseDataConnection() override
+    {
+        return end_of_test_ && socket_.is_open() ? socket_.release() : -1;
+    }
+
+private:
+    void Run()
+    {
+        std::cout << "TcpRequestResponseCommunicator::Start, " << message_size_ << " byte requests, " << response_.size()
+                  << " byte responses" << std::endl;
+        if (socket_.is_open())
+        {
+            io_service_.post(boost::bind(&TcpRequestResponseCommunicator::OnAccept, this, boost::system::error_code{}));
+            return;
+        }
+
+        acceptor_.async_accept(socket_,
+                               boost::bind(&TcpRequestResponseCommunicator::OnAccept, this, boost::asio::placeholders::error));
+    }
+
+    void OnAccept(const boost::system::error_code& error)
+    {
+        if (error)
+        {
+            std::cout << "TcpRequestResponseCommunicator::OnAccept error: " << error << std::endl;
+            return;
+        }
+
+        socket_options_.Apply(socket_.native_handle(), true);
+        std::cout << "TcpRequestResponseCommunicator data socket options: " << SocketOptions::Query(socket_.native_handle(), true)
+                  << std::endl;
+
+        tcp_info_sampler_.Start(socket_.native_handle());
+        auto result = Communicate();
+        std::cout << "TcpRequestResponseCommunicator finished: " << result << std::endl;
+        tcp_info_sampler_.Stop();
+    }
+
+    boost::system::error_code Communicate()
+    {
+        boost::system::error_code error;
+        while (!io_service_.stopped())
+        {
+            PhaseProbe probe(phases_, Phase::kReadHeader);
+            DataMessage::Buffer header;
+            boost::asio::read(socket_, boost::asio::buffer(header), error);
+            stats_.no_of_syscalls++;
+            if (error)
+            {
+                return error;
+            }
+
+            // a data connection kept for the next test ends with an EndOfTestMessage rather than being closed
+            if (header[0] == static_cast<uint8_t>(MessageTag::kEndOfTestMessage))
+            {
+                end_of_test_ = true;
+                return boost::asio::error::eof;
+            }
+
+            phases_.Enter(Phase::kDecode);
+            auto request = DataMessage::Decode(header);
+            phases_.Enter(Phase::kReadPayload);
+            boost::asio::read(socket_, boost::asio::buffer(request_), error);
+            stats_.no_of_syscalls++;
+            if (error)
+            {
+                return error;
+            }
+
+            phases_.Enter(Phase::kProcess);
+            OnDataMessage(request.message_no, request_.data(), request_.size());
+            phases_.Enter(Phase::kUpdateStats);
+            stats_.no_of_read_messages++;
+            stats_.no_of_read_bytes += DataMessage::kSize + message_size_;
+
+            // header and payload in one gathered write
+            phases_.Enter(Phase::kSendAck);
+            auto response_header = ResponseMessage::Encode({ request.message_no });
+            std::array<boost::asio::const_buffer, 2> response = { boost::asio::buffer(response_header), boost::asio::buffer(response_) };
+            boost::asio::write(socket_, response, error);
+            stats_.no_of_syscalls++;
+            if (error)
+            {
+                return error;
+            }
+        }
+
+        return make_error_code(boost::system::errc::success);
+    }
+
+private:
+    Protocol protocol_;
+    CommunicationMechanism communication_mechanism_;
+    std::size_t message_size_;
+    SocketOptions socket_options_{};
+
+    boost::asio::io_service io_service_;
+    tcp::acceptor acceptor_;
+    tcp::socket socket_;
+    bool end_of_test_ = false;
+
+    std::vector<uint8_t> request_;
+    std::vector<uint8_t> response_;
+
+    TcpInfoSampler tcp_info_sampler_;
+    Stats stats_;
+};
+
+using boost::asio::local::stream_protocol;
+
+/**
+ * Runs every coroutine communicator of the process on one io_context served
+ * by one thread, so a session costs a coroutine frame and a socket instead of
+ * a thread and its stack.
+ */
+class CoroutineScheduler
+{
+public:
+    static CoroutineScheduler& Instance()
+    {
+        static CoroutineScheduler scheduler;
+        return scheduler;
+    }
+
+    CoroutineScheduler(const CoroutineScheduler&) = delete;
+    CoroutineScheduler& operator=(const CoroutineScheduler&) = delete;
+
+    ~CoroutineScheduler()
+    {
+        work_.reset();
+        io_context_.stop();
+        thread_.join();
+    }
+
+    boost::asio::io_context& Context()
+    {
+        return io_context_;
+    }
+
+    pid_t ThreadId() const
+    {
+        return thread_id_;
+    }
+
+    // returns the number of sessions sharing the thread, including the new one
+    uint32_t OnSessionStarted()
+    {
+        auto no_of_sessions = ++no_of_sessions_;
+        peak_no_of_sessions_ = std::max(peak_no_of_sessions_.load(), no_of_sessions);
+        return no_of_sessions;
+    }
+
+    void OnSessionFinished()
+    {
+        no_of_sessions_--;
+    }
+
+    uint32_t PeakNoOfSessions() const
+    {
+        return peak_no_of_sessions_;
+    }
+
+private:
+    CoroutineScheduler()
+        : work_{boost::asio::make_work_guard(io_context_)}
+        , thread_id_{0}
+    {
+        std::promise<pid_t> started;
+        auto thread_id = started.get_future();
+        thread_ = boost::thread([this, &started]() {
+            started.set_value(static_cast<pid_t>(syscall(SYS_gettid)));
+            io_context_.run();
+        });
+        thread_id_ = thread_id.get();
+    }
+
+private:
+    boost::asio::io_context io_context_;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_;
+    boost::thread thread_;
+    pid_t thread_id_;
+    std::atomic<uint32_t> no_of_sessions_{0};
+    std::atomic<uint32_t> peak_no_of_sessions_{0};
+};
+
+// what differs between the stream transports of the coroutine and specialized communicators
+template <typename StreamProtocol>
+struct StreamTransport;
+
+template <>
+struct StreamTransport<tcp>
+{
+    static constexpr Protocol kProtocol = Protocol::kTcp;
+
+    static tcp::endpoint Endpoint(uint16_t client_id)
+    {
+        return tcp::endpoint(tcp::v4(), client_id);
+    }
+
+    static void Release(uint16_t client_id)
+    {}
+};
+
+template <>
+struct StreamTransport<stream_protocol>
+{
+    static constexpr Protocol kProtocol = Protocol::kUnixStream;
+
+    static stream_protocol::endpoint Endpoint(uint16_t client_id)
+    {
+        // remove a socket file left behind by a crashed run
+        ::unlink(UnixSocketPath(client_id).c_str());
+        return stream_protocol::endpoint(UnixSocketPath(client_id));
+    }
+
+    static void Release(uint16_t client_id)
+    {
+        ::unlink(UnixSocketPath(client_id).c_str());
+    }
+};
+
+/**
+ * Serves a TCP or Unix stream session as a C++20 coroutine on the shared
+ * CoroutineScheduler. The protocol logic is the same straight-line loop as in
+ * the thread-per-session communicators, every blocking call is a co_await, and
+ * Start() returns at once instead of occupying the calling thread.
+ */
+template <typename StreamProtocol>
+class CoroutineCommunicator : public Communicator
+{
+    using Transport = StreamTransport<StreamProtocol>;
+    static constexpr bool kTcp = Transport::kProtocol == Protocol::kTcp;
+
+public:
+    CoroutineCommunicator(CommunicationMechanism communication_mechanism, std::size_t message_size, uint16_t client_id,
+                          std::chrono::milliseconds tcp_info_interval)
+        : protocol_{Transport::kProtocol}
+        , communication_mechanism_{communication_mechanism}
+        , message_size_{message_size}
+        , client_id_{client_id}
+        , scheduler_{CoroutineScheduler::Instance()}
+        , acceptor_{scheduler_.Context(), Transport::Endpoint(client_id)}
+        , socket_{scheduler_.Context()}
+        , started_{false}
+        , tcp_info_sampler_{tcp_info_interval}
+        , stats_{protocol_, communication_mechanism_, 0, 0}
+    {}
+
+    ~CoroutineCommunicator() override
+    {
+        Transport::Release(client_id_);
+    }
+
+    bool Asynchronous() const override
+    {
+        return true;
+    }
+
+    void Start() override
+    {
+        std::cout << "CoroutineCommunicator::Start" << std::endl;
+        started_ = true;
+        boost::asio::co_spawn(scheduler_.Context(), Communicate(), [this](std::exception_ptr exception) {
+            if (exception)
+            {
+                try
+                {
+                    std::rethrow_exception(exception);
+                }
+                catch (std::exception& ex)
+                {
+                    std::cout << "CoroutineCommunicator error: " << ex.what() << std::endl;
+                }
+            }
+
+            finished_.set_value();
+        });
+    }
+
+    // waits for the coroutine, which ends when the client closes the data connection
+    void Stop() override
+    {
+        std::cout << "CoroutineCommunicator::Stop" << std::endl;
+        if (!started_)
+        {
+            return;
+        }
+
+        // a client that never connected leaves the coroutine waiting in accept; the close
+        // must have run before this returns, the communicator may be destroyed right after
+        std::promise<void> closed;
+        boost::asio::post(scheduler_.Context(), [this, &closed]() {
+            boost::system::error_code error;
+            acceptor_.close(error);
+            closed.set_value();
+        });
+        closed.get_future().wait();
+        finished_.get_future().wait();
+    }
+
+    Stats GetStats() const override
+    {
+        return stats_;
+    }
+
+    SocketOptions Configure(const SocketOptions& socket_options) override
+    {
+        // options set on the listening socket are inherited by the accepted data socket
+        socket_options_ = socket_options;
+        socket_options_.Apply(acceptor_.native_handle(), kTcp);
+        return SocketOptions::Query(acceptor_.native_handle(), kTcp);
+    }
+
+private:
+    boost::asio::awaitable<void> Communicate()
+    {
+        co_await acceptor_.async_accept(socket_, boost::asio::use_awaitable);
+        socket_options_.Apply(socket_.native_handle(), kTcp);
+
+        auto no_of_sessions = scheduler_.OnSessionStarted();
+        std::cout << "CoroutineCommunicator accepted, " << no_of_sessions << " sessions on the scheduler thread" << std::endl;
+
+        // no per-message logging here: one thread serves every session
+        DataMessage::Buffer header;
+        std::vector<uint8_t> payload(message_size_);
+        AcknowledgeMessage::Buffer ack;
+        boost::system::error_code error;
+        auto awaitable = boost::asio::redirect_error(boost::asio::use_awaitable, error);
+
+        for (;;)
+        {
+            // the phases suspended in a read or write also hold the time the thread spent on other sessions meanwhile
+            PhaseProbe probe(phases_, Phase::kReadHeader);
+            co_await boost::asio::async_read(socket_, boost::asio::buffer(header), awaitable);
+            stats_.no_of_syscalls++;
+            if (error)
+            {
+                break;
+            }
+
+            phases_.Enter(Phase::kReadPayload);
+            co_await boost::asio::async_read(socket_, boost::asio::buffer(payload), awaitable);
+            stats_.no_of_syscalls++;
+            if (error)
+            {
+                break;
+            }
+
+            phases_.Enter(Phase::kDecode);
+            auto message_no = DataMessage::Decode(header).message_no;
+            phases_.Enter(Phase::kProcess);
+            OnDataMessage(message_no, payload.data(), payload.size());
+            phases_.Enter(Phase::kUpdateStats);
+            stats_.no_of_read_messages++;
+            stats_.no_of_read_bytes += DataMessage::kSize + message_size_;
+
+            phases_.Enter(Phase::kSendAck);
+            ack = AcknowledgeMessage::Encode({ message_no });
+            co_await boost::asio::async_write(socket_, boost::asio::buffer(ack), awaitable);
+            stats_.no_of_syscalls++;
+            if (error)
+            {
+                break;
+            }
+
+            if (kTcp)
+            {
+                phases_.Enter(Phase::kUpdateStats);
+                tcp_info_sampler_.Poll(socket_.native_handle());
+            }
+        }
+
+        if (error != boost::asio::error::eof)
+        {
+            std::cout << "CoroutineCommunicator error: " << error << std::endl;
+        }
+
+        stats_.tcp_info = tcp_info_sampler_.Samples();
+        scheduler_.OnSessionFinished();
+        socket_.close(error);
+    }
+
+private:
+    Protocol protocol_;
+    CommunicationMechanism communication_mechanism_;
+    std::size_t message_size_;
+    uint16_t client_id_;
+    SocketOptions socket_options_{};
+
+    CoroutineScheduler& scheduler_;
+    typename StreamProtocol::acceptor acceptor_;
+    typename StreamProtocol::socket socket_;
+    bool started_;
+    std::promise<void> finished_;
+
+    // polled from the coroutine, a sampler thread per session would defeat the purpose
+    TcpInfoSampler tcp_info_sampler_;
+    Stats stats_;
+};
+
+/**
+ * Ack policies of the specialized communicators. AckEachMessage writes one
+ * AcknowledgeMessage per DataMessage, as the stop-and-go client needs it;
+ * AckEachRead collects the ACKs of all messages taken from one read and
+ * writes them with a single call. The byte stream is the same either way.
+ */
+class AckEachMessage
+{
+public:
+    template <typename Socket>
+    boost::system::error_code OnMessage(Socket& socket, uint32_t message_no, uint64_t& no_of_syscalls)
+    {
+        boost::system::error_code error;
+        auto ack = AcknowledgeMessage::Encode({ message_no });
+        boost::asio::write(socket, boost::asio::buffer(ack), error);
+        no_of_syscalls++;
+        return error;
+    }
+
+    template <typename Socket>
+    boost::system::error_code OnReadProcessed(Socket& socket, uint64_t& no_of_syscalls)
+    {
+        return {};
+    }
+};
+
+class AckEachRead
+{
+public:
+    template <typename Socket>
+    boost::system::error_code OnMessage(Socket& socket, uint32_t message_no, uint64_t& no_of_syscalls)
+    {
+        auto ack = AcknowledgeMessage::Encode({ message_no });
+        pending_.insert(pending_.end(), ack.begin(), ack.end());
+        return {};
+    }
+
+    template <typename Socket>
+    boost::system::error_code OnReadProcessed(Socket& socket, uint64_t& no_of_syscalls)
+    {
+        boost::system::error_code error;
+        if (!pending_.empty())
+        {
+            boost::asio::write(socket, boost::asio::buffer(pending_), error);
+            no_of_syscalls++;
+            pending_.clear();
+        }
+        return error;
+    }
+
+private:
+    std::vector<uint8_t> pending_;
+};
+
+/**
+ * One TCP or Unix stream communicator compiled per transport, mechanism, ack
+ * and I/O policy combination, serving both the Asio and the specialized
+ * backend. The batched loop parses every complete message of a read in place
+ * from one preallocated buffer; the message at a time loop reads a header and
+ * a payload per message into the same buffer. Neither makes a virtual call,
+ * an allocation or a runtime branch on the mode per message.
+ */
+template <typename StreamProtocol, typename MechanismPolicy, typename AckPolicy, typename IoPolicy>
+class SpecializedCommunicator : public Communicator
+{
+    using Transport = StreamTransport<StreamProtocol>;
+    static constexpr bool kTcp = Transport::kProtocol == Protocol::kTcp;
+    static constexpr std::size_t kMinReceiveBufferSize = 64 * 1024;
+
+public:
+    SpecializedCommunicator(std::size_t message_size, uint16_t client_id, std::chrono::milliseconds tcp_info_interval)
+        : message_size_{message_size}
+        , frame_size_{DataMessage::kSize + message_size}
+        , client_id_{client_id}
+        , io_service_{}
+        , acceptor_{io_service_, Transport::Endpoint(client_id)}
+        , socket_{io_service_}
+        , receive_buffer_(std::max(kMinReceiveBufferSize, 2 * frame_size_))
+        , tcp_info_sampler_{tcp_info_interval}
+        , stats_{Transport::kProtocol, MechanismPolicy::kMechanism, 0, 0}
+    {}
+
+    ~SpecializedCommunicator() override
+    {
+        Transport::Release(client_id_);
+    }
+
+    void Start() override
+    {
+        std::cout << "SpecializedCommunicator::Start" << std::endl;
+
+        // an adopted data connection is already warmed up by the previous test
+        boost::system::error_code error;
+        if (!socket_.is_open())
+        {
+            acceptor_.accept(socket_, error);
+            if (error)
+            {
+                std::cout << "SpecializedCommunicator accept error: " << error << std::endl;
+                return;
+            }
+        }
+
+        socket_options_.Apply(socket_.native_handle(), kTcp);
+        std::cout << "Data socket options: " << SocketOptions::Query(socket_.native_handle(), kTcp) << std::endl;
+        if (kTcp)
+        {
+            tcp_info_sampler_.Start(socket_.native_handle());
+        }
+
+        error = IoPolicy::kBatched ? CommunicateBatched() : CommunicateMessageAtATime();
+        if (error != boost::asio::error::eof)
+        {
+            std::cout << "SpecializedCommunicator error: " << error << std::endl;
+        }
+
+        tcp_info_sampler_.Stop();
+        stats_.tcp_info = tcp_info_sampler_.Samples();
+    }
+
+    void Stop() override
+    {
+        std::cout << "SpecializedCommunicator::Stop" << std::endl;
+
+        // wakes a blocking accept that no client will complete; closing the descriptor would not
+        ::shutdown(acceptor_.native_handle(), SHUT_RDWR);
+    }
+
+    Stats GetStats() const override
+    {
+        return stats_;
+    }
+
+    SocketOptions Configure(const SocketOptions& socket_options) override
+    {
+        // options set on the listening socket are inherited by the accepted data socket
+        socket_options_ = socket_options;
+        socket_options_.Apply(acceptor_.native_handle(), kTcp);
+        return SocketOptions::Query(acceptor_.native_handle(), kTcp);
+    }
+
+    // only a message at a time over TCP finds the EndOfTestMessage a kept connection ends with
+    bool AdoptDataConnection(int fd) override
+    {
+        if constexpr (kTcp && !IoPolicy::kBatched)
+        {
+            socket_.assign(tcp::v4(), fd);
+            return true;
+        }
+        return false;
+    }
+
+    int ReleaseDataConnection() override
+    {
+        return end_of_test_ && socket_.is_open() ? socket_.release() : -1;
+    }
+
+private:
+    boost::system::error_code CommunicateBatched()
+    {
+        boost::system::error_code error;
+        std::size_t filled = 0;
+
+        for (;;)
+        {
+            PhaseProbe probe(phases_, Phase::kReceive);
+            filled += socket_.read_some(boost::asio::buffer(receive_buffer_.data() + filled, receive_buffer_.size() - filled), error);
+            stats_.no_of_syscalls++;
+            if (error)
+            {
+                return error;
+            }
+
+            std::size_t offset = 0;
+            for (; filled - offset >= frame_size_; offset += frame_size_)
+            {
+                phases_.Enter(Phase::kDecode);
+                if (receive_buffer_[offset] != static_cast<uint8_t>(MessageTag::kDataMessage))
+                {
+                    return make_error_code(boost::system::errc::protocol_error);
+                }
+
+                auto message_no = FromBytes(&receive_buffer_[offset + 1]);
+                phases_.Enter(Phase::kProcess);
+                OnDataMessage(message_no, &receive_buffer_[offset + DataMessage::kSize], message_size_);
+                phases_.Enter(Phase::kUpdateStats);
+                stats_.no_of_read_messages++;
+                stats_.no_of_read_bytes += frame_size_;
+
+                phases_.Enter(Phase::kSendAck);
+                error = ack_policy_.OnMessage(socket_, message_no, stats_.no_of_syscalls);
+                if (error)
+                {
+                    return error;
+                }
+            }
+
+            phases_.Enter(Phase::kSendAck);
+            error = ack_policy_.OnReadProcessed(socket_, stats_.no_of_syscalls);
+            if (error)
+            {
+                return error;
+            }
+
+            // keep the partial message for the next read
+            phases_.Enter(Phase::kReceive);
+            std::memmove(receive_buffer_.data(), receive_buffer_.data() + offset, filled - offset);
+            filled -= offset;
+        }
+    }
+
+    boost::system::error_code CommunicateMessageAtATime()
+    {
+        boost::system::error_code error;
+
+        for (;;)
+        {
+            PhaseProbe probe(phases_, Phase::kReadHeader);
+            boost::asio::read(socket_, boost::asio::buffer(receive_buffer_.data(), DataMessage::kSize), error);
+            stats_.no_of_syscalls++;
+            if (error)
+            {
+                return error;
+            }
+
+            // a data connection kept for the next test ends with an EndOfTestMessage rather than being closed
+            if (receive_buffer_[0] == static_cast<uint8_t>(MessageTag::kEndOfTestMessage))
+            {
+                end_of_test_ = true;
+                return boost::asio::error::eof;
+            }
+
+            phases_.Enter(Phase::kDecode);
+            if (receive_buffer_[0] != static_cast<uint8_t>(MessageTag::kDataMessage))
+            {
+                return make_error_code(boost::system::errc::protocol_error);
+            }
+            auto message_no = FromBytes(&receive_buffer_[1]);
+
+            phases_.Enter(Phase::kReadPayload);
+            boost::asio::read(socket_, boost::asio::buffer(receive_buffer_.data() + DataMessage::kSize, message_size_), error);
+            stats_.no_of_syscalls++;
+            if (error)
+            {
+                return error;
+            }
+
+            phases_.Enter(Phase::kProcess);
+            OnDataMessage(message_no, &receive_buffer_[DataMessage::kSize], message_size_);
+            phases_.Enter(Phase::kUpdateStats);
+            stats_.no_of_read_messages++;
+            stats_.no_of_read_bytes += frame_size_;
+
+            phases_.Enter(Phase::kSendAck);
+            error = ack_policy_.OnMessage(socket_, message_no, stats_.no_of_syscalls);
+            if (error)
+            {
+                return error;
+            }
+        }
+    }
+
+private:
+    std::size_t message_size_;
+    std::size_t frame_size_;
+    uint16_t client_id_;
+    SocketOptions socket_options_{};
+
+    boost::asio::io_service io_service_;
+    typename StreamProtocol::acceptor acceptor_;
+    typename StreamProtocol::socket socket_;
+    std::vector<uint8_t> receive_buffer_;
+    AckPolicy ack_policy_;
+    bool end_of_test_ = false;
+
+    TcpInfoSampler tcp_info_sampler_;
+    Stats stats_;
+};
+
+// the only runtime dispatch of the stream communicators, once per session; a message at a time is acknowledged on its own
+template <typename StreamProtocol, typename IoPolicy>
+std::unique_ptr<Communicator> SpecializedCommunicatorFactory(CommunicationMechanism communication_mechanism, std::size_t message_size,
+                                                             uint16_t client_id, std::chrono::milliseconds tcp_info_interval)
+{
+    using StreamingAckPolicy = std::conditional_t<IoPolicy::kBatched, AckEachRead, AckEachMessage>;
+
+    switch (communication_mechanism)
+    {
+        case CommunicationMechanism::kStopAndGo:
+        {
+            return std::make_unique<SpecializedCommunicator<StreamProtocol, StopAndGoPolicy, AckEachMessage, IoPolicy>>(
+                message_size, client_id, tcp_info_interval);
+        }
+        case CommunicationMechanism::kStreaming:
+        {
+            return std::make_unique<SpecializedCommunicator<StreamProtocol, StreamingPolicy, StreamingAckPolicy, IoPolicy>>(
+                message_size, client_id, tcp_info_interval);
+        }
+        default:
+        {
+            std::cerr << communication_mechanism << std::endl;
+            return nullptr;
+        }
+    }
+}
+
+class SharedMemoryCommunicator : public Communicator
+{
+public:
+    SharedMemoryCommunicator(CommunicationMechanism communication_mechanism, std::size_t message_size, uint16_t client_id)
+        : protocol_{Protocol::kSharedMemory}
+        , communication_mechanism_{communication_mechanism}
+        , message_size_{message_size}
+        , segment_{SharedMemorySegment::Create(SharedMemoryName(client_id))}
+        , data_ring_{segment_.DataRing()}
+        , ack_ring_{segment_.AckRing()}
+        , stats_{protocol_, communication_mechanism_, 0, 0}
+    {}
+
+    void Start() override
+    {
+        std::cout << "SharedMemoryCommunicator::Start" << std::endl;
+
+        try
+        {
+            Communicate();
+        }
+        catch (std::exception& ex)
+        {
+            std::cout << ex.what() << std::endl;
+        }
+    }
+
+    void Stop() override
+    {
+        std::cout << "SharedMemoryCommunicator::Stop" << std::endl;
+        data_ring_.Close();
+        ack_ring_.Close();
+    }
+
+    Stats GetStats() const override
+    {
+        return stats_;
+    }
+
+private:
+    boost::system::error_code Communicate()
+    {
+        std::vector<uint8_t> payload(message_size_);
+
+        while (true)
+        {
+            // read message
+            PhaseProbe probe(phases_, Phase::kReadHeader);
+            DataMessage::Buffer data_message_buffer;
+            auto error = data_ring_.Read(data_message_buffer.data(), data_message_buffer.size());
+            if (!error)
+            {
+                phases_.Enter(Phase::kReadPayload);
+                error = data_ring_.Read(payload.data(), payload.size());
+            }
+
+            if (error)
+            {
+                std::cout << "Communicate error on reading DataMessage: " << error << std::endl;
+                return error;
+            }
+
+            phases_.Enter(Phase::kDecode);
+            auto data_message = DataMessage::Decode(data_message_buffer);
+
+            phases_.Enter(Phase::kProcess);
+            OnDataMessage(data_message.message_no, payload.data(), payload.size());
+            phases_.Enter(Phase::kUpdateStats);
+            UpdateStats();
+
+            // send response message
+            phases_.Enter(Phase::kSendAck);
+            AcknowledgeMessage ack_message = { data_message.message_no };
+            auto ack_buffer = AcknowledgeMessage::Encode(ack_message);
+            error = ack_ring_.Write(ack_buffer.data(), ack_buffer.size());
+            if (error)
+            {
+                std::cout << "Communicate error on sending AcknowledgeMessage: " << error << std::endl;
+                return error;
+            }
+        }
+    }
+
+    void UpdateStats()
+    {
+        stats_.no_of_read_messages++;
+        stats_.no_of_read_bytes += DataMessage::kSize + message_size_;
+    }
+
+private:
+    Protocol protocol_;
+    CommunicationMechanism communication_mechanism_;
+    std::size_t message_size_;
 
-struct Stats
-{
-    Protocol protocol;
-    CommunicationMechanism communication_mechanism;
-    uint32_t no_of_read_messages;
-    uint32_t no_of_read_bytes;
-};
+    SharedMemorySegment segment_;
+    SharedMemoryRing data_ring_;
+    SharedMemoryRing ack_ring_;
 
-class Communicator
-{
-public:
-    virtual ~Communicator() = default;
-    virtual void Start() = 0;
-    virtual void Stop() = 0;
-    virtual Stats GetStats() const = 0;
+    Stats stats_;
 };
 
-using boost::asio::ip::tcp;
-
-class TcpStopAndGoCommunicator : public Communicator
+const std::size_t kIoUringReceiveBufferSize = 1024 * 1024;
+const std::size_t kIoUringAckBufferSize = 64 * 1024;
+const uint16_t kIoUringProvidedBufferCount = 64;
+const uint32_t kIoUringProvidedBufferSize = 64 * 1024;
+
+/**
+ * TCP communicator driven by io_uring instead of blocking Asio calls.
+ * Incoming bytes land in a registered buffer, every complete DataMessage in it
+ * is parsed, and all the resulting ACKs go out as a single fixed write that is
+ * submitted together with the next receive: one io_uring_enter per batch
+ * instead of three syscalls per message. With kIoUringMultishot a single
+ * multishot recv over a provided buffer ring replaces the per-batch reads.
+ */
+class IoUringCommunicator : public Communicator
 {
 public:
-    TcpStopAndGoCommunicator(std::size_t message_size, uint16_t client_id)
+    IoUringCommunicator(CommunicationMechanism communication_mechanism, std::size_t message_size, uint8_t io_uring_flags, uint16_t client_id,
+                        std::chrono::milliseconds tcp_info_interval)
         : protocol_{Protocol::kTcp}
-        , communication_mechanism_{CommunicationMechanism::kStopAndGo}
+        , communication_mechanism_{communication_mechanism}
         , message_size_{message_size}
+        , multishot_{(io_uring_flags & kIoUringMultishot) != 0}
+        , ring_{kIoUringEntries, (io_uring_flags & kIoUringSqPoll) != 0}
         , io_service_{}
         , acceptor_{io_service_, tcp::endpoint(tcp::v4(), client_id)}
         , socket_{io_service_}
+        , receive_buffer_(std::max(kIoUringReceiveBufferSize, 4 * (DataMessage::kSize + message_size)))
+        , ack_buffer_(kIoUringAckBufferSize)
+        , tcp_info_sampler_{tcp_info_interval}
         , stats_{protocol_, communication_mechanism_, 0, 0}
-    {}
+    {
+        ring_.RegisterBuffers({ { receive_buffer_.data(), receive_buffer_.size() },
+                                { ack_buffer_.data(), ack_buffer_.size() } });
+
+        if (multishot_)
+        {
+            provided_buffers_.resize(kIoUringProvidedBufferCount * kIoUringProvidedBufferSize);
+            ring_.RegisterBufferRing(kBufferGroup, provided_buffers_.data(), kIoUringProvidedBufferSize, kIoUringProvidedBufferCount);
+        }
+    }
 
     void Start() override
     {
@@ -55,124 +1081,238 @@ public:
 
     void Stop() override
     {
-        std::cout << "TcpStopAndGoCommunicator::Stop" << std::endl;
+        std::cout << "IoUringCommunicator::Stop" << std::endl;
         io_service_.stop();
+        // Communicate() blocks in io_uring_enter, which io_service_ cannot interrupt
+        ring_.Wake();
     }
 
     Stats GetStats() const override
     {
-        return stats_;
+        auto stats = stats_;
+        stats.no_of_syscalls = ring_.NoOfEnterCalls();
+        stats.tcp_info = tcp_info_sampler_.Samples();
+        return stats;
+    }
+
+    SocketOptions Configure(const SocketOptions& socket_options) override
+    {
+        // options set on the listening socket are inherited by the accepted data socket
+        socket_options_ = socket_options;
+        socket_options_.Apply(acceptor_.native_handle(), true);
+        return SocketOptions::Query(acceptor_.native_handle(), true);
     }
 
 private:
+    enum Operation : uint64_t
+    {
+        kRead = 1,
+        kWrite = 2,
+        kRecvMultishot = 3,
+        kWakeup = 4
+    };
+
+    static const uint16_t kBufferGroup = 0;
+    static const uint16_t kReceiveBufferIndex = 0;
+    static const uint16_t kAckBufferIndex = 1;
+
     void Run()
     {
-        std::cout << "TcpStopAndGoCommunicator::Start" << std::endl;
+        std::cout << "IoUringCommunicator::Start" << std::endl;
         acceptor_.async_accept(socket_,
-                               boost::bind(&TcpStopAndGoCommunicator::OnAccept, this, boost::asio::placeholders::error));
+                               boost::bind(&IoUringCommunicator::OnAccept, this, boost::asio::placeholders::error));
     }
 
     void OnAccept(const boost::system::error_code& error)
     {
         if (error)
         {
-            std::cout << "TcpStopAndGoCommunicator::OnAccept error: " << error << std::endl;
+            std::cout << "IoUringCommunicator::OnAccept error: " << error << std::endl;
             return;
         }
 
-        Communicate();
+        socket_options_.Apply(socket_.native_handle(), true);
+        std::cout << "IoUringCommunicator data socket options: " << SocketOptions::Query(socket_.native_handle(), true) << std::endl;
+
+        tcp_info_sampler_.Start(socket_.native_handle());
+        auto communicate_error = Communicate();
+        tcp_info_sampler_.Stop();
+        std::cout << "IoUringCommunicator finished: " << communicate_error << std::endl;
     }
 
     boost::system::error_code Communicate()
     {
+        int fd = socket_.native_handle();
+
+        ring_.ArmWakeup(kWakeup);
+        if (multishot_)
+        {
+            IoUring::PrepRecvMultishot(ring_.GetSqe(), fd, kBufferGroup, kRecvMultishot);
+        }
+
         while (!io_service_.stopped())
         {
-            // read message
-            DataMessage data_message;
-            auto error = ReadDataMessage(data_message);
-            if (error)
+            PhaseProbe probe(phases_, Phase::kReceive);
+            if (!multishot_ && !read_in_flight_)
             {
-                std::cout << "Communicate error on reading DataMessage: " << error << std::endl;
-                return error;
+                CompactReceiveBuffer();
+                IoUring::PrepReadFixed(ring_.GetSqe(), fd, receive_buffer_.data() + received_end_,
+                                       static_cast<uint32_t>(receive_buffer_.size() - received_end_), kReceiveBufferIndex, kRead);
+                read_in_flight_ = true;
             }
 
-            std::cout << "Read DataMessage " << data_message.message_no << std::endl;
-
-            // process data message
-            // TODO: put the bytes from the payload to a file
-
-            UpdateStats();
+            if (!write_in_flight_ && !pending_acks_.empty())
+            {
+                phases_.Enter(Phase::kSendAck);
+                SubmitAcks(fd);
+            }
 
-            // send response message
-            AcknowledgeMessage ack_message = { data_message.message_no };
-            error = SendAckMessage(ack_message);
-            if (error)
+            // submits and blocks for the next completion
+            phases_.Enter(Phase::kWait);
+            int result = ring_.Submit(1);
+            if (result < 0)
             {
-                std::cout << "Communicate error on sending AcknowledgeMessage: " << error << std::endl;
-                return error;
+                return boost::system::error_code(-result, boost::system::system_category());
             }
 
-            std::cout << "Sent ACK for DataMessage " << ack_message.message_no << std::endl;
+            io_uring_cqe cqe{};
+            while (ring_.PeekCompletion(cqe))
+            {
+                phases_.Enter(Phase::kReceive);
+                auto error = HandleCompletion(fd, cqe);
+                if (error)
+                {
+                    return error;
+                }
+            }
         }
 
         return make_error_code(boost::system::errc::success);
     }
 
-    boost::system::error_code ReadDataMessage(DataMessage& data_message)
+    boost::system::error_code HandleCompletion(int fd, const io_uring_cqe& cqe)
     {
-        boost::system::error_code error;
-
-        // wait data message
-        DataMessage::Buffer data_message_buffer;
-
-        auto read_bytes = socket_.read_some(boost::asio::buffer(data_message_buffer), error);
-
-        if (error)
+        if (cqe.user_data == kRecvMultishot && cqe.res == -ENOBUFS)
         {
-            std::cout << "Read DataMessage header error: " << error << std::endl;
-            return error;
+            // the kernel filled every provided buffer before we recycled one; just re-arm
+            IoUring::PrepRecvMultishot(ring_.GetSqe(), fd, kBufferGroup, kRecvMultishot);
+            return make_error_code(boost::system::errc::success);
         }
 
-        if (read_bytes < DataMessage::kSize)
+        if (cqe.res < 0)
         {
-            std::cout << "Read DataMessage header of wrong size" << std::endl;
-            return make_error_code(boost::system::errc::protocol_error);
+            return boost::system::error_code(-cqe.res, boost::system::system_category());
         }
 
-        // decode data message header
-        data_message = DataMessage::Decode(data_message_buffer);
+        switch (cqe.user_data)
+        {
+            case kRead:
+            {
+                read_in_flight_ = false;
+                if (cqe.res == 0)
+                {
+                    return make_error_code(boost::system::errc::no_message_available);
+                }
 
-        // read the payload
-        data_message.data.resize(message_size_);
-        read_bytes = socket_.read_some(boost::asio::buffer(data_message.data), error);
+                received_end_ += cqe.res;
+                ParseDataMessages();
+                break;
+            }
+            case kRecvMultishot:
+            {
+                if (cqe.res == 0)
+                {
+                    return make_error_code(boost::system::errc::no_message_available);
+                }
 
-        if (error)
-        {
-            std::cout << "Read DataMessage payload error: " << error << std::endl;
-            return error;
-        }
+                auto id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                CompactReceiveBuffer();
+                std::memcpy(receive_buffer_.data() + received_end_, ring_.ProvidedBuffer(id), cqe.res);
+                received_end_ += cqe.res;
+                ring_.RecycleBuffer(id);
+                ParseDataMessages();
 
-        if (read_bytes < message_size_)
-        {
-            std::cout << "Read DataMessage payload of wrong size" << std::endl;
-            return make_error_code(boost::system::errc::protocol_error);
+                // the kernel ends a multishot recv when it runs out of buffers
+                if (!(cqe.flags & IORING_CQE_F_MORE))
+                {
+                    IoUring::PrepRecvMultishot(ring_.GetSqe(), fd, kBufferGroup, kRecvMultishot);
+                }
+                break;
+            }
+            case kWakeup:
+            {
+                return boost::asio::error::operation_aborted;
+            }
+            case kWrite:
+            {
+                ack_offset_ += cqe.res;
+                if (ack_offset_ < ack_length_)
+                {
+                    // short write, send the rest of the batch
+                    IoUring::PrepWriteFixed(ring_.GetSqe(), fd, ack_buffer_.data() + ack_offset_,
+                                            static_cast<uint32_t>(ack_length_ - ack_offset_), kAckBufferIndex, kWrite);
+                }
+                else
+                {
+                    write_in_flight_ = false;
+                }
+                break;
+            }
+            default:
+            {
+                break;
+            }
         }
 
         return make_error_code(boost::system::errc::success);
     }
 
-    boost::system::error_code SendAckMessage(AcknowledgeMessage ack_message)
+    void ParseDataMessages()
     {
-        // send the ACK
-        auto sent_bytes = socket_.send(boost::asio::buffer(AcknowledgeMessage::Encode(ack_message)));
+        std::size_t message_length = DataMessage::kSize + message_size_;
+
+        while (received_end_ - received_begin_ >= message_length)
+        {
+            phases_.Enter(Phase::kDecode);
+            DataMessage::Buffer header;
+            std::copy_n(receive_buffer_.begin() + received_begin_, DataMessage::kSize, header.begin());
+            auto data_message = DataMessage::Decode(header);
+            phases_.Enter(Phase::kProcess);
+            OnDataMessage(data_message.message_no, &receive_buffer_[received_begin_ + DataMessage::kSize], message_size_);
+            received_begin_ += message_length;
+
+            phases_.Enter(Phase::kUpdateStats);
+            UpdateStats();
+
+            phases_.Enter(Phase::kSendAck);
+            AcknowledgeMessage ack_message = { data_message.message_no };
+            auto ack_buffer = AcknowledgeMessage::Encode(ack_message);
+            pending_acks_.insert(pending_acks_.end(), ack_buffer.begin(), ack_buffer.end());
+        }
+    }
 
-        if (sent_bytes < AcknowledgeMessage::kSize)
+    void CompactReceiveBuffer()
+    {
+        // keep the partial message at the front so the next read has room for at least one message
+        std::size_t remaining = received_end_ - received_begin_;
+        if (received_begin_ > 0 && receive_buffer_.size() - received_end_ < kIoUringProvidedBufferSize + DataMessage::kSize + message_size_)
         {
-            std::cout << "Failed to send AcknowledgeMessage" << std::endl;
-            return make_error_code(boost::system::errc::protocol_error);
+            std::memmove(receive_buffer_.data(), receive_buffer_.data() + received_begin_, remaining);
+            received_begin_ = 0;
+            received_end_ = remaining;
         }
+    }
 
-        return make_error_code(boost::system::errc::success);
+    void SubmitAcks(int fd)
+    {
+        ack_length_ = std::min(pending_acks_.size(), ack_buffer_.size());
+        ack_length_ -= ack_length_ % AcknowledgeMessage::kSize;
+        std::copy_n(pending_acks_.begin(), ack_length_, ack_buffer_.begin());
+        pending_acks_.erase(pending_acks_.begin(), pending_acks_.begin() + ack_length_);
+        ack_offset_ = 0;
+
+        IoUring::PrepWriteFixed(ring_.GetSqe(), fd, ack_buffer_.data(), static_cast<uint32_t>(ack_length_), kAckBufferIndex, kWrite);
+        write_in_flight_ = true;
     }
 
     void UpdateStats()
@@ -185,34 +1325,88 @@ private:
     Protocol protocol_;
     CommunicationMechanism communication_mechanism_;
     std::size_t message_size_;
+    SocketOptions socket_options_{};
+    bool multishot_;
+
+    IoUring ring_;
 
     boost::asio::io_service io_service_;
     tcp::acceptor acceptor_;
     tcp::socket socket_;
 
+    std::vector<uint8_t> receive_buffer_;
+    std::size_t received_begin_ = 0;
+    std::size_t received_end_ = 0;
+    bool read_in_flight_ = false;
+    std::vector<uint8_t> provided_buffers_;
+
+    std::vector<uint8_t> ack_buffer_;
+    std::vector<uint8_t> pending_acks_;
+    std::size_t ack_offset_ = 0;
+    std::size_t ack_length_ = 0;
+    bool write_in_flight_ = false;
+
+    TcpInfoSampler tcp_info_sampler_;
     Stats stats_;
 };
 
-class TcpStreamingCommunicator : public Communicator
+using boost::asio::ip::udp;
+
+/**
+ * UDP communicator built around recvmmsg: every call drains up to batch_size
+ * datagrams (or batch_size GRO-coalesced bursts). Stop-and-go ACKs of one
+ * batch go back in a single sendmmsg, streaming is fire and forget and only
+ * counts losses and reordering from the message numbers. A window of message
+ * numbers above the lowest one still missing tells new messages from
+ * duplicates, which are not received again; the messages lost are those sent,
+ * as the EndOfTestMessage tells, that were never received.
+ */
+class UdpCommunicator : public Communicator
 {
 public:
-    TcpStreamingCommunicator(std::size_t message_size, uint16_t client_id)
-        : protocol_{Protocol::kTcp}
-        , communication_mechanism_{CommunicationMechanism::kStreaming}
+    UdpCommunicator(CommunicationMechanism communication_mechanism, std::size_t message_size, uint16_t batch_size, uint8_t udp_flags, uint16_t client_id,
+                    const FecOptions& fec = {}, bool reliable = false)
+        : protocol_{Protocol::kUdp}
+        , communication_mechanism_{communication_mechanism}
+        , reliable_{reliable}
         , message_size_{message_size}
         , io_service_{}
-        , acceptor_{io_service_, tcp::endpoint(tcp::v4(), client_id)}
-        , socket_{io_service_}
+        , socket_{io_service_, udp::endpoint(udp::v4(), client_id)}
+        , receiver_{socket_.native_handle(), std::max<uint16_t>(batch_size, 1),
+                    (fec.Enabled() ? ParityMessage::kSize : DataMessage::kSize) + message_size, (udp_flags & kUdpGro) != 0}
+        , ack_sender_{socket_.native_handle(), std::max<uint16_t>(batch_size, 1), false}
+        , stopped_{false}
+        , next_message_no_{0}
+        , received_(kReceiveWindow, false)
+        , window_base_{0}
+        , test_ended_{false}
+        , no_of_sent_messages_{0}
         , stats_{protocol_, communication_mechanism_, 0, 0}
-    {}
+    {
+        // wake up periodically so Stop() is noticed once the socket is drained
+        timeval timeout = { 0, kReceiveTimeoutUs };
+        setsockopt(socket_.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        if (fec.Enabled())
+        {
+            std::cout << "FEC: " << fec << std::endl;
+            fec_decoder_ = std::make_unique<FecDecoder>(fec, message_size_);
+        }
+    }
 
     void Start() override
     {
+        std::cout << "UdpCommunicator::Start" << std::endl;
+
         try
         {
-            // create new socket for the data transfer
-            Run();
-            io_service_.run();
+            auto error = Communicate();
+            std::cout << "UdpCommunicator finished: " << error << std::endl;
+            // they are missing from the read messages, so they count as lost
+            if (receiver_.NoOfTruncated() > 0)
+            {
+                std::cout << "Dropped " << receiver_.NoOfTruncated() << " truncated datagrams larger than the receive buffer" << std::endl;
+            }
         }
         catch (std::exception& ex)
         {
@@ -222,171 +1416,335 @@ public:
 
     void Stop() override
     {
-        std::cout << "TcpStreamingCommunicator::Stop" << std::endl;
-        io_service_.stop();
-    }
-
-    Stats GetStats() const override
-    {
-        return stats_;
+        std::cout << "UdpCommunicator::Stop" << std::endl;
+        stopped_ = true;
     }
 
-private:
-    void Run()
+    void EndTest(uint32_t no_of_sent_messages) override
     {
-        std::cout << "TcpStreamingCommunicator::Start" << std::endl;
-        acceptor_.async_accept(socket_,
-                               boost::bind(&TcpStreamingCommunicator::OnAccept, this, boost::asio::placeholders::error));
+        test_ended_ = true;
+        no_of_sent_messages_ = no_of_sent_messages;
     }
 
-    void OnAccept(const boost::system::error_code& error)
+    Stats GetStats() const override
     {
-        if (error)
+        auto stats = stats_;
+        stats.no_of_syscalls = receiver_.NoOfSyscalls() + ack_sender_.NoOfSyscalls();
+        // of the messages sent, or without an EndOfTestMessage of those up to the highest received, the ones never received
+        uint64_t no_of_expected_messages = test_ended_ ? no_of_sent_messages_ : next_message_no_;
+        stats.no_of_lost_messages = static_cast<uint32_t>(
+            no_of_expected_messages > stats_.no_of_read_messages ? no_of_expected_messages - stats_.no_of_read_messages : 0);
+        if (fec_decoder_)
         {
-            std::cout << "TcpStreamingCommunicator::OnAccept error: " << error << std::endl;
-            return;
+            stats.no_of_recovered_messages = fec_decoder_->NoOfRecoveredMessages();
+            stats.fec_decode_time = fec_decoder_->DecodeTime();
+            stats.no_of_fec_decoded_bytes = fec_decoder_->NoOfDecodedBytes();
         }
+        return stats;
+    }
 
-        Communicate();
+    SocketOptions Configure(const SocketOptions& socket_options) override
+    {
+        socket_options.Apply(socket_.native_handle(), false);
+        return SocketOptions::Query(socket_.native_handle(), false);
     }
 
+private:
+    static const long kReceiveTimeoutUs = 100 * 1000;
+    // message numbers tracked above the lowest one missing, 128 KiB of bits
+    static const uint32_t kReceiveWindow = 1 << 20;
+
+    enum class Arrival
+    {
+        kNew,
+        kDuplicate,
+        // too far ahead of a reliable stream's window
+        kOutsideWindow
+    };
+
     boost::system::error_code Communicate()
     {
-        while (!io_service_.stopped())
+        std::vector<uint8_t> acks;
+        sockaddr_storage peer{};
+        socklen_t peer_length = 0;
+
+        while (true)
         {
-            // read message
-            DataMessage data_message;
-            auto error = ReadDataMessage(data_message);
-            if (error)
+            PhaseProbe probe(phases_, Phase::kReceive);
+            acks.clear();
+            int result = receiver_.Receive([&](const uint8_t* data, std::size_t size, const sockaddr_storage& from, socklen_t from_length)
             {
-                std::cout << "Communicate error on reading DataMessage: " << error << std::endl;
-                return error;
-            }
+                // every way out goes back to receiving the rest of the batch
+                phases_.Enter(Phase::kDecode);
+                if (fec_decoder_ && size > 0 && data[0] == static_cast<uint8_t>(MessageTag::kParityMessage))
+                {
+                    phases_.Enter(Phase::kProcess);
+                    OnParityMessage(data, size);
+                    phases_.Enter(Phase::kReceive);
+                    return;
+                }
+
+                if (size < DataMessage::kSize + message_size_)
+                {
+                    std::cout << "Read DataMessage of wrong size: " << size << std::endl;
+                    phases_.Enter(Phase::kReceive);
+                    return;
+                }
 
-            std::cout << "Read DataMessage " << data_message.message_no << std::endl;
+                DataMessage::Buffer header;
+                std::copy_n(data, DataMessage::kSize, header.begin());
+                auto data_message = DataMessage::Decode(header);
+                auto arrival = Track(data_message.message_no);
+                if (arrival == Arrival::kOutsideWindow)
+                {
+                    // not acknowledged either, the client sends it again once the window has moved on
+                    phases_.Enter(Phase::kReceive);
+                    return;
+                }
 
-            // process data message
-            // TODO: put the bytes from the payload to a file
+                // a duplicate, e.g. a retransmission or the late original of a message rebuilt already, is only acknowledged again
+                if (arrival == Arrival::kNew
+                    && (!fec_decoder_ || fec_decoder_->AddData(data_message.message_no, data + DataMessage::kSize,
+                                                              [this](uint32_t message_no, const uint8_t* data) { OnRecovered(message_no, data); })))
+                {
+                    phases_.Enter(Phase::kProcess);
+                    OnDataMessage(data_message.message_no, data + DataMessage::kSize, size - DataMessage::kSize);
+                    phases_.Enter(Phase::kUpdateStats);
+                    UpdateStats(data_message.message_no);
+                }
 
-            UpdateStats();
+                if (communication_mechanism_ == CommunicationMechanism::kStopAndGo || reliable_)
+                {
+                    phases_.Enter(Phase::kSendAck);
+                    auto ack_buffer = AcknowledgeMessage::Encode({ data_message.message_no });
+                    acks.insert(acks.end(), ack_buffer.begin(), ack_buffer.end());
+                    peer = from;
+                    peer_length = from_length;
+                }
+                phases_.Enter(Phase::kReceive);
+            });
 
-            // send response message
-            AcknowledgeMessage ack_message = { data_message.message_no };
-            error = SendAckMessage(ack_message);
-            if (error)
+            if (result < 0)
             {
-                std::cout << "Communicate error on sending AcknowledgeMessage: " << error << std::endl;
-                return error;
+                if (-result == EAGAIN || -result == EWOULDBLOCK || -result == EINTR)
+                {
+                    // only leave once stopped and there is nothing left in the socket
+                    if (stopped_)
+                    {
+                        return make_error_code(boost::system::errc::success);
+                    }
+                    continue;
+                }
+
+                return boost::system::error_code(-result, boost::system::system_category());
             }
 
-            std::cout << "Sent ACK for DataMessage " << ack_message.message_no << std::endl;
+            if (!acks.empty())
+            {
+                phases_.Enter(Phase::kSendAck);
+                auto error = ack_sender_.Send(acks.data(), AcknowledgeMessage::kSize, acks.size() / AcknowledgeMessage::kSize, &peer, peer_length);
+                if (error)
+                {
+                    std::cout << "Communicate error on sending AcknowledgeMessages: " << error << std::endl;
+                    return error;
+                }
+            }
         }
-
-        return make_error_code(boost::system::errc::success);
     }
 
-    boost::system::error_code ReadDataMessage(DataMessage& data_message)
+    /**
+     * Marks the message received. Below the window every message was received
+     * or given up, so the window's memory is bounded whatever number comes off
+     * the wire. A reliable stream waits for the window's lowest message, the
+     * client retransmitting it; any other test moves the window up to a message
+     * beyond it, and the messages left behind unreceived stay lost.
+     */
+    Arrival Track(uint32_t message_no)
     {
-        boost::system::error_code error;
-
-        // wait data message
-        DataMessage::Buffer data_message_buffer;
-
-        auto read_bytes = socket_.read_some(boost::asio::buffer(data_message_buffer), error);
-
-        if (error)
+        if (message_no < window_base_)
         {
-            std::cout << "Read DataMessage header error: " << error << std::endl;
-            return error;
+            return Arrival::kDuplicate;
         }
 
-        if (read_bytes < DataMessage::kSize)
+        if (message_no - window_base_ >= kReceiveWindow)
         {
-            std::cout << "Read DataMessage header of wrong size" << std::endl;
-            return make_error_code(boost::system::errc::protocol_error);
+            if (reliable_)
+            {
+                return Arrival::kOutsideWindow;
+            }
+            SlideWindow(uint64_t{message_no} - kReceiveWindow + 1);
         }
 
-        // decode data message header
-        data_message = DataMessage::Decode(data_message_buffer);
+        auto slot = message_no % kReceiveWindow;
+        if (received_[slot])
+        {
+            return Arrival::kDuplicate;
+        }
+        received_[slot] = true;
 
-        // read the payload
-        data_message.data.resize(message_size_);
-        read_bytes = socket_.read_some(boost::asio::buffer(data_message.data), error);
+        // the window starts at the lowest message still missing
+        while (received_[window_base_ % kReceiveWindow])
+        {
+            received_[window_base_ % kReceiveWindow] = false;
+            window_base_++;
+        }
+        return Arrival::kNew;
+    }
 
-        if (error)
+    void SlideWindow(uint64_t window_base)
+    {
+        if (window_base - window_base_ >= kReceiveWindow)
+        {
+            std::fill(received_.begin(), received_.end(), false);
+        }
+        else
         {
-            std::cout << "Read DataMessage payload error: " << error << std::endl;
-            return error;
+            for (; window_base_ < window_base; ++window_base_)
+            {
+                received_[window_base_ % kReceiveWindow] = false;
+            }
         }
+        window_base_ = window_base;
+    }
 
-        if (read_bytes < message_size_)
+    void OnParityMessage(const uint8_t* data, std::size_t size)
+    {
+        if (size < ParityMessage::kSize + message_size_)
         {
-            std::cout << "Read DataMessage payload of wrong size" << std::endl;
-            return make_error_code(boost::system::errc::protocol_error);
+            std::cout << "Read ParityMessage of wrong size: " << size << std::endl;
+            return;
         }
 
-        return make_error_code(boost::system::errc::success);
+        auto parity_message = ParityMessage::Decode(data);
+        fec_decoder_->AddParity(parity_message.group_no, parity_message.parity_index, parity_message.no_of_data_shards,
+                                data + ParityMessage::kSize,
+                                [this](uint32_t message_no, const uint8_t* data) { OnRecovered(message_no, data); });
     }
 
-    boost::system::error_code SendAckMessage(AcknowledgeMessage ack_message)
+    // a rebuilt message is received like any other, only not counted as reordered
+    void OnRecovered(uint32_t message_no, const uint8_t* data)
     {
-        // send the ACK
-        auto sent_bytes = socket_.send(boost::asio::buffer(AcknowledgeMessage::Encode(ack_message)));
-
-        if (sent_bytes < AcknowledgeMessage::kSize)
+        if (Track(message_no) != Arrival::kNew)
         {
-            std::cout << "Failed to send AcknowledgeMessage" << std::endl;
-            return make_error_code(boost::system::errc::protocol_error);
+            return;
         }
 
-        return make_error_code(boost::system::errc::success);
+        OnDataMessage(message_no, data, message_size_);
+        UpdateStats(message_no, true);
     }
 
-    void UpdateStats()
+    void UpdateStats(uint32_t message_no, bool recovered = false)
     {
         stats_.no_of_read_messages++;
         stats_.no_of_read_bytes += DataMessage::kSize + message_size_;
+
+        // duplicates are not counted here, so a message below the highest one received arrived after a later one
+        if (message_no >= next_message_no_)
+        {
+            next_message_no_ = uint64_t{message_no} + 1;
+        }
+        else if (!recovered)
+        {
+            stats_.no_of_reordered_messages++;
+        }
     }
 
 private:
     Protocol protocol_;
     CommunicationMechanism communication_mechanism_;
+    // a stream with user-space congestion control: every message is acknowledged and may be retransmitted
+    bool reliable_;
     std::size_t message_size_;
 
     boost::asio::io_service io_service_;
-    tcp::acceptor acceptor_;
-    tcp::socket socket_;
+    udp::socket socket_;
+    UdpBatchReceiver receiver_;
+    UdpBatchSender ack_sender_;
+    std::atomic<bool> stopped_;
+    // one above the highest message received
+    uint64_t next_message_no_;
+    std::unique_ptr<FecDecoder> fec_decoder_;
+    // the messages received in the window, indexed by message number modulo its size
+    std::vector<bool> received_;
+    // every message below it was received or given up
+    uint64_t window_base_;
+    // set from the EndOfTestMessage
+    bool test_ended_;
+    uint32_t no_of_sent_messages_;
 
     Stats stats_;
 };
 
 
-std::unique_ptr<Communicator> CommunicatorFactory(Protocol protocol, CommunicationMechanism communication_mechanism, std::size_t message_size, uint16_t client_id)
+std::unique_ptr<Communicator> CommunicatorFactory(const HelloMessage& hello_message, uint16_t client_id)
 {
     std::unique_ptr<Communicator> communicator = nullptr;
 
+    auto protocol = hello_message.protocol;
+    auto communication_mechanism = hello_message.communication_mechanism;
+    // the send time is framed as the first bytes of the data, so the receive loops stay as they are
+    auto message_size = hello_message.message_size + (hello_message.send_timestamps ? kSendTimeSize : 0);
+    auto tcp_info_interval = std::chrono::milliseconds(hello_message.tcp_info_interval_ms);
+
+    // request/response is only implemented on the Asio TCP communicator, whatever backend was asked for; the client falls back alike
+    if (communication_mechanism == CommunicationMechanism::kRequestResponse)
+    {
+        if (protocol != Protocol::kTcp)
+        {
+            return nullptr;
+        }
+
+        return std::make_unique<TcpRequestResponseCommunicator>(message_size, hello_message.response_size, client_id, tcp_info_interval);
+    }
+
+    if (hello_message.io_backend == IoBackend::kSpecialized)
+    {
+        if (protocol == Protocol::kTcp)
+        {
+            return SpecializedCommunicatorFactory<tcp, BatchedIo>(communication_mechanism, message_size, client_id, tcp_info_interval);
+        }
+
+        if (protocol == Protocol::kUnixStream)
+        {
+            return SpecializedCommunicatorFactory<stream_protocol, BatchedIo>(communication_mechanism, message_size, client_id,
+                                                                              tcp_info_interval);
+        }
+    }
+
+    if (hello_message.io_backend == IoBackend::kCoroutine)
+    {
+        if (protocol == Protocol::kTcp)
+        {
+            return std::make_unique<CoroutineCommunicator<tcp>>(communication_mechanism, message_size, client_id, tcp_info_interval);
+        }
+
+        if (protocol == Protocol::kUnixStream)
+        {
+            return std::make_unique<CoroutineCommunicator<stream_protocol>>(communication_mechanism, message_size, client_id,
+                                                                            tcp_info_interval);
+        }
+    }
+
+    if (protocol == Protocol::kTcp && hello_message.io_backend == IoBackend::kIoUring)
+    {
+        try
+        {
+            return std::make_unique<IoUringCommunicator>(communication_mechanism, message_size, hello_message.io_uring_flags, client_id,
+                                                         tcp_info_interval);
+        }
+        catch (std::exception& ex)
+        {
+            // same wire format, so a client using io_uring can still talk to an Asio communicator
+            std::cout << "io_uring unavailable, falling back to Asio: " << ex.what() << std::endl;
+        }
+    }
+
     switch (protocol)
     {
         case Protocol::kTcp:
         {
-            switch (communication_mechanism)
-            {
-                case CommunicationMechanism::kStopAndGo:
-                {
-                    communicator = std::make_unique<TcpStopAndGoCommunicator>(message_size, client_id);
-                    break;
-                }
-                case CommunicationMechanism::kStreaming:
-                {
-                    communicator = std::make_unique<TcpStreamingCommunicator>(message_size, client_id);
-                    break;
-                }
-                default:
-                {
-                    std::cerr << communication_mechanism << std::endl;
-                    break;
-                }
-            }
+            communicator = SpecializedCommunicatorFactory<tcp, MessageAtATimeIo>(communication_mechanism, message_size, client_id,
+                                                                                 tcp_info_interval);
             break;
         }
         case Protocol::kUdp:
@@ -394,13 +1752,14 @@ std::unique_ptr<Communicator> CommunicatorFactory(Protocol protocol, Communicati
             switch (communication_mechanism)
             {
                 case CommunicationMechanism::kStopAndGo:
-                {
-//                    communicator = std::make_unique<UdpStopAndGoCommunicator>(message_size, client_id);
-                    break;
-                }
                 case CommunicationMechanism::kStreaming:
                 {
-//                    communicator = std::make_unique<UdpStreamingCommunicator>(message_size, client_id);
+                    // every message of a stop-and-go test or of a reliable stream is acknowledged, there is nothing for parity to do
+                    bool reliable = communication_mechanism == CommunicationMechanism::kStreaming
+                                    && hello_message.udp_congestion_control != UdpCongestionControl::kNone;
+                    auto fec = communication_mechanism == CommunicationMechanism::kStreaming && !reliable ? hello_message.fec : FecOptions{};
+                    communicator = std::make_unique<UdpCommunicator>(communication_mechanism, message_size, hello_message.batch_size,
+                                                                     hello_message.udp_flags, client_id, fec, reliable);
                     break;
                 }
                 default:
@@ -409,6 +1768,18 @@ std::unique_ptr<Communicator> CommunicatorFactory(Protocol protocol, Communicati
                     break;
                 }
             }
+            break;
+        }
+        case Protocol::kUnixStream:
+        {
+            communicator = SpecializedCommunicatorFactory<stream_protocol, MessageAtATimeIo>(communication_mechanism, message_size, client_id,
+                                                                                             tcp_info_interval);
+            break;
+        }
+        case Protocol::kSharedMemory:
+        {
+            communicator = std::make_unique<SharedMemoryCommunicator>(communication_mechanism, message_size, client_id);
+            break;
         }
         default:
         {
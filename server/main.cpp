@@ -2,20 +2,125 @@
 // Created by virgil on 10.03.2019.
 //
 
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <string>
 
+#include <boost/thread.hpp>
+
+#include "c10k_server.h"
 #include "server.h"
 
-int main()
+int main(int argc, char* argv[])
 {
     std::cout << "Hello, Server!" << std::endl;
 
     try
     {
+        ServerOptions options;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string option = argv[i];
+            if (option.rfind("--control-port=", 0) == 0)
+            {
+                options.control_port = static_cast<uint16_t>(std::stoul(option.substr(option.find('=') + 1)));
+            }
+            else if (option.rfind("--data-port=", 0) == 0)
+            {
+                options.data_port = static_cast<uint16_t>(std::stoul(option.substr(option.find('=') + 1)));
+            }
+            else if (option.rfind("--control-cpu=", 0) == 0)
+            {
+                options.control_cpu = std::stoi(option.substr(option.find('=') + 1));
+            }
+            else if (option.rfind("--communicator-cpu=", 0) == 0)
+            {
+                options.communicator_cpu = std::stoi(option.substr(option.find('=') + 1));
+            }
+            else if (option.rfind("--memory-node=", 0) == 0)
+            {
+                options.memory_node = std::stoi(option.substr(option.find('=') + 1));
+            }
+            else if (option.rfind("--max-sessions=", 0) == 0)
+            {
+                options.max_sessions = static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1)));
+            }
+            else if (option.rfind("--max-queued=", 0) == 0)
+            {
+                options.max_queued_sessions = static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1)));
+            }
+            else if (option.rfind("--c10k-port=", 0) == 0)
+            {
+                options.c10k_port = static_cast<uint16_t>(std::stoul(option.substr(option.find('=') + 1)));
+            }
+            else if (option.rfind("--io-threads=", 0) == 0)
+            {
+                options.io_threads = std::max<uint32_t>(1, static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1))));
+            }
+            else if (option.rfind("--acceptor-shards=", 0) == 0)
+            {
+                options.acceptor_shards = std::max<uint32_t>(1, static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1))));
+            }
+            else if (option.rfind("--trace=", 0) == 0)
+            {
+                options.trace.prefix = option.substr(option.find('=') + 1);
+            }
+            else if (option.rfind("--drain-timeout=", 0) == 0)
+            {
+                options.drain_timeout = std::chrono::seconds(std::stoul(option.substr(option.find('=') + 1)));
+            }
+            else if (option.rfind("--trace-capacity=", 0) == 0)
+            {
+                options.trace.capacity = static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1)));
+            }
+            else
+            {
+                std::cerr << "Usage: server [--control-port=N] [--data-port=N] [--control-cpu=N] [--communicator-cpu=N] [--memory-node=N] [--max-sessions=N] [--max-queued=N] "
+                             "[--c10k-port=N] [--io-threads=N] [--acceptor-shards=N] [--drain-timeout=S] [--trace=PREFIX [--trace-capacity=N]]" << std::endl;
+                return -1;
+            }
+        }
+
         boost::asio::io_service io_service;
-        Server server(io_service);
+        Server server(io_service, options);
         server.Start();
+
+        std::unique_ptr<C10kServer> c10k_server;
+        if (options.c10k_port != 0)
+        {
+            c10k_server = std::make_unique<C10kServer>(io_service, options.c10k_port, options.acceptor_shards);
+            c10k_server->Start();
+        }
+
+        // SIGINT/SIGTERM drain the running sessions instead of cutting them off
+        boost::asio::signal_set signals(io_service, SIGINT, SIGTERM);
+        signals.async_wait([&](const boost::system::error_code& error, int) {
+            if (!error)
+            {
+                if (c10k_server)
+                {
+                    c10k_server->Stop();
+                }
+                if (!server.Shutdown())
+                {
+                    // the stuck sessions' threads still use the server, which therefore cannot be destroyed
+                    std::cout.flush();
+                    std::_Exit(-2);
+                }
+                io_service.stop();
+            }
+        });
+
+        // the C10K sessions of acceptor shard 0 are served by these threads, the other shards run threads of their own
+        boost::thread_group io_threads;
+        for (uint32_t i = 1; i < options.io_threads; ++i)
+        {
+            io_threads.create_thread([&io_service]() { io_service.run(); });
+        }
+
         io_service.run();
+        io_threads.join_all();
     }
     catch (std::exception& ex)
     {
@@ -5,53 +5,118 @@
 #ifndef MEASURE_TRANSFER_SERVER_H
 #define MEASURE_TRANSFER_SERVER_H
 
-#include "session.h"
+#include <atomic>
+
+#include "acceptor_shards.h"
+#include "session_registry.h"
 
 using boost::asio::ip::tcp;
 
+// -1 leaves the placement to the kernel
+struct ServerOptions
+{
+    // servers sharing a host each need their own control port and data port range
+    uint16_t control_port = 4991;
+    // sessions take consecutive ports from here
+    uint16_t data_port = 5000;
+    int control_cpu = -1;
+    int communicator_cpu = -1;
+    int memory_node = -1;
+    uint32_t max_sessions = 64;
+    uint32_t max_queued_sessions = 256;
+    // 0 disables the C10K mode
+    uint16_t c10k_port = 0;
+    uint32_t io_threads = 1;
+    // SO_REUSEPORT listening sockets on each of the control and C10K ports, one thread each
+    uint32_t acceptor_shards = 1;
+    // how long a shutdown waits for the running sessions to finish
+    std::chrono::seconds drain_timeout{30};
+    TraceOptions trace{};
+};
+
 class Server
 {
 public:
-    Server(boost::asio::io_service& io_service)
-        : acceptor_(io_service, tcp::endpoint(tcp::v4(), 4991))
+    Server(boost::asio::io_service& io_service, const ServerOptions& options)
+        : acceptors_(io_service, options.control_port, options.acceptor_shards, tcp::acceptor::max_listen_connections)
+        , options_(options)
+        , next_data_port_{options.data_port}
+        , registry_(options.max_sessions, options.max_queued_sessions)
     {
-        acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+        // the first accept/control thread is the one running the io_service, i.e. the constructing one
+        auto placement = ApplyPlacement(options_.control_cpu, options_.memory_node);
+        std::cout << "Control placement: " << placement << std::endl;
     }
 
     void Start()
     {
-        // accept a new client
-        Accept();
+        // accept a new client on every shard
+        for (std::size_t shard = 0; shard < acceptors_.Size(); ++shard)
+        {
+            Accept(shard);
+        }
+
+        // the other shards' threads follow the control CPU, one CPU each
+        acceptors_.Start([this](std::size_t shard) {
+            ApplyPlacement(options_.control_cpu < 0 ? -1 : options_.control_cpu + static_cast<int>(shard), options_.memory_node);
+        });
+    }
+
+    // stops accepting, waits for every admitted session to finish its transfer and joins their threads; false if some are still running
+    bool Shutdown()
+    {
+        std::cout << "Server shutting down, draining sessions" << std::endl;
+        acceptors_.Stop();
+        bool drained = registry_.Drain(options_.drain_timeout);
+        std::cout << "Sessions: " << registry_.GetStats() << std::endl;
+        std::cout << "Control accepts: " << acceptors_.GetStats() << std::endl;
+        return drained;
     }
 
 private:
-    void Accept()
+    void Accept(std::size_t shard)
     {
-        // create the new session
-        Session::Pointer new_session = Session::Create(acceptor_.get_io_service());
+        // create the new session, the data ports are shared by the shards
+        Session::Pointer new_session = Session::Create(acceptors_.IoService(shard), next_data_port_.fetch_add(1, std::memory_order_relaxed),
+                                                       options_.communicator_cpu, options_.memory_node, options_.trace);
 
         // wait for the new client to connect
-        acceptor_.async_accept(new_session->Socket(),
-                               boost::bind(&Server::OnAccept, this, new_session, boost::asio::placeholders::error));
+        acceptors_.Acceptor(shard).async_accept(new_session->Socket(),
+                                                boost::bind(&Server::OnAccept, this, shard, new_session, boost::asio::placeholders::error));
     }
 
-    void OnAccept(Session::Pointer new_session, const boost::system::error_code& error)
+    void OnAccept(std::size_t shard, Session::Pointer new_session, const boost::system::error_code& error)
     {
+        // the acceptor was closed by Shutdown()
+        if (error == boost::asio::error::operation_aborted)
+        {
+            return;
+        }
+
         if (error)
         {
             std::cout << "Server::OnAccept error: " << error << std::endl;
             return;
         }
 
-        // communicate with the client
-        new_session->Start();
+        acceptors_.CountAccept(shard);
+
+        // communicate with the client on a registry thread; a rejected client sees its control connection closed
+        if (!registry_.Admit(new_session))
+        {
+            new_session->Socket().close();
+        }
 
         // accept another client
-        Accept();
+        Accept(shard);
     }
 
 private:
-    tcp::acceptor acceptor_;
+    AcceptorShards acceptors_;
+    ServerOptions options_;
+    std::atomic<uint16_t> next_data_port_;
+    // after the acceptors, the sessions' sockets go before the shards' io_services
+    SessionRegistry registry_;
 };
 
 #endif //MEASURE_TRANSFER_SERVER_H
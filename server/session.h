@@ -12,7 +12,9 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 
+#include "affinity.h"
 #include "communicator.h"
+#include "cpu_usage.h"
 
 using boost::asio::ip::tcp;
 
@@ -21,50 +23,50 @@ class Session : public boost::enable_shared_from_this<Session>
 public:
     using Pointer = boost::shared_ptr<Session>;
 
-    static Pointer Create(boost::asio::io_service& io_service)
+    // client_id is the session's data port
+    static Pointer Create(boost::asio::io_service& io_service, uint16_t client_id, int communicator_cpu, int memory_node, const TraceOptions& trace_options)
     {
-        static uint16_t client_id = 5000;
-        return Pointer(new Session(io_service, client_id++));
+        return Pointer(new Session(io_service, client_id, communicator_cpu, memory_node, trace_options));
     }
 
     ~Session()
     {
-        // print the stats
-        auto stats = communicator_->GetStats();
-        std::cout << "Protocol: " << stats.protocol << std::endl;
-        std::cout << "Communication mechanism: " << stats.communication_mechanism << std::endl;
-        std::cout << "# read messages: " << stats.no_of_read_messages << std::endl;
-        std::cout << "# read bytes: " << stats.no_of_read_bytes << std::endl;
+        if (data_connection_ >= 0)
+        {
+            close(data_connection_);
+        }
     }
 
     void Start()
     {
         std::cout << "Session " << client_id_ << " started" << std::endl;
 
-        do
+        // one HelloMessage per test; the client ends every test with an EndOfTestMessage and the session with a GoodbyeMessage
+        auto error = ReadHello();
+        while (!error)
         {
-            // wait hello message from the client
-            auto error = HandleHello();
-
-            if (error)
+            MessageTag tag;
+            error = ReadControlMessage(tag);
+            if (error || tag == MessageTag::kGoodbyeMessage)
             {
-                std::cout << "Session::Start hello error: " << error << std::endl;
                 break;
             }
 
-            // wait goodbye message from the client
-            error = HandleGoodbye();
-
-            if (error)
+            FinishTest(true);
+            error = SendTestStats();
+            if (!error)
             {
-                std::cout << "Session::Start goodbye error: " << error << std::endl;
-                break;
+                error = ReadHello(true);
             }
-        } while (false);
+        }
 
-        // end the session
-        communicator_->Stop();
-        std::cout << "Session " << client_id_ << " finished" << std::endl;
+        if (error && error != boost::asio::error::eof)
+        {
+            std::cout << "Session::Start control error: " << error << std::endl;
+        }
+
+        FinishTest(false);
+        std::cout << "Session " << client_id_ << " finished after " << no_of_tests_ << " tests" << std::endl;
     }
 
     tcp::socket& Socket()
@@ -72,21 +74,159 @@ public:
         return socket_;
     }
 
+    uint16_t ClientId() const
+    {
+        return client_id_;
+    }
+
 private:
-    Session(boost::asio::io_service& io_service, uint16_t client_id)
+    Session(boost::asio::io_service& io_service, uint16_t client_id, int communicator_cpu, int memory_node, const TraceOptions& trace_options)
         : client_id_(client_id)
         , socket_(io_service)
         , communicator_(nullptr)
+        , communicator_cpu_{communicator_cpu}
+        , memory_node_{memory_node}
+        , trace_options_(trace_options)
+        , placement_{ -1, -1, -1, -1 }
+        , cpu_usage_{}
+        , communication_time_{0}
+        , baseline_memory_{0}
+        , session_memory_{0}
+        , no_of_tests_{0}
+        , reuses_data_connection_{false}
+        , data_connection_{-1}
+        , test_stats_{}
     {}
 
-    boost::system::error_code HandleHello()
+    // ends the communicator of the current test, prints its stats and keeps its data connection if asked to
+    void FinishTest(bool end_of_test)
+    {
+        if (!communicator_)
+        {
+            return;
+        }
+
+        // datagram communicators only finish draining after Stop(); a kept data connection ends with an EndOfTestMessage instead
+        auto memory = ResidentMemory();
+        session_memory_ = memory > baseline_memory_ ? memory - baseline_memory_ : 0;
+        if (end_of_test && reuses_data_connection_ && communication_thread_.joinable())
+        {
+            communication_thread_.join();
+        }
+        communicator_->Stop();
+
+        if (communicator_->Asynchronous())
+        {
+            cpu_usage_ = ThreadCpuUsage(CoroutineScheduler::Instance().ThreadId()) - cpu_usage_;
+            communication_time_ = std::chrono::steady_clock::now() - start_time_;
+        }
+
+        if (communication_thread_.joinable())
+        {
+            communication_thread_.join();
+        }
+
+        if (reuses_data_connection_)
+        {
+            data_connection_ = communicator_->ReleaseDataConnection();
+        }
+
+        PrintStats();
+        communicator_.reset();
+    }
+
+    void PrintStats()
+    {
+        auto stats = communicator_->GetStats();
+        test_stats_ = { stats.no_of_read_messages, stats.no_of_read_bytes, stats.no_of_syscalls, stats.no_of_lost_messages,
+                        stats.no_of_reordered_messages, static_cast<uint64_t>(cpu_usage_.Total().count()), stats.no_of_recovered_messages,
+                        static_cast<uint64_t>(stats.fec_decode_time.count()), stats.no_of_fec_decoded_bytes };
+
+        std::cout << "Session " << client_id_ << " test " << no_of_tests_ << std::endl;
+        std::cout << "Protocol: " << stats.protocol << std::endl;
+        std::cout << "Communication mechanism: " << stats.communication_mechanism << std::endl;
+        std::cout << "# read messages: " << stats.no_of_read_messages << std::endl;
+        std::cout << "# read bytes: " << stats.no_of_read_bytes << std::endl;
+        std::cout << "# I/O syscalls: " << stats.no_of_syscalls << std::endl;
+
+        if (stats.protocol == Protocol::kUdp)
+        {
+            std::cout << "# lost messages: " << stats.no_of_lost_messages << std::endl;
+            std::cout << "# reordered messages: " << stats.no_of_reordered_messages << std::endl;
+            if (stats.no_of_recovered_messages > 0)
+            {
+                std::cout << "# recovered messages: " << stats.no_of_recovered_messages << ", decoded at "
+                          << static_cast<double>(stats.no_of_fec_decoded_bytes) / std::max<int64_t>(stats.fec_decode_time.count(), 1) << " GB/s"
+                          << std::endl;
+            }
+        }
+
+        if (communicator_->Verifier())
+        {
+            communicator_->Verifier()->Print();
+        }
+
+        if (communicator_->Trace())
+        {
+            communicator_->Trace()->Print();
+        }
+
+        if (communicator_->OneWayDelay())
+        {
+            communicator_->OneWayDelay()->Print();
+        }
+
+        communicator_->Phases().Print();
+
+        PrintTcpInfoSummary(stats.tcp_info);
+        std::cout << "Session memory (RSS growth): " << session_memory_ << " bytes" << std::endl;
+        if (communicator_->Asynchronous())
+        {
+            // the figures below belong to the scheduler thread, shared with every concurrent coroutine session
+            std::cout << "Coroutine scheduler thread, peak " << CoroutineScheduler::Instance().PeakNoOfSessions() << " concurrent sessions"
+                      << std::endl;
+        }
+        else
+        {
+            std::cout << "Communicator placement: " << placement_ << std::endl;
+        }
+        PrintCpuCost(cpu_usage_, stats.no_of_read_bytes, stats.no_of_read_messages, communication_time_);
+    }
+
+    // runs on the communication thread so the sampler only accounts the data path
+    void Communicate()
+    {
+        placement_ = ApplyPlacement(communicator_cpu_, memory_node_);
+
+        CpuUsageSampler sampler;
+        auto start_time = std::chrono::steady_clock::now();
+        sampler.Start();
+
+        communicator_->Start();
+
+        cpu_usage_ = sampler.Stop();
+        communication_time_ = std::chrono::steady_clock::now() - start_time;
+        placement_.observed_cpu = CurrentCpu();
+    }
+
+    // the first test of a session must start with a HelloMessage, after that the client may also say goodbye
+    boost::system::error_code ReadHello(bool goodbye_allowed = false)
     {
         boost::system::error_code error;
 
         // wait hello message from the client
         HelloMessage::Buffer buffer;
 
-        auto read_bytes = socket_.read_some(boost::asio::buffer(buffer), error);
+        boost::asio::read(socket_, boost::asio::buffer(buffer.data(), kMessageTagSize), error);
+        if (!error && goodbye_allowed && buffer[0] == static_cast<uint8_t>(MessageTag::kGoodbyeMessage))
+        {
+            return boost::asio::error::eof;
+        }
+
+        if (!error)
+        {
+            boost::asio::read(socket_, boost::asio::buffer(buffer.data() + kMessageTagSize, HelloMessage::kSize - kMessageTagSize), error);
+        }
 
         if (error)
         {
@@ -94,19 +234,88 @@ private:
             return error;
         }
 
-        if (read_bytes < HelloMessage::kSize)
+        if (buffer[0] != static_cast<uint8_t>(MessageTag::kHelloMessage))
         {
-            std::cout << "Read HelloMessage of wrong size" << std::endl;
+            std::cout << "Expected a HelloMessage" << std::endl;
             return make_error_code(boost::system::errc::protocol_error);
         }
 
-        // parse message
-        HelloMessage hello_message = HelloMessage::Decode(buffer);
+        return HandleHello(HelloMessage::Decode(buffer));
+    }
+
+    boost::system::error_code HandleHello(const HelloMessage& hello_message)
+    {
+        boost::system::error_code error;
 
         // build communicator
-        communicator_ = CommunicatorFactory(hello_message.protocol, hello_message.communication_mechanism, hello_message.message_size, client_id_);
-        boost::thread communication_thread(boost::bind(&Communicator::Start, communicator_));
-        communication_thread.detach();
+        baseline_memory_ = ResidentMemory();
+        communicator_ = CommunicatorFactory(hello_message, client_id_);
+        if (!communicator_)
+        {
+            std::cout << "No communicator for " << hello_message.protocol << "/" << hello_message.communication_mechanism << std::endl;
+            return make_error_code(boost::system::errc::protocol_not_supported);
+        }
+
+        // both ends keep the data connection only while consecutive tests ask for it
+        no_of_tests_++;
+        reuses_data_connection_ = ReusesDataConnection(hello_message);
+        if (data_connection_ >= 0)
+        {
+            if (reuses_data_connection_ && communicator_->AdoptDataConnection(data_connection_))
+            {
+                std::cout << "Test " << no_of_tests_ << " reuses the data connection" << std::endl;
+            }
+            else
+            {
+                close(data_connection_);
+            }
+            data_connection_ = -1;
+        }
+
+        if (hello_message.verify_payload)
+        {
+            error = HandlePayload(hello_message.message_size);
+            if (error)
+            {
+                return error;
+            }
+        }
+
+        if (hello_message.send_timestamps)
+        {
+            communicator_->EnableOneWayDelay();
+        }
+
+        if (!trace_options_.prefix.empty())
+        {
+            try
+            {
+                communicator_->EnableTracing(std::make_unique<TraceWriter>(TracePath(trace_options_, TraceRole::kServer, client_id_, no_of_tests_),
+                                                                           TraceRole::kServer, trace_options_.capacity, hello_message.protocol,
+                                                                           hello_message.communication_mechanism,
+                                                                           static_cast<uint32_t>(hello_message.message_size)));
+            }
+            catch (std::exception& ex)
+            {
+                std::cout << "Tracing disabled: " << ex.what() << std::endl;
+            }
+        }
+
+        auto granted_socket_options = communicator_->Configure(hello_message.socket_options);
+        std::cout << "Requested socket options: " << hello_message.socket_options << std::endl;
+        std::cout << "Granted socket options: " << granted_socket_options << std::endl;
+
+        if (communicator_->Asynchronous())
+        {
+            // runs on the shared scheduler thread, whose usage is sampled around the session from here
+            start_time_ = std::chrono::steady_clock::now();
+            cpu_usage_ = ThreadCpuUsage(CoroutineScheduler::Instance().ThreadId());
+            communicator_->Start();
+        }
+        else
+        {
+            communication_thread_ = boost::thread(boost::bind(&Session::Communicate, shared_from_this()));
+        }
 
         // send response
         AcknowledgeMessage response_message = { client_id_ };
@@ -119,37 +328,132 @@ private:
             return make_error_code(boost::system::errc::protocol_error);
         }
 
+        // echo the socket options the kernel granted
+        SocketOptionsMessage options_message = { granted_socket_options };
+        sent_bytes = socket_.send(boost::asio::buffer(SocketOptionsMessage::Encode(options_message)));
+        if (sent_bytes < SocketOptionsMessage::kSize)
+        {
+            std::cout << "Failed to send SocketOptionsMessage" << std::endl;
+            return make_error_code(boost::system::errc::protocol_error);
+        }
+
         return make_error_code(boost::system::errc::success);
     }
 
-    boost::system::error_code HandleGoodbye()
+    // reads the PayloadMessage that follows a HelloMessage asking for verification
+    boost::system::error_code HandlePayload(std::size_t message_size)
     {
         boost::system::error_code error;
 
-        // wait goodbye message from the client
-        GoodbyeMessage::Buffer buffer;
+        PayloadMessage::HeaderBuffer header;
+        boost::asio::read(socket_, boost::asio::buffer(header), error);
+        if (error)
+        {
+            std::cout << "Read PayloadMessage error: " << error << std::endl;
+            return error;
+        }
 
-        auto read_bytes = socket_.read_some(boost::asio::buffer(buffer), error);
+        if (header[0] != static_cast<uint8_t>(MessageTag::kPayloadMessage))
+        {
+            std::cout << "Expected a PayloadMessage" << std::endl;
+            return make_error_code(boost::system::errc::protocol_error);
+        }
 
+        std::string text(PayloadMessage::TextSize(header), '\0');
+        boost::asio::read(socket_, boost::asio::buffer(&text[0], text.size()), error);
         if (error)
         {
-            std::cout << "Read GoodbyeMessage error: " << error << std::endl;
+            std::cout << "Read PayloadMessage text error: " << error << std::endl;
             return error;
         }
 
-        if (read_bytes < GoodbyeMessage::kSize)
+        auto payload_message = PayloadMessage::Decode(header, text);
+        try
+        {
+            communicator_->EnableVerification(std::make_unique<PayloadVerifier>(payload_message.payload_options, message_size));
+            std::cout << "Verifying " << payload_message.payload_options.mode << " payloads" << std::endl;
+        }
+        catch (std::exception& ex)
+        {
+            // e.g. a corpus file that only exists on the client's machine
+            std::cout << "Payload verification disabled: " << ex.what() << std::endl;
+        }
+
+        return make_error_code(boost::system::errc::success);
+    }
+
+    // waits for the end of the current test: an EndOfTestMessage, or a GoodbyeMessage ending the session with it
+    boost::system::error_code ReadControlMessage(MessageTag& tag)
+    {
+        boost::system::error_code error;
+
+        EndOfTestMessage::Buffer buffer;
+        boost::asio::read(socket_, boost::asio::buffer(buffer.data(), kMessageTagSize), error);
+        if (error)
         {
-            std::cout << "Read GoodbyeMessage of wrong size" << std::endl;
+            std::cout << "Read control message error: " << error << std::endl;
+            return error;
+        }
+
+        tag = static_cast<MessageTag>(buffer[0]);
+        if (tag == MessageTag::kGoodbyeMessage)
+        {
+            return make_error_code(boost::system::errc::success);
+        }
+
+        if (tag != MessageTag::kEndOfTestMessage)
+        {
+            std::cout << "Expected an EndOfTestMessage or a GoodbyeMessage" << std::endl;
             return make_error_code(boost::system::errc::protocol_error);
         }
 
+        boost::asio::read(socket_, boost::asio::buffer(buffer.data() + kMessageTagSize, EndOfTestMessage::kSize - kMessageTagSize), error);
+        if (error)
+        {
+            std::cout << "Read EndOfTestMessage error: " << error << std::endl;
+            return error;
+        }
+
+        auto no_of_sent_messages = EndOfTestMessage::Decode(buffer).no_of_messages;
+        std::cout << "Test " << no_of_tests_ << " ended, " << no_of_sent_messages << " messages sent" << std::endl;
+        if (communicator_)
+        {
+            // the messages sent after the last one received were lost too
+            communicator_->EndTest(no_of_sent_messages);
+        }
         return make_error_code(boost::system::errc::success);
     }
 
+    boost::system::error_code SendTestStats()
+    {
+        boost::system::error_code error;
+        boost::asio::write(socket_, boost::asio::buffer(TestStatsMessage::Encode(test_stats_)), error);
+        if (error)
+        {
+            std::cout << "Failed to send TestStatsMessage: " << error << std::endl;
+        }
+        return error;
+    }
+
 private:
     uint16_t client_id_;
     tcp::socket socket_;
-    std::shared_ptr<Communicator> communicator_;
+    std::unique_ptr<Communicator> communicator_;
+    boost::thread communication_thread_;
+    int communicator_cpu_;
+    int memory_node_;
+    TraceOptions trace_options_;
+    Placement placement_;
+    CpuUsage cpu_usage_;
+    std::chrono::steady_clock::time_point start_time_;
+    std::chrono::nanoseconds communication_time_;
+    std::size_t baseline_memory_;
+    std::size_t session_memory_;
+    uint32_t no_of_tests_;
+    bool reuses_data_connection_;
+    // the data connection kept from the previous test, -1 if there is none
+    int data_connection_;
+    TestStatsMessage test_stats_;
 };
 
 #endif //MEASURE_TRANSFER_SESSION_H
@@ -0,0 +1,220 @@
+#ifndef MEASURE_TRANSFER_SESSION_REGISTRY_H
+#define MEASURE_TRANSFER_SESSION_REGISTRY_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include "session.h"
+
+struct RegistryStats
+{
+    uint64_t no_of_admitted_sessions;
+    uint64_t no_of_queued_sessions;
+    uint64_t no_of_rejected_sessions;
+    uint32_t peak_active_sessions;
+    uint32_t peak_queued_sessions;
+    std::chrono::microseconds max_queue_wait;
+    std::chrono::microseconds total_queue_wait;
+};
+
+/**
+ * Owns every live session. At most max_active sessions run at once, each on
+ * its own thread; up to max_queued more wait, still holding their control
+ * connection, and are started in arrival order as running ones finish. Beyond
+ * that a new connection is closed straight away, so overload shows up as a
+ * bounded queue wait instead of an unbounded number of threads.
+ */
+class SessionRegistry
+{
+public:
+    SessionRegistry(uint32_t max_active, uint32_t max_queued)
+        : max_active_{std::max<uint32_t>(max_active, 1)}
+        , max_queued_{max_queued}
+        , draining_{false}
+        , no_of_active_{0}
+        , stats_{}
+    {}
+
+    // the sessions' threads use the registry, so it outlives them however long they take
+    ~SessionRegistry()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        draining_ = true;
+        idle_.wait(lock, [this]() { return Idle(); });
+        JoinFinished();
+    }
+
+    // returns false if the session was rejected
+    bool Admit(const Session::Pointer& session)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        JoinFinished();
+
+        if (draining_ || (no_of_active_ >= max_active_ && queue_.size() >= max_queued_))
+        {
+            stats_.no_of_rejected_sessions++;
+            std::cout << "SessionRegistry: rejecting session, " << no_of_active_ << " active, " << queue_.size() << " queued" << std::endl;
+            return false;
+        }
+
+        if (no_of_active_ < max_active_)
+        {
+            Launch(session, std::chrono::steady_clock::now());
+            return true;
+        }
+
+        queue_.push_back({ session, std::chrono::steady_clock::now() });
+        stats_.no_of_queued_sessions++;
+        stats_.peak_queued_sessions = std::max<uint32_t>(stats_.peak_queued_sessions, static_cast<uint32_t>(queue_.size()));
+        std::cout << "SessionRegistry: session queued, " << queue_.size() << " waiting" << std::endl;
+        return true;
+    }
+
+    /**
+     * Refuses new sessions, lets the running and queued ones finish their
+     * transfers and joins all of their threads. Gives up after timeout and
+     * returns false, naming the sessions still running.
+     */
+    bool Drain(std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        draining_ = true;
+        if (!idle_.wait_for(lock, timeout, [this]() { return Idle(); }))
+        {
+            std::cout << "SessionRegistry: drain timed out after " << timeout.count() << " ms, " << queue_.size() << " queued, active sessions:";
+            for (auto client_id : active_sessions_)
+            {
+                std::cout << " " << client_id;
+            }
+            std::cout << std::endl;
+            return false;
+        }
+
+        JoinFinished();
+        return true;
+    }
+
+    RegistryStats GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    struct QueuedSession
+    {
+        Session::Pointer session;
+        std::chrono::steady_clock::time_point arrival_time;
+    };
+
+    // must be called with mutex_ held
+    void Launch(const Session::Pointer& session, std::chrono::steady_clock::time_point arrival_time)
+    {
+        auto wait = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - arrival_time);
+        stats_.max_queue_wait = std::max(stats_.max_queue_wait, wait);
+        stats_.total_queue_wait += wait;
+        stats_.no_of_admitted_sessions++;
+
+        no_of_active_++;
+        stats_.peak_active_sessions = std::max(stats_.peak_active_sessions, no_of_active_);
+        active_sessions_.insert(session->ClientId());
+
+        auto thread = std::make_unique<boost::thread>([this, running_session = session]() mutable {
+            try
+            {
+                running_session->Start();
+            }
+            catch (std::exception& ex)
+            {
+                std::cout << "Session error: " << ex.what() << std::endl;
+            }
+
+            // released before the drain can complete, so the session's sockets are closed by then
+            auto client_id = running_session->ClientId();
+            running_session.reset();
+            OnFinished(client_id);
+        });
+        threads_[thread->get_id()] = std::move(thread);
+    }
+
+    void OnFinished(uint16_t client_id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_.push_back(boost::this_thread::get_id());
+        no_of_active_--;
+        active_sessions_.erase(client_id);
+
+        // queued sessions are started even while draining, they were already admitted
+        if (!queue_.empty())
+        {
+            auto next = queue_.front();
+            queue_.pop_front();
+            Launch(next.session, next.arrival_time);
+        }
+
+        if (Idle())
+        {
+            idle_.notify_all();
+        }
+    }
+
+    // must be called with mutex_ held
+    bool Idle() const
+    {
+        return no_of_active_ == 0 && queue_.empty();
+    }
+
+    // a finished thread cannot join itself, so it is joined by the next caller instead; must be called with mutex_ held
+    void JoinFinished()
+    {
+        for (auto id : finished_)
+        {
+            auto thread = threads_.find(id);
+            if (thread != threads_.end())
+            {
+                thread->second->join();
+                threads_.erase(thread);
+            }
+        }
+
+        finished_.clear();
+    }
+
+private:
+    uint32_t max_active_;
+    uint32_t max_queued_;
+    bool draining_;
+    uint32_t no_of_active_;
+    // by data port, to name the ones a drain gives up on
+    std::set<uint16_t> active_sessions_;
+    std::deque<QueuedSession> queue_;
+    std::map<boost::thread::id, std::unique_ptr<boost::thread>> threads_;
+    std::vector<boost::thread::id> finished_;
+    mutable std::mutex mutex_;
+    std::condition_variable idle_;
+    RegistryStats stats_;
+};
+
+std::ostream& operator<<(std::ostream& os, const RegistryStats& stats)
+{
+    os << "admitted " << stats.no_of_admitted_sessions
+       << ", queued " << stats.no_of_queued_sessions
+       << ", rejected " << stats.no_of_rejected_sessions
+       << ", peak active " << stats.peak_active_sessions
+       << ", peak queued " << stats.peak_queued_sessions
+       << ", max queue wait " << stats.max_queue_wait.count() << " us"
+       << ", avg queue wait " << (stats.no_of_admitted_sessions > 0 ? stats.total_queue_wait.count() / stats.no_of_admitted_sessions : 0) << " us";
+    return os;
+}
+
+#endif //MEASURE_TRANSFER_SESSION_REGISTRY_H
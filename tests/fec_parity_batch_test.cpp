@@ -0,0 +1,87 @@
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "fec.h"
+
+/**
+ * Runs the client's batching of data shards through the FecEncoder and checks
+ * that no batch closes more groups than MaxFecGroupsPerBatch() leaves room
+ * for in the parity buffer, for batch sizes that are not a multiple of the
+ * data shards and transfers that are not a multiple of the batch size.
+ */
+int CheckBatches(uint32_t no_of_messages, uint32_t batch_size, uint8_t data_shards, std::size_t& most_groups)
+{
+    const std::size_t shard_size = 16;
+    FecOptions options = { FecScheme::kXor, data_shards, 1 };
+    FecEncoder encoder(options, shard_size);
+    std::vector<uint8_t> shard(shard_size, 0x5A);
+
+    int failures = 0;
+    uint32_t no_of_groups = 0;
+    most_groups = 0;
+    for (uint32_t i = 0; i < no_of_messages; i += batch_size)
+    {
+        uint32_t count = std::min(batch_size, no_of_messages - i);
+        std::size_t groups = 0;
+        for (uint32_t j = 0; j < count; ++j)
+        {
+            if (encoder.Add(shard.data()))
+            {
+                encoder.CloseGroup();
+                groups++;
+            }
+        }
+
+        if (i + count == no_of_messages && encoder.NoOfShards() > 0)
+        {
+            encoder.CloseGroup();
+            groups++;
+        }
+
+        most_groups = std::max(most_groups, groups);
+        no_of_groups += static_cast<uint32_t>(groups);
+        if (groups > MaxFecGroupsPerBatch(batch_size, data_shards))
+        {
+            std::cout << "n=" << no_of_messages << " batch=" << batch_size << " k=" << static_cast<int>(data_shards) << ": batch at " << i
+                      << " closes " << groups << " groups, room for " << MaxFecGroupsPerBatch(batch_size, data_shards) << std::endl;
+            failures++;
+        }
+    }
+
+    if (no_of_groups != (no_of_messages + data_shards - 1) / data_shards)
+    {
+        std::cout << "n=" << no_of_messages << " batch=" << batch_size << " k=" << static_cast<int>(data_shards) << ": " << no_of_groups
+                  << " groups in all" << std::endl;
+        failures++;
+    }
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+
+    // the last batch completes a group opened by the one before, a whole group, and cuts the last one short
+    std::size_t most_groups = 0;
+    failures += CheckBatches(16, 8, 3, most_groups);
+    if (most_groups != 4)
+    {
+        std::cout << "n=16 batch=8 k=3: at most " << most_groups << " groups per batch, expected 4" << std::endl;
+        failures++;
+    }
+
+    for (uint32_t no_of_messages : { 1u, 7u, 16u, 17u, 100u, 1001u })
+    {
+        for (uint32_t batch_size : { 1u, 2u, 5u, 8u, 13u, 64u })
+        {
+            for (uint8_t data_shards : { 1, 2, 3, 4, 7, 8, 10 })
+            {
+                failures += CheckBatches(no_of_messages, batch_size, data_shards, most_groups);
+            }
+        }
+    }
+
+    std::cout << (failures == 0 ? "FEC parity batch test passed" : "FEC parity batch test failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
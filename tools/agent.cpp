@@ -0,0 +1,479 @@
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/asio.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "orchestration.h"
+
+using boost::asio::ip::tcp;
+
+/**
+ * Runs Client and Server processes on behalf of a controller, see the agent
+ * control protocol in orchestration.h. Every controller connection is a job
+ * running one process: it is started at the requested realtime instant,
+ * its output is filtered down to the lines the controller aggregates, and
+ * it is terminated if the controller asks for it or goes away.
+ */
+struct AgentOptions
+{
+    // loopback unless asked otherwise, anyone reaching the port and holding the token runs processes as the agent's user
+    std::string bind_address = "127.0.0.1";
+    uint16_t port = kAgentPort;
+    // where the Client and Server binaries are, the agent's own directory by default
+    std::string bin_dir;
+    // the shared secret every RUN carries
+    std::string token;
+};
+
+// the options of each binary an agent passes on; a prefix ending in '=' takes a value, none of them a path
+const std::vector<std::string> kClientArgumentAllowlist = {
+    "--io-backend=", "--sqpoll", "--multishot", "--batch-size=", "--sndbuf=", "--rcvbuf=", "--nodelay", "--cork", "--notsent-lowat=",
+    "--tcp-cc=", "--cpu=", "--memory-node=", "--tcp-info-interval=", "--c10k-sessions=", "--c10k-rate=", "--c10k-ramp=", "--c10k-port=",
+    "--connection-rate=", "--connection-rate-duration=", "--payload=", "--payload-pattern=", "--payload-seed=", "--payload-pool=", "--verify",
+    "--timestamps", "--response-size=", "--outstanding=", "--control-port=", "--report-interval=", "--reuse-connection", "--delay=",
+    "--jitter=", "--loss=", "--reorder=", "--duplicate=", "--bandwidth=", "--queue-limit=", "--rto=", "--udp-cc=", "--fec=", "--fec-data=",
+    "--fec-parity=", "--gso", "--gro"
+};
+const std::vector<std::string> kServerArgumentAllowlist = {
+    "--control-port=", "--data-port=", "--control-cpu=", "--communicator-cpu=", "--memory-node=", "--max-sessions=", "--max-queued=",
+    "--c10k-port=", "--io-threads=", "--acceptor-shards="
+};
+
+// the client's positional arguments are a host and numbers, the server has none
+bool IsAllowedArgument(const std::string& role, const std::string& argument)
+{
+    if (argument.rfind("--", 0) != 0)
+    {
+        return role == "client";
+    }
+
+    for (const auto& allowed : role == "client" ? kClientArgumentAllowlist : kServerArgumentAllowlist)
+    {
+        if (allowed.back() == '=' ? argument.rfind(allowed, 0) == 0 : argument == allowed)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the whole word must be a non-negative number, so a bad one is an error rather than an exception
+bool ParseStartTime(const std::string& word, int64_t& start_time)
+{
+    char* end = nullptr;
+    errno = 0;
+    auto value = std::strtoll(word.c_str(), &end, 10);
+    if (word.empty() || *end != '\0' || errno == ERANGE || value < 0)
+    {
+        return false;
+    }
+    start_time = value;
+    return true;
+}
+
+// takes as long for any token of the same length, so it cannot be guessed a character at a time
+bool TokenMatches(const std::string& token, const std::string& expected)
+{
+    if (token.size() != expected.size())
+    {
+        return false;
+    }
+
+    unsigned char difference = 0;
+    for (std::size_t i = 0; i < token.size(); ++i)
+    {
+        difference |= static_cast<unsigned char>(token[i] ^ expected[i]);
+    }
+    return difference == 0;
+}
+
+class AgentJob : public std::enable_shared_from_this<AgentJob>
+{
+public:
+    AgentJob(boost::asio::io_service& io_service, tcp::socket socket, const AgentOptions& options)
+        : socket_{std::move(socket)}
+        , options_{options}
+        , start_timer_{io_service}
+        , output_{io_service}
+        , pid_{-1}
+        , writing_{false}
+        , closing_{false}
+    {}
+
+    void Start()
+    {
+        ReadCommand();
+    }
+
+    // SIGTERM to the process, or no process at all if it has not been started yet
+    void Terminate()
+    {
+        if (pid_ > 0)
+        {
+            Kill(SIGTERM);
+        }
+        else if (!closing_)
+        {
+            start_timer_.cancel();
+            Finish(kExitReply + " " + std::to_string(128 + SIGTERM));
+        }
+    }
+
+private:
+    void ReadCommand()
+    {
+        boost::asio::async_read_until(socket_, commands_, '\n', [this, self = shared_from_this()](const boost::system::error_code& error, std::size_t) {
+            if (error)
+            {
+                // the controller went away, the process is not left behind
+                Kill(SIGTERM);
+                start_timer_.cancel();
+                return;
+            }
+
+            std::istream stream(&commands_);
+            std::string line;
+            std::getline(stream, line);
+            OnCommand(line);
+            ReadCommand();
+        });
+    }
+
+    void OnCommand(const std::string& line)
+    {
+        auto words = SplitWords(line);
+        if (words.empty())
+        {
+            return;
+        }
+
+        if (words[0] == kRunCommand && words.size() >= 4 && pid_ < 0 && arguments_.empty())
+        {
+            if (!TokenMatches(words[1], options_.token))
+            {
+                std::cout << "Refused a RUN with a wrong token" << std::endl;
+                Send(kErrorReply + " bad token");
+                return;
+            }
+
+            const auto& role = words[2];
+            if (role != "client" && role != "server")
+            {
+                Send(kErrorReply + " unknown role " + role);
+                return;
+            }
+
+            int64_t start_time = 0;
+            if (!ParseStartTime(words[3], start_time))
+            {
+                Send(kErrorReply + " bad start time " + words[3]);
+                return;
+            }
+
+            for (auto argument = words.begin() + 4; argument != words.end(); ++argument)
+            {
+                if (!IsAllowedArgument(role, *argument))
+                {
+                    Send(kErrorReply + " argument not allowed " + *argument);
+                    return;
+                }
+            }
+
+            binary_ = options_.bin_dir + (role == "client" ? "/Client" : "/Server");
+            arguments_.assign(words.begin() + 4, words.end());
+
+            // the realtime clock is the one the controller shares with the other agents, the wait itself is on the steady clock
+            auto delay = std::chrono::nanoseconds(std::max<int64_t>(start_time - RealtimeNow(), 0));
+            start_timer_.expires_from_now(delay);
+            start_timer_.async_wait([this, self = shared_from_this()](const boost::system::error_code& error) {
+                // a STOP may have finished the job after the timer expired but before this ran
+                if (!error && !closing_)
+                {
+                    Spawn();
+                }
+            });
+            return;
+        }
+
+        if (words[0] == kStopCommand)
+        {
+            Terminate();
+            return;
+        }
+
+        // the line may carry the token
+        Send(kErrorReply + " unexpected " + words[0]);
+    }
+
+    void Spawn()
+    {
+        int pipe_fds[2];
+        if (pipe2(pipe_fds, O_CLOEXEC) != 0)
+        {
+            Finish(kErrorReply + " pipe " + std::to_string(errno));
+            return;
+        }
+
+        std::vector<char*> argv;
+        argv.push_back(const_cast<char*>(binary_.c_str()));
+        for (auto& argument : arguments_)
+        {
+            argv.push_back(const_cast<char*>(argument.c_str()));
+        }
+        argv.push_back(nullptr);
+
+        pid_ = fork();
+        if (pid_ == 0)
+        {
+            dup2(pipe_fds[1], STDOUT_FILENO);
+            dup2(pipe_fds[1], STDERR_FILENO);
+            // the agent's sockets are not the process' business, a server would keep the agent port bound
+            close_range(3, ~0U, 0);
+            execv(argv[0], argv.data());
+            _exit(127);
+        }
+
+        close(pipe_fds[1]);
+        if (pid_ < 0)
+        {
+            close(pipe_fds[0]);
+            Finish(kErrorReply + " fork " + std::to_string(errno));
+            return;
+        }
+
+        std::cout << "Started " << binary_ << " as " << pid_ << std::endl;
+        output_.assign(pipe_fds[0]);
+        Send(kStartedReply + " " + std::to_string(pid_));
+        ReadOutput();
+    }
+
+    void ReadOutput()
+    {
+        boost::asio::async_read_until(output_, output_buffer_, '\n', [this, self = shared_from_this()](const boost::system::error_code& error, std::size_t) {
+            if (error)
+            {
+                // the process closed its output, i.e. exited
+                int status = 0;
+                waitpid(pid_, &status, 0);
+                int exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+                std::cout << "Process " << pid_ << " exited with " << exit_status << std::endl;
+                pid_ = -1;
+                Finish(kExitReply + " " + std::to_string(exit_status));
+                return;
+            }
+
+            std::istream stream(&output_buffer_);
+            std::string line;
+            std::getline(stream, line);
+            for (const auto& marker : { kIntervalMarker, kResultMarker, kSessionsMarker })
+            {
+                auto position = line.find(marker);
+                if (position != std::string::npos)
+                {
+                    Send(kLineReply + " " + line.substr(position));
+                    break;
+                }
+            }
+            ReadOutput();
+        });
+    }
+
+    void Kill(int signal)
+    {
+        if (pid_ > 0)
+        {
+            kill(pid_, signal);
+        }
+    }
+
+    // the last message of the job, the connection is closed once it is written
+    void Finish(const std::string& line)
+    {
+        Send(line);
+        closing_ = true;
+    }
+
+    void Send(const std::string& line)
+    {
+        outbox_.push_back(line + "\n");
+        if (!writing_)
+        {
+            Write();
+        }
+    }
+
+    void Write()
+    {
+        if (outbox_.empty())
+        {
+            writing_ = false;
+            if (closing_)
+            {
+                boost::system::error_code error;
+                socket_.shutdown(tcp::socket::shutdown_both, error);
+                socket_.close(error);
+            }
+            return;
+        }
+
+        writing_ = true;
+        boost::asio::async_write(socket_, boost::asio::buffer(outbox_.front()),
+                                 [this, self = shared_from_this()](const boost::system::error_code& error, std::size_t) {
+            outbox_.pop_front();
+            if (error)
+            {
+                outbox_.clear();
+            }
+            Write();
+        });
+    }
+
+private:
+    tcp::socket socket_;
+    AgentOptions options_;
+    boost::asio::steady_timer start_timer_;
+    boost::asio::posix::stream_descriptor output_;
+    boost::asio::streambuf commands_;
+    boost::asio::streambuf output_buffer_;
+    std::string binary_;
+    std::vector<std::string> arguments_;
+    pid_t pid_;
+    std::deque<std::string> outbox_;
+    bool writing_;
+    bool closing_;
+};
+
+class Agent
+{
+public:
+    Agent(boost::asio::io_service& io_service, const AgentOptions& options)
+        : io_service_(io_service)
+        , acceptor_(io_service, tcp::endpoint(boost::asio::ip::make_address(options.bind_address), options.port))
+        , socket_(io_service)
+        , options_(options)
+    {
+        std::cout << "Agent listening on " << options_.bind_address << ":" << options_.port << ", running the binaries of " << options_.bin_dir << std::endl;
+    }
+
+    void Accept()
+    {
+        acceptor_.async_accept(socket_, [this](const boost::system::error_code& error) {
+            if (error)
+            {
+                if (error != boost::asio::error::operation_aborted)
+                {
+                    std::cout << "Agent accept error: " << error << std::endl;
+                }
+                return;
+            }
+
+            auto job = std::make_shared<AgentJob>(io_service_, std::move(socket_), options_);
+            jobs_.push_back(job);
+            job->Start();
+            socket_ = tcp::socket(io_service_);
+            Accept();
+        });
+    }
+
+    // stops accepting and terminates the running processes; run() returns once their jobs are done
+    void Stop()
+    {
+        boost::system::error_code error;
+        acceptor_.close(error);
+        for (auto& job : jobs_)
+        {
+            if (auto running = job.lock())
+            {
+                running->Terminate();
+            }
+        }
+        jobs_.clear();
+    }
+
+private:
+    boost::asio::io_service& io_service_;
+    tcp::acceptor acceptor_;
+    tcp::socket socket_;
+    AgentOptions options_;
+    std::vector<std::weak_ptr<AgentJob>> jobs_;
+};
+
+int main(int argc, char* argv[])
+{
+    AgentOptions options;
+    options.bin_dir = ExecutableDirectory();
+    std::string token_file;
+    bool usage = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (option.rfind("--bind=", 0) == 0)
+        {
+            options.bind_address = option.substr(option.find('=') + 1);
+        }
+        else if (option.rfind("--port=", 0) == 0)
+        {
+            options.port = static_cast<uint16_t>(std::stoul(option.substr(option.find('=') + 1)));
+        }
+        else if (option.rfind("--bin-dir=", 0) == 0)
+        {
+            options.bin_dir = option.substr(option.find('=') + 1);
+        }
+        else if (option.rfind("--token-file=", 0) == 0)
+        {
+            token_file = option.substr(option.find('=') + 1);
+        }
+        else
+        {
+            usage = true;
+            break;
+        }
+    }
+
+    options.token = token_file.empty() ? TakeTokenVariable() : ReadTokenFile(token_file);
+    if (usage || options.token.empty())
+    {
+        std::cerr << "Usage: [" << kTokenVariable << "=SECRET] agent [--token-file=PATH] [--bind=ADDR] [--port=N] [--bin-dir=DIR]" << std::endl;
+        return -1;
+    }
+
+    try
+    {
+        boost::asio::io_service io_service;
+        Agent agent(io_service, options);
+        agent.Accept();
+
+        boost::asio::signal_set signals(io_service, SIGINT, SIGTERM);
+        signals.async_wait([&](const boost::system::error_code& error, int) {
+            if (!error)
+            {
+                agent.Stop();
+            }
+        });
+
+        io_service.run();
+    }
+    catch (std::exception& ex)
+    {
+        std::cout << ex.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
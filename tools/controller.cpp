@@ -0,0 +1,661 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/asio.hpp>
+
+#include "orchestration.h"
+#include "results.h"
+
+using boost::asio::ip::tcp;
+
+/**
+ * Drives a whole experiment from one place: every Client and Server process
+ * of a topology runs under an agent, the servers first, then every client at
+ * the same realtime instant. The clients report the progress of their
+ * transfers at the same multiples of the interval on the realtime clock, so
+ * the controller can sum them into the load the servers saw, interval by
+ * interval. With all agents on one host the clocks are trivially aligned;
+ * across hosts they need PTP.
+ */
+struct ControllerOptions
+{
+    std::chrono::milliseconds interval{1000};
+    // between the servers being started and the clients' start
+    std::chrono::milliseconds settle{500};
+    // from sending the start time to the clients to the start time itself, covers the slowest agent
+    std::chrono::milliseconds lead{1000};
+    std::chrono::seconds timeout{300};
+    uint32_t no_of_repetitions = 1;
+    // start an agent for every local agent address nobody listens on
+    bool spawn_agents = false;
+    // the secret the agents were started with, sent with every RUN
+    std::string token;
+};
+
+/**
+ * Topology, one process per line; # starts a comment:
+ * Format: <client|server> <agent host>[:<agent port>] <argument> ...
+ * The arguments are those of the Client or Server binary. Servers sharing a
+ * host need their own --control-port and --data-port, and their clients the
+ * matching --control-port.
+ */
+struct TopologyEntry
+{
+    std::string role;
+    std::string host;
+    uint16_t port;
+    std::vector<std::string> arguments;
+};
+
+std::vector<TopologyEntry> LoadTopology(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("Cannot open topology " + path);
+    }
+
+    std::vector<TopologyEntry> topology;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        auto words = SplitWords(line.substr(0, line.find('#')));
+        if (words.empty())
+        {
+            continue;
+        }
+
+        if (words.size() < 2 || (words[0] != "client" && words[0] != "server"))
+        {
+            throw std::runtime_error("Bad topology line: " + line);
+        }
+
+        TopologyEntry entry = { words[0], words[1], kAgentPort, { words.begin() + 2, words.end() } };
+        auto colon = entry.host.find(':');
+        if (colon != std::string::npos)
+        {
+            entry.port = static_cast<uint16_t>(std::stoul(entry.host.substr(colon + 1)));
+            entry.host = entry.host.substr(0, colon);
+        }
+        topology.push_back(entry);
+    }
+
+    if (topology.empty())
+    {
+        throw std::runtime_error("No processes in topology " + path);
+    }
+    return topology;
+}
+
+bool IsLocal(const std::string& host)
+{
+    return host == "localhost" || host == "127.0.0.1";
+}
+
+// one process of the topology, run by an agent over a connection of its own
+class AgentProcess
+{
+public:
+    AgentProcess(boost::asio::io_service& io_service, const TopologyEntry& entry, const std::string& token)
+        : entry_(entry)
+        , token_(token)
+        , socket_(io_service)
+        , started_{false}
+        , exited_{false}
+        , exit_status_{-1}
+    {}
+
+    const TopologyEntry& Entry() const
+    {
+        return entry_;
+    }
+
+    boost::system::error_code Connect(boost::asio::io_service& io_service)
+    {
+        boost::system::error_code error;
+        tcp::resolver resolver(io_service);
+        auto endpoints = resolver.resolve(tcp::resolver::query(entry_.host, std::to_string(entry_.port)), error);
+        if (!error)
+        {
+            boost::asio::connect(socket_, endpoints, error);
+        }
+        return error;
+    }
+
+    void Run(int64_t start_time, const std::vector<std::string>& extra_arguments)
+    {
+        auto command = kRunCommand + " " + token_ + " " + entry_.role + " " + std::to_string(start_time);
+        for (const auto& argument : entry_.arguments)
+        {
+            command += " " + argument;
+        }
+        for (const auto& argument : extra_arguments)
+        {
+            command += " " + argument;
+        }
+
+        Send(command);
+        ReadReply();
+    }
+
+    void Stop()
+    {
+        if (!exited_)
+        {
+            Send(kStopCommand);
+        }
+    }
+
+    // the agent terminates a process whose connection closes
+    void Close()
+    {
+        boost::system::error_code error;
+        socket_.close(error);
+    }
+
+    bool Started() const
+    {
+        return started_;
+    }
+
+    bool Exited() const
+    {
+        return exited_;
+    }
+
+    int ExitStatus() const
+    {
+        return exit_status_;
+    }
+
+    const std::vector<IntervalReport>& Intervals() const
+    {
+        return intervals_;
+    }
+
+    const std::vector<ResultRecord>& Results() const
+    {
+        return results_;
+    }
+
+    const std::vector<std::string>& Lines() const
+    {
+        return lines_;
+    }
+
+private:
+    void Send(const std::string& line)
+    {
+        boost::system::error_code error;
+        boost::asio::write(socket_, boost::asio::buffer(line + "\n"), error);
+        if (error)
+        {
+            std::cout << entry_.role << " on " << entry_.host << ":" << entry_.port << ": " << error.message() << std::endl;
+        }
+    }
+
+    void ReadReply()
+    {
+        boost::asio::async_read_until(socket_, replies_, '\n', [this](const boost::system::error_code& error, std::size_t) {
+            if (error)
+            {
+                // the agent closes the connection after EXIT, or went away
+                exited_ = true;
+                return;
+            }
+
+            std::istream stream(&replies_);
+            std::string line;
+            std::getline(stream, line);
+            OnReply(line);
+            ReadReply();
+        });
+    }
+
+    void OnReply(const std::string& line)
+    {
+        auto space = line.find(' ');
+        auto reply = line.substr(0, space);
+        auto text = space == std::string::npos ? std::string{} : line.substr(space + 1);
+
+        if (reply == kStartedReply)
+        {
+            started_ = true;
+        }
+        else if (reply == kExitReply)
+        {
+            exit_status_ = std::stoi(text);
+            exited_ = true;
+        }
+        else if (reply == kErrorReply)
+        {
+            std::cout << entry_.role << " on " << entry_.host << ":" << entry_.port << " failed: " << text << std::endl;
+        }
+        else if (reply == kLineReply)
+        {
+            IntervalReport interval;
+            ResultRecord result;
+            if (ParseIntervalReport(text, interval))
+            {
+                intervals_.push_back(interval);
+            }
+            else if (text.rfind(kResultMarker, 0) == 0 && ParseResultRecord(text.substr(kResultMarker.size()), result))
+            {
+                results_.push_back(result);
+            }
+            else
+            {
+                lines_.push_back(text);
+            }
+        }
+    }
+
+private:
+    TopologyEntry entry_;
+    std::string token_;
+    tcp::socket socket_;
+    boost::asio::streambuf replies_;
+    bool started_;
+    bool exited_;
+    int exit_status_;
+    std::vector<IntervalReport> intervals_;
+    std::vector<ResultRecord> results_;
+    std::vector<std::string> lines_;
+};
+
+struct IntervalTotal
+{
+    int64_t length;
+    uint64_t no_of_messages;
+    uint64_t no_of_bytes;
+    uint32_t no_of_reports;
+};
+
+class Controller
+{
+public:
+    Controller(std::vector<TopologyEntry> topology, const ControllerOptions& options, std::string bin_dir)
+        : topology_(std::move(topology))
+        , options_(options)
+        , bin_dir_(std::move(bin_dir))
+    {}
+
+    ~Controller()
+    {
+        // agents of our own go with us
+        for (auto pid : spawned_agents_)
+        {
+            kill(pid, SIGTERM);
+            waitpid(pid, nullptr, 0);
+        }
+    }
+
+    // returns false if any process failed
+    bool Run(uint32_t run_no)
+    {
+        io_service_.restart();
+        std::vector<std::unique_ptr<AgentProcess>> servers;
+        std::vector<std::unique_ptr<AgentProcess>> clients;
+        for (const auto& entry : topology_)
+        {
+            auto process = std::make_unique<AgentProcess>(io_service_, entry, options_.token);
+            Connect(*process);
+            (entry.role == "server" ? servers : clients).push_back(std::move(process));
+        }
+
+        std::cout << "Run " << run_no << ": " << clients.size() << " clients, " << servers.size() << " servers" << std::endl;
+        auto succeeded = Execute(clients, servers);
+
+        // the pending reads complete, aborted, before their processes go
+        for (auto& process : servers)
+        {
+            process->Close();
+        }
+        for (auto& process : clients)
+        {
+            process->Close();
+        }
+        io_service_.restart();
+        io_service_.poll();
+        return succeeded;
+    }
+
+private:
+    bool Execute(std::vector<std::unique_ptr<AgentProcess>>& clients, std::vector<std::unique_ptr<AgentProcess>>& servers)
+    {
+        for (auto& server : servers)
+        {
+            server->Run(0, {});
+        }
+        RunUntil([&]() { return All(servers, [](const AgentProcess& process) { return process.Started() || process.Exited(); }); },
+                 std::chrono::seconds(10));
+        for (auto& server : servers)
+        {
+            if (!server->Started() || server->Exited())
+            {
+                std::cout << "Server on " << server->Entry().host << " did not start" << std::endl;
+                return false;
+            }
+        }
+
+        // let the servers bind their control ports
+        RunFor(options_.settle);
+
+        auto start_time = RealtimeNow() + std::chrono::duration_cast<std::chrono::nanoseconds>(options_.lead).count();
+        for (auto& client : clients)
+        {
+            client->Run(start_time, { "--report-interval=" + std::to_string(options_.interval.count()) });
+        }
+
+        if (!RunUntil([&]() { return All(clients, [](const AgentProcess& process) { return process.Exited(); }); },
+                      options_.lead + options_.timeout))
+        {
+            std::cout << "Clients still running after " << options_.timeout.count() << " s, stopping them" << std::endl;
+            for (auto& client : clients)
+            {
+                client->Stop();
+            }
+            RunUntil([&]() { return All(clients, [](const AgentProcess& process) { return process.Exited(); }); }, std::chrono::seconds(10));
+        }
+
+        // the servers drain their sessions and print their totals
+        for (auto& server : servers)
+        {
+            server->Stop();
+        }
+        RunUntil([&]() { return All(servers, [](const AgentProcess& process) { return process.Exited(); }); }, std::chrono::seconds(30));
+
+        return Report(start_time, clients, servers);
+    }
+
+    void Connect(AgentProcess& process)
+    {
+        const auto& entry = process.Entry();
+        auto error = process.Connect(io_service_);
+        if (error && options_.spawn_agents && IsLocal(entry.host))
+        {
+            if (spawned_ports_.insert(entry.port).second)
+            {
+                SpawnAgent(entry.port);
+            }
+
+            // until the agent listens
+            for (int attempt = 0; error && attempt < 50; ++attempt)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                error = process.Connect(io_service_);
+            }
+        }
+
+        if (error)
+        {
+            throw boost::system::system_error(error, "agent " + entry.host + ":" + std::to_string(entry.port));
+        }
+    }
+
+    void SpawnAgent(uint16_t port)
+    {
+        auto binary = bin_dir_ + "/Agent";
+        auto port_option = "--port=" + std::to_string(port);
+        auto bin_dir_option = "--bin-dir=" + bin_dir_;
+
+        // the token goes into the agent's environment, which unlike its command line only its user can read
+        auto token_variable = std::string(kTokenVariable) + "=" + options_.token;
+        std::vector<char*> environment;
+        for (char** variable = environ; *variable != nullptr; ++variable)
+        {
+            environment.push_back(*variable);
+        }
+        environment.push_back(token_variable.data());
+        environment.push_back(nullptr);
+        char* const arguments[] = { binary.data(), port_option.data(), bin_dir_option.data(), nullptr };
+
+        auto pid = fork();
+        if (pid == 0)
+        {
+            execve(binary.c_str(), arguments, environment.data());
+            _exit(127);
+        }
+
+        if (pid < 0)
+        {
+            throw boost::system::system_error(errno, boost::system::system_category(), "fork " + binary);
+        }
+
+        std::cout << "Spawned agent " << pid << " on port " << port << std::endl;
+        spawned_agents_.push_back(pid);
+    }
+
+    template <typename Predicate>
+    static bool All(const std::vector<std::unique_ptr<AgentProcess>>& processes, Predicate predicate)
+    {
+        return std::all_of(processes.begin(), processes.end(), [&](const std::unique_ptr<AgentProcess>& process) { return predicate(*process); });
+    }
+
+    // runs the replies of the agents until done() holds or the timeout expires
+    bool RunUntil(const std::function<bool()>& done, std::chrono::steady_clock::duration timeout)
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!done())
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline)
+            {
+                return false;
+            }
+
+            if (io_service_.run_one_for(deadline - now) == 0 && io_service_.stopped())
+            {
+                // nothing left to wait for
+                io_service_.restart();
+                return done();
+            }
+        }
+        return true;
+    }
+
+    void RunFor(std::chrono::steady_clock::duration duration)
+    {
+        RunUntil([]() { return false; }, duration);
+    }
+
+    bool Report(int64_t start_time, const std::vector<std::unique_ptr<AgentProcess>>& clients,
+                const std::vector<std::unique_ptr<AgentProcess>>& servers)
+    {
+        bool succeeded = true;
+
+        // intervals of all clients, keyed by their common start
+        std::map<int64_t, IntervalTotal> totals;
+        for (const auto& client : clients)
+        {
+            for (const auto& interval : client->Intervals())
+            {
+                auto& total = totals[interval.time];
+                total.length = interval.length;
+                total.no_of_messages += interval.no_of_messages;
+                total.no_of_bytes += interval.no_of_bytes;
+                total.no_of_reports++;
+            }
+        }
+
+        auto precision = std::cout.precision();
+        std::cout << std::endl << std::setw(12) << "Time (s)" << std::setw(10) << "Clients" << std::setw(16) << "Messages/s" << std::setw(14)
+                  << "MiB/s" << std::endl;
+        uint64_t no_of_bytes = 0;
+        uint64_t no_of_messages = 0;
+        double peak = 0;
+        for (const auto& total : totals)
+        {
+            double seconds = total.second.length / 1e9;
+            double mib_per_s = total.second.no_of_bytes / seconds / (1024 * 1024);
+            std::cout << std::setw(12) << std::fixed << std::setprecision(1) << (total.first - start_time) / 1e9 << std::setw(10)
+                      << total.second.no_of_reports << std::setw(16) << std::setprecision(0) << total.second.no_of_messages / seconds << std::setw(14)
+                      << std::setprecision(2) << mib_per_s << std::defaultfloat << std::endl;
+            no_of_bytes += total.second.no_of_bytes;
+            no_of_messages += total.second.no_of_messages;
+            peak = std::max(peak, mib_per_s);
+        }
+        std::cout.precision(precision);
+        std::cout << "All clients: " << no_of_messages << " messages, " << no_of_bytes << " bytes, peak " << peak << " MiB/s" << std::endl;
+
+        std::cout << std::endl;
+        for (const auto& client : clients)
+        {
+            const auto& entry = client->Entry();
+            std::cout << "Client on " << entry.host << ":" << entry.port << " exited with " << client->ExitStatus();
+            for (const auto& result : client->Results())
+            {
+                for (const auto& metric : { "mib_per_s", "messages_per_s", "transactions_per_s", "ack_p99_us", "transaction_p99_us" })
+                {
+                    auto found = result.metrics.find(metric);
+                    if (found != result.metrics.end())
+                    {
+                        std::cout << ", " << found->first << " " << found->second;
+                    }
+                }
+            }
+            std::cout << std::endl;
+            succeeded = succeeded && client->ExitStatus() == 0;
+        }
+
+        for (const auto& server : servers)
+        {
+            const auto& entry = server->Entry();
+            std::cout << "Server on " << entry.host << ":" << entry.port << " exited with " << server->ExitStatus() << std::endl;
+            for (const auto& line : server->Lines())
+            {
+                std::cout << "  " << line << std::endl;
+            }
+        }
+
+        return succeeded;
+    }
+
+private:
+    boost::asio::io_service io_service_;
+    std::vector<TopologyEntry> topology_;
+    ControllerOptions options_;
+    std::string bin_dir_;
+    std::set<uint16_t> spawned_ports_;
+    std::vector<pid_t> spawned_agents_;
+};
+
+std::string RandomToken()
+{
+    std::random_device random;
+    std::ostringstream token;
+    for (int i = 0; i < 4; ++i)
+    {
+        token << std::hex << std::setw(8) << std::setfill('0') << random();
+    }
+    return token.str();
+}
+
+int main(int argc, char* argv[])
+{
+    ControllerOptions options;
+    std::string bin_dir = ExecutableDirectory();
+    std::string topology_path;
+    std::string token_file;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (option.rfind("--interval=", 0) == 0)
+        {
+            options.interval = std::chrono::milliseconds(std::max<uint64_t>(1, std::stoull(option.substr(option.find('=') + 1))));
+        }
+        else if (option.rfind("--settle=", 0) == 0)
+        {
+            options.settle = std::chrono::milliseconds(std::stoull(option.substr(option.find('=') + 1)));
+        }
+        else if (option.rfind("--lead=", 0) == 0)
+        {
+            options.lead = std::chrono::milliseconds(std::stoull(option.substr(option.find('=') + 1)));
+        }
+        else if (option.rfind("--timeout=", 0) == 0)
+        {
+            options.timeout = std::chrono::seconds(std::stoull(option.substr(option.find('=') + 1)));
+        }
+        else if (option.rfind("--repeat=", 0) == 0)
+        {
+            options.no_of_repetitions = std::max<uint32_t>(1, static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1))));
+        }
+        else if (option == "--spawn-agents")
+        {
+            options.spawn_agents = true;
+        }
+        else if (option.rfind("--bin-dir=", 0) == 0)
+        {
+            bin_dir = option.substr(option.find('=') + 1);
+        }
+        else if (option.rfind("--token-file=", 0) == 0)
+        {
+            token_file = option.substr(option.find('=') + 1);
+        }
+        else if (option.rfind("--", 0) != 0 && topology_path.empty())
+        {
+            topology_path = option;
+        }
+        else
+        {
+            std::cerr << "Unknown option " << option << std::endl;
+            topology_path.clear();
+            break;
+        }
+    }
+
+    options.token = token_file.empty() ? TakeTokenVariable() : ReadTokenFile(token_file);
+
+    // agents spawned by the controller only need to share a secret with it
+    if (options.token.empty() && options.spawn_agents)
+    {
+        options.token = RandomToken();
+    }
+
+    if (topology_path.empty() || options.token.empty())
+    {
+        std::cerr << "Usage: [" << kTokenVariable << "=SECRET] controller <topology> [--token-file=PATH] [--spawn-agents] [--interval=MS] "
+                     "[--settle=MS] [--lead=MS] [--timeout=S] [--repeat=N] [--bin-dir=DIR]" << std::endl;
+        std::cerr << "The token comes from " << kTokenVariable << " or the token file, --spawn-agents makes one up if there is none" << std::endl;
+        return -1;
+    }
+
+    int exit_code = 0;
+    try
+    {
+        Controller controller(LoadTopology(topology_path), options, bin_dir);
+        for (uint32_t run_no = 1; run_no <= options.no_of_repetitions; ++run_no)
+        {
+            if (!controller.Run(run_no))
+            {
+                exit_code = -2;
+            }
+        }
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return -1;
+    }
+
+    return exit_code;
+}
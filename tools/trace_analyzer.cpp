@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "latency.h"
+#include "trace.h"
+
+/**
+ * Offline analysis of a trace written by the client or the server with
+ * --trace. Aggregate stats hide the timeline of a run; this prints what they
+ * average away: the distribution of the gaps between messages, the stalls
+ * among them and how often they come back, and the throughput of every time
+ * bin. A client trace is analysed on its send times and additionally yields
+ * the ACK latencies, a server trace on its receive times.
+ */
+struct AnalyzerOptions
+{
+    std::chrono::milliseconds bin{100};
+    // 0 derives the stall threshold from the median gap
+    std::chrono::microseconds stall{0};
+    uint32_t top = 10;
+};
+
+struct TraceEvent
+{
+    int64_t time;
+    uint32_t message_no;
+    uint32_t size;
+};
+
+struct Stall
+{
+    int64_t start;
+    std::chrono::nanoseconds duration;
+    uint32_t message_no_before;
+    uint32_t message_no_after;
+};
+
+const uint32_t kHistogramBarWidth = 50;
+
+std::string Bar(uint64_t value, uint64_t max)
+{
+    return std::string(max > 0 ? static_cast<std::size_t>(value * kHistogramBarWidth / max) : 0, '#');
+}
+
+double Microseconds(std::chrono::nanoseconds duration)
+{
+    return duration.count() / 1e3;
+}
+
+double Milliseconds(int64_t nanoseconds)
+{
+    return nanoseconds / 1e6;
+}
+
+void PrintDistribution(const std::string& name, LatencyRecorder& recorder)
+{
+    std::cout << std::fixed << std::setprecision(1) << name << " (us): p50 " << Microseconds(recorder.Percentile(50)) << ", p90 " << Microseconds(recorder.Percentile(90))
+              << ", p99 " << Microseconds(recorder.Percentile(99)) << ", p99.9 " << Microseconds(recorder.Percentile(99.9))
+              << ", max " << Microseconds(recorder.Max()) << std::defaultfloat << std::endl;
+}
+
+// gaps bucketed by powers of two from 1 us, so both the common case and the tail stay readable
+void PrintGapHistogram(const std::vector<int64_t>& gaps)
+{
+    std::vector<uint64_t> buckets;
+    for (auto gap : gaps)
+    {
+        std::size_t bucket = 0;
+        for (int64_t bound = 1000; gap >= bound; bound *= 2)
+        {
+            bucket++;
+        }
+
+        buckets.resize(std::max(buckets.size(), bucket + 1), 0);
+        buckets[bucket]++;
+    }
+
+    uint64_t max = buckets.empty() ? 0 : *std::max_element(buckets.begin(), buckets.end());
+    for (std::size_t i = 0; i < buckets.size(); ++i)
+    {
+        std::ostringstream range;
+        range << (i == 0 ? 0 : 1 << (i - 1)) << "-" << (1 << i) << " us";
+        std::cout << std::setw(20) << range.str() << std::setw(12) << buckets[i] << " " << Bar(buckets[i], max) << std::endl;
+    }
+}
+
+void PrintStalls(const std::vector<TraceEvent>& events, const std::vector<int64_t>& gaps, std::chrono::nanoseconds threshold,
+                 const AnalyzerOptions& options)
+{
+    std::vector<Stall> stalls;
+    std::chrono::nanoseconds stalled_time{0};
+    for (std::size_t i = 0; i < gaps.size(); ++i)
+    {
+        if (gaps[i] >= threshold.count())
+        {
+            stalls.push_back({ events[i].time - events.front().time, std::chrono::nanoseconds(gaps[i]), events[i].message_no,
+                               events[i + 1].message_no });
+            stalled_time += std::chrono::nanoseconds(gaps[i]);
+        }
+    }
+
+    auto duration = events.back().time - events.front().time;
+    std::cout << "Stalls (gaps of at least " << Microseconds(threshold) << " us): " << stalls.size() << ", "
+              << Milliseconds(stalled_time.count()) << " ms stalled";
+    if (duration > 0)
+    {
+        std::cout << " (" << 100.0 * stalled_time.count() / duration << " % of the run)";
+    }
+    std::cout << std::endl;
+
+    if (stalls.empty())
+    {
+        return;
+    }
+
+    // stalls recurring at a steady spacing point at a timer, a flush or a GC-like hiccup rather than at the network
+    if (stalls.size() >= 3)
+    {
+        LatencyRecorder spacing;
+        for (std::size_t i = 1; i < stalls.size(); ++i)
+        {
+            spacing.Add(std::chrono::nanoseconds(stalls[i].start - stalls[i - 1].start));
+        }
+        std::cout << "Stall spacing (ms): p10 " << Milliseconds(spacing.Percentile(10).count()) << ", p50 "
+                  << Milliseconds(spacing.Percentile(50).count()) << ", p90 " << Milliseconds(spacing.Percentile(90).count()) << std::endl;
+    }
+
+    std::sort(stalls.begin(), stalls.end(), [](const Stall& a, const Stall& b) { return a.duration > b.duration; });
+    stalls.resize(std::min<std::size_t>(stalls.size(), options.top));
+    std::sort(stalls.begin(), stalls.end(), [](const Stall& a, const Stall& b) { return a.start < b.start; });
+
+    std::cout << "Longest stalls:" << std::endl;
+    std::cout << std::setw(14) << "At (ms)" << std::setw(16) << "Duration (us)" << std::setw(14) << "After msg" << std::setw(14)
+              << "Before msg" << std::endl;
+    for (const auto& stall : stalls)
+    {
+        std::cout << std::setw(14) << Milliseconds(stall.start) << std::setw(16) << Microseconds(stall.duration) << std::setw(14)
+                  << stall.message_no_before << std::setw(14) << stall.message_no_after << std::endl;
+    }
+}
+
+void PrintThroughput(const std::vector<TraceEvent>& events, const AnalyzerOptions& options)
+{
+    auto bin = std::chrono::duration_cast<std::chrono::nanoseconds>(options.bin).count();
+    std::vector<uint64_t> messages((events.back().time - events.front().time) / bin + 1, 0);
+    std::vector<uint64_t> bytes(messages.size(), 0);
+    for (const auto& event : events)
+    {
+        auto index = (event.time - events.front().time) / bin;
+        messages[index]++;
+        bytes[index] += event.size;
+    }
+
+    uint64_t max = *std::max_element(bytes.begin(), bytes.end());
+    std::cout << "Throughput per " << options.bin.count() << " ms:" << std::endl;
+    std::cout << std::setw(12) << "At (ms)" << std::setw(12) << "Messages" << std::setw(12) << "MiB/s" << std::endl;
+    for (std::size_t i = 0; i < messages.size(); ++i)
+    {
+        double mib_per_second = bytes[i] / (bin / 1e9) / (1024 * 1024);
+        std::cout << std::setw(12) << i * options.bin.count() << std::setw(12) << messages[i] << std::setw(12) << std::fixed
+                  << std::setprecision(2) << mib_per_second << std::defaultfloat << " " << Bar(bytes[i], max) << std::endl;
+    }
+}
+
+void Analyze(const std::string& path, const AnalyzerOptions& options)
+{
+    TraceReader trace(path);
+    const auto& header = trace.Header();
+    bool client = header.role == TraceRole::kClient;
+
+    std::cout << "Trace " << path << ": " << header.role << ", " << header.protocol << "/" << header.communication_mechanism << ", "
+              << header.message_size << " byte messages, " << header.no_of_records << " records" << std::endl;
+    if (header.no_of_dropped_events > 0)
+    {
+        std::cout << header.no_of_dropped_events << " events were beyond the trace capacity of " << header.capacity << std::endl;
+    }
+
+    std::vector<TraceEvent> events;
+    LatencyRecorder ack_latencies;
+    for (const auto& record : trace)
+    {
+        auto time = client ? record.send_time : record.receive_time;
+        if (time != 0)
+        {
+            events.push_back({ time, record.message_no, record.size });
+        }
+
+        if (client && record.send_time != 0 && record.ack_time != 0)
+        {
+            ack_latencies.Add(std::chrono::nanoseconds(record.ack_time - record.send_time));
+        }
+    }
+
+    if (events.size() < header.no_of_records)
+    {
+        std::cout << header.no_of_records - events.size() << " messages were never " << (client ? "sent" : "received") << std::endl;
+    }
+
+    if (events.size() < 2)
+    {
+        std::cout << "Too few events to analyse" << std::endl;
+        return;
+    }
+
+    // datagrams may arrive out of order, the timeline is what matters
+    std::sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) { return a.time < b.time; });
+
+    auto duration = events.back().time - events.front().time;
+    std::cout << "Duration: " << Milliseconds(duration) << " ms, " << events.size() * 1e9 / std::max<int64_t>(duration, 1)
+              << " messages/s" << std::endl;
+
+    std::vector<int64_t> gaps;
+    LatencyRecorder gap_distribution;
+    for (std::size_t i = 1; i < events.size(); ++i)
+    {
+        gaps.push_back(events[i].time - events[i - 1].time);
+        gap_distribution.Add(std::chrono::nanoseconds(gaps.back()));
+    }
+
+    std::cout << std::endl;
+    PrintDistribution(client ? "Inter-send gaps" : "Inter-arrival gaps", gap_distribution);
+    PrintGapHistogram(gaps);
+
+    std::cout << std::endl;
+    auto threshold = options.stall.count() > 0 ? std::chrono::nanoseconds(options.stall)
+                                               : std::max(gap_distribution.Percentile(50) * 10, std::chrono::nanoseconds(50000));
+    PrintStalls(events, gaps, threshold, options);
+
+    std::cout << std::endl;
+    PrintThroughput(events, options);
+
+    if (ack_latencies.Count() > 0)
+    {
+        std::cout << std::endl;
+        PrintDistribution("ACK latency", ack_latencies);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    AnalyzerOptions options;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (option.rfind("--bin-ms=", 0) == 0)
+        {
+            options.bin = std::chrono::milliseconds(std::max<int64_t>(1, std::stoll(option.substr(option.find('=') + 1))));
+        }
+        else if (option.rfind("--stall-us=", 0) == 0)
+        {
+            options.stall = std::chrono::microseconds(std::stoll(option.substr(option.find('=') + 1)));
+        }
+        else if (option.rfind("--top=", 0) == 0)
+        {
+            options.top = static_cast<uint32_t>(std::stoul(option.substr(option.find('=') + 1)));
+        }
+        else if (option.rfind("--", 0) == 0)
+        {
+            std::cerr << "Unknown option " << option << std::endl;
+            return -1;
+        }
+        else
+        {
+            paths.push_back(option);
+        }
+    }
+
+    if (paths.empty())
+    {
+        std::cerr << "Usage: trace_analyzer <trace>... [--bin-ms=N] [--stall-us=N] [--top=N]" << std::endl;
+        return -1;
+    }
+
+    for (const auto& path : paths)
+    {
+        try
+        {
+            Analyze(path, options);
+        }
+        catch (std::exception& ex)
+        {
+            std::cerr << ex.what() << std::endl;
+            return -2;
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}